@@ -0,0 +1,277 @@
+#include "async_io.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define BPTREE_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#else
+#define BPTREE_HAVE_IO_URING 0
+#endif
+
+namespace {
+
+constexpr uint64_t WAKE_TAG = UINT64_MAX;
+
+[[noreturn]] void ThrowErrno(const std::string &what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+}  // namespace
+
+AsyncReader::AsyncReader(unsigned queue_depth, bool use_io_uring, unsigned threads)
+    : backend_(AsyncBackend::THREADS), queue_depth_(std::max(1u, queue_depth)), in_flight_(0),
+      ring_fd_(-1), wake_fd_(-1), wake_buffer_(0), sq_ring_(nullptr), sq_ring_size_(0), cq_ring_(nullptr),
+      cq_ring_size_(0), sqes_(nullptr), sqes_size_(0), sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0),
+      sq_array_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr),
+      woken_(false), stopping_(false) {
+    // One extra entry for the wake-up read
+    if (use_io_uring && SetupRing(queue_depth_ + 1)) {
+        backend_ = AsyncBackend::IO_URING;
+        QueueRead(wake_fd_, &wake_buffer_, sizeof(wake_buffer_), 0, WAKE_TAG);
+        return;
+    }
+    for (unsigned i = 0; i < std::max(1u, threads); ++i) {
+        threads_.emplace_back(&AsyncReader::ThreadLoop, this);
+    }
+}
+
+AsyncReader::~AsyncReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (std::thread &thread : threads_) {
+        thread.join();
+    }
+    TeardownRing();
+}
+
+void AsyncReader::Submit(int fd, char *buffer, size_t length, off_t offset, uint64_t tag) {
+    if (in_flight_ >= queue_depth_) {
+        throw std::runtime_error("AsyncReader queue full");
+    }
+    ++in_flight_;
+    switch (backend_) {
+        case AsyncBackend::IO_URING:
+            QueueRead(fd, buffer, length, offset, tag);
+            break;
+        case AsyncBackend::THREADS: {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back({fd, buffer, length, offset, tag});
+            job_ready_.notify_one();
+            break;
+        }
+    }
+}
+
+void AsyncReader::Wait(std::vector<ReadCompletion> *completions, bool block) {
+    switch (backend_) {
+        case AsyncBackend::IO_URING:
+            WaitRing(completions, block);
+            break;
+        case AsyncBackend::THREADS:
+            WaitThreads(completions, block);
+            break;
+    }
+}
+
+void AsyncReader::Wake() {
+    switch (backend_) {
+        case AsyncBackend::IO_URING: {
+            uint64_t one = 1;
+            ssize_t written;
+            do {
+                written = write(wake_fd_, &one, sizeof(one));
+            } while (written < 0 && errno == EINTR);
+            break;
+        }
+        case AsyncBackend::THREADS: {
+            std::lock_guard<std::mutex> lock(mutex_);
+            woken_ = true;
+            done_ready_.notify_one();
+            break;
+        }
+    }
+}
+
+// ==================== io_uring ====================
+
+#if BPTREE_HAVE_IO_URING
+
+bool AsyncReader::SetupRing(unsigned entries) {
+    io_uring_params params{};
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0) {
+        return false;  // Not built into the kernel, or blocked by a sandbox
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_
+                           : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  ring_fd_, IORING_OFF_CQ_RING);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                 IORING_OFF_SQES);
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED || wake_fd_ < 0) {
+        TeardownRing();
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sq_ring_);
+    char *cq = static_cast<char *>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+    return true;
+}
+
+void AsyncReader::TeardownRing() {
+    if (sqes_ && sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ && sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    sqes_ = cq_ring_ = sq_ring_ = nullptr;
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
+
+// Only this thread writes the SQ tail; the kernel picks entries up at the
+// next io_uring_enter
+void AsyncReader::QueueRead(int fd, void *buffer, size_t length, off_t offset, uint64_t tag) {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->off = static_cast<uint64_t>(offset);
+    sqe->user_data = tag;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+}
+
+void AsyncReader::WaitRing(std::vector<ReadCompletion> *completions, bool block) {
+    unsigned head = *cq_head_;
+    bool ready = head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned min_complete = block && !ready ? 1 : 0;
+    if (to_submit > 0 || min_complete > 0) {
+        while (syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                       min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                ThrowErrno("io_uring_enter failed");
+            }
+            // Whatever was submitted before the signal left the SQ
+            to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    bool rearm = false;
+    for (; head != tail; ++head) {
+        const io_uring_cqe *cqe = static_cast<const io_uring_cqe *>(cqes_) + (head & cq_mask_);
+        if (cqe->user_data == WAKE_TAG) {
+            rearm = true;
+            continue;
+        }
+        completions->push_back({cqe->user_data, cqe->res});
+        --in_flight_;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    if (rearm) {
+        QueueRead(wake_fd_, &wake_buffer_, sizeof(wake_buffer_), 0, WAKE_TAG);
+    }
+}
+
+#else
+
+bool AsyncReader::SetupRing(unsigned) { return false; }
+void AsyncReader::TeardownRing() {}
+void AsyncReader::QueueRead(int, void *, size_t, off_t, uint64_t) {}
+void AsyncReader::WaitRing(std::vector<ReadCompletion> *, bool) {}
+
+#endif
+
+// ==================== Thread pool ====================
+
+void AsyncReader::WaitThreads(std::vector<ReadCompletion> *completions, bool block) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (block) {
+        done_ready_.wait(lock, [this] { return !done_.empty() || woken_; });
+    }
+    woken_ = false;
+    in_flight_ -= done_.size();
+    completions->insert(completions->end(), done_.begin(), done_.end());
+    done_.clear();
+}
+
+void AsyncReader::ThreadLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        job_ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;
+        }
+        Job job = jobs_.front();
+        jobs_.pop_front();
+        lock.unlock();
+
+        // Short only at end of file, as with ReadSlots
+        ssize_t result = 0;
+        while (static_cast<size_t>(result) < job.length) {
+            ssize_t bytes_read = pread(job.fd, job.buffer + result, job.length - result, job.offset + result);
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_read < 0) {
+                result = -errno;
+                break;
+            }
+            if (bytes_read == 0) {
+                break;
+            }
+            result += bytes_read;
+        }
+
+        lock.lock();
+        done_.push_back({job.tag, result});
+        done_ready_.notify_one();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How an AsyncReader performs its reads
+enum class AsyncBackend {
+    IO_URING,  // Kernel submission/completion rings, set up with raw syscalls
+    THREADS    // A small pool of threads calling pread
+};
+
+struct ReadCompletion {
+    uint64_t tag;    // As passed to Submit
+    ssize_t result;  // Bytes read, or -errno
+};
+
+// Positional reads that complete out of order. io_uring is used when the
+// kernel offers it (no liburing needed), with a pread thread pool as the
+// fallback. Submit and Wait belong to one thread; Wake may be called from any
+// thread to end that thread's blocking Wait. At most `queue_depth` reads may
+// be in flight.
+class AsyncReader {
+public:
+    AsyncReader(unsigned queue_depth, bool use_io_uring = true, unsigned threads = 4);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader &) = delete;
+    AsyncReader &operator=(const AsyncReader &) = delete;
+
+    void Submit(int fd, char *buffer, size_t length, off_t offset, uint64_t tag);
+
+    // Start everything submitted, then append finished reads to `completions`.
+    // With `block`, waits until at least one read finishes or Wake is called.
+    void Wait(std::vector<ReadCompletion> *completions, bool block);
+    void Wake();
+
+    AsyncBackend Backend() const { return backend_; }
+    size_t InFlight() const { return in_flight_; }
+
+private:
+    struct Job {
+        int fd;
+        char *buffer;
+        size_t length;
+        off_t offset;
+        uint64_t tag;
+    };
+
+    AsyncBackend backend_;
+    unsigned queue_depth_;
+    size_t in_flight_;
+
+    // io_uring
+    int ring_fd_;
+    int wake_fd_;                // eventfd with a read always queued on the ring
+    uint64_t wake_buffer_;
+    void *sq_ring_;
+    size_t sq_ring_size_;
+    void *cq_ring_;
+    size_t cq_ring_size_;
+    void *sqes_;
+    size_t sqes_size_;
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned sq_mask_;
+    unsigned *sq_array_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    void *cqes_;
+
+    // Thread pool
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable done_ready_;
+    std::deque<Job> jobs_;
+    std::vector<ReadCompletion> done_;
+    bool woken_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+
+    bool SetupRing(unsigned entries);
+    void TeardownRing();
+    void QueueRead(int fd, void *buffer, size_t length, off_t offset, uint64_t tag);
+    void WaitRing(std::vector<ReadCompletion> *completions, bool block);
+    void WaitThreads(std::vector<ReadCompletion> *completions, bool block);
+    void ThreadLoop();
+};
+
+#endif // ASYNC_IO_H
@@ -0,0 +1,271 @@
+#include "async_tree.h"
+#include "metrics.h"
+#include "probes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+AsyncTree::AsyncTree(BPlusTree *tree, AsyncTreeOptions options)
+    : tree_(tree), buffer_pool_manager_(tree->buffer_pool_manager_),
+      // Each operation in flight holds at most one pin or one reserved frame;
+      // the other half of the pool is left for the inserts' own work
+      max_in_flight_(std::clamp<size_t>(options.max_in_flight, 1,
+                                        std::max<size_t>(1, buffer_pool_manager_->GetPoolSize() / 2))),
+      reader_(static_cast<unsigned>(max_in_flight_), options.use_io_uring, options.io_threads),
+      stopping_(false), active_(0), peak_reads_(0) {
+    loop_ = std::thread(&AsyncTree::Run, this);
+}
+
+AsyncTree::~AsyncTree() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    reader_.Wake();
+    loop_.join();
+}
+
+// ==================== Requests ====================
+
+std::future<std::optional<std::string>> AsyncTree::Search(int64_t key) {
+    auto promise = std::make_shared<std::promise<std::optional<std::string>>>();
+    std::future<std::optional<std::string>> future = promise->get_future();
+    Search(key, [promise](std::optional<std::string> value, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(value));
+        }
+    });
+    return future;
+}
+
+std::future<bool> AsyncTree::Insert(int64_t key, std::string value) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    Insert(key, std::move(value), [promise](bool inserted, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(inserted);
+        }
+    });
+    return future;
+}
+
+void AsyncTree::Search(int64_t key, SearchCallback callback) {
+    Enqueue({key, std::string(), std::move(callback), nullptr});
+}
+
+void AsyncTree::Insert(int64_t key, std::string value, InsertCallback callback) {
+    Enqueue({key, std::move(value), nullptr, std::move(callback)});
+}
+
+void AsyncTree::Enqueue(Request request) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(request));
+    }
+    reader_.Wake();
+}
+
+// ==================== Event loop ====================
+
+// Start queued requests while there is room, then collect finished reads and
+// resume whoever waits on them. Sleeps in the reader only when no request
+// was started, so new requests are picked up right after a Wake.
+void AsyncTree::Run() {
+    std::vector<Request> admitted;
+    std::vector<ReadCompletion> completions;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!queue_.empty() && active_ + admitted.size() < max_in_flight_) {
+                admitted.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+            if (admitted.empty() && active_ == 0 && queue_.empty() && stopping_) {
+                break;
+            }
+        }
+        bool idle = admitted.empty();
+        for (Request &request : admitted) {
+            ++active_;
+            Execute(std::move(request));  // Runs up to its first miss
+        }
+        admitted.clear();
+
+        reader_.Wait(&completions, idle);
+        for (const ReadCompletion &completion : completions) {
+            FinishLoad(completion);
+        }
+        completions.clear();
+    }
+}
+
+// Pages are never freed, so a split anywhere shows up as a new page id
+int AsyncTree::PagesAllocated() const {
+    return buffer_pool_manager_->GetDiskManager()->GetNumPages();
+}
+
+AsyncTree::Task AsyncTree::Execute(Request request) {
+    auto start = std::chrono::steady_clock::now();
+    std::optional<std::string> value;
+    bool inserted = false;
+    std::exception_ptr error;
+    try {
+        // FindLeafPage, except that a miss suspends instead of reading. A
+        // split while suspended may have moved the key out of the child we
+        // were heading for, so the descent then starts over.
+        // With write buffers an insert reads nothing, and a search is done
+        // at the first buffer on its path holding the key
+        Page *leaf = nullptr;
+        const BPlusTree::Message *buffered = nullptr;
+        bool descend = !request.on_insert || tree_->options_.write_buffer_entries == 0;
+        while (descend && !leaf && !buffered && tree_->root_page_id_ != INVALID_PAGE_ID) {
+            int pages_allocated = PagesAllocated();
+            int page_id = tree_->root_page_id_;
+            while (true) {
+                Page *page = buffer_pool_manager_->FetchResidentPage(page_id);
+                if (!page) {
+                    co_await PageLoad{this, page_id, nullptr};
+                    if (PagesAllocated() != pages_allocated) {
+                        break;
+                    }
+                    continue;
+                }
+                if (reinterpret_cast<BPlusTreePageHeader *>(page->data)->page_type != PageType::INTERNAL) {
+                    leaf = page;
+                    break;
+                }
+                if (!tree_->buffers_.empty()) {
+                    buffered = tree_->BufferedMessage(page_id, request.key);
+                    if (buffered) {
+                        buffer_pool_manager_->UnpinPage(page_id, false);
+                        break;
+                    }
+                }
+                int child_page_id = tree_->InternalFindChild(page, request.key);
+                buffer_pool_manager_->UnpinPage(page_id, false);
+                page_id = child_page_id;
+            }
+        }
+
+        if (request.on_insert) {
+            if (leaf) {
+                buffer_pool_manager_->UnpinPage(leaf->page_id, false);
+            }
+            inserted = tree_->Insert(request.key, request.value);
+        } else {
+            if (buffered) {
+                value = buffered->value;
+            } else if (leaf) {
+                int idx = tree_->LeafFindKey(leaf, request.key);
+                if (idx < tree_->GetLeafHeader(leaf)->base.num_keys && tree_->LeafKeyAt(leaf, idx) == request.key) {
+                    std::string current = tree_->LeafValueAt(leaf, idx);
+                    if (!current.empty()) {
+                        value = std::move(current);
+                    }
+                }
+                buffer_pool_manager_->UnpinPage(leaf->page_id, false);
+            }
+            value = tree_->ResolveVersion(request.key, std::move(value), nullptr);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    --active_;
+    if (request.on_insert) {
+        request.on_insert(inserted, error);
+    } else {
+        RecordLatency(Operation::SEARCH, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now() - start).count());
+        request.on_search(std::move(value), error);
+    }
+}
+
+// ==================== Page loads ====================
+
+// Join the read already in flight for the page, or reserve a frame and
+// submit one. Returns false (and the waiter is not suspended) when the page
+// needs no read after all, or when no frame is free, with `error` set.
+bool AsyncTree::StartLoad(int page_id, Waiter waiter) {
+    auto it = loads_.find(page_id);
+    if (it != loads_.end()) {
+        it->second.waiters.push_back(waiter);
+        return true;
+    }
+
+    Page *frame = buffer_pool_manager_->ReserveFrame(page_id);
+    if (!frame) {
+        *waiter.error = std::make_exception_ptr(
+            std::runtime_error("No free frame to read page " + std::to_string(page_id)));
+        return false;
+    }
+
+    DiskManager *disk_manager = buffer_pool_manager_->GetDiskManager();
+    Load load;
+    load.frame = frame;
+    size_t length;
+    disk_manager->PlanRead(page_id, &load.offset, &length);
+    if (length == 0) {
+        // Never written: zeros, no I/O
+        if (buffer_pool_manager_->InstallFrame(frame, frame->data, 0)) {
+            buffer_pool_manager_->UnpinPage(page_id, false);
+        }
+        return false;
+    }
+    char *buffer = frame->data;
+    if (length != PAGE_SIZE) {
+        load.image = std::make_unique<char[]>(length);
+        buffer = load.image.get();
+    }
+    try {
+        reader_.Submit(disk_manager->GetFd(), buffer, length, load.offset, static_cast<uint64_t>(page_id));
+    } catch (...) {
+        buffer_pool_manager_->ReleaseFrame(frame);
+        throw;
+    }
+    BPTREE_PROBE2(io__read__start, load.offset, length);
+    load.waiters.push_back(waiter);
+    loads_.emplace(page_id, std::move(load));
+    if (reader_.InFlight() > peak_reads_) {
+        peak_reads_ = reader_.InFlight();
+    }
+    return true;
+}
+
+// Map the frame (unless the read went stale) and resume the waiters, which
+// pin the page again themselves; the frame's own pin is dropped last
+void AsyncTree::FinishLoad(const ReadCompletion &completion) {
+    int page_id = static_cast<int>(completion.tag);
+    auto it = loads_.find(page_id);
+    Load load = std::move(it->second);
+    loads_.erase(it);
+    BPTREE_PROBE2(io__read__done, load.offset, completion.result);
+
+    std::exception_ptr error;
+    bool installed = false;
+    if (completion.result < 0) {
+        buffer_pool_manager_->ReleaseFrame(load.frame);
+        error = std::make_exception_ptr(std::runtime_error("Failed to read page " + std::to_string(page_id) +
+                                                           ": " + std::strerror(-completion.result)));
+    } else {
+        try {
+            const char *image = load.image ? load.image.get() : load.frame->data;
+            installed = buffer_pool_manager_->InstallFrame(load.frame, image, completion.result);
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+
+    for (const Waiter &waiter : load.waiters) {
+        *waiter.error = error;
+        waiter.handle.resume();
+    }
+    if (installed) {
+        buffer_pool_manager_->UnpinPage(page_id, false);
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef ASYNC_TREE_H
+#define ASYNC_TREE_H
+
+#include "async_io.h"
+#include "btree.h"
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct AsyncTreeOptions {
+    size_t max_in_flight = 256;  // Operations in progress at once; at most half the pool
+    bool use_io_uring = true;    // false: read with the pread thread pool
+    unsigned io_threads = 4;     // Thread-pool backend only
+};
+
+// Asynchronous Search/Insert for a tree that does not fit in its pool.
+//
+// Requests from any thread are queued to one event loop thread, which runs
+// each as a coroutine. A descent that misses in the pool reserves a frame,
+// submits the read to an AsyncReader (io_uring when available) and suspends;
+// the loop meanwhile starts or resumes other operations, and resumes the
+// descent when the read completes. A few caller threads can so keep up to
+// `max_in_flight` reads outstanding. Concurrent misses on one page share
+// its read.
+//
+// A suspended Search holds no pins. If a split happened while it waited, it
+// restarts from the root, where its path is then mostly cached. Insert reads
+// its path the same way, then runs BPlusTree::Insert, which finds the path
+// resident (splits may still read or write synchronously).
+//
+// While an AsyncTree exists the tree and its pool must only be used through
+// it. Callbacks run on the event loop thread and must neither block nor
+// throw. Searches record their end-to-end latency under Operation::SEARCH;
+// inserts are timed by BPlusTree::Insert. The destructor finishes every
+// queued request.
+class AsyncTree {
+public:
+    using SearchCallback = std::function<void(std::optional<std::string> value, std::exception_ptr error)>;
+    using InsertCallback = std::function<void(bool inserted, std::exception_ptr error)>;
+
+    explicit AsyncTree(BPlusTree *tree, AsyncTreeOptions options = AsyncTreeOptions());
+    ~AsyncTree();
+
+    AsyncTree(const AsyncTree &) = delete;
+    AsyncTree &operator=(const AsyncTree &) = delete;
+
+    std::future<std::optional<std::string>> Search(int64_t key);
+    std::future<bool> Insert(int64_t key, std::string value);
+    void Search(int64_t key, SearchCallback callback);
+    void Insert(int64_t key, std::string value, InsertCallback callback);
+
+    AsyncBackend Backend() const { return reader_.Backend(); }
+    // Most reads outstanding at once so far
+    size_t PeakReadsInFlight() const { return peak_reads_; }
+
+private:
+    struct Request {
+        int64_t key;
+        std::string value;
+        SearchCallback on_search;  // Set for a search
+        InsertCallback on_insert;  // Set for an insert
+    };
+
+    // An operation in progress; starts eagerly and frees itself when done
+    struct Task {
+        struct promise_type {
+            Task get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        std::exception_ptr *error;
+    };
+
+    // co_await PageLoad{...}: suspend until `page_id` has been read in, or
+    // throw if it could not be
+    struct PageLoad {
+        AsyncTree *tree;
+        int page_id;
+        std::exception_ptr error;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) { return tree->StartLoad(page_id, {handle, &error}); }
+        void await_resume() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    };
+
+    // A read in flight into a reserved frame
+    struct Load {
+        Page *frame;
+        std::unique_ptr<char[]> image;  // Compressed images are read here, not into the frame
+        off_t offset;
+        std::vector<Waiter> waiters;
+    };
+
+    BPlusTree *tree_;
+    BufferPoolManager *buffer_pool_manager_;
+    size_t max_in_flight_;
+    AsyncReader reader_;
+
+    std::mutex mutex_;
+    std::deque<Request> queue_;
+    bool stopping_;
+
+    // Event loop thread only
+    size_t active_;
+    std::unordered_map<int, Load> loads_;
+    std::atomic<size_t> peak_reads_;
+
+    std::thread loop_;
+
+    void Enqueue(Request request);
+    void Run();
+    Task Execute(Request request);
+    bool StartLoad(int page_id, Waiter waiter);
+    void FinishLoad(const ReadCompletion &completion);
+    int PagesAllocated() const;
+};
+
+#endif // ASYNC_TREE_H
@@ -0,0 +1,134 @@
+#include "backup.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+
+OnlineBackup::OnlineBackup(BufferPoolManager *buffer_pool_manager, const std::string &dest_file,
+                           BackupOptions options)
+    : disk_manager_(buffer_pool_manager->GetDiskManager()), options_(options), dest_fd_(-1),
+      snapshot_pages_(0), next_page_(0), bytes_copied_(0) {
+    dest_fd_ = open(dest_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (dest_fd_ < 0) {
+        throw std::runtime_error("Failed to open backup file: " + dest_file);
+    }
+
+    // The point in time: everything dirty is written and checkpointed
+    buffer_pool_manager->FlushAllPages();
+    snapshot_pages_ = disk_manager_->GetNumPhysicalPages();
+    copied_.assign(snapshot_pages_, false);
+    if (ftruncate(dest_fd_, static_cast<off_t>(snapshot_pages_) * PAGE_SIZE) != 0) {
+        throw std::runtime_error("Failed to size backup file: " + dest_file);
+    }
+
+    disk_manager_->SetOverwriteHook([this](off_t offset, size_t length) { CopyBeforeOverwrite(offset, length); });
+    if (snapshot_pages_ == 0) {
+        Finish();
+    }
+}
+
+OnlineBackup::~OnlineBackup() {
+    disk_manager_->SetOverwriteHook(nullptr);
+    if (dest_fd_ >= 0) {
+        close(dest_fd_);
+    }
+}
+
+bool OnlineBackup::IsDone() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_page_ >= snapshot_pages_;
+}
+
+size_t OnlineBackup::BytesCopied() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_copied_;
+}
+
+bool OnlineBackup::Step() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (next_page_ >= snapshot_pages_) {
+        return false;
+    }
+
+    // The chunk is read and marked under the lock: the hook cannot copy a
+    // page of it in between, and a page it copied first is skipped here
+    int chunk_pages = static_cast<int>(std::max<size_t>(options_.chunk_size / PAGE_SIZE, 1));
+    int count = std::min(chunk_pages, snapshot_pages_ - next_page_);
+    std::vector<char> buffer(static_cast<size_t>(count) * PAGE_SIZE);
+    disk_manager_->ReadPhysicalPages(next_page_, count, buffer.data());
+
+    // Write runs of pages not already preserved by copy-before-write
+    int i = 0;
+    while (i < count) {
+        if (copied_[next_page_ + i]) {
+            ++i;
+            continue;
+        }
+        int run_start = i;
+        while (i < count && !copied_[next_page_ + i]) {
+            copied_[next_page_ + i] = true;
+            ++i;
+        }
+        WriteDest(next_page_ + run_start, i - run_start, buffer.data() + run_start * PAGE_SIZE);
+    }
+    next_page_ += count;
+
+    if (next_page_ >= snapshot_pages_) {
+        lock.unlock();
+        Finish();
+        return false;
+    }
+    return true;
+}
+
+void OnlineBackup::Run() {
+    auto start = std::chrono::steady_clock::now();
+    while (Step()) {
+        if (options_.max_bytes_per_sec == 0) {
+            continue;
+        }
+        // Sleep until the copied volume is back under the rate limit
+        auto due = start + std::chrono::microseconds(BytesCopied() * 1000000 / options_.max_bytes_per_sec);
+        std::this_thread::sleep_until(due);
+    }
+}
+
+void OnlineBackup::CopyBeforeOverwrite(off_t offset, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int first = static_cast<int>(offset / PAGE_SIZE);
+    int last = static_cast<int>((offset + length - 1) / PAGE_SIZE);
+    for (int physical_id = first; physical_id <= last && physical_id < snapshot_pages_; ++physical_id) {
+        if (copied_[physical_id]) {
+            continue;
+        }
+        char buffer[PAGE_SIZE];
+        disk_manager_->ReadPhysicalPages(physical_id, 1, buffer);
+        copied_[physical_id] = true;
+        WriteDest(physical_id, 1, buffer);
+    }
+}
+
+void OnlineBackup::WriteDest(int first_page, int count, const char *data) {
+    size_t length = static_cast<size_t>(count) * PAGE_SIZE;
+    off_t offset = static_cast<off_t>(first_page) * PAGE_SIZE;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t bytes_written = pwrite(dest_fd_, data + done, length - done, offset + done);
+        if (bytes_written <= 0) {
+            throw std::runtime_error("Failed to write backup page " + std::to_string(first_page));
+        }
+        done += bytes_written;
+    }
+    bytes_copied_ += length;
+}
+
+// The hook stays installed until destruction: Step() may finish on another
+// thread than the writer's, and every page is copied by now, so it does nothing
+void OnlineBackup::Finish() {
+    if (fsync(dest_fd_) != 0) {
+        throw std::runtime_error("Failed to sync backup file");
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include "buffer_pool_manager.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct BackupOptions {
+    size_t chunk_size = 1 << 20;     // Bytes per sequential read
+    size_t max_bytes_per_sec = 0;    // Throttle for Run(); 0 means unthrottled
+};
+
+// Online backup of a database file while it keeps serving traffic.
+//
+// Construction flushes the buffer pool, which makes the file a consistent
+// checkpoint; that instant is the backup's point in time. The file is then
+// copied in large sequential chunks by Step()/Run(), interleaved with normal
+// tree operations. Any page about to be overwritten before it was copied is
+// copied first (copy-before-write), so the destination always receives the
+// point-in-time image. In copy-on-write mode checkpointed pages are never
+// overwritten, so only the meta slots and recycled pages take that path.
+//
+// Step()/Run() may run on a background thread while another thread writes
+// the file: each chunk is read and marked copied under the same lock as the
+// copy-before-write hook, so a page is never copied after it was overwritten.
+// Construction and destruction install and remove the hook, so they must not
+// overlap writes. Only one backup per DiskManager may be active at a time.
+class OnlineBackup {
+public:
+    OnlineBackup(BufferPoolManager *buffer_pool_manager, const std::string &dest_file,
+                 BackupOptions options = BackupOptions());
+    ~OnlineBackup();
+
+    // Copy the next chunk; returns false once the backup is complete
+    bool Step();
+    // Copy everything, sleeping as needed to honor max_bytes_per_sec
+    void Run();
+
+    bool IsDone() const;
+    size_t BytesCopied() const;
+
+private:
+    DiskManager *disk_manager_;
+    BackupOptions options_;
+    int dest_fd_;
+    int snapshot_pages_;             // File length at the point in time
+
+    // Shared by Step() and the overwrite hook
+    mutable std::mutex mutex_;
+    int next_page_;                  // Sequential copy cursor
+    std::vector<bool> copied_;       // Pages already in the destination
+    size_t bytes_copied_;
+
+    void CopyBeforeOverwrite(off_t offset, size_t length);
+    // Callers hold mutex_
+    void WriteDest(int first_page, int count, const char *data);
+    void Finish();
+};
+
+#endif // BACKUP_H
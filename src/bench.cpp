@@ -0,0 +1,465 @@
+// YCSB-style benchmark driver for BPlusTree.
+//
+// Implements the core workloads A-F (read/update/insert/scan/read-modify-write
+// mixes over uniform, Zipfian and latest key distributions) and reports
+// throughput plus latency percentiles per operation type.
+//
+// The records live in a ShardedStore. Each shard's tree and buffer pool are
+// single-threaded, so worker threads serialize on the mutex of the shard they
+// touch (with the default --shards 1, on one mutex for everything); latencies
+// include the time spent waiting for it, which is what a client sharing a
+// store would see.
+
+#include "metrics.h"
+#include "sharded_store.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum class Distribution { UNIFORM, ZIPFIAN, LATEST };
+enum OpType { READ, UPDATE, INSERT, SCAN, READ_MODIFY_WRITE, NUM_OP_TYPES };
+
+const char *const OP_NAMES[NUM_OP_TYPES] = {"READ", "UPDATE", "INSERT", "SCAN", "READ-MODIFY-WRITE"};
+
+struct BenchConfig {
+    std::string workload = "A";
+    int64_t record_count = 100000;
+    int64_t operation_count = 0;  // 0: run for `duration` seconds
+    double duration = 10.0;
+    size_t value_size = 100;
+    int threads = 1;
+    int max_scan_length = 100;
+    size_t pool_pages = MAX_PAGES_IN_RAM;  // Per shard
+    size_t shards = 1;
+    size_t write_buffer = 0;  // TreeOptions::write_buffer_entries
+    bool copy_on_write = false;
+    std::string file = "bench.db";  // Manifest path of the store
+    std::string stats_format;  // Engine stats dump after the run: "text" or "json"
+    std::string trace_file;    // Page access trace of the run phase, if set
+    Distribution distribution = Distribution::ZIPFIAN;
+    double proportions[NUM_OP_TYPES] = {0.5, 0.5, 0, 0, 0};
+};
+
+// Core workload definitions (YCSB core properties)
+bool ApplyWorkload(BenchConfig *config, const std::string &name) {
+    static const std::map<std::string, std::pair<std::vector<double>, Distribution>> workloads = {
+        {"A", {{0.50, 0.50, 0.00, 0.00, 0.00}, Distribution::ZIPFIAN}},  // Update heavy
+        {"B", {{0.95, 0.05, 0.00, 0.00, 0.00}, Distribution::ZIPFIAN}},  // Read mostly
+        {"C", {{1.00, 0.00, 0.00, 0.00, 0.00}, Distribution::ZIPFIAN}},  // Read only
+        {"D", {{0.95, 0.00, 0.05, 0.00, 0.00}, Distribution::LATEST}},   // Read latest
+        {"E", {{0.00, 0.00, 0.05, 0.95, 0.00}, Distribution::ZIPFIAN}},  // Short ranges
+        {"F", {{0.50, 0.00, 0.00, 0.00, 0.50}, Distribution::ZIPFIAN}},  // Read-modify-write
+    };
+    auto it = workloads.find(name);
+    if (it == workloads.end()) {
+        return false;
+    }
+    config->workload = name;
+    std::copy(it->second.first.begin(), it->second.first.end(), config->proportions);
+    config->distribution = it->second.second;
+    return true;
+}
+
+uint64_t FnvHash64(uint64_t value) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; ++i) {
+        hash ^= value & 0xFF;
+        hash *= 0x100000001B3ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+// Zipfian ranks in [0, n) after Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases", as in YCSB. Rank 0 is the most popular; the zeta sum
+// is extended incrementally when n grows, so inserts stay cheap.
+class ZipfianGenerator {
+public:
+    explicit ZipfianGenerator(double theta = 0.99)
+        : theta_(theta), alpha_(1.0 / (1.0 - theta)), zeta2_(1.0 + std::pow(0.5, theta)), items_(0),
+          zetan_(0) {}
+
+    int64_t Next(int64_t n, std::mt19937_64 &rng) {
+        if (n != items_) {
+            Resize(n);
+        }
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta_)) {
+            return std::min<int64_t>(1, n - 1);
+        }
+        int64_t rank = static_cast<int64_t>(n * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return std::min(rank, n - 1);
+    }
+
+private:
+    void Resize(int64_t n) {
+        if (n < items_) {
+            items_ = 0;
+            zetan_ = 0;
+        }
+        for (int64_t i = items_ + 1; i <= n; ++i) {
+            zetan_ += 1.0 / std::pow(static_cast<double>(i), theta_);
+        }
+        items_ = n;
+        eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta_)) / (1.0 - zeta2_ / zetan_);
+    }
+
+    double theta_;
+    double alpha_;
+    double zeta2_;
+    int64_t items_;
+    double zetan_;
+    double eta_ = 0;
+};
+
+// Latency samples of one thread, in nanoseconds, per operation type
+struct ThreadStats {
+    std::vector<uint64_t> latencies[NUM_OP_TYPES];
+    uint64_t failures = 0;
+};
+
+class Benchmark {
+public:
+    explicit Benchmark(const BenchConfig &config)
+        : config_(config), store_(config.file, StoreOptions(config)),
+          value_(std::min(config.value_size, VALUE_SIZE - 1), 'v'), inserted_(config.record_count) {}
+
+    void Load() {
+        std::vector<int64_t> keys(config_.record_count);
+        for (int64_t i = 0; i < config_.record_count; ++i) {
+            keys[i] = i;
+        }
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t key : keys) {
+            store_.Insert(key, value_);
+        }
+        store_.Flush();
+        double seconds = Elapsed(start);
+        std::cout << "  Load: " << config_.record_count << " records in " << std::fixed << std::setprecision(2)
+                  << seconds << " s (" << std::setprecision(0) << config_.record_count / seconds << " ops/s)"
+                  << std::endl;
+    }
+
+    // A trace describes one pool, so tracing needs a single shard
+    void StartTrace(const std::string &path) { store_.ShardPool(0)->StartTrace(path); }
+
+    void Run() {
+        std::vector<ThreadStats> stats(config_.threads);
+        std::vector<std::thread> workers;
+        std::atomic<int64_t> remaining(config_.operation_count);
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(config_.duration));
+
+        for (int t = 0; t < config_.threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937_64 rng(1000 + t);
+                ZipfianGenerator zipfian;
+                while (true) {
+                    if (config_.operation_count > 0) {
+                        if (remaining.fetch_sub(1) <= 0) {
+                            break;
+                        }
+                    } else if (std::chrono::steady_clock::now() >= deadline) {
+                        break;
+                    }
+                    RunOperation(ChooseOperation(rng), rng, zipfian, &stats[t]);
+                }
+            });
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        double seconds = Elapsed(start);
+        Report(stats, seconds);
+    }
+
+private:
+    static ShardedStoreOptions StoreOptions(const BenchConfig &config) {
+        ShardedStoreOptions options;
+        options.num_shards = config.shards;
+        options.pool_pages = config.pool_pages;
+        options.copy_on_write = config.copy_on_write;
+        options.tree_options.write_buffer_entries = config.write_buffer;
+        return options;
+    }
+
+    static double Elapsed(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    OpType ChooseOperation(std::mt19937_64 &rng) const {
+        double total = 0;
+        for (double proportion : config_.proportions) {
+            total += proportion;
+        }
+        double pick = std::uniform_real_distribution<double>(0.0, total)(rng);
+        for (int op = 0; op < NUM_OP_TYPES; ++op) {
+            if (pick < config_.proportions[op]) {
+                return static_cast<OpType>(op);
+            }
+            pick -= config_.proportions[op];
+        }
+        return READ;
+    }
+
+    // Key of an existing record under the configured distribution. Zipfian
+    // ranks are scrambled so the hot records are spread over the key space;
+    // "latest" favours the most recently inserted records.
+    int64_t ChooseKey(std::mt19937_64 &rng, ZipfianGenerator &zipfian) const {
+        int64_t count = inserted_.load();
+        switch (config_.distribution) {
+            case Distribution::UNIFORM:
+                return std::uniform_int_distribution<int64_t>(0, count - 1)(rng);
+            case Distribution::ZIPFIAN:
+                return static_cast<int64_t>(FnvHash64(zipfian.Next(count, rng)) % count);
+            case Distribution::LATEST:
+                return count - 1 - zipfian.Next(count, rng);
+        }
+        return 0;
+    }
+
+    void RunOperation(OpType op, std::mt19937_64 &rng, ZipfianGenerator &zipfian, ThreadStats *stats) {
+        int64_t key = op == INSERT ? 0 : ChooseKey(rng, zipfian);
+        int scan_length = op == SCAN ? std::uniform_int_distribution<int>(1, config_.max_scan_length)(rng) : 0;
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = true;
+        switch (op) {
+            case READ:
+                ok = store_.Search(key).has_value();
+                break;
+            case UPDATE:
+                ok = store_.Insert(key, value_);
+                break;
+            case INSERT:
+                // Keys are handed out in order, so a scan of n records is the
+                // key range [start, start + n - 1]
+                ok = store_.Insert(inserted_++, value_);
+                break;
+            case SCAN:
+                ok = !store_.Scan(key, key + scan_length - 1).empty();
+                break;
+            case READ_MODIFY_WRITE:
+                ok = store_.Search(key).has_value() && store_.Insert(key, value_);
+                break;
+            default:
+                break;
+        }
+        auto end = std::chrono::steady_clock::now();
+        stats->latencies[op].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        if (!ok) {
+            stats->failures++;
+        }
+    }
+
+    void Report(std::vector<ThreadStats> &stats, double seconds) const {
+        uint64_t total_ops = 0;
+        uint64_t failures = 0;
+        std::vector<uint64_t> merged[NUM_OP_TYPES];
+        for (ThreadStats &thread_stats : stats) {
+            failures += thread_stats.failures;
+            for (int op = 0; op < NUM_OP_TYPES; ++op) {
+                merged[op].insert(merged[op].end(), thread_stats.latencies[op].begin(),
+                                  thread_stats.latencies[op].end());
+                total_ops += thread_stats.latencies[op].size();
+            }
+        }
+
+        std::cout << "  Run: " << total_ops << " ops in " << std::fixed << std::setprecision(2) << seconds
+                  << " s (" << std::setprecision(0) << total_ops / seconds << " ops/s)";
+        if (failures > 0) {
+            std::cout << ", " << failures << " failed";
+        }
+        std::cout << std::endl;
+
+        std::cout << "  " << std::left << std::setw(18) << "Operation" << std::right << std::setw(10) << "Count"
+                  << std::setw(11) << "p50(us)" << std::setw(11) << "p95(us)" << std::setw(11) << "p99(us)"
+                  << std::setw(12) << "p99.9(us)" << std::setw(11) << "max(us)" << std::endl;
+        for (int op = 0; op < NUM_OP_TYPES; ++op) {
+            std::vector<uint64_t> &samples = merged[op];
+            if (samples.empty()) {
+                continue;
+            }
+            std::sort(samples.begin(), samples.end());
+            auto percentile = [&](double p) {
+                size_t idx = static_cast<size_t>(p * (samples.size() - 1));
+                return samples[idx] / 1000.0;
+            };
+            std::cout << "  " << std::left << std::setw(18) << OP_NAMES[op] << std::right << std::setw(10)
+                      << samples.size() << std::setprecision(1) << std::setw(11) << percentile(0.50)
+                      << std::setw(11) << percentile(0.95) << std::setw(11) << percentile(0.99) << std::setw(12)
+                      << percentile(0.999) << std::setw(11) << samples.back() / 1000.0 << std::endl;
+        }
+    }
+
+    const BenchConfig &config_;
+    ShardedStore store_;
+    std::string value_;
+    std::atomic<int64_t> inserted_;  // Records 0 .. inserted_-1 exist (or are being inserted)
+};
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --workload A-F         YCSB core workload (default A)\n"
+              << "  --records N            records loaded before the run (default 100000)\n"
+              << "  --operations N         stop after N operations (default: run for --duration)\n"
+              << "  --duration S           run time in seconds (default 10)\n"
+              << "  --threads N            client threads (default 1)\n"
+              << "  --value-size B         value bytes, at most " << VALUE_SIZE - 1 << " (default 100)\n"
+              << "  --distribution D       uniform | zipfian | latest (default: per workload)\n"
+              << "  --read P --update P --insert P --scan P --rmw P\n"
+              << "                         override the operation mix (proportions)\n"
+              << "  --max-scan-length N    longest scan in records (default 100)\n"
+              << "  --pool-pages N         buffer pool frames per shard (default " << MAX_PAGES_IN_RAM << ")\n"
+              << "  --shards N             hash-partition the records over N trees and files (default 1)\n"
+              << "  --write-buffer N       buffer up to N writes per internal page (Bε-style)\n"
+              << "  --cow                  open the file in copy-on-write mode\n"
+              << "  --file PATH            store path (manifest; shards are PATH.0, PATH.1, ...),\n"
+              << "                         removed afterwards (default bench.db)\n"
+              << "  --stats text|json      dump engine metrics for the run phase\n"
+              << "  --trace PATH           record the run phase's page accesses for bptree_cachesim\n"
+              << "                         (single shard only)\n";
+}
+
+bool ParseArgs(int argc, char **argv, BenchConfig *config) {
+    bool mix_overridden = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cow") {
+            config->copy_on_write = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "--workload") {
+                if (!ApplyWorkload(config, value)) {
+                    return false;
+                }
+            } else if (arg == "--records") {
+                config->record_count = std::stoll(value);
+            } else if (arg == "--operations") {
+                config->operation_count = std::stoll(value);
+            } else if (arg == "--duration") {
+                config->duration = std::stod(value);
+            } else if (arg == "--threads") {
+                config->threads = std::stoi(value);
+            } else if (arg == "--value-size") {
+                config->value_size = std::stoul(value);
+            } else if (arg == "--max-scan-length") {
+                config->max_scan_length = std::stoi(value);
+            } else if (arg == "--pool-pages") {
+                config->pool_pages = std::stoul(value);
+            } else if (arg == "--shards") {
+                config->shards = std::stoul(value);
+            } else if (arg == "--write-buffer") {
+                config->write_buffer = std::stoul(value);
+            } else if (arg == "--file") {
+                config->file = value;
+            } else if (arg == "--trace") {
+                config->trace_file = value;
+            } else if (arg == "--stats") {
+                if (value != "text" && value != "json") {
+                    return false;
+                }
+                config->stats_format = value;
+            } else if (arg == "--distribution") {
+                if (value == "uniform") {
+                    config->distribution = Distribution::UNIFORM;
+                } else if (value == "zipfian") {
+                    config->distribution = Distribution::ZIPFIAN;
+                } else if (value == "latest") {
+                    config->distribution = Distribution::LATEST;
+                } else {
+                    return false;
+                }
+            } else {
+                static const std::map<std::string, OpType> mix_flags = {
+                    {"--read", READ}, {"--update", UPDATE}, {"--insert", INSERT},
+                    {"--scan", SCAN}, {"--rmw", READ_MODIFY_WRITE}};
+                auto it = mix_flags.find(arg);
+                if (it == mix_flags.end()) {
+                    return false;
+                }
+                if (!mix_overridden) {
+                    std::fill(std::begin(config->proportions), std::end(config->proportions), 0.0);
+                    mix_overridden = true;
+                }
+                config->proportions[it->second] = std::stod(value);
+            }
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+    return config->record_count > 0 && config->threads > 0 && config->max_scan_length > 0 &&
+           config->pool_pages > 0 && config->shards > 0 && (config->trace_file.empty() || config->shards == 1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    BenchConfig config;
+    ApplyWorkload(&config, "A");
+    if (!ParseArgs(argc, argv, &config)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (config.value_size >= VALUE_SIZE) {
+        std::cerr << "Value size capped at " << VALUE_SIZE - 1 << " bytes" << std::endl;
+    }
+
+    static const char *const DISTRIBUTION_NAMES[] = {"uniform", "zipfian", "latest"};
+    std::cout << "=== YCSB Workload " << config.workload << " ===" << std::endl;
+    std::cout << "  Mix:";
+    for (int op = 0; op < NUM_OP_TYPES; ++op) {
+        if (config.proportions[op] > 0) {
+            std::cout << " " << OP_NAMES[op] << "=" << config.proportions[op];
+        }
+    }
+    std::cout << " (" << DISTRIBUTION_NAMES[static_cast<int>(config.distribution)] << ")" << std::endl;
+    std::cout << "  Records: " << config.record_count << ", value size: "
+              << std::min(config.value_size, VALUE_SIZE - 1) << " bytes, threads: " << config.threads
+              << ", pool: " << config.pool_pages << " pages"
+              << (config.shards > 1 ? " x " + std::to_string(config.shards) + " hash shards" : "")
+              << (config.copy_on_write ? ", copy-on-write" : "")
+              << std::endl;
+
+    ShardedStore::Destroy(config.file);
+    {
+        Benchmark benchmark(config);
+        benchmark.Load();
+        ResetStats();
+        if (!config.trace_file.empty()) {
+            benchmark.StartTrace(config.trace_file);
+        }
+        benchmark.Run();
+    }
+    if (config.stats_format == "text") {
+        std::cout << "\n=== Engine Stats ===\n" << GetStats().ToText();
+    } else if (config.stats_format == "json") {
+        std::cout << GetStats().ToJson() << std::endl;
+    }
+    ShardedStore::Destroy(config.file);
+    return 0;
+}
@@ -1,13 +1,34 @@
 #include "btree.h"
+#include "metrics.h"
+#include "probes.h"
 #include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <utility>
 
-BPlusTree::BPlusTree(BufferPoolManager *buffer_pool_manager)
-    : buffer_pool_manager_(buffer_pool_manager), root_page_id_(INVALID_PAGE_ID) {
+BPlusTree::BPlusTree(BufferPoolManager *buffer_pool_manager, const std::string &name, TreeOptions options)
+    : buffer_pool_manager_(buffer_pool_manager), name_(name), options_(options), root_page_id_(INVALID_PAGE_ID),
+      current_ts_(0), buffered_writes_(0), dictionary_next_id_(1), dictionary_live_ids_(0),
+      dictionary_new_ids_(0) {
+    if (name_.size() > MAX_TREE_NAME_LENGTH ||
+        (options_.dedup_values && DictionaryName().size() > MAX_TREE_NAME_LENGTH)) {
+        throw std::runtime_error("Tree name too long: " + name_);
+    }
     LoadMetaPage();
+    if (options_.write_buffer_entries > 0) {
+        buffer_pool_manager_->AddFlushHook(this, [this] { FlushBuffers(); });
+    }
 }
 
 BPlusTree::~BPlusTree() {
+    buffer_pool_manager_->RemoveFlushHook(this);
+    try {
+        FlushBuffers();
+    } catch (const std::exception &e) {
+        std::cerr << "BPlusTree " << (name_.empty() ? "(default)" : name_) << ": " << buffered_writes_
+                  << " buffered writes lost at destruction: " << e.what() << std::endl;
+    }
     // Ensure meta page is flushed
     buffer_pool_manager_->FlushPage(META_PAGE_ID);
 }
@@ -18,11 +39,17 @@ void BPlusTree::LoadMetaPage() {
     // Check if database already has pages (not a fresh database)
     // If num_pages > 0, then page 0 (meta page) exists with tree metadata
     if (buffer_pool_manager_->GetDiskManager()->GetNumPages() > 0) {
-        Page *meta = buffer_pool_manager_->FetchPage(META_PAGE_ID);
-        if (meta) {
-            MetaPage *meta_data = reinterpret_cast<MetaPage *>(meta->data);
-            // Load the persisted root_page_id from the meta page
-            root_page_id_ = meta_data->root_page_id;
+        MetaPage *meta_data = FetchMetaPage(buffer_pool_manager_);
+        if (meta_data) {
+            if (name_.empty()) {
+                // Load the persisted root_page_id from the meta page
+                root_page_id_ = meta_data->root_page_id;
+            } else {
+                CatalogEntry *entry = FindCatalogEntry(meta_data, name_);
+                if (entry) {
+                    root_page_id_ = entry->root_page_id;
+                }
+            }
             buffer_pool_manager_->UnpinPage(META_PAGE_ID, false);
         }
     }
@@ -32,19 +59,133 @@ void BPlusTree::UpdateMetaPage() {
     Page *meta = buffer_pool_manager_->FetchPage(META_PAGE_ID);
     if (meta) {
         MetaPage *meta_data = reinterpret_cast<MetaPage *>(meta->data);
-        meta_data->root_page_id = root_page_id_;
+        if (name_.empty()) {
+            meta_data->root_page_id = root_page_id_;
+        } else {
+            CatalogEntry *entry = FindCatalogEntry(meta_data, name_);
+            if (!entry) {
+                // First root of a named tree: register it in the catalog
+                if (meta_data->num_trees >= static_cast<int>(MAX_CATALOG_ENTRIES)) {
+                    buffer_pool_manager_->UnpinPage(META_PAGE_ID, false);
+                    throw std::runtime_error("Catalog is full, cannot create tree: " + name_);
+                }
+                entry = &meta_data->trees[meta_data->num_trees++];
+                std::memset(entry, 0, sizeof(CatalogEntry));
+                std::memcpy(entry->name, name_.data(), name_.size());
+            }
+            entry->root_page_id = root_page_id_;
+        }
         buffer_pool_manager_->UnpinPage(META_PAGE_ID, true);
     }
 }
 
+CatalogEntry *BPlusTree::FindCatalogEntry(MetaPage *meta, const std::string &name) {
+    for (int i = 0; i < meta->num_trees; ++i) {
+        if (std::strncmp(meta->trees[i].name, name.c_str(), MAX_TREE_NAME_LENGTH + 1) == 0) {
+            return &meta->trees[i];
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::string> BPlusTree::ListTrees(BufferPoolManager *buffer_pool_manager) {
+    std::vector<std::string> names;
+    if (buffer_pool_manager->GetDiskManager()->GetNumPages() == 0) {
+        return names;
+    }
+
+    MetaPage *meta_data = FetchMetaPage(buffer_pool_manager);
+    if (!meta_data) {
+        return names;
+    }
+    for (int i = 0; i < meta_data->num_trees; ++i) {
+        names.emplace_back(meta_data->trees[i].name);
+    }
+    buffer_pool_manager->UnpinPage(META_PAGE_ID, false);
+    return names;
+}
+
+// Pin the meta page of an existing file after checking its format stamp
+MetaPage *BPlusTree::FetchMetaPage(BufferPoolManager *buffer_pool_manager) {
+    const std::string &file = buffer_pool_manager->GetDiskManager()->GetFileName();
+    Page *meta;
+    try {
+        meta = buffer_pool_manager->FetchPage(META_PAGE_ID);
+    } catch (const std::runtime_error &e) {
+        // Pages of version 1 have no checksum field to verify
+        throw std::runtime_error(std::string(e.what()) + " (a corrupt file, or one older than format version " +
+                                 std::to_string(FORMAT_VERSION) + ")");
+    }
+    if (!meta) {
+        return nullptr;
+    }
+    MetaPage *meta_data = reinterpret_cast<MetaPage *>(meta->data);
+    if (meta_data->magic != FORMAT_MAGIC || meta_data->format_version != FORMAT_VERSION) {
+        std::string found = meta_data->magic == FORMAT_MAGIC
+                                ? "format version " + std::to_string(meta_data->format_version)
+                                : "no format stamp (format version 1, with 32-bit keys, or not a tree file)";
+        buffer_pool_manager->UnpinPage(META_PAGE_ID, false);
+        throw std::runtime_error("Unsupported file format: " + file + " has " + found + ", this build reads format "
+                                 "version " + std::to_string(FORMAT_VERSION));
+    }
+    return meta_data;
+}
+
 // ==================== Helper Functions ====================
 
 LeafPageHeader *BPlusTree::GetLeafHeader(Page *page) {
     return reinterpret_cast<LeafPageHeader *>(page->data);
 }
 
-LeafEntry *BPlusTree::GetLeafEntries(Page *page) {
-    return reinterpret_cast<LeafEntry *>(page->data + LEAF_HEADER_SIZE);
+size_t BPlusTree::LeafEntrySize(ValueFormat format) {
+    return format == ValueFormat::DICTIONARY ? sizeof(DictionaryLeafEntry) : sizeof(LeafEntry);
+}
+
+int BPlusTree::LeafCapacity(Page *page) {
+    return GetLeafHeader(page)->base.value_format == ValueFormat::DICTIONARY
+               ? static_cast<int>(LEAF_MAX_DICTIONARY_ENTRIES)
+               : static_cast<int>(LEAF_MAX_ENTRIES);
+}
+
+// Entries of either format start with their 64-bit key; only the stride and
+// the value representation differ
+char *BPlusTree::LeafEntryAt(Page *page, int idx) {
+    return page->data + LEAF_HEADER_SIZE + idx * LeafEntrySize(GetLeafHeader(page)->base.value_format);
+}
+
+int64_t BPlusTree::LeafKeyAt(Page *page, int idx) {
+    return *reinterpret_cast<int64_t *>(LeafEntryAt(page, idx));
+}
+
+// Value of an entry; empty for lazily deleted entries
+std::string BPlusTree::LeafValueAt(Page *page, int idx) {
+    char *entry = LeafEntryAt(page, idx);
+    if (GetLeafHeader(page)->base.value_format == ValueFormat::DICTIONARY) {
+        uint32_t value_id = reinterpret_cast<DictionaryLeafEntry *>(entry)->value_id;
+        if (value_id == 0) {
+            return std::string();
+        }
+        std::optional<std::string> value = LookupValue(value_id);
+        if (!value) {
+            throw std::runtime_error("Value id missing from dictionary of tree: " + name_);
+        }
+        return std::move(*value);
+    }
+    return std::string(reinterpret_cast<LeafEntry *>(entry)->value);
+}
+
+void BPlusTree::WriteLeafEntry(char *entry, ValueFormat format, int64_t key, const std::string &value) {
+    if (format == ValueFormat::DICTIONARY) {
+        DictionaryLeafEntry *dictionary_entry = reinterpret_cast<DictionaryLeafEntry *>(entry);
+        dictionary_entry->value_id = InternValue(value);
+        dictionary_entry->key = key;
+        dictionary_entry->reserved = 0;
+        return;
+    }
+    LeafEntry *inline_entry = reinterpret_cast<LeafEntry *>(entry);
+    inline_entry->key = key;
+    std::memset(inline_entry->value, 0, VALUE_SIZE);
+    std::strncpy(inline_entry->value, value.c_str(), VALUE_SIZE - 1);
 }
 
 BPlusTreePageHeader *BPlusTree::GetInternalHeader(Page *page) {
@@ -57,20 +198,147 @@ int *BPlusTree::GetInternalChildren(Page *page) {
     return reinterpret_cast<int *>(page->data + INTERNAL_HEADER_SIZE);
 }
 
-int *BPlusTree::GetInternalKeys(Page *page) {
-    // Keys start after max children array
-    // Max children = INTERNAL_MAX_KEYS + 1
-    return reinterpret_cast<int *>(page->data + INTERNAL_HEADER_SIZE + (INTERNAL_MAX_KEYS + 1) * sizeof(int));
+namespace {
+
+// Typed views of an internal page's key area for the page's key format
+template <typename T>
+const T *InternalKeyArea(const Page *page, KeyFormat format) {
+    return reinterpret_cast<const T *>(page->data + InternalKeysOffset(format) + KeyFormatBaseSize(format));
+}
+
+int64_t InternalKeyBase(const Page *page, KeyFormat format) {
+    int64_t base;
+    std::memcpy(&base, page->data + InternalKeysOffset(format), sizeof(base));
+    return base;
+}
+
+// Number of deltas <= target among n sorted deltas. Binary search narrows the
+// range to a short window which is then counted without branches, a loop the
+// compiler vectorizes over the narrow delta lanes.
+template <typename T>
+int CountNotGreater(const T *deltas, int n, T target) {
+    constexpr int WINDOW = 32;
+    int lo = 0, hi = n;
+    while (hi - lo > WINDOW) {
+        int mid = (lo + hi) / 2;
+        if (deltas[mid] <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int count = 0;
+    for (int i = lo; i < hi; ++i) {
+        count += deltas[i] <= target;
+    }
+    return lo + count;
+}
+
+template <typename T>
+int DeltaUpperBound(const Page *page, KeyFormat format, int n, int64_t key) {
+    int64_t base = InternalKeyBase(page, format);
+    if (key < base) {
+        return 0;
+    }
+    uint64_t diff = static_cast<uint64_t>(key) - static_cast<uint64_t>(base);
+    if (diff > std::numeric_limits<T>::max()) {
+        return n;
+    }
+    return CountNotGreater(InternalKeyArea<T>(page, format), n, static_cast<T>(diff));
+}
+
+}  // namespace
+
+int64_t BPlusTree::InternalKeyAt(Page *page, int idx) {
+    KeyFormat format = GetInternalHeader(page)->key_format;
+    switch (format) {
+        case KeyFormat::DELTA16:
+            return static_cast<int64_t>(static_cast<uint64_t>(InternalKeyBase(page, format)) +
+                                        InternalKeyArea<uint16_t>(page, format)[idx]);
+        case KeyFormat::DELTA32:
+            return static_cast<int64_t>(static_cast<uint64_t>(InternalKeyBase(page, format)) +
+                                        InternalKeyArea<uint32_t>(page, format)[idx]);
+        default:
+            return InternalKeyArea<int64_t>(page, format)[idx];
+    }
+}
+
+// Decode all num_keys separators of an internal page into `keys`
+void BPlusTree::ReadInternalKeys(Page *page, int64_t *keys) {
+    int n = GetInternalHeader(page)->num_keys;
+    for (int i = 0; i < n; ++i) {
+        keys[i] = InternalKeyAt(page, i);
+    }
+}
+
+// Narrowest format able to hold these sorted keys within one page
+KeyFormat BPlusTree::ChooseKeyFormat(const int64_t *keys, int n) const {
+    if (!options_.pack_internal_keys || n == 0) {
+        return KeyFormat::FULL;
+    }
+    uint64_t range = static_cast<uint64_t>(keys[n - 1]) - static_cast<uint64_t>(keys[0]);
+    if (range <= std::numeric_limits<uint16_t>::max()) {
+        return KeyFormat::DELTA16;
+    }
+    if (range <= std::numeric_limits<uint32_t>::max() &&
+        n <= static_cast<int>(InternalMaxKeys(KeyFormat::DELTA32))) {
+        return KeyFormat::DELTA32;
+    }
+    return KeyFormat::FULL;
+}
+
+// Re-encode the key area of an internal page. Children sit right after the
+// header in every format, but the key area moves with the format's capacity,
+// so callers save the children they need before switching formats.
+void BPlusTree::WriteInternalKeys(Page *page, const int64_t *keys, int n) {
+    BPlusTreePageHeader *header = GetInternalHeader(page);
+    KeyFormat format = ChooseKeyFormat(keys, n);
+    if (n > static_cast<int>(InternalMaxKeys(format))) {
+        throw std::runtime_error("Internal page overflow");
+    }
+    header->key_format = format;
+    header->num_keys = n;
+
+    char *area = page->data + InternalKeysOffset(format);
+    if (format == KeyFormat::FULL) {
+        std::memcpy(area, keys, n * sizeof(int64_t));
+        return;
+    }
+    std::memcpy(area, &keys[0], sizeof(int64_t));
+    area += sizeof(int64_t);
+    for (int i = 0; i < n; ++i) {
+        uint64_t delta = static_cast<uint64_t>(keys[i]) - static_cast<uint64_t>(keys[0]);
+        if (format == KeyFormat::DELTA16) {
+            reinterpret_cast<uint16_t *>(area)[i] = static_cast<uint16_t>(delta);
+        } else {
+            reinterpret_cast<uint32_t *>(area)[i] = static_cast<uint32_t>(delta);
+        }
+    }
+}
+
+// Whether `key` can be added to this internal page without splitting it
+bool BPlusTree::InternalHasRoom(Page *page, int64_t key) {
+    int n = GetInternalHeader(page)->num_keys;
+    if (n >= static_cast<int>(INTERNAL_MAX_PACKED_KEYS)) {
+        return false;
+    }
+    if (!options_.pack_internal_keys) {
+        return n < static_cast<int>(INTERNAL_MAX_KEYS);
+    }
+    int64_t keys[INTERNAL_MAX_PACKED_KEYS + 1];
+    ReadInternalKeys(page, keys);
+    keys[n] = key;
+    std::sort(keys, keys + n + 1);
+    return n + 1 <= static_cast<int>(InternalMaxKeys(ChooseKeyFormat(keys, n + 1)));
 }
 
 // Binary search in leaf to find index where key should be
-int BPlusTree::LeafFindKey(Page *page, int key) {
+int BPlusTree::LeafFindKey(Page *page, int64_t key) {
     LeafPageHeader *header = GetLeafHeader(page);
-    LeafEntry *entries = GetLeafEntries(page);
     int lo = 0, hi = header->base.num_keys;
     while (lo < hi) {
         int mid = (lo + hi) / 2;
-        if (entries[mid].key < key) {
+        if (LeafKeyAt(page, mid) < key) {
             lo = mid + 1;
         } else {
             hi = mid;
@@ -79,29 +347,48 @@ int BPlusTree::LeafFindKey(Page *page, int key) {
     return lo;
 }
 
-// Find which child to follow in internal node
-int BPlusTree::InternalFindChild(Page *page, int key) {
+// Find which child to follow in internal node; if requested, narrows
+// *upper_fence to the separator bounding that child from above
+int BPlusTree::InternalFindChild(Page *page, int64_t key, std::optional<int64_t> *upper_fence) {
     BPlusTreePageHeader *header = GetInternalHeader(page);
     int *children = GetInternalChildren(page);
-    int *keys = GetInternalKeys(page);
     int n = header->num_keys;
 
-    // Binary search for the correct child
-    int lo = 0, hi = n;
-    while (lo < hi) {
-        int mid = (lo + hi) / 2;
-        if (keys[mid] <= key) {
-            lo = mid + 1;
-        } else {
-            hi = mid;
+    int lo;
+    switch (header->key_format) {
+        case KeyFormat::DELTA16:
+            lo = DeltaUpperBound<uint16_t>(page, header->key_format, n, key);
+            break;
+        case KeyFormat::DELTA32:
+            lo = DeltaUpperBound<uint32_t>(page, header->key_format, n, key);
+            break;
+        default: {
+            // Binary search for the correct child
+            const int64_t *keys = InternalKeyArea<int64_t>(page, KeyFormat::FULL);
+            int hi = n;
+            lo = 0;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (keys[mid] <= key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
         }
     }
+    if (upper_fence && lo < n) {
+        *upper_fence = InternalKeyAt(page, lo);
+    }
     return children[lo];
 }
 
 // ==================== Search ====================
 
-Page *BPlusTree::FindLeafPage(int key) {
+Page *BPlusTree::FindLeafPage(int64_t key, std::optional<int64_t> *upper_fence, const Message **buffered) {
+    if (upper_fence) {
+        upper_fence->reset();
+    }
     if (root_page_id_ == INVALID_PAGE_ID) {
         return nullptr;
     }
@@ -112,7 +399,15 @@ Page *BPlusTree::FindLeafPage(int key) {
     BPlusTreePageHeader *header = reinterpret_cast<BPlusTreePageHeader *>(page->data);
 
     while (header->page_type == PageType::INTERNAL) {
-        int child_page_id = InternalFindChild(page, key);
+        if (buffered && !buffers_.empty()) {
+            // Buffers nearer the root hold the newer writes
+            *buffered = BufferedMessage(page->page_id, key);
+            if (*buffered) {
+                buffer_pool_manager_->UnpinPage(page->page_id, false);
+                return nullptr;
+            }
+        }
+        int child_page_id = InternalFindChild(page, key, upper_fence);
         buffer_pool_manager_->UnpinPage(page->page_id, false);
         page = buffer_pool_manager_->FetchPage(child_page_id);
         if (!page) return nullptr;
@@ -122,62 +417,63 @@ Page *BPlusTree::FindLeafPage(int key) {
     return page;
 }
 
-std::optional<std::string> BPlusTree::Search(int key) {
-    Page *leaf = FindLeafPage(key);
-    if (!leaf) return std::nullopt;
+std::optional<std::string> BPlusTree::Search(int64_t key, const Snapshot *snapshot) {
+    OperationTimer timer(Operation::SEARCH);
+    const Message *buffered = nullptr;
+    Page *leaf = FindLeafPage(key, nullptr, &buffered);
+    if (buffered) return ResolveVersion(key, buffered->value, snapshot);
+    if (!leaf) return ResolveVersion(key, std::nullopt, snapshot);
 
     LeafPageHeader *header = GetLeafHeader(leaf);
-    LeafEntry *entries = GetLeafEntries(leaf);
 
     int idx = LeafFindKey(leaf, key);
     std::optional<std::string> result = std::nullopt;
 
-    if (idx < header->base.num_keys && entries[idx].key == key) {
+    if (idx < header->base.num_keys && LeafKeyAt(leaf, idx) == key) {
         // Check if entry is not deleted (lazy deletion: empty value means deleted)
-        if (entries[idx].value[0] != '\0') {
-            result = std::string(entries[idx].value);
+        std::string value = LeafValueAt(leaf, idx);
+        if (!value.empty()) {
+            result = std::move(value);
         }
     }
 
     buffer_pool_manager_->UnpinPage(leaf->page_id, false);
-    return result;
+    return ResolveVersion(key, std::move(result), snapshot);
 }
 
 // ==================== Insert ====================
 
-bool BPlusTree::LeafInsert(Page *page, int key, const std::string &value) {
+bool BPlusTree::LeafInsert(Page *page, int64_t key, const std::string &value) {
     LeafPageHeader *header = GetLeafHeader(page);
-    LeafEntry *entries = GetLeafEntries(page);
+    ValueFormat format = header->base.value_format;
+    header->base.common.codec = static_cast<uint8_t>(options_.leaf_codec);
 
     int idx = LeafFindKey(page, key);
 
     // Check for duplicate
-    if (idx < header->base.num_keys && entries[idx].key == key) {
+    if (idx < header->base.num_keys && LeafKeyAt(page, idx) == key) {
         // Update existing value
-        std::memset(entries[idx].value, 0, VALUE_SIZE);
-        std::strncpy(entries[idx].value, value.c_str(), VALUE_SIZE - 1);
+        WriteLeafEntry(LeafEntryAt(page, idx), format, key, value);
         return true;
     }
 
     // Shift entries to make room
-    for (int i = header->base.num_keys; i > idx; --i) {
-        entries[i] = entries[i - 1];
-    }
+    std::memmove(LeafEntryAt(page, idx + 1), LeafEntryAt(page, idx),
+                 (header->base.num_keys - idx) * LeafEntrySize(format));
 
     // Insert new entry
-    entries[idx].key = key;
-    std::memset(entries[idx].value, 0, VALUE_SIZE);
-    std::strncpy(entries[idx].value, value.c_str(), VALUE_SIZE - 1);
+    WriteLeafEntry(LeafEntryAt(page, idx), format, key, value);
     header->base.num_keys++;
 
     return true;
 }
 
-void BPlusTree::InternalInsert(Page *page, int key, int right_child_id) {
+void BPlusTree::InternalInsert(Page *page, int64_t key, int right_child_id) {
     BPlusTreePageHeader *header = GetInternalHeader(page);
     int *children = GetInternalChildren(page);
-    int *keys = GetInternalKeys(page);
     int n = header->num_keys;
+    int64_t keys[INTERNAL_MAX_PACKED_KEYS + 1];
+    ReadInternalKeys(page, keys);
 
     // Find position to insert
     int idx = 0;
@@ -194,24 +490,22 @@ void BPlusTree::InternalInsert(Page *page, int key, int right_child_id) {
     // Insert
     keys[idx] = key;
     children[idx + 1] = right_child_id;
-    header->num_keys++;
+    WriteInternalKeys(page, keys, n + 1);
 }
 
-void BPlusTree::CreateNewRoot(Page *left_page, int key, Page *right_page) {
+void BPlusTree::CreateNewRoot(Page *left_page, int64_t key, Page *right_page) {
     int new_root_id;
     Page *new_root = buffer_pool_manager_->NewPage(&new_root_id);
 
     BPlusTreePageHeader *header = GetInternalHeader(new_root);
     header->page_type = PageType::INTERNAL;
-    header->num_keys = 1;
     header->parent_page_id = INVALID_PAGE_ID;
 
     int *children = GetInternalChildren(new_root);
-    int *keys = GetInternalKeys(new_root);
 
     children[0] = left_page->page_id;
     children[1] = right_page->page_id;
-    keys[0] = key;
+    WriteInternalKeys(new_root, &key, 1);
 
     // Update parent pointers
     BPlusTreePageHeader *left_header = reinterpret_cast<BPlusTreePageHeader *>(left_page->data);
@@ -224,76 +518,70 @@ void BPlusTree::CreateNewRoot(Page *left_page, int key, Page *right_page) {
     buffer_pool_manager_->UnpinPage(new_root_id, true);
 }
 
-void BPlusTree::SplitLeaf(Page *leaf_page, int key, const std::string &value) {
+void BPlusTree::SplitLeaf(Page *leaf_page, int64_t key, const std::string &value) {
     LeafPageHeader *old_header = GetLeafHeader(leaf_page);
-    LeafEntry *old_entries = GetLeafEntries(leaf_page);
+    ValueFormat format = old_header->base.value_format;
+    size_t entry_size = LeafEntrySize(format);
 
     // Create temporary array with all entries including new one
-    LeafEntry temp[LEAF_MAX_ENTRIES + 1];
+    alignas(8) char temp[std::max((LEAF_MAX_ENTRIES + 1) * sizeof(LeafEntry),
+                                  (LEAF_MAX_DICTIONARY_ENTRIES + 1) * sizeof(DictionaryLeafEntry))];
+    int n = old_header->base.num_keys;
     int idx = LeafFindKey(leaf_page, key);
-    int j = 0;
-    for (int i = 0; i < old_header->base.num_keys; ++i) {
-        if (i == idx) {
-            temp[j].key = key;
-            std::memset(temp[j].value, 0, VALUE_SIZE);
-            std::strncpy(temp[j].value, value.c_str(), VALUE_SIZE - 1);
-            j++;
-        }
-        temp[j++] = old_entries[i];
-    }
-    if (idx == old_header->base.num_keys) {
-        temp[j].key = key;
-        std::memset(temp[j].value, 0, VALUE_SIZE);
-        std::strncpy(temp[j].value, value.c_str(), VALUE_SIZE - 1);
-        j++;
-    }
-    int total = j;
+    std::memcpy(temp, LeafEntryAt(leaf_page, 0), idx * entry_size);
+    WriteLeafEntry(temp + idx * entry_size, format, key, value);
+    std::memcpy(temp + (idx + 1) * entry_size, LeafEntryAt(leaf_page, idx), (n - idx) * entry_size);
+    int total = n + 1;
 
     // Create new leaf page
     int new_leaf_id;
     Page *new_leaf = buffer_pool_manager_->NewPage(&new_leaf_id);
     LeafPageHeader *new_header = GetLeafHeader(new_leaf);
-    LeafEntry *new_entries = GetLeafEntries(new_leaf);
 
-    // Split: left gets first half, right gets second half
-    int split = total / 2;
+    // Split: left gets first half, right gets second half. An append past
+    // the last key of the rightmost leaf leaves the old leaf full instead, so
+    // ascending inserts such as bulk loads pack their leaves.
+    bool append = idx == n && old_header->next_page_id == INVALID_PAGE_ID;
+    int split = append ? n : total / 2;
 
     // Update old leaf
     old_header->base.num_keys = split;
-    for (int i = 0; i < split; ++i) {
-        old_entries[i] = temp[i];
-    }
+    std::memcpy(LeafEntryAt(leaf_page, 0), temp, split * entry_size);
 
     // Initialize new leaf
+    old_header->base.common.codec = static_cast<uint8_t>(options_.leaf_codec);
+    new_header->base.common.codec = static_cast<uint8_t>(options_.leaf_codec);
     new_header->base.page_type = PageType::LEAF;
+    new_header->base.value_format = format;
     new_header->base.num_keys = total - split;
     new_header->base.parent_page_id = old_header->base.parent_page_id;
     new_header->next_page_id = old_header->next_page_id;
     old_header->next_page_id = new_leaf_id;
 
-    for (int i = split; i < total; ++i) {
-        new_entries[i - split] = temp[i];
-    }
+    std::memcpy(LeafEntryAt(new_leaf, 0), temp + split * entry_size, (total - split) * entry_size);
 
     // Copy up the first key of the new leaf
-    int middle_key = new_entries[0].key;
+    int64_t middle_key = LeafKeyAt(new_leaf, 0);
 
     // Insert into parent (still needs access to new_leaf's page_id)
-    InsertIntoParent(leaf_page, middle_key, new_leaf);
+    RecordSplit(0);
+    BPTREE_PROBE2(split, leaf_page->page_id, 0);
+    InsertIntoParent(leaf_page, middle_key, new_leaf, 0);
     
     // Unpin new leaf only after InsertIntoParent is complete
     buffer_pool_manager_->UnpinPage(new_leaf_id, true);
 }
 
-void BPlusTree::SplitInternal(Page *internal_page, int key, int right_child_id) {
+void BPlusTree::SplitInternal(Page *internal_page, int64_t key, int right_child_id, int level) {
     BPlusTreePageHeader *old_header = GetInternalHeader(internal_page);
     int *old_children = GetInternalChildren(internal_page);
-    int *old_keys = GetInternalKeys(internal_page);
     int n = old_header->num_keys;
+    int64_t old_keys[INTERNAL_MAX_PACKED_KEYS];
+    ReadInternalKeys(internal_page, old_keys);
 
     // Create temporary arrays
-    int temp_keys[INTERNAL_MAX_KEYS + 1];
-    int temp_children[INTERNAL_MAX_KEYS + 2];
+    int64_t temp_keys[INTERNAL_MAX_PACKED_KEYS + 1];
+    int temp_children[INTERNAL_MAX_PACKED_KEYS + 2];
 
     // Find position to insert
     int idx = 0;
@@ -328,33 +616,28 @@ void BPlusTree::SplitInternal(Page *internal_page, int key, int right_child_id)
 
     // Split point: middle key moves up
     int split = total_keys / 2;
-    int middle_key = temp_keys[split];
+    int64_t middle_key = temp_keys[split];
 
     // Create new internal page
     int new_internal_id;
     Page *new_internal = buffer_pool_manager_->NewPage(&new_internal_id);
     BPlusTreePageHeader *new_header = GetInternalHeader(new_internal);
     int *new_children = GetInternalChildren(new_internal);
-    int *new_keys = GetInternalKeys(new_internal);
 
     // Update old internal page
-    old_header->num_keys = split;
-    for (int i = 0; i < split; ++i) {
-        old_keys[i] = temp_keys[i];
+    WriteInternalKeys(internal_page, temp_keys, split);
+    for (int i = 0; i <= split; ++i) {
         old_children[i] = temp_children[i];
     }
-    old_children[split] = temp_children[split];
 
     // Initialize new internal page (keys after middle)
     new_header->page_type = PageType::INTERNAL;
-    new_header->num_keys = total_keys - split - 1;
     new_header->parent_page_id = old_header->parent_page_id;
+    WriteInternalKeys(new_internal, temp_keys + split + 1, total_keys - split - 1);
 
-    for (int i = split + 1; i < total_keys; ++i) {
-        new_keys[i - split - 1] = temp_keys[i];
+    for (int i = split + 1; i <= total_keys; ++i) {
         new_children[i - split - 1] = temp_children[i];
     }
-    new_children[new_header->num_keys] = temp_children[total_keys];
 
     // Update parent pointers of children moved to new page
     for (int i = 0; i <= new_header->num_keys; ++i) {
@@ -365,14 +648,22 @@ void BPlusTree::SplitInternal(Page *internal_page, int key, int right_child_id)
         buffer_pool_manager_->UnpinPage(child_id, true);
     }
 
+    // Buffered writes follow their keys to the new page
+    if (!buffers_.empty()) {
+        SplitBuffer(internal_page->page_id, middle_key, new_internal_id);
+    }
+
     // Insert middle key into parent (still needs access to new_internal's page_id)
-    InsertIntoParent(internal_page, middle_key, new_internal);
+    RecordSplit(level);
+    BPTREE_PROBE2(split, internal_page->page_id, level);
+    InsertIntoParent(internal_page, middle_key, new_internal, level);
     
     // Unpin new internal only after InsertIntoParent is complete
     buffer_pool_manager_->UnpinPage(new_internal_id, true);
 }
 
-void BPlusTree::InsertIntoParent(Page *left_page, int key, Page *right_page) {
+// `level` is the height of the split pages above the leaves (0 for leaves)
+void BPlusTree::InsertIntoParent(Page *left_page, int64_t key, Page *right_page, int level) {
     BPlusTreePageHeader *left_header = reinterpret_cast<BPlusTreePageHeader *>(left_page->data);
 
     // If left is root, create new root
@@ -383,135 +674,428 @@ void BPlusTree::InsertIntoParent(Page *left_page, int key, Page *right_page) {
 
     // Fetch parent
     Page *parent = buffer_pool_manager_->FetchPage(left_header->parent_page_id);
-    BPlusTreePageHeader *parent_header = GetInternalHeader(parent);
 
     // Update right page's parent
     BPlusTreePageHeader *right_header = reinterpret_cast<BPlusTreePageHeader *>(right_page->data);
     right_header->parent_page_id = parent->page_id;
 
-    if (parent_header->num_keys < static_cast<int>(INTERNAL_MAX_KEYS)) {
+    if (InternalHasRoom(parent, key)) {
         // Parent has room
         InternalInsert(parent, key, right_page->page_id);
         buffer_pool_manager_->UnpinPage(parent->page_id, true);
     } else {
         // Need to split parent
-        SplitInternal(parent, key, right_page->page_id);
+        SplitInternal(parent, key, right_page->page_id, level + 1);
         buffer_pool_manager_->UnpinPage(parent->page_id, true);
     }
 }
 
-bool BPlusTree::Insert(int key, const std::string &value) {
-    // Empty tree: create root leaf
-    if (root_page_id_ == INVALID_PAGE_ID) {
-        // First, allocate meta page (page 0) if this is a fresh tree
+void BPlusTree::StartNewTree(int64_t key, const std::string &value) {
+    // First, allocate meta page (page 0) if this is a fresh database
+    if (buffer_pool_manager_->GetDiskManager()->GetNumPages() == 0) {
         int meta_id;
         Page *meta = buffer_pool_manager_->NewPage(&meta_id);
         if (meta) {
-            // Initialize meta page to all zeros
+            // Initialize meta page to all zeros, then stamp the format
             std::fill(meta->data, meta->data + PAGE_SIZE, 0);
+            MetaPage *meta_data = reinterpret_cast<MetaPage *>(meta->data);
+            meta_data->magic = FORMAT_MAGIC;
+            meta_data->format_version = FORMAT_VERSION;
             buffer_pool_manager_->UnpinPage(meta_id, true);  // Mark dirty to initialize on disk
         }
-
-        Page *root = buffer_pool_manager_->NewPage(&root_page_id_);
-        LeafPageHeader *header = GetLeafHeader(root);
-        header->base.page_type = PageType::LEAF;
-        header->base.num_keys = 0;
-        header->base.parent_page_id = INVALID_PAGE_ID;
-        header->next_page_id = INVALID_PAGE_ID;
-
-        LeafInsert(root, key, value);
-        UpdateMetaPage();  // Persist root_page_id to meta page
-        buffer_pool_manager_->UnpinPage(root_page_id_, true);
-        return true;
     }
 
-    // Find leaf page
-    Page *leaf = FindLeafPage(key);
-    if (!leaf) return false;
+    Page *root = buffer_pool_manager_->NewPage(&root_page_id_);
+    LeafPageHeader *header = GetLeafHeader(root);
+    header->base.page_type = PageType::LEAF;
+    header->base.value_format = options_.dedup_values ? ValueFormat::DICTIONARY : ValueFormat::INLINE;
+    header->base.num_keys = 0;
+    header->base.parent_page_id = INVALID_PAGE_ID;
+    header->next_page_id = INVALID_PAGE_ID;
+
+    LeafInsert(root, key, value);
+    UpdateMetaPage();  // Persist root_page_id to meta page
+    buffer_pool_manager_->UnpinPage(root_page_id_, true);
+}
 
+bool BPlusTree::InsertIntoLeaf(Page *leaf, int64_t key, const std::string &value) {
     LeafPageHeader *header = GetLeafHeader(leaf);
+    int idx = LeafFindKey(leaf, key);
+    bool exists = idx < header->base.num_keys && LeafKeyAt(leaf, idx) == key;
 
-    if (header->base.num_keys < static_cast<int>(LEAF_MAX_ENTRIES)) {
-        // Leaf has room
+    if (exists || header->base.num_keys < LeafCapacity(leaf)) {
+        // Leaf has room (or the key is updated in place)
         LeafInsert(leaf, key, value);
-        buffer_pool_manager_->UnpinPage(leaf->page_id, true);
+        return false;
+    }
+
+    // Need to split
+    SplitLeaf(leaf, key, value);
+    return true;
+}
+
+bool BPlusTree::LeafRemove(Page *page, int64_t key) {
+    LeafPageHeader *header = GetLeafHeader(page);
+
+    // Search for the key in the leaf
+    int idx = LeafFindKey(page, key);
+
+    // Check if key exists
+    if (idx >= header->base.num_keys || LeafKeyAt(page, idx) != key) {
+        return false;  // Key not found
+    }
+
+    // Lazy deletion: mark the value as deleted by setting it to empty
+    WriteLeafEntry(LeafEntryAt(page, idx), header->base.value_format, key, std::string());
+    header->base.common.codec = static_cast<uint8_t>(options_.leaf_codec);
+    return true;
+}
+
+bool BPlusTree::Insert(int64_t key, const std::string &value) {
+    OperationTimer timer(Operation::INSERT);
+    if (!indexes_.empty()) {
+        CheckIndexedKey(key);
+        UpdateIndexes(key, value);
+    }
+
+    ++current_ts_;
+    if (!snapshots_.empty()) {
+        RecordVersion(key);
+    }
+
+    if (Buffering()) {
+        BufferWrite(key, value);
+    } else if (root_page_id_ == INVALID_PAGE_ID) {
+        // Empty tree: create root leaf
+        StartNewTree(key, value);
     } else {
-        // Need to split
-        SplitLeaf(leaf, key, value);
+        Page *leaf = FindLeafPage(key);
+        if (!leaf) return false;
+
+        InsertIntoLeaf(leaf, key, value);
         buffer_pool_manager_->UnpinPage(leaf->page_id, true);
     }
+    MaybeCompactDictionary();
 
+    if (write_observer_) {
+        WriteBatch batch;
+        batch.Put(key, value);
+        write_observer_(batch);
+    }
     return true;
 }
 
-bool BPlusTree::Remove(int key) {
+bool BPlusTree::Remove(int64_t key) {
+    OperationTimer timer(Operation::REMOVE);
     // Lazy deletion: mark entry as deleted rather than physically removing it
     // This avoids expensive tree rebalancing operations
     
     if (root_page_id_ == INVALID_PAGE_ID) {
         return false;  // Tree is empty
     }
-
-    // Find the leaf page containing the key
-    Page *leaf = FindLeafPage(key);
-    if (!leaf) {
+    if (!options_.blind_removes && Buffering() && !Search(key)) {
         return false;
     }
 
-    LeafPageHeader *header = GetLeafHeader(leaf);
-    LeafEntry *entries = GetLeafEntries(leaf);
+    if (!indexes_.empty()) {
+        UpdateIndexes(key, std::nullopt);
+    }
 
-    // Search for the key in the leaf
-    int idx = LeafFindKey(leaf, key);
+    ++current_ts_;
+    if (!snapshots_.empty()) {
+        RecordVersion(key);
+    }
 
-    // Check if key exists
-    if (idx >= header->base.num_keys || entries[idx].key != key) {
-        buffer_pool_manager_->UnpinPage(leaf->page_id, false);
-        return false;  // Key not found
+    bool removed = true;
+    if (Buffering()) {
+        // Unless removes are blind, whether the key exists was looked up above
+        BufferWrite(key, std::nullopt);
+    } else {
+        // Find the leaf page containing the key
+        Page *leaf = FindLeafPage(key);
+        if (!leaf) {
+            return false;
+        }
+
+        removed = LeafRemove(leaf, key);
+
+        // Mark page as dirty (only if something changed) and unpin
+        buffer_pool_manager_->UnpinPage(leaf->page_id, removed);
     }
+    MaybeCompactDictionary();
 
-    // Lazy deletion: mark the value as deleted by setting it to empty
-    std::memset(entries[idx].value, 0, VALUE_SIZE);
+    if (removed && write_observer_) {
+        WriteBatch batch;
+        batch.Delete(key);
+        write_observer_(batch);
+    }
+    return removed;
+}
 
-    // Mark page as dirty and unpin
-    buffer_pool_manager_->UnpinPage(leaf->page_id, true);
+// ==================== Write Batch ====================
+
+bool BPlusTree::Write(const WriteBatch &batch) {
+    OperationTimer timer(Operation::WRITE_BATCH);
+    if (batch.Count() == 0) {
+        return true;
+    }
+
+    // Sort by key so neighbouring writes share one descent; for repeated
+    // keys only the last operation in the batch survives
+    std::vector<const WriteBatch::Op *> ops;
+    ops.reserve(batch.Count());
+    for (const WriteBatch::Op &op : batch.Ops()) {
+        ops.push_back(&op);
+    }
+    std::stable_sort(ops.begin(), ops.end(), [](const WriteBatch::Op *a, const WriteBatch::Op *b) {
+        return a->key < b->key;
+    });
+    std::vector<const WriteBatch::Op *> unique_ops;
+    unique_ops.reserve(ops.size());
+    for (const WriteBatch::Op *op : ops) {
+        if (!unique_ops.empty() && unique_ops.back()->key == op->key) {
+            unique_ops.back() = op;
+        } else {
+            unique_ops.push_back(op);
+        }
+    }
+
+    // Index maintenance runs first; key checks throw before anything changes
+    if (!indexes_.empty()) {
+        for (const WriteBatch::Op *op : unique_ops) {
+            CheckIndexedKey(op->key);
+        }
+        for (const WriteBatch::Op *op : unique_ops) {
+            UpdateIndexes(op->key, op->is_delete ? std::nullopt : std::optional<std::string>(op->value));
+        }
+    }
+
+    // The whole batch shares one timestamp, so snapshots see all of it or none
+    ++current_ts_;
+    if (!snapshots_.empty()) {
+        for (const WriteBatch::Op *op : unique_ops) {
+            RecordVersion(op->key);
+        }
+    }
+
+    if (Buffering()) {
+        for (const WriteBatch::Op *op : unique_ops) {
+            BufferWrite(op->key, op->is_delete ? std::nullopt : std::optional<std::string>(op->value));
+        }
+    } else if (!ApplyToLeaves(unique_ops)) {
+        return false;
+    }
+    MaybeCompactDictionary();
+
+    if (write_observer_) {
+        write_observer_(batch);
+    }
     return true;
 }
 
+// Apply distinct, key-ordered writes with one descent per leaf they touch
+bool BPlusTree::ApplyToLeaves(const std::vector<const WriteBatch::Op *> &ops) {
+    size_t i = 0;
+    while (i < ops.size()) {
+        if (root_page_id_ == INVALID_PAGE_ID) {
+            const WriteBatch::Op &op = *ops[i++];
+            if (!op.is_delete) {
+                StartNewTree(op.key, op.value);
+            }
+            continue;
+        }
+
+        std::optional<int64_t> upper_fence;
+        Page *leaf = FindLeafPage(ops[i]->key, &upper_fence);
+        if (!leaf) return false;
+
+        // Apply every operation that falls inside this leaf's key range
+        bool dirty = false;
+        while (i < ops.size() && (!upper_fence || ops[i]->key < *upper_fence)) {
+            const WriteBatch::Op &op = *ops[i++];
+            if (op.is_delete) {
+                dirty |= LeafRemove(leaf, op.key);
+                continue;
+            }
+            dirty = true;
+            if (InsertIntoLeaf(leaf, op.key, op.value)) {
+                break;  // Leaf split: key ranges changed, descend again
+            }
+        }
+        buffer_pool_manager_->UnpinPage(leaf->page_id, dirty);
+    }
+    return true;
+}
+
+bool BPlusTree::ChangedSince(int64_t key, const Snapshot *snapshot) const {
+    auto it = versions_.find(key);
+    if (it == versions_.end()) {
+        return false;
+    }
+    for (const Version &version : it->second) {
+        if (version.overwritten_at > snapshot->timestamp) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ==================== Secondary Indexes ====================
+
+void BPlusTree::CreateIndex(const std::string &index_name, SecondaryKeyExtractor extractor) {
+    for (const SecondaryIndex &index : indexes_) {
+        if (index.name == index_name) {
+            throw std::runtime_error("Index already declared: " + index_name);
+        }
+    }
+
+    SecondaryIndex index{index_name, std::move(extractor),
+                         std::make_unique<BPlusTree>(buffer_pool_manager_, index_name)};
+
+    // Backfill a new index from the existing entries
+    if (index.tree->IsEmpty() && !IsEmpty()) {
+        for (auto &[key, value] : Scan(INT64_MIN, INT64_MAX)) {
+            CheckIndexedKey(key);
+            std::optional<int> secondary_key = index.extractor(value);
+            if (secondary_key) {
+                index.tree->Insert(IndexKey(*secondary_key, key), std::to_string(key));
+            }
+        }
+    }
+    indexes_.push_back(std::move(index));
+}
+
+std::vector<int64_t> BPlusTree::SearchIndex(const std::string &index_name, int start_secondary_key,
+                                            int end_secondary_key) {
+    std::vector<int64_t> primary_keys;
+    for (SecondaryIndex &index : indexes_) {
+        if (index.name != index_name) {
+            continue;
+        }
+        auto entries = index.tree->Scan(IndexKey(start_secondary_key, INT32_MIN),
+                                        IndexKey(end_secondary_key, INT32_MAX));
+        for (auto &entry : entries) {
+            // The primary key is the low half of the composite index key
+            primary_keys.push_back(static_cast<int32_t>(static_cast<uint32_t>(entry.first) ^ 0x80000000u));
+        }
+        return primary_keys;
+    }
+    throw std::runtime_error("No such index: " + index_name);
+}
+
+void BPlusTree::CheckIndexedKey(int64_t key) {
+    if (key < INT32_MIN || key > INT32_MAX) {
+        throw std::out_of_range("Primary key does not fit an index entry: " + std::to_string(key));
+    }
+}
+
+// Composite key ordered by (secondary key, primary key): the secondary key
+// fills the high 32 bits, the primary key is sign-flipped into the low 32 bits
+int64_t BPlusTree::IndexKey(int secondary_key, int64_t primary_key) {
+    uint64_t high = static_cast<uint64_t>(static_cast<int64_t>(secondary_key)) << 32;
+    uint64_t low = static_cast<uint32_t>(primary_key) ^ 0x80000000u;
+    return static_cast<int64_t>(high | low);
+}
+
+void BPlusTree::UpdateIndexes(int64_t key, const std::optional<std::string> &new_value) {
+    // Index what will actually be stored: truncated, and empty means deleted
+    std::optional<std::string> stored = new_value ? StoredValue(*new_value) : std::nullopt;
+    std::optional<std::string> old_value = Search(key);
+
+    for (SecondaryIndex &index : indexes_) {
+        std::optional<int> old_secondary;
+        std::optional<int> new_secondary;
+        if (old_value) {
+            old_secondary = index.extractor(*old_value);
+        }
+        if (stored) {
+            new_secondary = index.extractor(*stored);
+        }
+        if (old_secondary == new_secondary) {
+            continue;
+        }
+        if (old_secondary) {
+            index.tree->Remove(IndexKey(*old_secondary, key));
+        }
+        if (new_secondary) {
+            index.tree->Insert(IndexKey(*new_secondary, key), std::to_string(key));
+        }
+    }
+}
+
 // ==================== Range Scan ====================
 
-std::vector<std::pair<int, std::string>> BPlusTree::Scan(int start_key, int end_key) {
-    std::vector<std::pair<int, std::string>> results;
+std::vector<std::pair<int64_t, std::string>> BPlusTree::Scan(int64_t start_key, int64_t end_key,
+                                                         const Snapshot *snapshot, size_t limit) {
+    OperationTimer timer(Operation::SCAN);
+    std::vector<std::pair<int64_t, std::string>> results;
 
     if (root_page_id_ == INVALID_PAGE_ID) {
         return results;
     }
 
+    // Buffered writes in the range are merged with the leaves in key order
+    std::map<int64_t, const Message *> buffered = BufferedRange(start_key, end_key);
+    auto next_buffered = buffered.begin();
+
+    // Add a key's entry as the snapshot sees it; false once `limit` is reached
+    auto emit = [&](int64_t key, std::optional<std::string> value) {
+        // Tombstoned keys stay in the leaf, so a snapshot can still see
+        // values that were removed after it was taken
+        value = ResolveVersion(key, std::move(value), snapshot);
+        if (value) {
+            results.emplace_back(key, std::move(*value));
+        }
+        return results.size() < limit;
+    };
+    // Buffered keys below `key` that no leaf holds yet
+    auto emit_buffered_before = [&](std::optional<int64_t> key) {
+        for (; next_buffered != buffered.end() && (!key || next_buffered->first < *key); ++next_buffered) {
+            if (!emit(next_buffered->first, next_buffered->second->value)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
     // Find leaf containing start_key using tree traversal
     Page *leaf = FindLeafPage(start_key);
-    if (!leaf) {
-        return results;
-    }
-
+    bool first_leaf = true;
     while (leaf) {
         LeafPageHeader *header = GetLeafHeader(leaf);
-        LeafEntry *entries = GetLeafEntries(leaf);
 
         // Find starting position in this leaf only on the first iteration
-        int start_idx = 0;
-        if (results.empty()) {
-            start_idx = LeafFindKey(leaf, start_key);
-        }
+        int start_idx = first_leaf ? LeafFindKey(leaf, start_key) : 0;
+        first_leaf = false;
 
         for (int i = start_idx; i < header->base.num_keys; ++i) {
             // Stop if we've exceeded the end_key
-            if (entries[i].key > end_key) {
+            int64_t key = LeafKeyAt(leaf, i);
+            if (key > end_key) {
+                buffer_pool_manager_->UnpinPage(leaf->page_id, false);
+                emit_buffered_before(std::nullopt);
+                return results;
+            }
+            if (key < start_key) {
+                continue;
+            }
+            if (!emit_buffered_before(key)) {
                 buffer_pool_manager_->UnpinPage(leaf->page_id, false);
                 return results;
             }
-            // Include entry if it's >= start_key and not deleted (lazy deletion: empty value means deleted)
-            if (entries[i].key >= start_key && entries[i].value[0] != '\0') {
-                results.emplace_back(entries[i].key, std::string(entries[i].value));
+            // Include entry if it's not deleted (lazy deletion: empty value means deleted)
+            std::optional<std::string> value;
+            if (next_buffered != buffered.end() && next_buffered->first == key) {
+                value = (next_buffered++)->second->value;
+            } else {
+                std::string stored = LeafValueAt(leaf, i);
+                if (!stored.empty()) {
+                    value = std::move(stored);
+                }
+            }
+            if (!emit(key, std::move(value))) {
+                buffer_pool_manager_->UnpinPage(leaf->page_id, false);
+                return results;
             }
         }
 
@@ -528,11 +1112,250 @@ std::vector<std::pair<int, std::string>> BPlusTree::Scan(int start_key, int end_
 
         // Fetch the next leaf page in the linked list
         leaf = buffer_pool_manager_->FetchPage(next_page_id);
-        if (!leaf) {
-            // Handle case where FetchPage fails
+    }
+
+    emit_buffered_before(std::nullopt);
+    return results;
+}
+
+// ==================== Snapshots ====================
+
+const Snapshot *BPlusTree::GetSnapshot() {
+    snapshots_.push_back(Snapshot{current_ts_});
+    return &snapshots_.back();
+}
+
+void BPlusTree::ReleaseSnapshot(const Snapshot *snapshot) {
+    for (auto it = snapshots_.begin(); it != snapshots_.end(); ++it) {
+        if (&*it == snapshot) {
+            snapshots_.erase(it);
             break;
         }
     }
+    CollectGarbageVersions();
+}
 
-    return results;
+// Save the value `key` holds right before the write stamped current_ts_
+void BPlusTree::RecordVersion(int64_t key) {
+    std::vector<Version> &chain = versions_[key];
+
+    // A version already written after the newest snapshot hides every later
+    // overwrite from all live snapshots, so there is nothing new to keep
+    if (!chain.empty() && chain.back().overwritten_at > snapshots_.back().timestamp) {
+        return;
+    }
+    chain.push_back(Version{current_ts_, Search(key)});
+}
+
+std::optional<std::string> BPlusTree::ResolveVersion(int64_t key, std::optional<std::string> current,
+                                                     const Snapshot *snapshot) const {
+    if (!snapshot) {
+        return current;
+    }
+
+    auto it = versions_.find(key);
+    if (it == versions_.end()) {
+        return current;
+    }
+
+    // Oldest overwrite newer than the snapshot holds the value it saw
+    for (const Version &version : it->second) {
+        if (version.overwritten_at > snapshot->timestamp) {
+            return version.value;
+        }
+    }
+    return current;
+}
+
+void BPlusTree::CollectGarbageVersions() {
+    if (snapshots_.empty()) {
+        versions_.clear();
+        return;
+    }
+
+    // Versions overwritten at or before the oldest snapshot are invisible to all
+    uint64_t oldest = snapshots_.front().timestamp;
+    for (auto it = versions_.begin(); it != versions_.end();) {
+        std::vector<Version> &chain = it->second;
+        auto keep = chain.begin();
+        while (keep != chain.end() && keep->overwritten_at <= oldest) {
+            ++keep;
+        }
+        chain.erase(chain.begin(), keep);
+
+        if (chain.empty()) {
+            it = versions_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// ==================== Value Dictionary ====================
+
+std::string BPlusTree::DictionaryName() const {
+    return name_ + "#dict";
+}
+
+namespace {
+
+// The dictionary tree holds three kinds of entries: ids 1 and up map to
+// their value, key 0 holds the next id never handed out, and negative keys
+// index values by hash (FNV-1a) to the id holding them, for interning.
+constexpr int64_t DICTIONARY_NEXT_ID_KEY = 0;
+constexpr size_t DICTIONARY_SCAN_CHUNK = 1024;
+
+int64_t DictionaryHashKey(const std::string &value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : value) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return -1 - static_cast<int64_t>(hash >> 1);
+}
+
+}  // namespace
+
+void BPlusTree::LoadDictionary() {
+    if (dictionary_) {
+        return;
+    }
+    dictionary_ = std::make_unique<BPlusTree>(buffer_pool_manager_, DictionaryName());
+    if (auto next_id = dictionary_->Search(DICTIONARY_NEXT_ID_KEY)) {
+        dictionary_next_id_ = static_cast<uint32_t>(std::stoul(*next_id));
+    }
+}
+
+std::optional<std::string> BPlusTree::LookupValue(uint32_t value_id) {
+    auto cached = dictionary_cache_.find(value_id);
+    if (cached != dictionary_cache_.end()) {
+        return cached->second;
+    }
+    LoadDictionary();
+    std::optional<std::string> value = dictionary_->Search(value_id);
+    if (value) {
+        if (dictionary_cache_.size() >= DICTIONARY_CACHE_ENTRIES) {
+            dictionary_cache_.clear();
+        }
+        dictionary_cache_.emplace(value_id, *value);
+    }
+    return value;
+}
+
+std::optional<std::string> BPlusTree::StoredValue(const std::string &value) {
+    size_t length = strnlen(value.c_str(), VALUE_SIZE - 1);
+    if (length == 0) {
+        return std::nullopt;
+    }
+    return value.substr(0, length);
+}
+
+// Id of `value` in the dictionary, adding it on first use. Values are cut to
+// the same length an inline entry keeps; the empty value is always id 0. On
+// a hash collision the value gets an id of its own without a hash entry.
+uint32_t BPlusTree::InternValue(const std::string &value) {
+    std::optional<std::string> stored = StoredValue(value);
+    if (!stored) {
+        return 0;
+    }
+    auto cached = dictionary_id_cache_.find(*stored);
+    if (cached != dictionary_id_cache_.end()) {
+        return cached->second;
+    }
+    if (dictionary_id_cache_.size() >= DICTIONARY_CACHE_ENTRIES) {
+        dictionary_id_cache_.clear();
+    }
+
+    LoadDictionary();
+    int64_t hash_key = DictionaryHashKey(*stored);
+    std::optional<std::string> hashed = dictionary_->Search(hash_key);
+    if (hashed) {
+        uint32_t value_id = static_cast<uint32_t>(std::stoul(*hashed));
+        if (LookupValue(value_id) == stored) {
+            dictionary_id_cache_.emplace(std::move(*stored), value_id);
+            return value_id;
+        }
+    }
+
+    uint32_t value_id;
+    if (!dictionary_free_ids_.empty()) {
+        value_id = dictionary_free_ids_.back();
+        dictionary_free_ids_.pop_back();
+    } else {
+        if (dictionary_next_id_ == std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Value dictionary is full: " + DictionaryName());
+        }
+        value_id = dictionary_next_id_++;
+        dictionary_->Insert(DICTIONARY_NEXT_ID_KEY, std::to_string(dictionary_next_id_));
+    }
+    dictionary_->Insert(value_id, *stored);
+    if (!hashed) {
+        dictionary_->Insert(hash_key, std::to_string(value_id));
+    }
+    dictionary_id_cache_.emplace(std::move(*stored), value_id);
+    dictionary_new_ids_++;
+    return value_id;
+}
+
+// Compacting once the ids handed out since the last compaction match the
+// ids live then keeps the dictionary within about twice its live size, at
+// an amortized constant number of leaf visits per new id
+void BPlusTree::MaybeCompactDictionary() {
+    if (dictionary_ && dictionary_new_ids_ >= std::max(DICTIONARY_COMPACT_MIN_IDS, dictionary_live_ids_)) {
+        CompactDictionary();
+    }
+}
+
+// Walk the leaf chain for the ids still referenced, then drop every other
+// id with its hash entry and keep it for reuse. Runs between operations,
+// when no leaf holds an entry that is only partly written.
+void BPlusTree::CompactDictionary() {
+    std::vector<bool> referenced(dictionary_next_id_, false);
+    if (root_page_id_ != INVALID_PAGE_ID) {
+        Page *leaf = FindLeafPage(std::numeric_limits<int64_t>::min());
+        while (leaf) {
+            LeafPageHeader *header = GetLeafHeader(leaf);
+            if (header->base.value_format == ValueFormat::DICTIONARY) {
+                for (int i = 0; i < header->base.num_keys; ++i) {
+                    uint32_t value_id = reinterpret_cast<DictionaryLeafEntry *>(LeafEntryAt(leaf, i))->value_id;
+                    if (value_id < referenced.size()) {
+                        referenced[value_id] = true;
+                    }
+                }
+            }
+            int next_page_id = header->next_page_id;
+            buffer_pool_manager_->UnpinPage(leaf->page_id, false);
+            leaf = next_page_id == INVALID_PAGE_ID ? nullptr : buffer_pool_manager_->FetchPage(next_page_id);
+        }
+    }
+
+    size_t live_ids = 0;
+    for (int64_t start = 1; start < dictionary_next_id_;) {
+        auto chunk = dictionary_->Scan(start, dictionary_next_id_ - 1, nullptr, DICTIONARY_SCAN_CHUNK);
+        if (chunk.empty()) {
+            break;
+        }
+        for (auto &[value_id, value] : chunk) {
+            if (referenced[value_id]) {
+                live_ids++;
+                continue;
+            }
+            dictionary_->Remove(value_id);
+            int64_t hash_key = DictionaryHashKey(value);
+            if (dictionary_->Search(hash_key) == std::to_string(value_id)) {
+                dictionary_->Remove(hash_key);
+            }
+        }
+        start = chunk.back().first + 1;
+    }
+
+    dictionary_free_ids_.clear();
+    for (uint32_t value_id = dictionary_next_id_ - 1; value_id >= 1; --value_id) {
+        if (!referenced[value_id]) {
+            dictionary_free_ids_.push_back(value_id);
+        }
+    }
+    dictionary_cache_.clear();
+    dictionary_id_cache_.clear();
+    dictionary_live_ids_ = live_ids;
+    dictionary_new_ids_ = 0;
 }
@@ -2,30 +2,88 @@
 #define BTREE_H
 
 #include "buffer_pool_manager.h"
+#include "write_batch.h"
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <cstring>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
 constexpr size_t VALUE_SIZE = 128;
 constexpr int INVALID_PAGE_ID = -1;
 constexpr int META_PAGE_ID = 0;
+constexpr size_t MULTIGET_GROUP_SIZE = 8;  // Lookups BPlusTree::MultiGet interleaves by default
+constexpr size_t DICTIONARY_CACHE_ENTRIES = 4096;  // Dictionary entries a dedup tree caches per direction
+constexpr size_t DICTIONARY_COMPACT_MIN_IDS = 1024;  // New value ids before a dictionary compaction
 
-// Meta page structure (Page 0)
+// Catalog entry mapping a named tree to its root page
+constexpr size_t MAX_TREE_NAME_LENGTH = 31;
+
+struct CatalogEntry {
+    char name[MAX_TREE_NAME_LENGTH + 1];
+    int root_page_id;
+};
+
+constexpr size_t MAX_CATALOG_ENTRIES =
+    (PAGE_SIZE - sizeof(PageHeader) - 2 * sizeof(uint32_t) - 2 * sizeof(int)) / sizeof(CatalogEntry);
+
+// Stamped on the meta page when a file is created. Any change to the on-disk
+// layout of pages bumps FORMAT_VERSION; opening a file of another version
+// throws instead of misreading it.
+//   1  32-bit keys, no page headers. Predates the stamp, so such files are
+//      recognized by its absence.
+//   2  64-bit keys; every page starts with a PageHeader (codec, CRC32C);
+//      catalog of named trees; packed internal keys; dictionary leaves
+constexpr uint32_t FORMAT_MAGIC = 0x45525442;  // "BTRE"
+constexpr uint32_t FORMAT_VERSION = 2;
+
+// Meta page structure (Page 0): format stamp and root of the default
+// (unnamed) tree, followed by the catalog of named trees sharing this file
+// and buffer pool
 struct MetaPage {
+    PageHeader header;
+    uint32_t magic;
+    uint32_t format_version;
     int root_page_id;
+    int num_trees;
+    CatalogEntry trees[MAX_CATALOG_ENTRIES];
 };
+static_assert(sizeof(MetaPage) <= PAGE_SIZE, "MetaPage must fit in a page");
 
-enum class PageType : int {
+enum class PageType : uint8_t {
     INVALID = 0,
     LEAF = 1,
     INTERNAL = 2
 };
 
+// How an internal page stores its separator keys: full 64-bit keys, or
+// frame-of-reference deltas from the page's smallest key
+enum class KeyFormat : uint8_t {
+    FULL = 0,
+    DELTA32 = 1,
+    DELTA16 = 2
+};
+
+// How a leaf page stores values: inline fixed-size copies, or ids into the
+// tree's value dictionary
+enum class ValueFormat : uint8_t {
+    INLINE = 0,
+    DICTIONARY = 1
+};
+
 // Common header for all B+ tree pages
 struct BPlusTreePageHeader {
+    PageHeader common;
     PageType page_type;
+    KeyFormat key_format;      // Internal pages only
+    ValueFormat value_format;  // Leaf pages only
+    uint8_t reserved;
     int num_keys;
     int parent_page_id;
 };
@@ -38,59 +96,347 @@ struct LeafPageHeader {
 
 // Leaf entry
 struct LeafEntry {
-    int key;
+    int64_t key;
     char value[VALUE_SIZE];
 };
 
+// Leaf entry of a dictionary-encoded leaf; value id 0 is the empty
+// (deleted) value
+struct DictionaryLeafEntry {
+    int64_t key;
+    uint32_t value_id;
+    uint32_t reserved;
+};
+
 // Calculate max entries per page
 constexpr size_t LEAF_HEADER_SIZE = sizeof(LeafPageHeader);
 constexpr size_t LEAF_ENTRY_SIZE = sizeof(LeafEntry);
 constexpr size_t LEAF_MAX_ENTRIES = (PAGE_SIZE - LEAF_HEADER_SIZE) / LEAF_ENTRY_SIZE;
+constexpr size_t LEAF_MAX_DICTIONARY_ENTRIES = (PAGE_SIZE - LEAF_HEADER_SIZE) / sizeof(DictionaryLeafEntry);
 
-// Internal page: header + array of children (n+1) interleaved with keys (n)
-// Layout: [header][child0][key0][child1][key1]...[keyN-1][childN]
+// Internal page: header + array of children (n+1) followed by keys (n)
+// Layout: [header][child0][child1]...[childN][pad][key0][key1]...[keyN-1]
+// (keys start at the next 8-byte boundary after the children). Delta
+// formats store [base key][delta0]...[deltaN-1] in the key area instead;
+// narrower keys leave room for more children, so capacity is per format.
 constexpr size_t INTERNAL_HEADER_SIZE = sizeof(BPlusTreePageHeader);
-constexpr size_t INTERNAL_MAX_KEYS = (PAGE_SIZE - INTERNAL_HEADER_SIZE - sizeof(int)) / (2 * sizeof(int));
+
+constexpr size_t KeyFormatWidth(KeyFormat format) {
+    return format == KeyFormat::DELTA16 ? sizeof(uint16_t)
+         : format == KeyFormat::DELTA32 ? sizeof(uint32_t) : sizeof(int64_t);
+}
+
+constexpr size_t KeyFormatBaseSize(KeyFormat format) {
+    return format == KeyFormat::FULL ? 0 : sizeof(int64_t);
+}
+
+constexpr size_t InternalMaxKeys(KeyFormat format) {
+    return (PAGE_SIZE - INTERNAL_HEADER_SIZE - sizeof(int) - (alignof(int64_t) - sizeof(int)) -
+            KeyFormatBaseSize(format)) / (sizeof(int) + KeyFormatWidth(format));
+}
+
+constexpr size_t InternalKeysOffset(KeyFormat format) {
+    return (INTERNAL_HEADER_SIZE + (InternalMaxKeys(format) + 1) * sizeof(int) + alignof(int64_t) - 1) /
+           alignof(int64_t) * alignof(int64_t);
+}
+
+constexpr size_t INTERNAL_MAX_KEYS = InternalMaxKeys(KeyFormat::FULL);
+constexpr size_t INTERNAL_MAX_PACKED_KEYS = InternalMaxKeys(KeyFormat::DELTA16);
+static_assert(InternalKeysOffset(KeyFormat::FULL) + INTERNAL_MAX_KEYS * sizeof(int64_t) <= PAGE_SIZE,
+              "Internal page must fit in a page");
+static_assert(InternalKeysOffset(KeyFormat::DELTA32) + sizeof(int64_t) +
+              InternalMaxKeys(KeyFormat::DELTA32) * sizeof(uint32_t) <= PAGE_SIZE,
+              "Packed internal page must fit in a page");
+static_assert(InternalKeysOffset(KeyFormat::DELTA16) + sizeof(int64_t) +
+              INTERNAL_MAX_PACKED_KEYS * sizeof(uint16_t) <= PAGE_SIZE,
+              "Packed internal page must fit in a page");
+static_assert(LEAF_HEADER_SIZE % alignof(LeafEntry) == 0, "Leaf entries must be aligned");
+
+// Consistent read view of the tree. Every write is stamped with a
+// monotonically increasing timestamp; a snapshot sees exactly the writes
+// stamped at or before its own timestamp.
+struct Snapshot {
+    uint64_t timestamp;
+};
+
+// Per-tree options; they govern pages this tree writes, every page records
+// its own format so trees opened with different options read each other fine
+struct TreeOptions {
+    // On-disk codec for leaf pages (applied by copy-on-write files only)
+    PageCodec leaf_codec = PageCodec::NONE;
+    // Store internal-page keys as 16/32-bit deltas when their range allows,
+    // raising fan-out for dense integer keys (up to 2x at 16 bits)
+    bool pack_internal_keys = false;
+    // Store each distinct value once, in a dictionary kept as the catalogued
+    // tree "<name>#dict"; leaves then hold (key, value id) pairs, 254 per page
+    // instead of 29. Takes effect when the tree creates its first leaf.
+    bool dedup_values = false;
+    // Write-optimized mode (Bε-tree style, btree_buffer.cpp): every internal
+    // page buffers up to this many pending puts and deletes in memory. A full
+    // buffer passes its largest group of messages to that child, so leaves
+    // are written in batches instead of once per key; reads check the
+    // buffers on their path. 0 writes straight through to the leaves.
+    size_t write_buffer_entries = 0;
+    // Cap on messages buffered across all internal pages; past it every
+    // buffer is applied to the leaves. 0 means 16 * write_buffer_entries.
+    size_t write_buffer_total_entries = 0;
+    // With write buffers, a Remove normally looks the key up first so it can
+    // return false for a missing key. Blind removes skip that read: they are
+    // buffered as they come and always return true.
+    bool blind_removes = false;
+};
+
+struct AnalyzeOptions {
+    int threads = 0;  // Page readers per tree level; 0 means one per core, at most 8
+};
+
+// Shape, space usage and integrity of one tree, as found by BPlusTree::Analyze()
+struct TreeStats {
+    struct Level {
+        size_t pages = 0;
+        uint64_t keys = 0;        // Entries on leaves, separator keys above
+        uint64_t free_bytes = 0;  // Unused bytes on the level's pages
+    };
+
+    int height = 0;                     // 0 for an empty tree
+    std::vector<Level> levels;          // levels[0] is the leaf level
+    uint64_t live_entries = 0;
+    uint64_t tombstones = 0;            // Entries emptied by Remove() and never reclaimed
+    size_t leaf_fill[10] = {};          // Leaves per 10% fill-factor bucket
+    size_t internal_key_formats[3] = {};  // Internal pages per KeyFormat
+    size_t leaf_value_formats[2] = {};    // Leaves per ValueFormat
+
+    // Leaf chain layout on disk. A link is sequential when the next leaf
+    // starts within a page after the current one, forward when it lies
+    // further ahead and backward otherwise; scans pay a seek for the latter.
+    size_t sequential_links = 0;
+    size_t forward_links = 0;
+    size_t backward_links = 0;
+    uint64_t link_distance_pages = 0;   // Sum of |distance| between consecutive leaves
+
+    std::vector<int> pages;             // Every page reachable from the root
+    std::vector<std::string> errors;    // Integrity violations (at most MAX_ERRORS)
+
+    static constexpr size_t MAX_ERRORS = 100;
+
+    bool IsConsistent() const { return errors.empty(); }
+    double TombstoneRatio() const;
+    double AverageLeafFill() const;     // Fraction of leaf capacity in use
+    std::string ToText() const;
+};
+
+// Extracts the secondary key from a primary value; nullopt leaves it unindexed
+using SecondaryKeyExtractor = std::function<std::optional<int>(const std::string &value)>;
 
 class BPlusTree {
 public:
-    explicit BPlusTree(BufferPoolManager *buffer_pool_manager);
+    // An empty name opens the default tree; any other name opens (or creates
+    // on first insert) a named tree registered in the catalog on Page 0
+    explicit BPlusTree(BufferPoolManager *buffer_pool_manager, const std::string &name = "",
+                       TreeOptions options = TreeOptions());
     ~BPlusTree();
 
-    bool Insert(int key, const std::string &value);
-    bool Remove(int key);
-    std::optional<std::string> Search(int key);
-    std::vector<std::pair<int, std::string>> Scan(int start_key, int end_key);
+    // Names of all catalogued trees in the pool's database file
+    static std::vector<std::string> ListTrees(BufferPoolManager *buffer_pool_manager);
+
+    // What a leaf keeps of `value`: cut at the first NUL and to VALUE_SIZE - 1
+    // bytes. nullopt if nothing is left, since an empty value reads as deleted.
+    static std::optional<std::string> StoredValue(const std::string &value);
+
+    bool Insert(int64_t key, const std::string &value);
+    bool Remove(int64_t key);
+    std::optional<std::string> Search(int64_t key, const Snapshot *snapshot = nullptr);
+    // At most `limit` entries, from the lowest key up
+    std::vector<std::pair<int64_t, std::string>> Scan(int64_t start_key, int64_t end_key,
+                                                  const Snapshot *snapshot = nullptr,
+                                                  size_t limit = SIZE_MAX);
+
+    // Search for every key; results line up with `keys`. Up to `group_size`
+    // lookups run interleaved as coroutines: each prefetches the next page
+    // on its path and yields, so one lookup's cache misses overlap the others'
+    // work. 1 runs them one after another (btree_multiget.cpp).
+    std::vector<std::optional<std::string>> MultiGet(const std::vector<int64_t> &keys,
+                                                     const Snapshot *snapshot = nullptr,
+                                                     size_t group_size = MULTIGET_GROUP_SIZE);
+
+    // Snapshots stay valid until released; overwritten values are kept in a
+    // side store only for as long as some snapshot can still observe them.
+    const Snapshot *GetSnapshot();
+    void ReleaseSnapshot(const Snapshot *snapshot);
+    // Keys whose overwritten values are held in the side store
+    size_t VersionedKeys() const { return versions_.size(); }
+
+    // Apply all puts/deletes of a batch under a single timestamp; the batch
+    // is sorted by key so writes landing in the same leaf share a descent
+    bool Write(const WriteBatch &batch);
+
+    // Called after every successful Insert, Remove and Write with the writes
+    // it applied (an Insert or Remove as a one-entry batch), on the writing
+    // thread; used to stream changes to followers (replication.h). Null clears it.
+    using WriteObserver = std::function<void(const WriteBatch &batch)>;
+    void SetWriteObserver(WriteObserver observer) { write_observer_ = std::move(observer); }
+
+    // True if `key` was written after `snapshot` was taken (snapshot must be live)
+    bool ChangedSince(int64_t key, const Snapshot *snapshot) const;
+
+    // Declare a secondary index stored as the catalogued tree `index_name`.
+    // Entries are (secondary key, primary key) pairs maintained by every
+    // Insert/Remove/Write of this tree. Extractors are code, so indexes must
+    // be declared again whenever the tree is opened; an empty index tree is
+    // backfilled from this tree. Indexed trees need 32-bit primary keys.
+    void CreateIndex(const std::string &index_name, SecondaryKeyExtractor extractor);
+
+    // Index-only lookup: primary keys whose secondary key is in [start, end],
+    // ordered by (secondary key, primary key); the primary tree is not read
+    std::vector<int64_t> SearchIndex(const std::string &index_name, int start_secondary_key,
+                                     int end_secondary_key);
+
+    // Walk the whole tree and report its shape, space usage and leaf layout,
+    // checking key order, fences, parent links and the leaf chain on the way.
+    // The pool is flushed first; pages are then read straight from the file,
+    // one level at a time, by `options.threads` readers in parallel.
+    TreeStats Analyze(const AnalyzeOptions &options = AnalyzeOptions());
+
+    // Apply every buffered write to the leaves (write_buffer_entries only).
+    // A buffering tree registers this as a flush hook of its pool, so every
+    // FlushAllPages, and with it every checkpoint and backup, includes the
+    // buffered writes. The destructor flushes too, but can only report a
+    // failure on stderr, and the buffered writes are then lost.
+    void FlushBuffers();
+    size_t BufferedWrites() const { return buffered_writes_; }
 
     bool IsEmpty() const { return root_page_id_ == INVALID_PAGE_ID; }
 
 private:
+    // Page-level microbenchmarks (src/microbench.cpp) drive the helpers directly
+    friend class Microbench;
+    // Runs its own suspendable descents over the page helpers (async_tree.h)
+    friend class AsyncTree;
+
+    struct PageVisit;
+    struct PageReport;
+
+    // Value a key held before the write stamped `overwritten_at`
+    // (nullopt if the key was absent or deleted at that point)
+    struct Version {
+        uint64_t overwritten_at;
+        std::optional<std::string> value;
+    };
+
+    // A buffered write: the value to put, or nullopt to delete, stamped with
+    // the write's timestamp
+    struct Message {
+        uint64_t timestamp;
+        std::optional<std::string> value;
+    };
+    using MessageBuffer = std::map<int64_t, Message>;
+
+    struct SecondaryIndex {
+        std::string name;
+        SecondaryKeyExtractor extractor;
+        std::unique_ptr<BPlusTree> tree;
+    };
+
     BufferPoolManager *buffer_pool_manager_;
+    std::string name_;
+    TreeOptions options_;
     int root_page_id_;
+    std::vector<SecondaryIndex> indexes_;
+    WriteObserver write_observer_;
+
+    // MVCC state: write clock, live snapshots (oldest first) and version chains
+    uint64_t current_ts_;
+    std::list<Snapshot> snapshots_;
+    std::unordered_map<int64_t, std::vector<Version>> versions_;
+
+    // Write buffers of internal pages, by page id; only non-empty ones are kept
+    std::unordered_map<int, MessageBuffer> buffers_;
+    size_t buffered_writes_;
+
+    // Value dictionary for DICTIONARY leaves, opened on first use. Values are
+    // read from the dictionary tree on demand through a small cache; ids no
+    // leaf references are freed by compaction and handed out again.
+    std::unique_ptr<BPlusTree> dictionary_;
+    uint32_t dictionary_next_id_;                  // Ids below it have been handed out
+    std::vector<uint32_t> dictionary_free_ids_;    // Unreferenced ids, lowest last
+    size_t dictionary_live_ids_;                   // Ids referenced at the last compaction
+    size_t dictionary_new_ids_;                    // Ids handed out since then
+    // Recently used entries, each map at most DICTIONARY_CACHE_ENTRIES
+    std::unordered_map<uint32_t, std::string> dictionary_cache_;
+    std::unordered_map<std::string, uint32_t> dictionary_id_cache_;
 
     // Helper functions for leaf pages
     LeafPageHeader *GetLeafHeader(Page *page);
-    LeafEntry *GetLeafEntries(Page *page);
-    int LeafFindKey(Page *page, int key);
-    bool LeafInsert(Page *page, int key, const std::string &value);
+    static size_t LeafEntrySize(ValueFormat format);
+    int LeafCapacity(Page *page);
+    char *LeafEntryAt(Page *page, int idx);
+    int64_t LeafKeyAt(Page *page, int idx);
+    std::string LeafValueAt(Page *page, int idx);
+    void WriteLeafEntry(char *entry, ValueFormat format, int64_t key, const std::string &value);
+    int LeafFindKey(Page *page, int64_t key);
+    bool LeafInsert(Page *page, int64_t key, const std::string &value);
 
     // Helper functions for internal pages
     BPlusTreePageHeader *GetInternalHeader(Page *page);
     int *GetInternalChildren(Page *page);
-    int *GetInternalKeys(Page *page);
-    int InternalFindChild(Page *page, int key);
-    void InternalInsert(Page *page, int key, int right_child_id);
+    int64_t InternalKeyAt(Page *page, int idx);
+    void ReadInternalKeys(Page *page, int64_t *keys);
+    void WriteInternalKeys(Page *page, const int64_t *keys, int n);
+    KeyFormat ChooseKeyFormat(const int64_t *keys, int n) const;
+    bool InternalHasRoom(Page *page, int64_t key);
+    int InternalFindChild(Page *page, int64_t key, std::optional<int64_t> *upper_fence = nullptr);
+    void InternalInsert(Page *page, int64_t key, int right_child_id);
 
     // Tree operations
-    Page *FindLeafPage(int key);
-    void InsertIntoParent(Page *left_page, int key, Page *right_page);
-    void SplitLeaf(Page *leaf_page, int key, const std::string &value);
-    void SplitInternal(Page *internal_page, int key, int right_child_id);
-    void CreateNewRoot(Page *left_page, int key, Page *right_page);
+    // With `buffered`, a buffer on the path holding `key` ends the descent:
+    // *buffered points at its message and no leaf is returned
+    Page *FindLeafPage(int64_t key, std::optional<int64_t> *upper_fence = nullptr,
+                       const Message **buffered = nullptr);
+    void StartNewTree(int64_t key, const std::string &value);
+    bool InsertIntoLeaf(Page *leaf, int64_t key, const std::string &value);
+    bool LeafRemove(Page *page, int64_t key);
+    void InsertIntoParent(Page *left_page, int64_t key, Page *right_page, int level);
+    void SplitLeaf(Page *leaf_page, int64_t key, const std::string &value);
+    void SplitInternal(Page *internal_page, int64_t key, int right_child_id, int level);
+    void CreateNewRoot(Page *left_page, int64_t key, Page *right_page);
+    bool ApplyToLeaves(const std::vector<const WriteBatch::Op *> &ops);
+
+    // Write buffers (btree_buffer.cpp)
+    bool Buffering();
+    void BufferWrite(int64_t key, std::optional<std::string> value);
+    void FlushBuffer(int page_id);
+    const Message *BufferedMessage(int page_id, int64_t key) const;
+    std::map<int64_t, const Message *> BufferedRange(int64_t start_key, int64_t end_key) const;
+    void SplitBuffer(int page_id, int64_t middle_key, int new_page_id);
+    WriteBatch::Op MessageOp(int64_t key, std::optional<std::string> value) const;
+
+    // Version store
+    void RecordVersion(int64_t key);
+    std::optional<std::string> ResolveVersion(int64_t key, std::optional<std::string> current,
+                                              const Snapshot *snapshot) const;
+    void CollectGarbageVersions();
+
+    // Secondary index maintenance
+    static void CheckIndexedKey(int64_t key);
+    static int64_t IndexKey(int secondary_key, int64_t primary_key);
+    void UpdateIndexes(int64_t key, const std::optional<std::string> &new_value);
+
+    // Value dictionary
+    std::string DictionaryName() const;
+    void LoadDictionary();
+    std::optional<std::string> LookupValue(uint32_t value_id);
+    uint32_t InternValue(const std::string &value);
+    void MaybeCompactDictionary();
+    void CompactDictionary();
+
+    // Analysis (btree_analyze.cpp); safe to run on several threads at once
+    void AnalyzePage(const PageVisit &visit, Page *page, PageReport *report);
 
     // Meta page operations
     void LoadMetaPage();
     void UpdateMetaPage();
+    static CatalogEntry *FindCatalogEntry(MetaPage *meta, const std::string &name);
+    static MetaPage *FetchMetaPage(BufferPoolManager *buffer_pool_manager);
 };
 
 #endif // BTREE_H
@@ -0,0 +1,310 @@
+#include "btree.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+// A page to examine, with the key range its parent routes to it: keys in
+// [low, high), an unset end being unbounded
+struct BPlusTree::PageVisit {
+    int page_id;
+    int parent_id;
+    std::optional<int64_t> low;
+    std::optional<int64_t> high;
+};
+
+// What one page contributed, filled in by a reader thread
+struct BPlusTree::PageReport {
+    bool readable = false;
+    PageType type = PageType::INVALID;
+    KeyFormat key_format = KeyFormat::FULL;
+    ValueFormat value_format = ValueFormat::INLINE;
+    int num_keys = 0;
+    int capacity = 0;
+    uint64_t free_bytes = 0;
+    uint64_t tombstones = 0;
+    uint32_t max_value_id = 0;
+    int next_page_id = INVALID_PAGE_ID;
+    std::vector<PageVisit> children;
+    std::vector<std::string> errors;
+};
+
+// Uses only the page buffer and DiskManager::ReadPageConcurrent, so reader
+// threads can run it side by side
+void BPlusTree::AnalyzePage(const PageVisit &visit, Page *page, PageReport *report) {
+    auto fail = [&](const std::string &what) {
+        report->errors.push_back("page " + std::to_string(visit.page_id) + ": " + what);
+    };
+    if (!buffer_pool_manager_->GetDiskManager()->ReadPageConcurrent(visit.page_id, page->data)) {
+        fail("checksum mismatch");
+        return;
+    }
+    page->page_id = visit.page_id;
+    report->readable = true;
+
+    BPlusTreePageHeader *header = GetInternalHeader(page);
+    report->type = header->page_type;
+    report->num_keys = header->num_keys;
+    if (header->parent_page_id != visit.parent_id) {
+        fail("parent link is " + std::to_string(header->parent_page_id) + ", reached from " +
+             std::to_string(visit.parent_id));
+    }
+    auto in_fences = [&](int64_t key) {
+        return (!visit.low || key >= *visit.low) && (!visit.high || key < *visit.high);
+    };
+
+    std::vector<int64_t> keys;
+    if (header->page_type == PageType::LEAF) {
+        if (header->value_format != ValueFormat::INLINE && header->value_format != ValueFormat::DICTIONARY) {
+            fail("unknown value format " + std::to_string(static_cast<int>(header->value_format)));
+            return;
+        }
+        report->value_format = header->value_format;
+        report->capacity = LeafCapacity(page);
+        report->next_page_id = GetLeafHeader(page)->next_page_id;
+        if (header->num_keys < 0 || header->num_keys > report->capacity) {
+            fail("holds " + std::to_string(header->num_keys) + " entries, capacity " +
+                 std::to_string(report->capacity));
+            return;
+        }
+        for (int i = 0; i < header->num_keys; ++i) {
+            keys.push_back(LeafKeyAt(page, i));
+            char *entry = LeafEntryAt(page, i);
+            if (header->value_format == ValueFormat::DICTIONARY) {
+                uint32_t value_id = reinterpret_cast<DictionaryLeafEntry *>(entry)->value_id;
+                report->tombstones += value_id == 0;
+                report->max_value_id = std::max(report->max_value_id, value_id);
+            } else {
+                report->tombstones += reinterpret_cast<LeafEntry *>(entry)->value[0] == '\0';
+            }
+        }
+        report->free_bytes = PAGE_SIZE - LEAF_HEADER_SIZE - header->num_keys * LeafEntrySize(header->value_format);
+    } else if (header->page_type == PageType::INTERNAL) {
+        if (header->key_format != KeyFormat::FULL && header->key_format != KeyFormat::DELTA32 &&
+            header->key_format != KeyFormat::DELTA16) {
+            fail("unknown key format " + std::to_string(static_cast<int>(header->key_format)));
+            return;
+        }
+        report->key_format = header->key_format;
+        report->capacity = static_cast<int>(InternalMaxKeys(header->key_format));
+        if (header->num_keys < 1 || header->num_keys > report->capacity) {
+            fail("holds " + std::to_string(header->num_keys) + " keys, capacity " +
+                 std::to_string(report->capacity));
+            return;
+        }
+        keys.resize(header->num_keys);
+        ReadInternalKeys(page, keys.data());
+        int *children = GetInternalChildren(page);
+        for (int i = 0; i <= header->num_keys; ++i) {
+            report->children.push_back({children[i], visit.page_id, i == 0 ? visit.low : keys[i - 1],
+                                        i == header->num_keys ? visit.high : keys[i]});
+        }
+        report->free_bytes = PAGE_SIZE - INTERNAL_HEADER_SIZE - (header->num_keys + 1) * sizeof(int) -
+                             KeyFormatBaseSize(header->key_format) -
+                             header->num_keys * KeyFormatWidth(header->key_format);
+    } else {
+        fail("not a tree page (type " + std::to_string(static_cast<int>(header->page_type)) + ")");
+        return;
+    }
+
+    // One report per kind of violation keeps a badly damaged page readable
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (keys[i] <= keys[i - 1]) {
+            fail("keys out of order at index " + std::to_string(i));
+            break;
+        }
+    }
+    for (int64_t key : keys) {
+        if (!in_fences(key)) {
+            fail("key " + std::to_string(key) + " outside the range its parent routes here");
+            break;
+        }
+    }
+}
+
+TreeStats BPlusTree::Analyze(const AnalyzeOptions &options) {
+    TreeStats stats;
+    if (root_page_id_ == INVALID_PAGE_ID) {
+        return stats;
+    }
+    // Readers go to the file directly, so it has to be current
+    buffer_pool_manager_->FlushAllPages();
+    DiskManager *disk_manager = buffer_pool_manager_->GetDiskManager();
+    int num_pages = disk_manager->GetNumPages();
+    size_t threads = options.threads > 0 ? options.threads
+                                         : std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 8);
+
+    auto error = [&](const std::string &message) {
+        if (stats.errors.size() < TreeStats::MAX_ERRORS) {
+            stats.errors.push_back(message);
+        }
+    };
+
+    std::vector<TreeStats::Level> levels;              // Root first
+    std::vector<std::pair<int, int>> leaves;            // (page, next page) in key order
+    std::unordered_set<int> seen = {root_page_id_};
+    std::vector<PageVisit> level = {{root_page_id_, INVALID_PAGE_ID, std::nullopt, std::nullopt}};
+    uint32_t max_value_id = 0;
+    while (!level.empty()) {
+        // Readers claim pages of the level in turn
+        std::vector<PageReport> reports(level.size());
+        std::atomic<size_t> next_visit{0};
+        auto reader = [&]() {
+            Page page;
+            for (size_t i; (i = next_visit.fetch_add(1)) < level.size();) {
+                AnalyzePage(level[i], &page, &reports[i]);
+            }
+        };
+        std::vector<std::thread> readers;
+        for (size_t t = 1; t < std::min(threads, level.size()); ++t) {
+            readers.emplace_back(reader);
+        }
+        reader();
+        for (std::thread &thread : readers) {
+            thread.join();
+        }
+
+        TreeStats::Level summary;
+        std::vector<PageVisit> next_level;
+        bool has_leaves = false;
+        for (size_t i = 0; i < level.size(); ++i) {
+            const PageReport &report = reports[i];
+            stats.pages.push_back(level[i].page_id);
+            for (const std::string &message : report.errors) {
+                error(message);
+            }
+            if (!report.readable) {
+                continue;
+            }
+            summary.pages++;
+            summary.keys += std::max(report.num_keys, 0);
+            summary.free_bytes += report.free_bytes;
+            if (report.type == PageType::LEAF) {
+                has_leaves = true;
+                leaves.emplace_back(level[i].page_id, report.next_page_id);
+                if (report.capacity > 0) {
+                    int bucket = std::min(9, report.num_keys * 10 / report.capacity);
+                    stats.leaf_fill[std::max(bucket, 0)]++;
+                    stats.leaf_value_formats[static_cast<int>(report.value_format)]++;
+                    stats.live_entries += report.num_keys - report.tombstones;
+                    stats.tombstones += report.tombstones;
+                    max_value_id = std::max(max_value_id, report.max_value_id);
+                }
+            } else if (report.type == PageType::INTERNAL && report.capacity > 0) {
+                stats.internal_key_formats[static_cast<int>(report.key_format)]++;
+            }
+            for (const PageVisit &child : report.children) {
+                if (child.page_id <= META_PAGE_ID || child.page_id >= num_pages) {
+                    error("page " + std::to_string(level[i].page_id) + ": child " + std::to_string(child.page_id) +
+                          " out of range");
+                } else if (!seen.insert(child.page_id).second) {
+                    error("page " + std::to_string(child.page_id) + " reached more than once");
+                } else {
+                    next_level.push_back(child);
+                }
+            }
+        }
+        if (has_leaves && !next_level.empty()) {
+            error("leaves and internal pages share level " + std::to_string(levels.size()) +
+                  " from the root; the tree is unbalanced");
+            next_level.clear();
+        }
+        levels.push_back(summary);
+        level = std::move(next_level);
+    }
+    stats.height = static_cast<int>(levels.size());
+    stats.levels.assign(levels.rbegin(), levels.rend());
+
+    // The leaf chain must visit the leaves in key order; how far apart the
+    // links are on disk decides how sequential a scan's reads are
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        int expected = i + 1 < leaves.size() ? leaves[i + 1].first : INVALID_PAGE_ID;
+        if (leaves[i].second != expected) {
+            error("leaf " + std::to_string(leaves[i].first) + " links to " + std::to_string(leaves[i].second) +
+                  ", expected " + std::to_string(expected));
+        }
+        if (i + 1 == leaves.size()) {
+            break;
+        }
+        int from = disk_manager->GetPhysicalSlot(leaves[i].first);
+        int to = disk_manager->GetPhysicalSlot(leaves[i + 1].first);
+        if (from < 0 || to < 0) {
+            continue;
+        }
+        int distance = to - from;
+        if (distance > 0 && distance <= DiskManager::SLOTS_PER_PAGE) {
+            stats.sequential_links++;
+        } else if (distance > 0) {
+            stats.forward_links++;
+        } else {
+            stats.backward_links++;
+        }
+        stats.link_distance_pages += std::abs(distance) / DiskManager::SLOTS_PER_PAGE;
+    }
+
+    if (max_value_id > 0) {
+        try {
+            LoadDictionary();
+            if (max_value_id >= dictionary_next_id_) {
+                error("value id " + std::to_string(max_value_id) + " missing from dictionary " + DictionaryName());
+            }
+        } catch (const std::runtime_error &e) {
+            error(e.what());
+        }
+    }
+    return stats;
+}
+
+double TreeStats::TombstoneRatio() const {
+    uint64_t entries = live_entries + tombstones;
+    return entries ? static_cast<double>(tombstones) / entries : 0;
+}
+
+double TreeStats::AverageLeafFill() const {
+    if (levels.empty() || levels[0].pages == 0) {
+        return 0;
+    }
+    uint64_t capacity = leaf_value_formats[0] * LEAF_MAX_ENTRIES +
+                        leaf_value_formats[1] * LEAF_MAX_DICTIONARY_ENTRIES;
+    return capacity ? static_cast<double>(levels[0].keys) / capacity : 0;
+}
+
+std::string TreeStats::ToText() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (height == 0) {
+        out << "empty tree\n";
+        return out.str();
+    }
+    out << "height " << height << ", " << pages.size() << " pages, " << live_entries << " live entries, "
+        << tombstones << " tombstones (" << 100 * TombstoneRatio() << "%)\n";
+    for (int level = height - 1; level >= 0; --level) {
+        const Level &info = levels[level];
+        out << "  level " << level << (level == 0 ? " (leaves)" : "") << ": " << info.pages << " pages, "
+            << info.keys << " keys, " << info.free_bytes / 1024 << " KB free\n";
+    }
+    out << "leaf fill: average " << 100 * AverageLeafFill() << "%, by decile";
+    for (size_t count : leaf_fill) {
+        out << " " << count;
+    }
+    out << "\n";
+    size_t links = sequential_links + forward_links + backward_links;
+    out << "leaf chain: " << links << " links, " << sequential_links << " sequential, " << forward_links
+        << " forward, " << backward_links << " backward, average distance "
+        << (links ? static_cast<double>(link_distance_pages) / links : 0.0) << " pages\n";
+    out << "formats: internal full/delta32/delta16 " << internal_key_formats[0] << "/" << internal_key_formats[1]
+        << "/" << internal_key_formats[2] << ", leaves inline/dictionary " << leaf_value_formats[0] << "/"
+        << leaf_value_formats[1] << "\n";
+    if (errors.empty()) {
+        out << "integrity: ok\n";
+    } else {
+        out << "integrity: " << errors.size() << (errors.size() == MAX_ERRORS ? "+" : "") << " errors\n";
+        for (const std::string &message : errors) {
+            out << "  " << message << "\n";
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,218 @@
+#include "btree.h"
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+// Write buffers for TreeOptions::write_buffer_entries: a Bε-tree whose
+// buffers live in memory beside the internal pages.
+//
+// Writes enter the root's buffer as messages. When a buffer grows past its
+// capacity, its messages are grouped by child and the largest group moves
+// down: into the child's own buffer if the child is internal, or onto the
+// leaf, which is then read and written once for the whole group. On a tree
+// larger than the pool, a random write so costs a fraction of a leaf read
+// and write instead of one of each. A key's newest message is the one
+// nearest the root, so a read stops at the first buffer on its path that
+// holds the key. Buffers are not part of the page images; FlushBuffers
+// applies them all, whenever the pool is flushed, and until then they are
+// lost on a crash along with the pool's dirty pages.
+
+// Only an internal root buffers: a tree of one leaf has nothing to batch
+bool BPlusTree::Buffering() {
+    if (options_.write_buffer_entries == 0 || root_page_id_ == INVALID_PAGE_ID) {
+        return false;
+    }
+    Page *root = buffer_pool_manager_->FetchPage(root_page_id_);
+    if (!root) {
+        return false;
+    }
+    bool internal = reinterpret_cast<BPlusTreePageHeader *>(root->data)->page_type == PageType::INTERNAL;
+    buffer_pool_manager_->UnpinPage(root_page_id_, false);
+    return internal;
+}
+
+// Buffer a write stamped current_ts_ at the root. The message holds the
+// value as the leaf will store it, so reads agree before and after a flush.
+void BPlusTree::BufferWrite(int64_t key, std::optional<std::string> value) {
+    if (value) {
+        value = StoredValue(*value);
+    }
+    MessageBuffer &buffer = buffers_[root_page_id_];
+    buffered_writes_ += buffer.insert_or_assign(key, Message{current_ts_, std::move(value)}).second;
+    if (buffer.size() > options_.write_buffer_entries) {
+        FlushBuffer(root_page_id_);
+    }
+    // Each buffer is bounded, but a tree with many internal pages could still
+    // hold far more writes in memory than one buffer's worth
+    size_t total_entries = options_.write_buffer_total_entries != 0 ? options_.write_buffer_total_entries
+                                                                     : 16 * options_.write_buffer_entries;
+    if (buffered_writes_ > total_entries) {
+        FlushBuffers();
+    }
+}
+
+// Move message groups out of an overfull buffer until it fits again
+void BPlusTree::FlushBuffer(int page_id) {
+    while (true) {
+        // Looked up again each round: flushing below may split this page
+        auto it = buffers_.find(page_id);
+        if (it == buffers_.end() || it->second.size() <= options_.write_buffer_entries) {
+            return;
+        }
+        MessageBuffer &buffer = it->second;
+
+        Page *page = buffer_pool_manager_->FetchPage(page_id);
+        if (!page) {
+            throw std::runtime_error("Buffer pool exhausted while flushing write buffers");
+        }
+        int n = GetInternalHeader(page)->num_keys;
+        int64_t keys[INTERNAL_MAX_PACKED_KEYS];
+        ReadInternalKeys(page, keys);
+        std::vector<int> children(GetInternalChildren(page), GetInternalChildren(page) + n + 1);
+        buffer_pool_manager_->UnpinPage(page_id, false);
+
+        // Messages are in key order, so each child's group is a consecutive run
+        int best = 0;
+        size_t best_count = 0;
+        int child = 0;
+        size_t count = 0;
+        for (const auto &entry : buffer) {
+            while (child < n && entry.first >= keys[child]) {
+                if (count > best_count) {
+                    best = child;
+                    best_count = count;
+                }
+                ++child;
+                count = 0;
+            }
+            ++count;
+        }
+        if (count > best_count) {
+            best = child;
+        }
+
+        auto first = best == 0 ? buffer.begin() : buffer.lower_bound(keys[best - 1]);
+        auto last = best == n ? buffer.end() : buffer.lower_bound(keys[best]);
+        MessageBuffer group;
+        while (first != last) {
+            group.insert(buffer.extract(first++));
+        }
+        if (buffer.empty()) {
+            buffers_.erase(it);
+        }
+
+        int child_page_id = children[best];
+        Page *child_page = buffer_pool_manager_->FetchPage(child_page_id);
+        if (!child_page) {
+            throw std::runtime_error("Buffer pool exhausted while flushing write buffers");
+        }
+        bool leaf = reinterpret_cast<BPlusTreePageHeader *>(child_page->data)->page_type == PageType::LEAF;
+        buffer_pool_manager_->UnpinPage(child_page_id, false);
+
+        if (!leaf) {
+            // The group is newer than anything the child holds for its keys
+            MessageBuffer &child_buffer = buffers_[child_page_id];
+            for (auto &[key, message] : group) {
+                buffered_writes_ -= !child_buffer.insert_or_assign(key, std::move(message)).second;
+            }
+            FlushBuffer(child_page_id);
+            continue;
+        }
+
+        std::vector<WriteBatch::Op> ops;
+        ops.reserve(group.size());
+        for (auto &[key, message] : group) {
+            ops.push_back(MessageOp(key, std::move(message.value)));
+        }
+        std::vector<const WriteBatch::Op *> sorted;
+        sorted.reserve(ops.size());
+        for (const WriteBatch::Op &op : ops) {
+            sorted.push_back(&op);
+        }
+        buffered_writes_ -= ops.size();
+        if (!ApplyToLeaves(sorted)) {
+            throw std::runtime_error("Buffer pool exhausted while flushing write buffers");
+        }
+    }
+}
+
+void BPlusTree::FlushBuffers() {
+    if (buffers_.empty()) {
+        return;
+    }
+    // Every key's newest message, applied in one key-ordered pass
+    std::vector<WriteBatch::Op> ops;
+    for (const auto &[key, message] : BufferedRange(std::numeric_limits<int64_t>::min(),
+                                                     std::numeric_limits<int64_t>::max())) {
+        ops.push_back(MessageOp(key, message->value));
+    }
+
+    std::vector<const WriteBatch::Op *> sorted;
+    sorted.reserve(ops.size());
+    for (const WriteBatch::Op &op : ops) {
+        sorted.push_back(&op);
+    }
+    // The buffers stay until every write has landed, so a failed flush can
+    // be retried; the writes it did apply are simply applied again
+    if (!ApplyToLeaves(sorted)) {
+        throw std::runtime_error("Buffer pool exhausted while flushing write buffers");
+    }
+    buffers_.clear();
+    buffered_writes_ = 0;
+    MaybeCompactDictionary();
+}
+
+// The leaf write for a message. A delete whose key has saved versions
+// becomes a tombstone even if the leaf never held the key (its insert may
+// have been overwritten while buffered), so scans under a snapshot still
+// reach the key.
+WriteBatch::Op BPlusTree::MessageOp(int64_t key, std::optional<std::string> value) const {
+    if (!value && versions_.count(key)) {
+        return {key, false, std::string()};
+    }
+    return {key, !value, std::move(value).value_or(std::string())};
+}
+
+const BPlusTree::Message *BPlusTree::BufferedMessage(int page_id, int64_t key) const {
+    auto it = buffers_.find(page_id);
+    if (it == buffers_.end()) {
+        return nullptr;
+    }
+    auto found = it->second.find(key);
+    return found == it->second.end() ? nullptr : &found->second;
+}
+
+// Newest buffered message of every key in [start_key, end_key]
+std::map<int64_t, const BPlusTree::Message *> BPlusTree::BufferedRange(int64_t start_key, int64_t end_key) const {
+    std::map<int64_t, const Message *> range;
+    for (const auto &[page_id, buffer] : buffers_) {
+        for (auto it = buffer.lower_bound(start_key); it != buffer.end() && it->first <= end_key; ++it) {
+            auto [slot, inserted] = range.emplace(it->first, &it->second);
+            if (!inserted && it->second.timestamp > slot->second->timestamp) {
+                slot->second = &it->second;
+            }
+        }
+    }
+    return range;
+}
+
+// An internal page split at `middle_key`: keys from there on now route to
+// `new_page_id`, and so do their messages
+void BPlusTree::SplitBuffer(int page_id, int64_t middle_key, int new_page_id) {
+    auto it = buffers_.find(page_id);
+    if (it == buffers_.end()) {
+        return;
+    }
+    MessageBuffer &source = it->second;
+    auto first = source.lower_bound(middle_key);
+    if (first == source.end()) {
+        return;
+    }
+    MessageBuffer &target = buffers_[new_page_id];  // May rehash; `source` stays valid
+    while (first != source.end()) {
+        target.insert(source.extract(first++));
+    }
+    if (source.empty()) {
+        buffers_.erase(page_id);
+    }
+}
@@ -0,0 +1,136 @@
+#include "btree.h"
+#include "metrics.h"
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+// Batched point lookups with interleaved descents (AMAC / group prefetching).
+//
+// On a tree that fits in the pool, each level of a descent is a dependent
+// cache miss: the page to read next is known only once the current page has
+// been searched. A lookup here is a coroutine that finds its next page, has
+// the pool prefetch that frame, and suspends. The scheduler resumes the
+// other lookups of its group meanwhile, so by the time it comes back the
+// page is (ideally) in cache, and the group's misses are in flight together
+// instead of one after another.
+
+namespace {
+
+// One lookup: created suspended, resumed by MultiGet until done
+class Lookup {
+public:
+    struct promise_type {
+        std::exception_ptr exception;
+
+        Lookup get_return_object() { return Lookup(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    Lookup() = default;
+    explicit Lookup(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Lookup(Lookup &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Lookup &operator=(Lookup &&other) noexcept {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    ~Lookup() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool Active() const { return handle_ && !handle_.done(); }
+    void Resume() { handle_.resume(); }
+    std::exception_ptr Exception() const { return handle_ ? handle_.promise().exception : nullptr; }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+}  // namespace
+
+std::vector<std::optional<std::string>> BPlusTree::MultiGet(const std::vector<int64_t> &keys,
+                                                            const Snapshot *snapshot, size_t group_size) {
+    OperationTimer timer(Operation::MULTI_GET);
+    std::vector<std::optional<std::string>> results(keys.size());
+    if (root_page_id_ != INVALID_PAGE_ID && !keys.empty()) {
+        // Each lookup in flight pins one page; leave the rest of the pool for its misses
+        size_t pool_size = buffer_pool_manager_->GetPoolSize();
+        group_size = std::clamp<size_t>(group_size, 1, std::max<size_t>(1, pool_size / 2));
+
+        // Same descent and leaf read as FindLeafPage + Search, except that
+        // before each child is fetched its frame is prefetched and the lookup
+        // yields. The root is shared by all lookups and stays cached.
+        auto lookup = [this](int64_t key, std::optional<std::string> *result) -> Lookup {
+            Page *page = buffer_pool_manager_->FetchPage(root_page_id_);
+            while (page && reinterpret_cast<BPlusTreePageHeader *>(page->data)->page_type == PageType::INTERNAL) {
+                if (const Message *buffered = buffers_.empty() ? nullptr : BufferedMessage(page->page_id, key)) {
+                    *result = buffered->value;
+                    buffer_pool_manager_->UnpinPage(page->page_id, false);
+                    co_return;
+                }
+                int child_page_id = InternalFindChild(page, key);
+                buffer_pool_manager_->UnpinPage(page->page_id, false);
+                buffer_pool_manager_->PrefetchPage(child_page_id);
+                co_await std::suspend_always{};
+                page = buffer_pool_manager_->FetchPage(child_page_id);
+            }
+            if (!page) {
+                co_return;
+            }
+            int idx = LeafFindKey(page, key);
+            if (idx < GetLeafHeader(page)->base.num_keys && LeafKeyAt(page, idx) == key) {
+                std::string value = LeafValueAt(page, idx);
+                if (!value.empty()) {
+                    *result = std::move(value);
+                }
+            }
+            buffer_pool_manager_->UnpinPage(page->page_id, false);
+        };
+
+        // Round-robin over the group; a finished slot takes the next key. After
+        // an error no new lookups start, but those in flight finish so their
+        // pins are released, then the first error is rethrown.
+        std::vector<Lookup> group(std::min(group_size, keys.size()));
+        size_t next = 0;
+        size_t active = 0;
+        std::exception_ptr error;
+        for (Lookup &slot : group) {
+            slot = lookup(keys[next], &results[next]);
+            ++next;
+            ++active;
+        }
+        while (active > 0) {
+            for (Lookup &slot : group) {
+                if (!slot.Active()) {
+                    continue;
+                }
+                slot.Resume();
+                if (slot.Active()) {
+                    continue;
+                }
+                if (!error) {
+                    error = slot.Exception();
+                }
+                if (next < keys.size() && !error) {
+                    slot = lookup(keys[next], &results[next]);
+                    ++next;
+                } else {
+                    --active;
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        results[i] = ResolveVersion(keys[i], std::move(results[i]), snapshot);
+    }
+    return results;
+}
@@ -1,5 +1,8 @@
 #include "buffer_pool_manager.h"
+#include "metrics.h"
+#include "probes.h"
 #include <algorithm>
+#include <chrono>
 
 BufferPoolManager::BufferPoolManager(size_t pool_size, DiskManager *disk_manager)
     : pool_size_(pool_size), disk_manager_(disk_manager) {
@@ -21,41 +24,127 @@ Page *BufferPoolManager::FetchPage(int page_id) {
         size_t frame_id = it->second;
         Page *page = &pages_[frame_id];
         page->pin_count++;
+        CountMetric(Counter::POOL_HITS);
+        BPTREE_PROBE1(page__hit, page_id);
+        if (trace_) {
+            TraceAccess(TraceEvent::FETCH, page_id, TRACE_HIT);
+        }
 
-        // Move to front of LRU (most recently used)
-        if (lru_map_.count(frame_id)) {
-            lru_list_.erase(lru_map_[frame_id]);
-            lru_map_.erase(frame_id);
+        // Pinned again: no longer an eviction candidate (UnpinPage re-queues it)
+        auto lru = lru_map_.find(frame_id);
+        if (lru != lru_map_.end()) {
+            lru_list_.erase(lru->second);
+            lru_map_.erase(lru);
         }
         return page;
     }
 
     // Page not in pool, need to fetch from disk
+    CountMetric(Counter::POOL_MISSES);
+    BPTREE_PROBE1(page__miss, page_id);
+    if (trace_) {
+        TraceAccess(TraceEvent::FETCH, page_id, 0);
+    }
     size_t frame_id = FindVictimPage();
     if (frame_id == pool_size_) {
         return nullptr;  // No available frame
     }
 
+    auto wait_start = std::chrono::steady_clock::now();
     Page *page = &pages_[frame_id];
 
     // If victim page is dirty, flush it
-    if (page->page_id != -1) {
-        if (page->is_dirty) {
-            disk_manager_->WritePage(page->page_id, page->data);
-        }
-        page_table_.erase(page->page_id);
-    }
+    EvictFrame(page);
 
     // Read new page from disk
     page->page_id = page_id;
     page->is_dirty = false;
     page->pin_count = 1;
-    disk_manager_->ReadPage(page_id, page->data);
+    try {
+        disk_manager_->ReadPage(page_id, page->data);
+    } catch (...) {
+        // Corrupt page: give the frame back instead of leaking it pinned
+        page->page_id = -1;
+        page->pin_count = 0;
+        free_list_.push_back(frame_id);
+        throw;
+    }
 
     page_table_[page_id] = frame_id;
+    CountMetric(Counter::PIN_WAIT_NS, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - wait_start).count());
+    return page;
+}
+
+Page *BufferPoolManager::FetchResidentPage(int page_id) {
+    return page_table_.count(page_id) ? FetchPage(page_id) : nullptr;
+}
+
+Page *BufferPoolManager::ReserveFrame(int page_id) {
+    CountMetric(Counter::POOL_MISSES);
+    BPTREE_PROBE1(page__miss, page_id);
+    if (trace_) {
+        TraceAccess(TraceEvent::FETCH, page_id, 0);
+    }
+    size_t frame_id = FindVictimPage();
+    if (frame_id == pool_size_) {
+        return nullptr;
+    }
+    Page *page = &pages_[frame_id];
+    EvictFrame(page);
+    page->page_id = page_id;
+    page->is_dirty = false;
+    page->pin_count = 1;
+    reserved_[page_id] = false;
     return page;
 }
 
+bool BufferPoolManager::InstallFrame(Page *page, const char *image, size_t bytes_read) {
+    if (reserved_[page->page_id] || page_table_.count(page->page_id)) {
+        ReleaseFrame(page);
+        return false;
+    }
+    try {
+        disk_manager_->FinishRead(page->page_id, image, bytes_read, page->data);
+    } catch (...) {
+        ReleaseFrame(page);
+        throw;
+    }
+    reserved_.erase(page->page_id);
+    page_table_[page->page_id] = page - pages_;
+    return true;
+}
+
+void BufferPoolManager::ReleaseFrame(Page *page) {
+    reserved_.erase(page->page_id);
+    page->page_id = -1;
+    page->pin_count = 0;
+    free_list_.push_back(page - pages_);
+}
+
+// A read started by ReserveFrame may have fetched the image this write replaces
+void BufferPoolManager::NoteWrite(int page_id) {
+    auto it = reserved_.find(page_id);
+    if (it != reserved_.end()) {
+        it->second = true;
+    }
+}
+
+// The lines a fetch and a page search touch first: the frame's page id and
+// pin count, the page header, and the first bisection probes
+void BufferPoolManager::PrefetchPage(int page_id) const {
+    auto it = page_table_.find(page_id);
+    if (it == page_table_.end()) {
+        return;
+    }
+    const Page *page = &pages_[it->second];
+    __builtin_prefetch(page->data);
+    __builtin_prefetch(page->data + PAGE_SIZE / 4);
+    __builtin_prefetch(page->data + PAGE_SIZE / 2);
+    __builtin_prefetch(page->data + 3 * PAGE_SIZE / 4);
+    __builtin_prefetch(&page->pin_count, 1);
+}
+
 bool BufferPoolManager::UnpinPage(int page_id, bool is_dirty) {
     auto it = page_table_.find(page_id);
     if (it == page_table_.end()) {
@@ -73,6 +162,9 @@ bool BufferPoolManager::UnpinPage(int page_id, bool is_dirty) {
     if (is_dirty) {
         page->is_dirty = true;
     }
+    if (trace_) {
+        TraceAccess(TraceEvent::UNPIN, page_id, is_dirty ? TRACE_DIRTY : 0);
+    }
 
     // Add to LRU list when pin_count becomes 0
     if (page->pin_count == 0) {
@@ -91,6 +183,8 @@ bool BufferPoolManager::FlushPage(int page_id) {
 
     size_t frame_id = it->second;
     Page *page = &pages_[frame_id];
+    BPTREE_PROBE1(page__flush, page_id);
+    NoteWrite(page_id);
     disk_manager_->WritePage(page->page_id, page->data);
     page->is_dirty = false;
     return true;
@@ -105,12 +199,7 @@ Page *BufferPoolManager::NewPage(int *page_id) {
     Page *page = &pages_[frame_id];
 
     // Flush victim if dirty
-    if (page->page_id != -1) {
-        if (page->is_dirty) {
-            disk_manager_->WritePage(page->page_id, page->data);
-        }
-        page_table_.erase(page->page_id);
-    }
+    EvictFrame(page);
 
     *page_id = disk_manager_->AllocatePage();
     page->page_id = *page_id;
@@ -119,12 +208,19 @@ Page *BufferPoolManager::NewPage(int *page_id) {
     std::fill(page->data, page->data + PAGE_SIZE, 0);
 
     page_table_[*page_id] = frame_id;
+    if (trace_) {
+        TraceAccess(TraceEvent::NEW, *page_id, 0);
+    }
     return page;
 }
 
 bool BufferPoolManager::DeletePage(int page_id) {
+    NoteWrite(page_id);
     auto it = page_table_.find(page_id);
     if (it == page_table_.end()) {
+        if (trace_) {
+            TraceAccess(TraceEvent::DELETE, page_id, 0);
+        }
         return true;  // Page not in pool
     }
 
@@ -146,18 +242,72 @@ bool BufferPoolManager::DeletePage(int page_id) {
     page->is_dirty = false;
     page->pin_count = 0;
     free_list_.push_back(frame_id);
+    if (trace_) {
+        TraceAccess(TraceEvent::DELETE, page_id, 0);
+    }
 
     return true;
 }
 
 void BufferPoolManager::FlushAllPages() {
+    for (const auto &[owner, hook] : flush_hooks_) {
+        hook();
+    }
+    int flushed = 0;
+    BPTREE_PROBE1(flush__start, static_cast<int>(page_table_.size()));
     for (auto &[page_id, frame_id] : page_table_) {
         Page *page = &pages_[frame_id];
         if (page->is_dirty) {
+            NoteWrite(page_id);
             disk_manager_->WritePage(page->page_id, page->data);
             page->is_dirty = false;
+            flushed++;
         }
     }
+    BPTREE_PROBE1(flush__done, flushed);
+    // In copy-on-write mode the pages written so far only become visible on
+    // reopen once a checkpoint publishes them; in-place files need no fsync here
+    if (disk_manager_->IsCopyOnWrite()) {
+        disk_manager_->Checkpoint();
+    }
+}
+
+void BufferPoolManager::AddFlushHook(const void *owner, std::function<void()> hook) {
+    RemoveFlushHook(owner);
+    flush_hooks_.emplace_back(owner, std::move(hook));
+}
+
+void BufferPoolManager::RemoveFlushHook(const void *owner) {
+    std::erase_if(flush_hooks_, [owner](const auto &entry) { return entry.first == owner; });
+}
+
+void BufferPoolManager::StartTrace(const std::string &path) {
+    trace_ = std::make_unique<PageTraceWriter>(path, pool_size_);
+}
+
+void BufferPoolManager::StopTrace() {
+    trace_.reset();
+}
+
+void BufferPoolManager::TraceAccess(TraceEvent event, int page_id, uint8_t flags) {
+    Operation op = CurrentOperation();
+    trace_->Record(event, page_id, flags,
+                   op == Operation::NUM_OPERATIONS ? TRACE_NO_OPERATION : static_cast<uint8_t>(op));
+}
+
+// Drop the page held by a victim frame, writing it back first if dirty
+void BufferPoolManager::EvictFrame(Page *page) {
+    if (page->page_id == -1) {
+        return;
+    }
+    CountMetric(Counter::POOL_EVICTIONS);
+    BPTREE_PROBE2(page__evict, page->page_id, static_cast<int>(page->is_dirty));
+    if (page->is_dirty) {
+        CountMetric(Counter::POOL_DIRTY_WRITEBACKS);
+        NoteWrite(page->page_id);
+        disk_manager_->WritePage(page->page_id, page->data);
+    }
+    page_table_.erase(page->page_id);
 }
 
 size_t BufferPoolManager::FindVictimPage() {
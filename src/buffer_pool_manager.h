@@ -3,12 +3,18 @@
 
 #include "config.h"
 #include "disk_manager.h"
+#include "page_trace.h"
+#include <functional>
 #include <list>
+#include <memory>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 struct Page {
     int page_id = -1;
-    char data[PAGE_SIZE];
+    alignas(8) char data[PAGE_SIZE];
     bool is_dirty = false;
     int pin_count = 0;
 };
@@ -23,10 +29,45 @@ public:
     bool FlushPage(int page_id);
     Page *NewPage(int *page_id);
     bool DeletePage(int page_id);
+    // Write every dirty page. In copy-on-write mode this ends with a
+    // DiskManager::Checkpoint; in-place files are not fsynced, so call
+    // Checkpoint when the writes must be durable. Flush hooks run first.
     void FlushAllPages();
+    // Run `hook` at the start of every FlushAllPages, so state an owner keeps
+    // outside the pages (a tree's write buffers) is written into them before
+    // the flush. One hook per owner; remove it before the owner goes away.
+    void AddFlushHook(const void *owner, std::function<void()> hook);
+    void RemoveFlushHook(const void *owner);
+    // Hint that `page_id` is about to be fetched: when it is resident, start
+    // pulling its frame into the CPU cache. Never pins or reads from disk.
+    void PrefetchPage(int page_id) const;
+    // Frames filled by the caller's own reads (async_tree.h). FetchResidentPage
+    // is FetchPage without the disk read: nullptr when the page is not in the
+    // pool. ReserveFrame takes a frame for `page_id` without mapping it, or
+    // nullptr if every frame is pinned. The caller reads the range given by
+    // DiskManager::PlanRead, into the frame or a buffer of its own, then
+    // either hands the bytes to InstallFrame, which decodes them into the
+    // frame and maps it (the page comes back pinned once), or gives the frame
+    // back with ReleaseFrame. InstallFrame returns false and frees the frame
+    // if the page was loaded some other way or written out while the read
+    // was in flight; like FetchPage it throws on a corrupt page.
+    Page *FetchResidentPage(int page_id);
+    Page *ReserveFrame(int page_id);
+    bool InstallFrame(Page *page, const char *image, size_t bytes_read);
+    void ReleaseFrame(Page *page);
+
     DiskManager *GetDiskManager() const { return disk_manager_; }
+    size_t GetPoolSize() const { return pool_size_; }
+
+    // Record every fetch/new/unpin/delete to a binary trace (page_trace.h)
+    // until StopTrace(); replay it with bptree_cachesim to pick a pool size
+    void StartTrace(const std::string &path);
+    void StopTrace();
 
 private:
+    // Page-level microbenchmarks (src/microbench.cpp) time FindVictimPage alone
+    friend class Microbench;
+
     size_t pool_size_;
     DiskManager *disk_manager_;
     Page *pages_;
@@ -34,8 +75,14 @@ private:
     std::list<size_t> free_list_;
     std::list<size_t> lru_list_;
     std::unordered_map<size_t, std::list<size_t>::iterator> lru_map_;
+    std::unique_ptr<PageTraceWriter> trace_;  // Null unless tracing
+    std::unordered_map<int, bool> reserved_;  // Page id -> written since ReserveFrame
+    std::vector<std::pair<const void *, std::function<void()>>> flush_hooks_;
 
     size_t FindVictimPage();
+    void EvictFrame(Page *page);
+    void NoteWrite(int page_id);
+    void TraceAccess(TraceEvent event, int page_id, uint8_t flags);
 };
 
 #endif // BUFFER_POOL_MANAGER_H
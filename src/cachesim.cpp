@@ -0,0 +1,491 @@
+// Offline buffer pool simulator: replays a page trace recorded with
+// BufferPoolManager::StartTrace() against a range of pool sizes and
+// replacement policies and prints the resulting miss-ratio curves.
+//
+// LRU is profiled exactly for every size in one pass (Mattson stack
+// distances); FIFO, CLOCK and OPT (Belady's offline optimum, a lower bound
+// for any policy) are simulated once per size. Fetches are the references;
+// new pages enter the cache without a miss and deleted pages leave it. Pins
+// are not modelled, so very small pools look better than the real pool,
+// which cannot evict pinned pages.
+
+#include "metrics.h"
+#include "page_trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Reference {
+    int page_id;
+    TraceEvent event;  // FETCH, NEW or DELETE
+};
+
+struct TraceSummary {
+    uint64_t events[4] = {};
+    uint64_t observed_hits = 0;
+    uint64_t fetches_by_operation[NUM_OPERATIONS + 1] = {};  // Last slot: outside any operation
+    size_t distinct_pages = 0;
+    size_t pool_size = 0;
+
+    uint64_t Fetches() const { return events[static_cast<int>(TraceEvent::FETCH)]; }
+};
+
+std::vector<Reference> LoadTrace(const std::string &path, TraceSummary *summary) {
+    PageTraceReader reader(path);
+    summary->pool_size = reader.Header().pool_size;
+    std::vector<Reference> references;
+    std::unordered_map<int, bool> pages;
+    PageTraceRecord record;
+    while (reader.Next(&record)) {
+        summary->events[static_cast<int>(record.event)]++;
+        if (record.event == TraceEvent::UNPIN) {
+            continue;
+        }
+        if (record.event == TraceEvent::FETCH) {
+            summary->observed_hits += (record.flags & TRACE_HIT) ? 1 : 0;
+            summary->fetches_by_operation[std::min<size_t>(record.operation, NUM_OPERATIONS)]++;
+        }
+        pages[record.page_id] = true;
+        references.push_back({record.page_id, record.event});
+    }
+    summary->distinct_pages = pages.size();
+    return references;
+}
+
+// ==================== LRU: stack distances ====================
+
+class FenwickTree {
+public:
+    explicit FenwickTree(size_t size) : tree_(size + 1, 0) {}
+
+    void Add(size_t position, int delta) {
+        for (size_t i = position + 1; i < tree_.size(); i += i & (~i + 1)) {
+            tree_[i] += delta;
+        }
+    }
+
+    // Sum over positions [0, end)
+    int64_t Prefix(size_t end) const {
+        int64_t sum = 0;
+        for (size_t i = end; i > 0; i -= i & (~i + 1)) {
+            sum += tree_[i];
+        }
+        return sum;
+    }
+
+private:
+    std::vector<int64_t> tree_;
+};
+
+// histogram[d]: fetches whose LRU stack distance is d, i.e. that hit in any
+// LRU pool of at least d frames. Cold fetches miss at every size.
+struct LruProfile {
+    std::vector<uint64_t> histogram;
+    uint64_t cold_misses = 0;
+
+    uint64_t Misses(size_t frames) const {
+        uint64_t misses = cold_misses;
+        for (size_t d = frames + 1; d < histogram.size(); ++d) {
+            misses += histogram[d];
+        }
+        return misses;
+    }
+};
+
+LruProfile ProfileLru(const std::vector<Reference> &references) {
+    LruProfile profile;
+    profile.histogram.assign(2, 0);
+    // A mark at each page's latest reference: the marks after a page's last
+    // position count the distinct pages touched since, which is its depth in
+    // the LRU stack
+    FenwickTree marks(references.size());
+    std::unordered_map<int, size_t> last_position;
+    for (size_t i = 0; i < references.size(); ++i) {
+        const Reference &ref = references[i];
+        auto it = last_position.find(ref.page_id);
+        if (ref.event == TraceEvent::DELETE) {
+            if (it != last_position.end()) {
+                marks.Add(it->second, -1);
+                last_position.erase(it);
+            }
+            continue;
+        }
+        if (it != last_position.end()) {
+            if (ref.event == TraceEvent::FETCH) {
+                size_t distance = static_cast<size_t>(marks.Prefix(i) - marks.Prefix(it->second + 1)) + 1;
+                if (distance >= profile.histogram.size()) {
+                    profile.histogram.resize(distance + 1, 0);
+                }
+                profile.histogram[distance]++;
+            }
+            marks.Add(it->second, -1);
+        } else if (ref.event == TraceEvent::FETCH) {
+            profile.cold_misses++;
+        }
+        marks.Add(i, 1);
+        last_position[ref.page_id] = i;
+    }
+    return profile;
+}
+
+// ==================== Simulated policies ====================
+
+class Cache {
+public:
+    virtual ~Cache() = default;
+    // Reference the page at trace position `position`; returns true on a hit.
+    // A missing page is brought in, evicting another one when full.
+    virtual bool Access(int page_id, size_t position) = 0;
+    virtual void Erase(int page_id) = 0;
+};
+
+class FifoCache : public Cache {
+public:
+    explicit FifoCache(size_t capacity) : capacity_(capacity) {}
+
+    bool Access(int page_id, size_t) override {
+        if (where_.count(page_id)) {
+            return true;
+        }
+        if (where_.size() == capacity_) {
+            where_.erase(queue_.front());
+            queue_.pop_front();
+        }
+        queue_.push_back(page_id);
+        where_[page_id] = std::prev(queue_.end());
+        return false;
+    }
+
+    void Erase(int page_id) override {
+        auto it = where_.find(page_id);
+        if (it != where_.end()) {
+            queue_.erase(it->second);
+            where_.erase(it);
+        }
+    }
+
+private:
+    size_t capacity_;
+    std::list<int> queue_;
+    std::unordered_map<int, std::list<int>::iterator> where_;
+};
+
+// Second chance: a hit sets the frame's reference bit, and the hand clears
+// bits until it finds an unreferenced victim
+class ClockCache : public Cache {
+public:
+    explicit ClockCache(size_t capacity) : frames_(capacity, -1), referenced_(capacity, false), hand_(0) {
+        for (size_t i = capacity; i > 0; --i) {
+            free_.push_back(i - 1);
+        }
+    }
+
+    bool Access(int page_id, size_t) override {
+        auto it = where_.find(page_id);
+        if (it != where_.end()) {
+            referenced_[it->second] = true;
+            return true;
+        }
+        size_t frame;
+        if (!free_.empty()) {
+            frame = free_.back();
+            free_.pop_back();
+        } else {
+            while (referenced_[hand_]) {
+                referenced_[hand_] = false;
+                hand_ = (hand_ + 1) % frames_.size();
+            }
+            frame = hand_;
+            hand_ = (hand_ + 1) % frames_.size();
+            where_.erase(frames_[frame]);
+        }
+        frames_[frame] = page_id;
+        referenced_[frame] = false;
+        where_[page_id] = frame;
+        return false;
+    }
+
+    void Erase(int page_id) override {
+        auto it = where_.find(page_id);
+        if (it != where_.end()) {
+            frames_[it->second] = -1;
+            referenced_[it->second] = false;
+            free_.push_back(it->second);
+            where_.erase(it);
+        }
+    }
+
+private:
+    std::vector<int> frames_;
+    std::vector<bool> referenced_;
+    std::vector<size_t> free_;
+    std::unordered_map<int, size_t> where_;
+    size_t hand_;
+};
+
+// Belady: evict the page whose next reference is furthest in the future
+class OptimalCache : public Cache {
+public:
+    OptimalCache(size_t capacity, const std::vector<size_t> *next_use) : capacity_(capacity), next_use_(next_use) {}
+
+    bool Access(int page_id, size_t position) override {
+        size_t next = (*next_use_)[position];
+        auto it = resident_.find(page_id);
+        if (it != resident_.end()) {
+            by_next_use_.erase({it->second, page_id});
+            by_next_use_.insert({next, page_id});
+            it->second = next;
+            return true;
+        }
+        if (resident_.size() == capacity_) {
+            auto victim = std::prev(by_next_use_.end());
+            resident_.erase(victim->second);
+            by_next_use_.erase(victim);
+        }
+        by_next_use_.insert({next, page_id});
+        resident_[page_id] = next;
+        return false;
+    }
+
+    void Erase(int page_id) override {
+        auto it = resident_.find(page_id);
+        if (it != resident_.end()) {
+            by_next_use_.erase({it->second, page_id});
+            resident_.erase(it);
+        }
+    }
+
+private:
+    size_t capacity_;
+    const std::vector<size_t> *next_use_;
+    std::set<std::pair<size_t, int>> by_next_use_;
+    std::unordered_map<int, size_t> resident_;
+};
+
+// Position of each reference's next use of the same page; a delete ends the
+// page's lifetime, so a later reuse of its id does not count
+std::vector<size_t> ComputeNextUse(const std::vector<Reference> &references) {
+    constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+    std::vector<size_t> next_use(references.size(), NEVER);
+    std::unordered_map<int, size_t> upcoming;
+    for (size_t i = references.size(); i-- > 0;) {
+        const Reference &ref = references[i];
+        if (ref.event == TraceEvent::DELETE) {
+            upcoming[ref.page_id] = NEVER;
+            continue;
+        }
+        auto it = upcoming.find(ref.page_id);
+        next_use[i] = it == upcoming.end() ? NEVER : it->second;
+        upcoming[ref.page_id] = i;
+    }
+    return next_use;
+}
+
+uint64_t SimulateMisses(Cache *cache, const std::vector<Reference> &references) {
+    uint64_t misses = 0;
+    for (size_t i = 0; i < references.size(); ++i) {
+        const Reference &ref = references[i];
+        if (ref.event == TraceEvent::DELETE) {
+            cache->Erase(ref.page_id);
+        } else if (!cache->Access(ref.page_id, i) && ref.event == TraceEvent::FETCH) {
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// ==================== Driver ====================
+
+std::vector<size_t> ParseSizes(const std::string &list) {
+    std::vector<size_t> sizes;
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ',');) {
+        size_t size = std::stoul(item);
+        if (size == 0) {
+            throw std::invalid_argument("pool size must be positive");
+        }
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+// Powers of two up to the working set, plus the size the trace was taken at
+std::vector<size_t> DefaultSizes(const TraceSummary &summary) {
+    std::vector<size_t> sizes;
+    for (size_t size = 8; size < summary.distinct_pages * 2; size *= 2) {
+        sizes.push_back(size);
+    }
+    if (summary.pool_size > 0) {
+        sizes.push_back(summary.pool_size);
+    }
+    return sizes;
+}
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " TRACE [options]\n"
+              << "  --sizes N,N,...        pool sizes in frames (default: powers of two up to the working set)\n"
+              << "  --policies P,P,...     lru, fifo, clock, opt (default: all)\n"
+              << "  --target PCT           report the smallest LRU pool missing at most PCT% (default 1)\n"
+              << "  --csv                  print the curves as CSV\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string trace_path;
+    std::string size_list;
+    std::vector<std::string> policies = {"lru", "fifo", "clock", "opt"};
+    double target = 1.0;
+    bool csv = false;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--csv") {
+                csv = true;
+            } else if (i + 1 < argc && arg == "--sizes") {
+                size_list = argv[++i];
+            } else if (i + 1 < argc && arg == "--policies") {
+                policies.clear();
+                std::istringstream in(argv[++i]);
+                for (std::string policy; std::getline(in, policy, ',');) {
+                    if (policy != "lru" && policy != "fifo" && policy != "clock" && policy != "opt") {
+                        throw std::invalid_argument("unknown policy " + policy);
+                    }
+                    policies.push_back(policy);
+                }
+            } else if (i + 1 < argc && arg == "--target") {
+                target = std::stod(argv[++i]);
+            } else if (arg[0] != '-' && trace_path.empty()) {
+                trace_path = arg;
+            } else {
+                throw std::invalid_argument("bad argument " + arg);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (trace_path.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    TraceSummary summary;
+    std::vector<Reference> references;
+    std::vector<size_t> sizes;
+    try {
+        references = LoadTrace(trace_path, &summary);
+        sizes = size_list.empty() ? DefaultSizes(summary) : ParseSizes(size_list);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+    uint64_t fetches = summary.Fetches();
+    LruProfile lru = ProfileLru(references);
+    std::vector<size_t> next_use;
+    if (std::find(policies.begin(), policies.end(), "opt") != policies.end()) {
+        next_use = ComputeNextUse(references);
+    }
+
+    // misses[policy][size]
+    std::vector<std::vector<uint64_t>> misses(policies.size());
+    for (size_t p = 0; p < policies.size(); ++p) {
+        for (size_t size : sizes) {
+            std::unique_ptr<Cache> cache;
+            if (policies[p] == "lru") {
+                misses[p].push_back(lru.Misses(size));
+                continue;
+            } else if (policies[p] == "fifo") {
+                cache = std::make_unique<FifoCache>(size);
+            } else if (policies[p] == "clock") {
+                cache = std::make_unique<ClockCache>(size);
+            } else {
+                cache = std::make_unique<OptimalCache>(size, &next_use);
+            }
+            misses[p].push_back(SimulateMisses(cache.get(), references));
+        }
+    }
+    auto ratio = [&](uint64_t count) { return fetches ? 100.0 * count / fetches : 0.0; };
+
+    if (csv) {
+        std::cout << "frames";
+        for (const std::string &policy : policies) {
+            std::cout << "," << policy;
+        }
+        std::cout << "\n";
+        for (size_t s = 0; s < sizes.size(); ++s) {
+            std::cout << sizes[s];
+            for (size_t p = 0; p < policies.size(); ++p) {
+                std::cout << "," << std::fixed << std::setprecision(6) << ratio(misses[p][s]) / 100.0;
+            }
+            std::cout << "\n";
+        }
+        return 0;
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "=== Page trace: " << trace_path << " ===" << std::endl;
+    std::cout << "  Events: " << fetches << " fetches, " << summary.events[static_cast<int>(TraceEvent::NEW)]
+              << " new, " << summary.events[static_cast<int>(TraceEvent::UNPIN)] << " unpins, "
+              << summary.events[static_cast<int>(TraceEvent::DELETE)] << " deletes; " << summary.distinct_pages
+              << " distinct pages" << std::endl;
+    std::cout << "  Traced pool: " << summary.pool_size << " frames, observed miss ratio "
+              << ratio(fetches - summary.observed_hits) << "%" << std::endl;
+    std::cout << "  Fetches by operation:";
+    for (size_t op = 0; op <= NUM_OPERATIONS; ++op) {
+        if (summary.fetches_by_operation[op]) {
+            std::cout << " " << (op < NUM_OPERATIONS ? OperationName(static_cast<Operation>(op)) : "other") << "="
+                      << summary.fetches_by_operation[op];
+        }
+    }
+    std::cout << std::endl;
+
+    std::cout << "\n=== Miss ratio (%) ===" << std::endl;
+    std::cout << "  " << std::setw(8) << "frames";
+    for (const std::string &policy : policies) {
+        std::cout << std::setw(9) << policy;
+    }
+    std::cout << std::endl;
+    for (size_t s = 0; s < sizes.size(); ++s) {
+        std::cout << "  " << std::setw(8) << sizes[s];
+        for (size_t p = 0; p < policies.size(); ++p) {
+            std::cout << std::setw(9) << ratio(misses[p][s]);
+        }
+        std::cout << (sizes[s] == summary.pool_size ? "  <- traced" : "") << std::endl;
+    }
+
+    // Smallest LRU pool within the target, straight from the stack distances
+    size_t needed = 0;
+    uint64_t allowed = static_cast<uint64_t>(target / 100.0 * fetches);
+    if (lru.cold_misses <= allowed) {
+        uint64_t misses_above = fetches - lru.cold_misses;
+        while (needed + 1 < lru.histogram.size() && lru.cold_misses + misses_above > allowed) {
+            ++needed;
+            misses_above -= lru.histogram[needed];
+        }
+        needed = std::max<size_t>(needed, 1);
+    }
+    if (needed) {
+        std::cout << "\n  LRU pool for <= " << target << "% misses: " << needed << " frames" << std::endl;
+    } else {
+        std::cout << "\n  LRU cannot reach " << target << "% misses: cold misses alone are "
+                  << ratio(lru.cold_misses) << "%" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t CRC32C_POLY = 0x82F63B78;  // Reflected Castagnoli polynomial
+
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+uint32_t Crc32cSoftware(uint32_t crc, const uint8_t *data, size_t length) {
+    static const Crc32cTable table;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t Crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+    // Byte steps up to an 8-byte boundary, then 8 bytes per instruction
+    while (length > 0 && reinterpret_cast<uintptr_t>(data) % sizeof(uint64_t) != 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        length--;
+    }
+    uint64_t crc64 = crc;
+    while (length >= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += sizeof(word);
+        length -= sizeof(word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (length > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        length--;
+    }
+    return crc;
+}
+#endif
+
+using Crc32cFunction = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+
+Crc32cFunction SelectCrc32c() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return Crc32cHardware;
+    }
+#endif
+    return Crc32cSoftware;
+}
+
+}  // namespace
+
+uint32_t Crc32c(const void *data, size_t length, uint32_t crc) {
+    static const Crc32cFunction implementation = SelectCrc32c();
+    return ~implementation(~crc, static_cast<const uint8_t *>(data), length);
+}
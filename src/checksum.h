@@ -0,0 +1,12 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU has it
+// (checked once at runtime) and a byte-wise table otherwise. Pass a previous
+// result as `crc` to extend a checksum over several buffers.
+uint32_t Crc32c(const void *data, size_t length, uint32_t crc = 0);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,170 @@
+#include "compression.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_BITS = 12;
+
+inline uint32_t Load32(const unsigned char *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Extended lengths: a nibble of 15 is followed by bytes of 255 and a final remainder
+bool WriteLength(size_t length, unsigned char *&out, const unsigned char *out_end) {
+    while (length >= 255) {
+        if (out >= out_end) return false;
+        *out++ = 255;
+        length -= 255;
+    }
+    if (out >= out_end) return false;
+    *out++ = static_cast<unsigned char>(length);
+    return true;
+}
+
+bool ReadLength(size_t &length, const unsigned char *&in, const unsigned char *in_end) {
+    unsigned char byte;
+    do {
+        if (in >= in_end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool EmitSequence(const unsigned char *literals, size_t literal_length, size_t match_length, size_t offset,
+                  unsigned char *&out, const unsigned char *out_end) {
+    if (out >= out_end) return false;
+    unsigned char *token = out++;
+    size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+    *token = static_cast<unsigned char>(((literal_length < 15 ? literal_length : 15) << 4) |
+                                        (match_code < 15 ? match_code : 15));
+
+    if (literal_length >= 15 && !WriteLength(literal_length - 15, out, out_end)) return false;
+    if (static_cast<size_t>(out_end - out) < literal_length) return false;
+    std::memcpy(out, literals, literal_length);
+    out += literal_length;
+
+    if (match_length == 0) {
+        return true;  // Final literal-only sequence
+    }
+    if (out_end - out < 2) return false;
+    *out++ = static_cast<unsigned char>(offset & 0xff);
+    *out++ = static_cast<unsigned char>(offset >> 8);
+    if (match_code >= 15 && !WriteLength(match_code - 15, out, out_end)) return false;
+    return true;
+}
+
+size_t LzCompress(const char *input, size_t input_size, char *output, size_t capacity) {
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(input);
+    const unsigned char *in_end = in + input_size;
+    unsigned char *out = reinterpret_cast<unsigned char *>(output);
+    const unsigned char *out_end = out + capacity;
+
+    int table[1 << HASH_BITS];
+    std::memset(table, -1, sizeof(table));
+
+    const unsigned char *anchor = in;
+    const unsigned char *p = in;
+    while (in_end - p >= static_cast<ptrdiff_t>(MIN_MATCH)) {
+        uint32_t sequence = Load32(p);
+        uint32_t h = Hash(sequence);
+        int candidate = table[h];
+        table[h] = static_cast<int>(p - in);
+
+        if (candidate < 0 || static_cast<size_t>(p - in - candidate) > MAX_OFFSET ||
+            Load32(in + candidate) != sequence) {
+            ++p;
+            continue;
+        }
+
+        // Extend the match as far as it goes
+        const unsigned char *match = in + candidate;
+        size_t length = MIN_MATCH;
+        while (p + length < in_end && p[length] == match[length]) {
+            ++length;
+        }
+
+        if (!EmitSequence(anchor, p - anchor, length, p - match, out, out_end)) return 0;
+        p += length;
+        anchor = p;
+    }
+
+    if (!EmitSequence(anchor, in_end - anchor, 0, 0, out, out_end)) return 0;
+    return out - reinterpret_cast<unsigned char *>(output);
+}
+
+bool LzDecompress(const char *input, size_t input_size, char *output, size_t output_size) {
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(input);
+    const unsigned char *in_end = in + input_size;
+    unsigned char *out = reinterpret_cast<unsigned char *>(output);
+    unsigned char *out_begin = out;
+    unsigned char *out_end = out + output_size;
+
+    while (in < in_end) {
+        unsigned char token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(literal_length, in, in_end)) return false;
+        if (static_cast<size_t>(in_end - in) < literal_length ||
+            static_cast<size_t>(out_end - out) < literal_length) {
+            return false;
+        }
+        std::memcpy(out, in, literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        if (in == in_end) {
+            break;  // Final literal-only sequence
+        }
+
+        if (in_end - in < 2) return false;
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t match_length = token & 0x0f;
+        if (match_length == 15 && !ReadLength(match_length, in, in_end)) return false;
+        match_length += MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(out - out_begin) ||
+            static_cast<size_t>(out_end - out) < match_length) {
+            return false;
+        }
+        // Byte-wise copy: overlapping matches encode runs
+        const unsigned char *match = out - offset;
+        for (size_t i = 0; i < match_length; ++i) {
+            out[i] = match[i];
+        }
+        out += match_length;
+    }
+    return out == out_end;
+}
+
+}  // namespace
+
+size_t CompressBlock(PageCodec codec, const char *input, size_t input_size, char *output, size_t capacity) {
+    switch (codec) {
+    case PageCodec::LZ:
+        return LzCompress(input, input_size, output, capacity);
+    case PageCodec::NONE:
+    default:
+        return 0;
+    }
+}
+
+bool DecompressBlock(PageCodec codec, const char *input, size_t input_size, char *output, size_t output_size) {
+    switch (codec) {
+    case PageCodec::LZ:
+        return LzDecompress(input, input_size, output, output_size);
+    case PageCodec::NONE:
+    default:
+        return false;
+    }
+}
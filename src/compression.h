@@ -0,0 +1,22 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-page codecs. LZ is a self-contained LZ77 byte codec in the style of
+// the LZ4 block format (token, literals, 16-bit offset, extended lengths);
+// it needs no external library and is fast enough to sit in the I/O path.
+enum class PageCodec : uint8_t {
+    NONE = 0,
+    LZ = 1
+};
+
+// Compress `input` into `output`; returns the compressed size, or 0 if the
+// result would not fit in `capacity` (the caller then stores it raw)
+size_t CompressBlock(PageCodec codec, const char *input, size_t input_size, char *output, size_t capacity);
+
+// Decompress exactly `output_size` bytes; returns false on corrupt input
+bool DecompressBlock(PageCodec codec, const char *input, size_t input_size, char *output, size_t output_size);
+
+#endif // COMPRESSION_H
@@ -1,12 +1,20 @@
 #include "disk_manager.h"
+#include "checksum.h"
+#include "metrics.h"
+#include "probes.h"
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
+#include <iterator>
 #include <stdexcept>
 #include <sys/stat.h>
 
-DiskManager::DiskManager(const std::string &db_file) : db_file_(db_file), num_pages_(0) {
+DiskManager::DiskManager(const std::string &db_file, bool copy_on_write)
+    : db_file_(db_file), num_pages_(0), copy_on_write_(copy_on_write), generation_(0),
+      active_slot_(0), num_slots_(0), checksum_verify_(ChecksumVerify::ALWAYS) {
     fd_ = open(db_file.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
     if (fd_ < 0) {
         throw std::runtime_error("Failed to open database file: " + db_file);
@@ -14,6 +22,16 @@ DiskManager::DiskManager(const std::string &db_file) : db_file_(db_file), num_pa
 
     struct stat file_stat;
     if (fstat(fd_, &file_stat) == 0) {
+        if (copy_on_write_ && file_stat.st_size > static_cast<off_t>(MAX_SLOTS) * static_cast<off_t>(SLOT_SIZE)) {
+            close(fd_);
+            throw std::runtime_error("Copy-on-write file " + db_file + " is larger than its locations can address");
+        }
+        num_slots_ = static_cast<int>((file_stat.st_size + SLOT_SIZE - 1) / SLOT_SIZE);
+    }
+
+    if (copy_on_write_) {
+        OpenShadow();
+    } else {
         num_pages_ = static_cast<int>(file_stat.st_size / PAGE_SIZE);
     }
 }
@@ -25,31 +43,141 @@ DiskManager::~DiskManager() {
 }
 
 void DiskManager::ReadPage(int page_id, char *page_data) {
-    off_t offset = static_cast<off_t>(page_id) * PAGE_SIZE;
-    if (lseek(fd_, offset, SEEK_SET) < 0) {
-        throw std::runtime_error("Failed to seek to page " + std::to_string(page_id));
+    if (!copy_on_write_) {
+        ReadSlots(page_id * SLOTS_PER_PAGE, SLOTS_PER_PAGE, page_data);
+        VerifyPage(page_id, page_data);
+        return;
     }
 
-    ssize_t bytes_read = read(fd_, page_data, PAGE_SIZE);
-    if (bytes_read < 0) {
-        throw std::runtime_error("Failed to read page " + std::to_string(page_id));
+    // Pages allocated but never written read back as zeros, like a short read
+    if (page_id < 0 || page_id >= static_cast<int>(page_map_.size()) || page_map_[page_id] < 0) {
+        std::memset(page_data, 0, PAGE_SIZE);
+        return;
     }
+    ReadLocation(page_map_[page_id], page_data);
+    VerifyPage(page_id, page_data);
+}
+
+bool DiskManager::ReadPageConcurrent(int page_id, char *page_data) const {
+    try {
+        if (!copy_on_write_) {
+            ReadSlots(page_id * SLOTS_PER_PAGE, SLOTS_PER_PAGE, page_data);
+        } else if (page_id < 0 || page_id >= static_cast<int>(page_map_.size()) || page_map_[page_id] < 0) {
+            std::memset(page_data, 0, PAGE_SIZE);
+            return true;
+        } else {
+            ReadLocation(page_map_[page_id], page_data);
+        }
+    } catch (const std::runtime_error &) {
+        return false;  // Unreadable or undecodable image
+    }
+    uint32_t stored = reinterpret_cast<const PageHeader *>(page_data)->checksum;
+    return stored == PageChecksum(page_data) ||
+           (stored == 0 && std::all_of(page_data, page_data + PAGE_SIZE, [](char c) { return c == 0; }));
+}
+
+void DiskManager::PlanRead(int page_id, off_t *offset, size_t *length) const {
+    int slot = GetPhysicalSlot(page_id);
+    if (!copy_on_write_) {
+        // Pages past the end read as zeros, like a short pread
+        *offset = static_cast<off_t>(page_id) * PAGE_SIZE;
+        *length = PAGE_SIZE;
+    } else if (slot < 0) {
+        *offset = 0;
+        *length = 0;
+    } else {
+        *offset = static_cast<off_t>(slot) * SLOT_SIZE;
+        *length = static_cast<size_t>(LocationCount(page_map_[page_id])) * SLOT_SIZE;
+    }
+}
+
+void DiskManager::FinishRead(int page_id, const char *image, size_t bytes_read, char *page_data) {
+    off_t offset;
+    size_t length;
+    PlanRead(page_id, &offset, &length);
+    CountMetric(Counter::DISK_BYTES_READ, bytes_read);
+    if (length == 0) {
+        std::memset(page_data, 0, PAGE_SIZE);
+        return;
+    }
+    if (length == PAGE_SIZE) {
+        if (image != page_data) {
+            std::memcpy(page_data, image, bytes_read);
+        }
+        std::memset(page_data + bytes_read, 0, PAGE_SIZE - bytes_read);  // Past end of file
+    } else {
+        if (bytes_read < length) {
+            throw std::runtime_error("Short read of compressed page " + std::to_string(page_id));
+        }
+        DecodeImage(page_map_[page_id], image, page_data);
+    }
+    VerifyPage(page_id, page_data);
+}
 
-    if (bytes_read < static_cast<ssize_t>(PAGE_SIZE)) {
-        std::memset(page_data + bytes_read, 0, PAGE_SIZE - bytes_read);
+int DiskManager::GetPhysicalSlot(int page_id) const {
+    if (!copy_on_write_) {
+        return page_id >= 0 && page_id < num_pages_ ? page_id * SLOTS_PER_PAGE : -1;
     }
+    if (page_id < 0 || page_id >= static_cast<int>(page_map_.size()) || page_map_[page_id] < 0) {
+        return -1;
+    }
+    return LocationSlot(page_map_[page_id]);
 }
 
 void DiskManager::WritePage(int page_id, const char *page_data) {
-    off_t offset = static_cast<off_t>(page_id) * PAGE_SIZE;
-    if (lseek(fd_, offset, SEEK_SET) < 0) {
-        throw std::runtime_error("Failed to seek to page " + std::to_string(page_id));
+    // Stamp the checksum on a copy so the caller's frame is left untouched
+    alignas(8) char page[PAGE_SIZE];
+    std::memcpy(page, page_data, PAGE_SIZE);
+    reinterpret_cast<PageHeader *>(page)->checksum = PageChecksum(page);
+    MarkVerified(page_id);
+
+    if (!copy_on_write_) {
+        WriteSlots(page_id * SLOTS_PER_PAGE, SLOTS_PER_PAGE, page);
+        return;
+    }
+
+    // Build the on-disk image: compressed if the page asks for a codec and
+    // that saves at least one slot, otherwise the raw page
+    const char *image = page;
+    int count = SLOTS_PER_PAGE;
+    char compressed[PAGE_SIZE];
+    PageCodec codec = static_cast<PageCodec>(reinterpret_cast<const PageHeader *>(page)->codec);
+    if (codec != PageCodec::NONE) {
+        size_t capacity = PAGE_SIZE - SLOT_SIZE - sizeof(SlotHeader);
+        size_t length = CompressBlock(codec, page, PAGE_SIZE, compressed + sizeof(SlotHeader), capacity);
+        if (length > 0) {
+            SlotHeader *header = reinterpret_cast<SlotHeader *>(compressed);
+            header->codec = static_cast<uint8_t>(codec);
+            header->reserved = 0;
+            header->length = static_cast<uint16_t>(length);
+            size_t used = sizeof(SlotHeader) + length;
+            count = static_cast<int>((used + SLOT_SIZE - 1) / SLOT_SIZE);
+            std::memset(compressed + used, 0, count * SLOT_SIZE - used);
+            image = compressed;
+        }
     }
 
-    ssize_t bytes_written = write(fd_, page_data, PAGE_SIZE);
-    if (bytes_written != static_cast<ssize_t>(PAGE_SIZE)) {
-        throw std::runtime_error("Failed to write page " + std::to_string(page_id));
+    if (page_id >= static_cast<int>(page_map_.size())) {
+        page_map_.resize(page_id + 1, -1);
     }
+
+    int current = page_map_[page_id];
+    if (current >= 0 && uncommitted_.count(current)) {
+        // Already shadowed since the last checkpoint: nobody else can see it
+        if (LocationCount(current) == count) {
+            WriteSlots(LocationSlot(current), count, image);
+            return;
+        }
+        uncommitted_.erase(current);
+        FreeSlots(current);
+    } else if (current >= 0) {
+        pending_free_.push_back(current);
+    }
+
+    int location = AllocateSlots(count);
+    WriteSlots(LocationSlot(location), count, image);
+    uncommitted_.insert(location);
+    page_map_[page_id] = location;
 }
 
 int DiskManager::AllocatePage() {
@@ -59,3 +187,333 @@ int DiskManager::AllocatePage() {
 int DiskManager::GetNumPages() const {
     return num_pages_;
 }
+
+void DiskManager::Checkpoint() {
+    if (!copy_on_write_) {
+        Sync();
+        return;
+    }
+
+    // Nothing written since the last checkpoint
+    if (uncommitted_.empty() && pending_free_.empty()) {
+        return;
+    }
+
+    // 1. Write the page map to fresh pages; the committed map stays intact
+    page_map_.resize(num_pages_, -1);
+    size_t num_map_pages = (page_map_.size() + PAGE_MAP_ENTRIES - 1) / PAGE_MAP_ENTRIES;
+    std::vector<int> new_map_pages;
+    for (size_t i = 0; i < num_map_pages; ++i) {
+        new_map_pages.push_back(AllocateSlots(SLOTS_PER_PAGE));
+    }
+
+    char buffer[PAGE_SIZE];
+    for (size_t i = 0; i < num_map_pages; ++i) {
+        std::memset(buffer, 0, PAGE_SIZE);
+        PageMapHeader *header = reinterpret_cast<PageMapHeader *>(buffer);
+        int *entries = reinterpret_cast<int *>(buffer + sizeof(PageMapHeader));
+
+        size_t first = i * PAGE_MAP_ENTRIES;
+        size_t count = std::min(PAGE_MAP_ENTRIES, page_map_.size() - first);
+        header->next_page = (i + 1 < num_map_pages) ? new_map_pages[i + 1] : -1;
+        header->count = static_cast<int>(count);
+        std::copy(page_map_.begin() + first, page_map_.begin() + first + count, entries);
+        WriteSlots(LocationSlot(new_map_pages[i]), SLOTS_PER_PAGE, buffer);
+    }
+
+    // 2. Data and map must be durable before the meta slot points at them
+    Sync();
+
+    // 3. Publish: flip to the other meta slot
+    std::vector<int> old_map_pages = std::move(map_pages_);
+    map_pages_ = std::move(new_map_pages);
+    generation_++;
+    active_slot_ = (active_slot_ + 1) % NUM_META_SLOTS;
+    WriteMetaSlot(active_slot_);
+    Sync();
+
+    // 4. Space only the previous version referenced can now be recycled
+    for (int location : old_map_pages) {
+        FreeSlots(location);
+    }
+    for (int location : pending_free_) {
+        FreeSlots(location);
+    }
+    pending_free_.clear();
+    uncommitted_.clear();
+}
+
+// ==================== Physical I/O ====================
+
+int DiskManager::GetNumPhysicalPages() const {
+    return (num_slots_ + SLOTS_PER_PAGE - 1) / SLOTS_PER_PAGE;
+}
+
+void DiskManager::ReadPhysicalPages(int first_physical_id, int count, char *buffer) {
+    ReadSlots(first_physical_id * SLOTS_PER_PAGE, count * SLOTS_PER_PAGE, buffer);
+}
+
+void DiskManager::ReadSlots(int first_slot, int count, char *data) const {
+    size_t length = static_cast<size_t>(count) * SLOT_SIZE;
+    off_t offset = static_cast<off_t>(first_slot) * SLOT_SIZE;
+    size_t done = 0;
+    BPTREE_PROBE2(io__read__start, offset, length);
+    while (done < length) {
+        ssize_t bytes_read = pread(fd_, data + done, length - done, offset + done);
+        if (bytes_read < 0) {
+            throw std::runtime_error("Failed to read slot " + std::to_string(first_slot));
+        }
+        if (bytes_read == 0) {
+            std::memset(data + done, 0, length - done);  // Past end of file
+            break;
+        }
+        done += bytes_read;
+    }
+    BPTREE_PROBE2(io__read__done, offset, done);
+    CountMetric(Counter::DISK_BYTES_READ, done);
+}
+
+void DiskManager::WriteSlots(int first_slot, int count, const char *data) {
+    size_t length = static_cast<size_t>(count) * SLOT_SIZE;
+    off_t offset = static_cast<off_t>(first_slot) * SLOT_SIZE;
+    if (overwrite_hook_) {
+        overwrite_hook_(offset, length);
+    }
+
+    BPTREE_PROBE2(io__write__start, offset, length);
+    ssize_t bytes_written = pwrite(fd_, data, length, offset);
+    BPTREE_PROBE2(io__write__done, offset, bytes_written);
+    if (bytes_written != static_cast<ssize_t>(length)) {
+        throw std::runtime_error("Failed to write slot " + std::to_string(first_slot));
+    }
+    CountMetric(Counter::DISK_BYTES_WRITTEN, length);
+    num_slots_ = std::max(num_slots_, first_slot + count);
+}
+
+void DiskManager::Sync() {
+    BPTREE_PROBE0(io__sync__start);
+    if (fsync(fd_) != 0) {
+        throw std::runtime_error("Failed to sync database file: " + db_file_);
+    }
+    BPTREE_PROBE0(io__sync__done);
+    CountMetric(Counter::DISK_SYNCS);
+}
+
+// ==================== Shadow Paging ====================
+
+void DiskManager::OpenShadow() {
+    if (num_slots_ == 0) {
+        // Fresh file: publish an empty generation so the file is recognizable
+        num_slots_ = NUM_META_SLOTS * SLOTS_PER_PAGE;
+        active_slot_ = NUM_META_SLOTS - 1;
+        WriteMetaSlot(active_slot_);
+        Sync();
+        return;
+    }
+
+    // The newest valid slot wins; a torn meta write leaves the other intact
+    ShadowMeta meta{};
+    ShadowMeta candidate{};
+    bool found = false;
+    for (int slot = 0; slot < NUM_META_SLOTS; ++slot) {
+        if (ReadMetaSlot(slot, &candidate) && (!found || candidate.generation > meta.generation)) {
+            meta = candidate;
+            active_slot_ = slot;
+            found = true;
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("Not a copy-on-write database file: " + db_file_);
+    }
+
+    generation_ = meta.generation;
+    num_pages_ = meta.num_pages;
+    page_map_.assign(num_pages_, -1);
+
+    // Load the page map chain
+    char buffer[PAGE_SIZE];
+    size_t next_entry = 0;
+    for (int map_page = meta.map_head; map_page >= 0;) {
+        ReadSlots(LocationSlot(map_page), SLOTS_PER_PAGE, buffer);
+        map_pages_.push_back(map_page);
+        PageMapHeader *header = reinterpret_cast<PageMapHeader *>(buffer);
+        int *entries = reinterpret_cast<int *>(buffer + sizeof(PageMapHeader));
+        for (int i = 0; i < header->count && next_entry < page_map_.size(); ++i) {
+            page_map_[next_entry++] = entries[i];
+        }
+        map_page = header->next_page;
+    }
+
+    // Everything the checkpoint does not reference is free space
+    std::vector<bool> in_use(num_slots_, false);
+    auto mark = [&](int location) {
+        for (int i = 0; i < LocationCount(location); ++i) {
+            if (LocationSlot(location) + i < num_slots_) {
+                in_use[LocationSlot(location) + i] = true;
+            }
+        }
+    };
+    std::fill(in_use.begin(), in_use.begin() + NUM_META_SLOTS * SLOTS_PER_PAGE, true);
+    for (int location : page_map_) {
+        if (location >= 0) {
+            mark(location);
+        }
+    }
+    for (int location : map_pages_) {
+        mark(location);
+    }
+
+    // Hand free runs to the allocator
+    for (int slot = 0; slot < num_slots_;) {
+        if (in_use[slot]) {
+            ++slot;
+            continue;
+        }
+        int count = 0;
+        while (slot + count < num_slots_ && !in_use[slot + count]) {
+            ++count;
+        }
+        FreeRun(slot, count);
+        slot += count;
+    }
+}
+
+bool DiskManager::ReadMetaSlot(int slot, ShadowMeta *meta) {
+    char buffer[PAGE_SIZE];
+    ReadSlots(slot * SLOTS_PER_PAGE, SLOTS_PER_PAGE, buffer);
+    std::memcpy(meta, buffer, sizeof(ShadowMeta));
+    return meta->magic == SHADOW_MAGIC && meta->checksum == MetaChecksum(*meta);
+}
+
+void DiskManager::WriteMetaSlot(int slot) {
+    ShadowMeta meta{};
+    meta.magic = SHADOW_MAGIC;
+    meta.generation = generation_;
+    meta.num_pages = num_pages_;
+    meta.map_head = map_pages_.empty() ? -1 : map_pages_.front();
+    meta.checksum = MetaChecksum(meta);
+
+    char buffer[PAGE_SIZE];
+    std::memset(buffer, 0, PAGE_SIZE);
+    std::memcpy(buffer, &meta, sizeof(ShadowMeta));
+    WriteSlots(slot * SLOTS_PER_PAGE, SLOTS_PER_PAGE, buffer);
+}
+
+void DiskManager::ReadLocation(int location, char *page_data) const {
+    int count = LocationCount(location);
+    if (count == SLOTS_PER_PAGE) {
+        ReadSlots(LocationSlot(location), count, page_data);
+        return;
+    }
+
+    char image[PAGE_SIZE];
+    ReadSlots(LocationSlot(location), count, image);
+    DecodeImage(location, image, page_data);
+}
+
+void DiskManager::DecodeImage(int location, const char *image, char *page_data) const {
+    int count = LocationCount(location);
+    const SlotHeader *header = reinterpret_cast<const SlotHeader *>(image);
+    if (sizeof(SlotHeader) + header->length > count * SLOT_SIZE ||
+        !DecompressBlock(static_cast<PageCodec>(header->codec), image + sizeof(SlotHeader), header->length,
+                         page_data, PAGE_SIZE)) {
+        throw std::runtime_error("Corrupt compressed page at slot " + std::to_string(LocationSlot(location)));
+    }
+}
+
+uint32_t DiskManager::PageChecksum(const char *page_data) {
+    constexpr size_t field = offsetof(PageHeader, checksum);
+    uint32_t crc = Crc32c(page_data, field);
+    return Crc32c(page_data + field + sizeof(uint32_t), PAGE_SIZE - field - sizeof(uint32_t), crc);
+}
+
+// Compressed pages are checked after decompression, so the checksum covers
+// the codec as well as the media
+void DiskManager::VerifyPage(int page_id, const char *page_data) {
+    if (checksum_verify_ == ChecksumVerify::NEVER ||
+        (checksum_verify_ == ChecksumVerify::FIRST_READ && page_id < static_cast<int>(verified_.size()) &&
+         verified_[page_id])) {
+        return;
+    }
+    uint32_t stored = reinterpret_cast<const PageHeader *>(page_data)->checksum;
+    if (stored != PageChecksum(page_data)) {
+        // Allocated pages that were never written read back as zeros
+        bool zero = stored == 0 && std::all_of(page_data, page_data + PAGE_SIZE, [](char c) { return c == 0; });
+        if (!zero) {
+            throw std::runtime_error("Checksum mismatch on page " + std::to_string(page_id) + " of " + db_file_);
+        }
+    }
+    MarkVerified(page_id);
+}
+
+void DiskManager::MarkVerified(int page_id) {
+    if (checksum_verify_ != ChecksumVerify::FIRST_READ) {
+        return;
+    }
+    if (page_id >= static_cast<int>(verified_.size())) {
+        verified_.resize(page_id + 1, false);
+    }
+    verified_[page_id] = true;
+}
+
+int DiskManager::AllocateSlots(int count) {
+    // Best fit: the shortest free run that holds `count`, lowest first
+    auto fit = free_by_length_.lower_bound({count, 0});
+    if (fit != free_by_length_.end()) {
+        auto [length, first_slot] = *fit;
+        EraseRun(free_runs_.find(first_slot));
+        if (length > count) {
+            FreeRun(first_slot + count, length - count);
+        }
+        return EncodeLocation(first_slot, count);
+    }
+
+    // Grow the file
+    if (count > MAX_SLOTS - num_slots_) {
+        throw std::runtime_error("Copy-on-write file " + db_file_ + " is full: locations cannot address more than " +
+                                 std::to_string(static_cast<int64_t>(MAX_SLOTS) * SLOT_SIZE >> 20) + " MB");
+    }
+    int first_slot = num_slots_;
+    num_slots_ += count;
+    return EncodeLocation(first_slot, count);
+}
+
+void DiskManager::FreeSlots(int location) {
+    FreeRun(LocationSlot(location), LocationCount(location));
+}
+
+// Merges the run with free neighbours on either side, so space freed in
+// small pieces can later hold a larger page image
+void DiskManager::FreeRun(int first_slot, int count) {
+    auto next = free_runs_.lower_bound(first_slot);
+    if (next != free_runs_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == first_slot) {
+            first_slot = prev->first;
+            count += prev->second;
+            EraseRun(prev);
+        }
+    }
+    if (next != free_runs_.end() && next->first == first_slot + count) {
+        count += next->second;
+        EraseRun(next);
+    }
+    free_runs_.emplace(first_slot, count);
+    free_by_length_.emplace(count, first_slot);
+}
+
+void DiskManager::EraseRun(std::map<int, int>::iterator run) {
+    free_by_length_.erase({run->second, run->first});
+    free_runs_.erase(run);
+}
+
+uint64_t DiskManager::MetaChecksum(const ShadowMeta &meta) {
+    // FNV-1a over every field except the checksum itself
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&meta);
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < offsetof(ShadowMeta, checksum); ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -1,12 +1,57 @@
 #ifndef DISK_MANAGER_H
 #define DISK_MANAGER_H
 
+#include "compression.h"
 #include "config.h"
+#include <sys/types.h>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
+// Common header at the start of every page. The page's owner sets `codec` to
+// ask for compressed storage; the disk manager owns the remaining bytes and
+// stamps `checksum` (CRC32C of the page with this field skipped) on write.
+struct PageHeader {
+    uint8_t codec;
+    uint8_t reserved[3];
+    uint32_t checksum;
+};
+
+// When ReadPage verifies page checksums. FIRST_READ skips pages already
+// verified (or written) by this DiskManager, so hot pages that are evicted
+// and re-read pay for the check once.
+enum class ChecksumVerify {
+    ALWAYS,
+    FIRST_READ,
+    NEVER
+};
+
+// Page ids handed to callers are logical. In the default mode a logical page
+// lives at offset page_id * PAGE_SIZE and is overwritten in place.
+//
+// In copy-on-write (shadow paging) mode a page map translates logical ids to
+// physical pages. A write never touches a page that belongs to the last
+// checkpoint; it goes to a free physical page instead. Checkpoint() writes the
+// new page map and then atomically publishes it by updating one of two meta
+// slots (physical pages 0 and 1), so after a crash the file always opens at
+// the last complete checkpoint without any recovery work. A page superseded
+// since the last checkpoint is still part of it, so its space is only reused
+// after the next checkpoint. Readers go through the buffer pool as in the
+// default mode: there are no snapshot readers and no reader tracking.
+//
+// Because pages move on every write anyway, copy-on-write files allocate
+// space in SLOT_SIZE units: a page whose header asks for a codec is stored
+// compressed in the fewest slots that hold it, other pages take a full page
+// worth of slots. Pages are always uncompressed in memory.
 class DiskManager {
 public:
-    explicit DiskManager(const std::string &db_file);
+    explicit DiskManager(const std::string &db_file, bool copy_on_write = false);
     ~DiskManager();
 
     void ReadPage(int page_id, char *page_data);
@@ -15,10 +60,117 @@ public:
     int AllocatePage();
     int GetNumPages() const;
 
+    // Make every page written so far durable (and, in copy-on-write mode,
+    // publish it as the new consistent version of the file)
+    void Checkpoint();
+
+    bool IsCopyOnWrite() const { return copy_on_write_; }
+    const std::string &GetFileName() const { return db_file_; }
+
+    // Read a page without updating any state of this DiskManager, so several
+    // threads may call it at once provided nothing writes meanwhile. Always
+    // verifies the checksum and returns false on a mismatch instead of throwing.
+    bool ReadPageConcurrent(int page_id, char *page_data) const;
+    // First slot of the page's on-disk image, -1 if it was never written
+    int GetPhysicalSlot(int page_id) const;
+
+    // ReadPage in two halves for callers that do their own I/O (async_tree.h).
+    // PlanRead gives the byte range of GetFd() holding the page's image;
+    // length 0 means the page was never written and reads as zeros.
+    // FinishRead turns the `bytes_read` bytes read from there into the page,
+    // decompressing and verifying it as ReadPage would. `image` may be
+    // `page_data` itself when the length is PAGE_SIZE.
+    void PlanRead(int page_id, off_t *offset, size_t *length) const;
+    void FinishRead(int page_id, const char *image, size_t bytes_read, char *page_data);
+    int GetFd() const { return fd_; }
+
+    // ReadPage throws std::runtime_error on a checksum mismatch
+    void SetChecksumVerify(ChecksumVerify verify) { checksum_verify_ = verify; }
+
+    // Raw access below the page map, used by online backup: the hook runs
+    // right before any byte range of the file is overwritten
+    int GetNumPhysicalPages() const;
+    void ReadPhysicalPages(int first_physical_id, int count, char *buffer);
+    void SetOverwriteHook(std::function<void(off_t, size_t)> hook) { overwrite_hook_ = std::move(hook); }
+
+    static constexpr size_t SLOT_SIZE = 512;
+    static constexpr int SLOTS_PER_PAGE = static_cast<int>(PAGE_SIZE / SLOT_SIZE);
+
 private:
+    // Meta slot stored in physical page 0 or 1 (copy-on-write mode only)
+    struct ShadowMeta {
+        uint64_t magic;
+        uint64_t generation;
+        int num_pages;       // logical pages
+        int map_head;        // location of the first page of the page map chain
+        uint64_t checksum;   // over all preceding fields
+    };
+
+    // Page map pages form a chain; entries continue logical ids in order.
+    // Map entries and chain links are slot locations (see EncodeLocation)
+    struct PageMapHeader {
+        int next_page;
+        int count;
+    };
+
+    // Prefix of a compressed page image
+    struct SlotHeader {
+        uint8_t codec;
+        uint8_t reserved;
+        uint16_t length;     // compressed bytes after this header
+    };
+
+    static constexpr uint64_t SHADOW_MAGIC = 0x32534552544250ULL;  // "PBTRES2"
+    static constexpr int NUM_META_SLOTS = 2;
+    static constexpr size_t PAGE_MAP_ENTRIES = (PAGE_SIZE - sizeof(PageMapHeader)) / sizeof(int);
+
     std::string db_file_;
     int fd_;
     int num_pages_;
+
+    // Copy-on-write state
+    bool copy_on_write_;
+    uint64_t generation_;
+    int active_slot_;
+    int num_slots_;                           // file length in SLOT_SIZE units
+    std::vector<int> page_map_;               // logical page -> location, -1 if never written
+    std::vector<int> map_pages_;              // locations holding the committed map
+    // Free runs, safe to overwrite. Neighbouring runs are always merged, so a
+    // run may be longer than a page; indexed by position and by length
+    std::map<int, int> free_runs_;            // first slot -> length
+    std::set<std::pair<int, int>> free_by_length_;  // (length, first slot)
+    std::vector<int> pending_free_;           // superseded, but still part of the last checkpoint
+    std::unordered_set<int> uncommitted_;     // written since the last checkpoint
+
+    std::function<void(off_t, size_t)> overwrite_hook_;
+
+    ChecksumVerify checksum_verify_;
+    std::vector<bool> verified_;              // logical pages known good since open
+
+    void ReadSlots(int first_slot, int count, char *data) const;
+    void WriteSlots(int first_slot, int count, const char *data);
+    void Sync();
+
+    void OpenShadow();
+    bool ReadMetaSlot(int slot, ShadowMeta *meta);
+    void WriteMetaSlot(int slot);
+    void ReadLocation(int location, char *page_data) const;
+    void DecodeImage(int location, const char *image, char *page_data) const;
+    int AllocateSlots(int count);
+    void FreeSlots(int location);
+    void FreeRun(int first_slot, int count);
+    void EraseRun(std::map<int, int>::iterator run);
+    static uint64_t MetaChecksum(const ShadowMeta &meta);
+    static uint32_t PageChecksum(const char *page_data);
+    void VerifyPage(int page_id, const char *page_data);
+    void MarkVerified(int page_id);
+
+    // A location packs the first slot and the run length into one int, which
+    // caps a copy-on-write file at MAX_SLOTS slots (just under 128 GB)
+    static constexpr int MAX_SLOTS = INT_MAX / SLOTS_PER_PAGE;
+    static int EncodeLocation(int first_slot, int count) { return first_slot * SLOTS_PER_PAGE + count - 1; }
+    static int LocationSlot(int location) { return location / SLOTS_PER_PAGE; }
+    static int LocationCount(int location) { return location % SLOTS_PER_PAGE + 1; }
 };
 
 #endif // DISK_MANAGER_H
@@ -0,0 +1,127 @@
+// Offline inspection of a database file: runs BPlusTree::Analyze() on the
+// default tree and every catalogued tree and prints their shape, fill,
+// tombstones and leaf layout, then accounts for the file's pages as a whole.
+// Exits with status 2 when any integrity check fails, so it can gate scripts.
+
+#include "btree.h"
+#include "buffer_pool_manager.h"
+#include "disk_manager.h"
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " DB_FILE [options]\n"
+              << "  --cow                  the file is in copy-on-write mode\n"
+              << "  --tree NAME            analyze one tree (\"\" for the default tree)\n"
+              << "  --threads N            page readers per level (default: one per core, at most 8)\n"
+              << "  --check                print only integrity errors\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string db_file;
+    bool copy_on_write = false;
+    bool check_only = false;
+    bool single_tree = false;
+    std::string tree_name;
+    AnalyzeOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cow") {
+            copy_on_write = true;
+        } else if (arg == "--check") {
+            check_only = true;
+        } else if (i + 1 < argc && arg == "--tree") {
+            single_tree = true;
+            tree_name = argv[++i];
+        } else if (i + 1 < argc && arg == "--threads") {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg[0] != '-' && db_file.empty()) {
+            db_file = arg;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (db_file.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    try {
+        DiskManager disk_manager(db_file, copy_on_write);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        std::vector<std::string> names;
+        if (single_tree) {
+            names.push_back(tree_name);
+        } else {
+            names.push_back("");
+            for (const std::string &name : BPlusTree::ListTrees(&buffer_pool)) {
+                names.push_back(name);
+            }
+        }
+
+        int num_pages = disk_manager.GetNumPages();
+        std::vector<int> owner(num_pages, -1);  // Index into names of the tree holding each page
+        if (num_pages > 0) {
+            owner[META_PAGE_ID] = static_cast<int>(names.size());
+        }
+        size_t errors = 0;
+        for (size_t t = 0; t < names.size(); ++t) {
+            BPlusTree tree(&buffer_pool, names[t]);
+            if (names[t].empty() && tree.IsEmpty() && !single_tree) {
+                continue;  // No default tree, only named ones
+            }
+            TreeStats stats = tree.Analyze(options);
+            for (int page_id : stats.pages) {
+                if (page_id < 0 || page_id >= num_pages) {
+                    continue;
+                }
+                if (owner[page_id] >= 0) {
+                    stats.errors.push_back("page " + std::to_string(page_id) + " also belongs to " +
+                                           (owner[page_id] == static_cast<int>(names.size())
+                                                ? std::string("the meta page")
+                                                : "tree \"" + names[owner[page_id]] + "\""));
+                }
+                owner[page_id] = static_cast<int>(t);
+            }
+            errors += stats.errors.size();
+
+            std::string label = names[t].empty() ? "default tree" : "tree \"" + names[t] + "\"";
+            if (!check_only) {
+                std::cout << "=== " << label << " ===\n" << stats.ToText() << "\n";
+            } else {
+                for (const std::string &message : stats.errors) {
+                    std::cout << label << ": " << message << "\n";
+                }
+            }
+        }
+
+        if (!single_tree && !check_only) {
+            size_t unreferenced = 0;
+            for (int owner_index : owner) {
+                unreferenced += owner_index < 0;
+            }
+            std::cout << "=== file ===\n"
+                      << num_pages << " pages (" << static_cast<uint64_t>(num_pages) * PAGE_SIZE / 1024
+                      << " KB), " << unreferenced << " not referenced by any tree\n";
+        }
+        if (errors > 0) {
+            std::cout << errors << " integrity errors" << std::endl;
+            return 2;
+        }
+        if (check_only) {
+            std::cout << "ok" << std::endl;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include "kv_client.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+[[noreturn]] void ThrowErrno(const std::string &what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+}  // namespace
+
+KvClient::KvClient(const std::string &unix_path) : fd_(-1), next_id_(1), input_consumed_(0) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (unix_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + unix_path);
+    }
+    std::memcpy(address.sun_path, unix_path.c_str(), unix_path.size() + 1);
+    Connect(AF_UNIX, &address, sizeof(address), unix_path);
+}
+
+KvClient::KvClient(int tcp_port) : fd_(-1), next_id_(1), input_consumed_(0) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(tcp_port));
+    Connect(AF_INET, &address, sizeof(address), "127.0.0.1:" + std::to_string(tcp_port));
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+KvClient::~KvClient() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void KvClient::Connect(int domain, const void *address, size_t address_size, const std::string &name) {
+    fd_ = socket(domain, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || connect(fd_, static_cast<const sockaddr *>(address), static_cast<socklen_t>(address_size)) != 0) {
+        int saved = errno;
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        errno = saved;
+        ThrowErrno("Failed to connect to " + name);
+    }
+}
+
+// ==================== Pipelining ====================
+
+uint32_t KvClient::Send(Request request) {
+    request.id = next_id_++;
+    EncodeRequest(request, &output_);
+    in_flight_.emplace_back(request.id, request.type);
+    return request.id;
+}
+
+// The server stops reading from a connection whose responses pile up, so a
+// long pipeline must drain responses while it is still writing requests
+void KvClient::Flush() {
+    size_t sent = 0;
+    while (sent < output_.size()) {
+        pollfd poll_fd{fd_, POLLIN | POLLOUT, 0};
+        if (poll(&poll_fd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowErrno("poll failed");
+        }
+        if (poll_fd.revents & POLLIN) {
+            FillInput();
+        }
+        if (poll_fd.revents & (POLLOUT | POLLERR | POLLHUP)) {
+            ssize_t bytes_written = send(fd_, output_.data() + sent, output_.size() - sent,
+                                         MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (bytes_written > 0) {
+                sent += bytes_written;
+            } else if (bytes_written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                ThrowErrno("Failed to send to server");
+            }
+        }
+    }
+    output_.clear();
+}
+
+void KvClient::FillInput() {
+    char buffer[64 << 10];
+    ssize_t bytes_read;
+    do {
+        bytes_read = recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    } while (bytes_read < 0 && errno == EINTR);
+    if (bytes_read > 0) {
+        input_.append(buffer, bytes_read);
+    } else if (bytes_read == 0) {
+        throw std::runtime_error("Server closed the connection");
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ThrowErrno("Failed to receive from server");
+    }
+}
+
+Response KvClient::Receive() {
+    if (in_flight_.empty()) {
+        throw std::runtime_error("No request awaiting a response");
+    }
+    Flush();
+    std::optional<size_t> body;
+    while (!(body = CompleteFrame(input_.data() + input_consumed_, input_.size() - input_consumed_))) {
+        pollfd poll_fd{fd_, POLLIN, 0};
+        if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+            ThrowErrno("poll failed");
+        }
+        FillInput();
+    }
+
+    Response response;
+    response.type = in_flight_.front().second;
+    if (!DecodeResponse(input_.data() + input_consumed_ + FRAME_HEADER_SIZE, *body, &response) ||
+        response.id != in_flight_.front().first) {
+        throw std::runtime_error("Malformed response from server");
+    }
+    // Drop decoded bytes only once they dominate the buffer, so draining a
+    // long pipeline stays linear
+    input_consumed_ += FRAME_HEADER_SIZE + *body;
+    if (input_consumed_ * 2 >= input_.size()) {
+        input_.erase(0, input_consumed_);
+        input_consumed_ = 0;
+    }
+    in_flight_.pop_front();
+    return response;
+}
+
+// ==================== Synchronous calls ====================
+
+Response KvClient::Call(Request request) {
+    if (!in_flight_.empty()) {
+        throw std::runtime_error("Synchronous call with pipelined responses outstanding");
+    }
+    Send(std::move(request));
+    Response response = Receive();
+    if (response.status == ResponseStatus::ERROR) {
+        throw std::runtime_error("Server error: " + response.value);
+    }
+    return response;
+}
+
+std::optional<std::string> KvClient::Search(int64_t key) {
+    Request request;
+    request.type = RequestType::SEARCH;
+    request.key = key;
+    Response response = Call(std::move(request));
+    if (response.status == ResponseStatus::NOT_FOUND) {
+        return std::nullopt;
+    }
+    return std::move(response.value);
+}
+
+void KvClient::Insert(int64_t key, const std::string &value) {
+    Request request;
+    request.type = RequestType::INSERT;
+    request.key = key;
+    request.value = value;
+    Call(std::move(request));
+}
+
+bool KvClient::Remove(int64_t key) {
+    Request request;
+    request.type = RequestType::REMOVE;
+    request.key = key;
+    return Call(std::move(request)).status == ResponseStatus::OK;
+}
+
+std::vector<std::pair<int64_t, std::string>> KvClient::Scan(int64_t start_key, int64_t end_key, size_t limit) {
+    std::vector<std::pair<int64_t, std::string>> results;
+    while (results.size() < limit) {
+        Request request;
+        request.type = RequestType::SCAN;
+        request.key = start_key;
+        request.end_key = end_key;
+        request.limit = static_cast<uint32_t>(std::min<size_t>(limit - results.size(), MAX_SCAN_ENTRIES));
+        std::vector<std::pair<int64_t, std::string>> entries = std::move(Call(std::move(request)).entries);
+        // A short page ends the range
+        bool more = entries.size() == MAX_SCAN_ENTRIES && entries.back().first < end_key;
+        if (more) {
+            start_key = entries.back().first + 1;
+        }
+        std::move(entries.begin(), entries.end(), std::back_inserter(results));
+        if (!more) {
+            break;
+        }
+    }
+    return results;
+}
+
+std::vector<std::optional<std::string>> KvClient::MultiGet(const std::vector<int64_t> &keys) {
+    Request request;
+    request.type = RequestType::MULTI_GET;
+    request.keys = keys;
+    return std::move(Call(std::move(request)).values);
+}
@@ -0,0 +1,58 @@
+#ifndef KV_CLIENT_H
+#define KV_CLIENT_H
+
+#include "protocol.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Blocking client for bptree_server. The synchronous calls send one request
+// and wait for its answer. To pipeline, Send() any number of requests, Flush()
+// them, then Receive() one response per request, in the order sent.
+// Connection failures, protocol errors and ERROR responses to the synchronous
+// calls throw std::runtime_error.
+class KvClient {
+public:
+    // Unix domain socket
+    explicit KvClient(const std::string &unix_path);
+    // TCP on 127.0.0.1
+    explicit KvClient(int tcp_port);
+    ~KvClient();
+
+    KvClient(const KvClient &) = delete;
+    KvClient &operator=(const KvClient &) = delete;
+
+    std::optional<std::string> Search(int64_t key);
+    void Insert(int64_t key, const std::string &value);
+    bool Remove(int64_t key);
+    // At most `limit` entries, fetched MAX_SCAN_ENTRIES per request
+    std::vector<std::pair<int64_t, std::string>> Scan(int64_t start_key, int64_t end_key, size_t limit = SIZE_MAX);
+    std::vector<std::optional<std::string>> MultiGet(const std::vector<int64_t> &keys);
+
+    // Pipelining. Send() buffers the request (assigning its id) and returns
+    // the id; Flush() writes everything buffered; Receive() flushes, then
+    // blocks for the next response
+    uint32_t Send(Request request);
+    void Flush();
+    Response Receive();
+
+    size_t Outstanding() const { return in_flight_.size(); }
+
+private:
+    int fd_;
+    uint32_t next_id_;
+    std::string output_;
+    std::string input_;
+    size_t input_consumed_;  // Prefix of `input_` already decoded
+    std::deque<std::pair<uint32_t, RequestType>> in_flight_;  // Sent, not yet answered
+
+    void Connect(int domain, const void *address, size_t address_size, const std::string &name);
+    void FillInput();
+    Response Call(Request request);
+};
+
+#endif // KV_CLIENT_H
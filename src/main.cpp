@@ -1,13 +1,65 @@
+#include "async_tree.h"
+#include "backup.h"
 #include "btree.h"
 #include "buffer_pool_manager.h"
+#include "checksum.h"
 #include "disk_manager.h"
+#include "kv_client.h"
+#include "memtable.h"
+#include "metrics.h"
+#include "page_trace.h"
+#include "replication.h"
+#include "server.h"
+#include "sharded_store.h"
+#include "transaction.h"
+#include "write_batch.h"
 #include <iostream>
+#include <map>
 #include <vector>
 #include <algorithm>
 #include <random>
 #include <iomanip>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
 
 constexpr const char *DB_FILE = "test.db";
+constexpr const char *COW_DB_FILE = "test_cow.db";
+constexpr const char *CRASH_DB_FILE = "test_crash.db";
+constexpr const char *BACKUP_DB_FILE = "test_backup.db";
+constexpr const char *CATALOG_DB_FILE = "test_catalog.db";
+constexpr const char *FORMAT_DB_FILE = "test_format.db";
+constexpr const char *PACKED_DB_FILE = "test_packed.db";
+constexpr const char *DEDUP_DB_FILE = "test_dedup.db";
+constexpr const char *CHECKSUM_DB_FILE = "test_checksum.db";
+constexpr const char *METRICS_DB_FILE = "test_metrics.db";
+constexpr const char *TRACE_DB_FILE = "test_trace.db";
+constexpr const char *TRACE_FILE = "test_trace.trace";
+constexpr const char *ANALYZE_DB_FILE = "test_analyze.db";
+constexpr const char *SERVER_DB_FILE = "test_server.db";
+constexpr const char *SERVER_SOCKET = "test_server.sock";
+constexpr const char *RESP_SOCKET = "test_resp.sock";
+constexpr const char *MULTIGET_DB_FILE = "test_multiget.db";
+constexpr const char *ASYNC_DB_FILE = "test_async.db";
+constexpr const char *SHARDED_STORE = "test_sharded";
+constexpr const char *LIVE_SPLIT_STORE = "test_live_split";
+constexpr const char *VOLUME_A = "test_volume_a";
+constexpr const char *VOLUME_B = "test_volume_b";
+constexpr const char *PRIMARY_DB_FILE = "test_primary.db";
+constexpr const char *FOLLOWER_DB_FILE = "test_follower.db";
+constexpr const char *REPLICATION_SOCKET = "test_replication.sock";
+constexpr const char *FOLLOWER_SOCKET = "test_follower.sock";
+constexpr const char *BUFFERED_DB_FILE = "test_buffered.db";
+constexpr const char *MEMTABLE_DB_FILE = "test_memtable.db";
 constexpr int NUM_KEYS = 10000;  // Stress test: 10k keys with only 64 buffer pool frames
 
 int main() {
@@ -238,6 +290,1823 @@ int main() {
         }
     }
 
+    // ==================== Phase 5: Snapshot Reads ====================
+    std::cout << "\n=== Phase 5: MVCC Snapshot Reads ===" << std::endl;
+    {
+        DiskManager disk_manager(DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+
+        const Snapshot *snapshot = tree.GetSnapshot();
+        std::cout << "  Snapshot taken, now updating 100, removing 101, re-inserting 5" << std::endl;
+        tree.Insert(100, "updated_100");
+        tree.Insert(100, "updated_again_100");
+        tree.Remove(101);
+        tree.Insert(5, "value_5_again");
+
+        auto old_100 = tree.Search(100, snapshot);
+        auto new_100 = tree.Search(100);
+        if (old_100 && *old_100 == "value_100" && new_100 && *new_100 == "updated_again_100") {
+            std::cout << "  ✓ Snapshot sees value_100, latest sees " << *new_100 << std::endl;
+        } else {
+            std::cout << "  ✗ Snapshot read of key 100 is inconsistent" << std::endl;
+        }
+
+        auto old_101 = tree.Search(101, snapshot);
+        auto old_5 = tree.Search(5, snapshot);
+        if (old_101 && !tree.Search(101) && !old_5 && tree.Search(5)) {
+            std::cout << "  ✓ Snapshot still sees removed key 101 and not re-inserted key 5" << std::endl;
+        } else {
+            std::cout << "  ✗ Snapshot read of removed key 101 or re-inserted key 5 is inconsistent" << std::endl;
+        }
+
+        // Key 5 was removed in Phase 4: both views hold 199 of keys 1..200
+        auto snap_scan = tree.Scan(1, 200, snapshot);
+        auto live_scan = tree.Scan(1, 200);
+        std::cout << (snap_scan.size() == 199 && live_scan.size() == 199 ? "  ✓" : "  ✗")
+                  << " Scan(1, 200): snapshot found " << snap_scan.size()
+                  << " keys (expected 199), latest found " << live_scan.size()
+                  << " keys (expected 199)" << std::endl;
+
+        size_t versioned = tree.VersionedKeys();
+        tree.ReleaseSnapshot(snapshot);
+        std::cout << (versioned == 3 && tree.VersionedKeys() == 0 ? "  ✓" : "  ✗")
+                  << " Snapshot released, versions of " << versioned << " keys collected, "
+                  << tree.VersionedKeys() << " left" << std::endl;
+    }
+
+    // ==================== Phase 6: Write Batches & Transactions ====================
+    std::cout << "\n=== Phase 6: Atomic Write Batches & Optimistic Transactions ===" << std::endl;
+    {
+        DiskManager disk_manager(DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+
+        const Snapshot *before = tree.GetSnapshot();
+        WriteBatch batch;
+        for (int key = NUM_KEYS + 500; key > NUM_KEYS; --key) {
+            batch.Put(key, "batch_" + std::to_string(key));
+        }
+        batch.Delete(7);
+        batch.Put(8, "first");
+        batch.Put(8, "batch_8");
+        bool applied = tree.Write(batch);
+
+        auto written = tree.Scan(NUM_KEYS + 1, NUM_KEYS + 500);
+        auto hidden = tree.Scan(NUM_KEYS + 1, NUM_KEYS + 500, before);
+        auto key_8 = tree.Search(8);
+        std::cout << "  Write(batch of " << batch.Count() << " ops): " << (applied ? "Success" : "Failed")
+                  << ", " << written.size() << " new keys visible (expected 500)" << std::endl;
+        if (hidden.empty() && tree.Search(7, before) && !tree.Search(7) && key_8 && *key_8 == "batch_8") {
+            std::cout << "  ✓ Older snapshot sees none of the batch, last write per key wins" << std::endl;
+        }
+        tree.ReleaseSnapshot(before);
+
+        Transaction txn(&tree);
+        auto balance = txn.Get(1);
+        txn.Put(2, "moved_from_1");
+        txn.Delete(1);
+        std::cout << "  Transaction read key 1 = " << (balance ? *balance : "<none>")
+                  << ", commit: " << (txn.Commit() ? "Success" : "Conflict") << std::endl;
+
+        Transaction conflicting(&tree);
+        conflicting.Get(3);
+        tree.Insert(3, "concurrent_writer");
+        conflicting.Put(3, "stale_update");
+        if (!conflicting.Commit() && *tree.Search(3) == "concurrent_writer") {
+            std::cout << "  ✓ Transaction with stale read set aborted on commit" << std::endl;
+        }
+    }
+
+    // ==================== Phase 7: Copy-on-Write Mode ====================
+    std::cout << "\n=== Phase 7: Copy-on-Write (Shadow Paging) Mode ===" << std::endl;
+    std::remove(COW_DB_FILE);
+    std::remove(CRASH_DB_FILE);
+    {
+        DiskManager disk_manager(COW_DB_FILE, true);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+
+        for (int key : keys) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+        buffer_pool.FlushAllPages();  // Checkpoint: atomically publish the new root
+        std::cout << "  ✓ Inserted " << NUM_KEYS << " keys and checkpointed" << std::endl;
+
+        // Keep writing (evictions go to shadow pages), then "crash" by
+        // copying the file before the next checkpoint
+        for (int key : keys) {
+            tree.Insert(key, "rewritten_" + std::to_string(key));
+        }
+        std::filesystem::copy_file(COW_DB_FILE, CRASH_DB_FILE);
+    }
+    {
+        DiskManager disk_manager(CRASH_DB_FILE, true);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+
+        int found = 0;
+        for (int key : keys) {
+            auto result = tree.Search(key);
+            if (result && *result == "value_" + std::to_string(key)) {
+                found++;
+            }
+        }
+        std::cout << "  ✓ Crash image opened at last checkpoint: " << found << "/" << NUM_KEYS
+                  << " keys hold their checkpointed value" << std::endl;
+    }
+    {
+        DiskManager disk_manager(COW_DB_FILE, true);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+
+        auto results = tree.Scan(0, NUM_KEYS - 1);
+        int rewritten = 0;
+        for (auto &pair : results) {
+            if (pair.second == "rewritten_" + std::to_string(pair.first)) {
+                rewritten++;
+            }
+        }
+        std::cout << "  ✓ Clean shutdown reopened with " << rewritten << "/" << NUM_KEYS
+                  << " rewritten values" << std::endl;
+    }
+    std::remove(COW_DB_FILE);
+    std::remove(CRASH_DB_FILE);
+
+    // ==================== Phase 8: Online Backup ====================
+    std::cout << "\n=== Phase 8: Online Backup While Writing ===" << std::endl;
+    size_t live_keys = 0;
+    {
+        DiskManager disk_manager(DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        live_keys = tree.Scan(0, NUM_KEYS - 1).size();
+
+        BackupOptions options;
+        options.chunk_size = 16 * PAGE_SIZE;
+        options.max_bytes_per_sec = 16 << 20;
+        OnlineBackup backup(&buffer_pool, BACKUP_DB_FILE, options);
+        backup.Step();
+
+        // Overwrite every key while a throttled backup thread is still copying
+        std::thread backup_thread([&backup] { backup.Run(); });
+        for (int key : keys) {
+            tree.Insert(key, "after_backup_" + std::to_string(key));
+        }
+        buffer_pool.FlushAllPages();
+        backup_thread.join();
+        std::cout << "  ✓ Backup copied " << backup.BytesCopied() / 1024
+                  << " KB while " << NUM_KEYS << " keys were overwritten" << std::endl;
+    }
+    {
+        DiskManager disk_manager(BACKUP_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+
+        auto results = tree.Scan(0, NUM_KEYS - 1);
+        bool point_in_time = true;
+        for (auto &pair : results) {
+            if (pair.second.rfind("after_backup_", 0) == 0) {
+                point_in_time = false;
+            }
+        }
+        std::cout << (point_in_time && results.size() == live_keys ? "  ✓" : "  ✗") << " Backup holds "
+                  << results.size() << "/" << live_keys
+                  << " keys, point-in-time image: " << (point_in_time ? "YES" : "NO") << std::endl;
+    }
+    std::remove(BACKUP_DB_FILE);
+
+    // ==================== Phase 9: Catalog of Named Trees ====================
+    std::cout << "\n=== Phase 9: Multiple Named Trees in One File ===" << std::endl;
+    std::remove(CATALOG_DB_FILE);
+    const std::vector<std::string> tree_names = {"users", "orders", "sessions"};
+    {
+        DiskManager disk_manager(CATALOG_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree users(&buffer_pool, tree_names[0]);
+        BPlusTree orders(&buffer_pool, tree_names[1]);
+        BPlusTree sessions(&buffer_pool, tree_names[2]);
+
+        for (int key : keys) {
+            users.Insert(key, "user_" + std::to_string(key));
+            orders.Insert(key, "order_" + std::to_string(key));
+            if (key % 2 == 0) {
+                sessions.Insert(key, "session_" + std::to_string(key));
+            }
+        }
+        std::cout << "  ✓ Filled 3 trees sharing one file and one " << MAX_PAGES_IN_RAM
+                  << "-frame pool" << std::endl;
+    }
+    {
+        DiskManager disk_manager(CATALOG_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+
+        auto names = BPlusTree::ListTrees(&buffer_pool);
+        std::cout << "  Catalog lists " << names.size() << " trees:";
+        for (auto &name : names) {
+            std::cout << " " << name;
+        }
+        std::cout << std::endl;
+
+        for (const std::string &name : tree_names) {
+            BPlusTree tree(&buffer_pool, name);
+            std::string prefix = name.substr(0, name.size() - 1) + "_";
+            auto results = tree.Scan(0, NUM_KEYS - 1);
+            bool values_match = true;
+            for (auto &pair : results) {
+                if (pair.second != prefix + std::to_string(pair.first)) {
+                    values_match = false;
+                }
+            }
+            // "sessions" only got the even keys
+            size_t expected = name == tree_names[2] ? NUM_KEYS / 2 : NUM_KEYS;
+            std::cout << (values_match && results.size() == expected ? "  ✓" : "  ✗") << " Tree '" << name
+                      << "' reopened with " << results.size() << "/" << expected
+                      << " keys, values isolated: " << (values_match ? "YES" : "NO") << std::endl;
+        }
+    }
+
+    // ==================== Phase 10: Secondary Indexes ====================
+    std::cout << "\n=== Phase 10: Secondary Indexes ===" << std::endl;
+    auto age_of = [](const std::string &value) -> std::optional<int> {
+        // Values look like "age=NN;name=..."
+        if (value.rfind("age=", 0) != 0) return std::nullopt;
+        return std::stoi(value.substr(4));
+    };
+    {
+        DiskManager disk_manager(CATALOG_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree people(&buffer_pool, "people");
+        people.CreateIndex("people_by_age", age_of);
+
+        for (int key : keys) {
+            people.Insert(key, "age=" + std::to_string(key % 100) + ";name=person_" + std::to_string(key));
+        }
+        people.Insert(42, "age=7;name=person_42");  // Moves 42 from age 42 to age 7
+        people.Remove(142);                         // Drops 142 from age 42
+        WriteBatch batch;
+        batch.Put(242, "no age on record");         // Unindexed value
+        batch.Put(NUM_KEYS, "age=42;name=newcomer");
+        people.Write(batch);
+
+        auto age_42 = people.SearchIndex("people_by_age", 42, 42);
+        bool all_match = true;
+        for (int64_t key : age_42) {
+            auto value = people.Search(key);
+            if (!value || age_of(*value) != 42) all_match = false;
+        }
+        std::cout << (all_match && age_42.size() == NUM_KEYS / 100 - 2 ? "  ✓" : "  ✗")
+                  << " SearchIndex(age 42) returned " << age_42.size()
+                  << " primary keys (expected " << NUM_KEYS / 100 - 2 << "), all match: "
+                  << (all_match ? "YES" : "NO") << std::endl;
+    }
+    {
+        DiskManager disk_manager(CATALOG_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree people(&buffer_pool, "people");
+        people.CreateIndex("people_by_age", age_of);
+        people.CreateIndex("people_by_key_mod", [](const std::string &value) -> std::optional<int> {
+            size_t pos = value.find("person_");
+            if (pos == std::string::npos) return std::nullopt;
+            return std::stoi(value.substr(pos + 7)) % 1000;
+        });
+
+        auto age_7 = people.SearchIndex("people_by_age", 7, 7);
+        auto mod_42 = people.SearchIndex("people_by_key_mod", 42, 42);
+        bool counts_match = age_7.size() == NUM_KEYS / 100 + 1 && mod_42.size() == NUM_KEYS / 1000;
+        std::cout << (counts_match ? "  ✓" : "  ✗") << " Reopened: age 7 has " << age_7.size()
+                  << " entries (expected "
+                  << NUM_KEYS / 100 + 1 << "), backfilled index finds " << mod_42.size()
+                  << " keys with key % 1000 == 42 (expected " << NUM_KEYS / 1000 << ")" << std::endl;
+    }
+    std::remove(CATALOG_DB_FILE);
+    {
+        // Files of another format version are refused, not misread
+        auto open_error = [] {
+            try {
+                DiskManager disk_manager(FORMAT_DB_FILE);
+                BufferPoolManager buffer_pool(16, &disk_manager);
+                BPlusTree tree(&buffer_pool);
+            } catch (const std::runtime_error &e) {
+                return std::string(e.what());
+            }
+            return std::string();
+        };
+        std::remove(FORMAT_DB_FILE);
+        {
+            // Version 1 layout: page 0 holds just the root id, leaves have 32-bit keys
+            std::vector<char> pages(2 * PAGE_SIZE, 0);
+            int root = 1;
+            std::memcpy(pages.data(), &root, sizeof(root));
+            std::ofstream out(FORMAT_DB_FILE, std::ios::binary);
+            out.write(pages.data(), pages.size());
+        }
+        std::string version_1 = open_error();
+        std::remove(FORMAT_DB_FILE);
+        {
+            DiskManager disk_manager(FORMAT_DB_FILE);
+            BufferPoolManager buffer_pool(16, &disk_manager);
+            BPlusTree tree(&buffer_pool);
+            tree.Insert(1, "one");
+            Page *meta = buffer_pool.FetchPage(META_PAGE_ID);
+            reinterpret_cast<MetaPage *>(meta->data)->format_version = FORMAT_VERSION + 1;
+            buffer_pool.UnpinPage(META_PAGE_ID, true);
+        }
+        std::string newer = open_error();
+        std::remove(FORMAT_DB_FILE);
+        bool refused = version_1.find("format version") != std::string::npos &&
+                       newer.find("has format version " + std::to_string(FORMAT_VERSION + 1)) != std::string::npos;
+        std::cout << (refused ? "  ✓" : "  ✗") << " Files of format version 1 and " << FORMAT_VERSION + 1
+                  << " are refused on open: " << newer << std::endl;
+    }
+
+    // ==================== Phase 11: Leaf Page Compression ====================
+    std::cout << "\n=== Phase 11: Leaf Page Compression (Copy-on-Write File) ===" << std::endl;
+    std::uintmax_t file_sizes[2] = {0, 0};
+    for (int compressed = 0; compressed <= 1; ++compressed) {
+        std::remove(COW_DB_FILE);
+        TreeOptions options;
+        options.leaf_codec = compressed ? PageCodec::LZ : PageCodec::NONE;
+        {
+            DiskManager disk_manager(COW_DB_FILE, true);
+            BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+            BPlusTree tree(&buffer_pool, "", options);
+            for (int key : keys) {
+                tree.Insert(key, "value_" + std::to_string(key));
+            }
+        }
+        file_sizes[compressed] = std::filesystem::file_size(COW_DB_FILE);
+    }
+    {
+        DiskManager disk_manager(COW_DB_FILE, true);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        auto results = tree.Scan(0, NUM_KEYS - 1);
+        std::cout << "  ✓ Reopened compressed file, Scan found " << results.size() << "/" << NUM_KEYS
+                  << " keys" << std::endl;
+    }
+    std::cout << "  File size: " << file_sizes[0] / 1024 << " KB raw, " << file_sizes[1] / 1024
+              << " KB with LZ leaf pages (" << std::fixed << std::setprecision(1)
+              << static_cast<double>(file_sizes[0]) / file_sizes[1] << "x smaller)" << std::endl;
+    std::remove(COW_DB_FILE);
+    {
+        // Rewrite pages as their images grow a slot at a time, as leaves do
+        // while filling, then start small again: the runs freed by smaller
+        // images must merge to hold larger ones, or the file keeps growing
+        constexpr int CHURN_PAGES = 64;
+        constexpr int CHURN_ROUNDS = 300;
+        DiskManager disk_manager(COW_DB_FILE, true);
+        std::mt19937 churn_rng(23);
+        char page[PAGE_SIZE];
+        for (int i = 0; i < CHURN_PAGES; ++i) {
+            disk_manager.AllocatePage();
+        }
+        int peak_pages = 0;
+        for (int round = 0; round < CHURN_ROUNDS; ++round) {
+            for (int i = 0; i < CHURN_PAGES; ++i) {
+                // Incompressible prefix of 1 to 7 slots, zeros after it
+                std::memset(page, 0, PAGE_SIZE);
+                size_t noise = DiskManager::SLOT_SIZE * (1 + round / 10 % 7) - 64;
+                for (size_t b = sizeof(PageHeader); b < noise; ++b) {
+                    page[b] = static_cast<char>(churn_rng());
+                }
+                reinterpret_cast<PageHeader *>(page)->codec = static_cast<uint8_t>(PageCodec::LZ);
+                disk_manager.WritePage(i, page);
+            }
+            disk_manager.Checkpoint();
+            peak_pages = std::max(peak_pages, disk_manager.GetNumPhysicalPages());
+        }
+        // One live and one superseded copy of every page, plus meta and map
+        int bound = 2 * CHURN_PAGES + 4;
+        std::cout << (peak_pages <= bound ? "  ✓" : "  ✗") << " " << CHURN_ROUNDS << " checkpoints of "
+                  << CHURN_PAGES << " pages growing and shrinking peaked at " << peak_pages
+                  << " physical pages (bound " << bound << ")" << std::endl;
+    }
+    std::remove(COW_DB_FILE);
+
+    // ==================== Phase 12: Packed Internal Keys ====================
+    std::cout << "\n=== Phase 12: Frame-of-Reference Internal Keys ===" << std::endl;
+    constexpr int DENSE_KEYS = 50000;
+    constexpr int SPARSE_KEYS = 2000;
+    // Dense keys pack into 16-bit deltas; sparse keys spread across the whole
+    // 64-bit range force 32-bit and full-width pages on the way up
+    std::vector<int64_t> packed_keys;
+    for (int i = 0; i < DENSE_KEYS; ++i) {
+        packed_keys.push_back(i);
+    }
+    for (int64_t i = 1; i <= SPARSE_KEYS; ++i) {
+        packed_keys.push_back(i * 1000000007LL);
+        packed_keys.push_back(-(i << 40));
+    }
+    std::shuffle(packed_keys.begin(), packed_keys.end(), g);
+    int packed_num_pages[2] = {0, 0};
+    for (int packed = 0; packed <= 1; ++packed) {
+        std::remove(PACKED_DB_FILE);
+        DiskManager disk_manager(PACKED_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        TreeOptions options;
+        options.pack_internal_keys = packed;
+        BPlusTree tree(&buffer_pool, "", options);
+        for (int i = 0; i < DENSE_KEYS; ++i) {
+            tree.Insert(i, "value_" + std::to_string(i));
+        }
+        packed_num_pages[packed] = disk_manager.GetNumPages();
+    }
+    std::cout << "  Sequential " << DENSE_KEYS << " keys: " << packed_num_pages[0] << " pages unpacked, "
+              << packed_num_pages[1] << " pages with packed internal keys" << std::endl;
+
+    std::remove(PACKED_DB_FILE);
+    {
+        DiskManager disk_manager(PACKED_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        TreeOptions options;
+        options.pack_internal_keys = true;
+        BPlusTree tree(&buffer_pool, "", options);
+        for (int64_t key : packed_keys) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+    }
+    {
+        // Reopen without packing: new internal pages are written full-width
+        // while the packed ones stay readable
+        DiskManager disk_manager(PACKED_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        for (int i = DENSE_KEYS; i < DENSE_KEYS + SPARSE_KEYS; ++i) {
+            tree.Insert(i, "value_" + std::to_string(i));
+            packed_keys.push_back(i);
+        }
+        int found = 0;
+        for (int64_t key : packed_keys) {
+            auto result = tree.Search(key);
+            if (result && *result == "value_" + std::to_string(key)) {
+                found++;
+            }
+        }
+        auto results = tree.Scan(0, DENSE_KEYS + SPARSE_KEYS - 1);
+        std::cout << (found == static_cast<int>(packed_keys.size()) ? "  ✓" : "  ✗")
+                  << " Mixed-format tree holds " << found << "/" << packed_keys.size()
+                  << " keys, dense Scan found " << results.size() << "/" << DENSE_KEYS + SPARSE_KEYS
+                  << std::endl;
+    }
+    std::remove(PACKED_DB_FILE);
+
+    // ==================== Phase 13: Deduplicated Values ====================
+    std::cout << "\n=== Phase 13: Dictionary-Encoded Values ===" << std::endl;
+    const std::vector<std::string> statuses = {"pending", "active", "suspended", "closed",
+                                               "archived", "deleted_by_user", "on_hold", "migrated"};
+    auto status_of = [&](int key) { return statuses[key % statuses.size()]; };
+    int dedup_num_pages[2] = {0, 0};
+    for (int dedup = 0; dedup <= 1; ++dedup) {
+        std::remove(DEDUP_DB_FILE);
+        DiskManager disk_manager(DEDUP_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        TreeOptions options;
+        options.dedup_values = dedup;
+        BPlusTree tree(&buffer_pool, "accounts", options);
+        for (int key : keys) {
+            tree.Insert(key, status_of(key));
+        }
+        for (int key = 0; key < NUM_KEYS; key += 100) {
+            tree.Remove(key);
+        }
+        dedup_num_pages[dedup] = disk_manager.GetNumPages();
+    }
+    std::cout << "  " << NUM_KEYS << " keys with " << statuses.size() << " distinct values: "
+              << dedup_num_pages[0] << " pages inline, " << dedup_num_pages[1] << " pages deduplicated"
+              << std::endl;
+    {
+        // Options only apply to new trees; the reopened tree keeps its format
+        DiskManager disk_manager(DEDUP_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool, "accounts");
+        int correct = 0;
+        for (int key = 0; key < NUM_KEYS; ++key) {
+            auto result = tree.Search(key);
+            if (key % 100 == 0 ? !result : result && *result == status_of(key)) {
+                correct++;
+            }
+        }
+        auto results = tree.Scan(0, NUM_KEYS - 1);
+        std::cout << (correct == NUM_KEYS ? "  ✓" : "  ✗") << " Reopened: " << correct << "/" << NUM_KEYS
+                  << " keys correct, Scan found " << results.size() << " live keys (expected "
+                  << NUM_KEYS - NUM_KEYS / 100 << ")" << std::endl;
+    }
+    std::remove(DEDUP_DB_FILE);
+    {
+        // Overwrite the same keys with ever new values: ids no leaf refers to
+        // any more are compacted away and reused, so the dictionary tracks the
+        // live values rather than every value ever written
+        constexpr int CHURN_KEYS = 1000;
+        constexpr int CHURN_ROUNDS = 20;
+        auto churn_value = [](int round, int key) { return "r" + std::to_string(round) + "_" + std::to_string(key); };
+        {
+            DiskManager disk_manager(DEDUP_DB_FILE);
+            BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+            TreeOptions options;
+            options.dedup_values = true;
+            BPlusTree tree(&buffer_pool, "churn", options);
+            for (int round = 0; round < CHURN_ROUNDS; ++round) {
+                for (int key = 0; key < CHURN_KEYS; ++key) {
+                    tree.Insert(key, churn_value(round, key));
+                }
+            }
+        }
+        DiskManager disk_manager(DEDUP_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool, "churn");
+        int correct = 0;
+        for (int key = 0; key < CHURN_KEYS; ++key) {
+            correct += tree.Search(key) == churn_value(CHURN_ROUNDS - 1, key);
+        }
+        BPlusTree dictionary(&buffer_pool, "churn#dict");
+        size_t stored = dictionary.Scan(1, INT64_MAX).size();
+        size_t ids = std::stoul(dictionary.Search(0).value_or("1")) - 1;
+        size_t bound = 2 * (CHURN_KEYS + DICTIONARY_COMPACT_MIN_IDS);
+        std::cout << (correct == CHURN_KEYS && ids <= bound ? "  ✓" : "  ✗") << " " << CHURN_KEYS * CHURN_ROUNDS
+                  << " distinct values written over " << CHURN_KEYS << " keys: dictionary holds " << stored
+                  << " values under " << ids << " ids (bound " << bound << "), " << correct << "/" << CHURN_KEYS
+                  << " keys correct" << std::endl;
+    }
+    std::remove(DEDUP_DB_FILE);
+
+    // ==================== Phase 14: Page Checksums ====================
+    std::cout << "\n=== Phase 14: Page Checksums (CRC32C) ===" << std::endl;
+    uint32_t check_value = Crc32c("123456789", 9);
+    std::cout << (check_value == 0xE3069283 ? "  ✓" : "  ✗") << " CRC32C(\"123456789\") = 0x" << std::hex
+              << check_value << std::dec << std::endl;
+    std::remove(CHECKSUM_DB_FILE);
+    {
+        DiskManager disk_manager(CHECKSUM_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        for (int key : keys) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+    }
+    {
+        // Hot re-reads skip verification; every page is still checked once
+        DiskManager disk_manager(CHECKSUM_DB_FILE);
+        disk_manager.SetChecksumVerify(ChecksumVerify::FIRST_READ);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        size_t scanned = 0;
+        for (int round = 0; round < 2; ++round) {
+            scanned += tree.Scan(0, NUM_KEYS - 1).size();
+        }
+        std::cout << (scanned == 2 * NUM_KEYS ? "  ✓" : "  ✗") << " Intact file scanned twice with FIRST_READ: "
+                  << scanned << "/" << 2 * NUM_KEYS << " entries" << std::endl;
+    }
+    {
+        // Flip one byte in the middle of a page, as a torn write would
+        std::fstream file(CHECKSUM_DB_FILE, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(5 * PAGE_SIZE + PAGE_SIZE / 2);
+        char byte = static_cast<char>(file.get());
+        file.seekp(5 * PAGE_SIZE + PAGE_SIZE / 2);
+        file.put(static_cast<char>(byte ^ 0xFF));
+    }
+    {
+        DiskManager disk_manager(CHECKSUM_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        std::string error;
+        try {
+            tree.Scan(0, NUM_KEYS - 1);
+        } catch (const std::runtime_error &e) {
+            error = e.what();
+        }
+        std::cout << (!error.empty() ? "  ✓" : "  ✗") << " Corrupted page detected on read: "
+                  << (error.empty() ? "no error" : error) << std::endl;
+    }
+    std::remove(CHECKSUM_DB_FILE);
+
+    // ==================== Phase 15: Engine Metrics ====================
+    std::cout << "\n=== Phase 15: Engine Metrics ===" << std::endl;
+    std::remove(METRICS_DB_FILE);
+    ResetStats();
+    {
+        DiskManager disk_manager(METRICS_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        for (int key : keys) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+        for (int key : keys) {
+            tree.Search(key);
+        }
+        for (int key = 0; key < NUM_KEYS; key += 100) {
+            tree.Remove(key);
+        }
+        tree.Scan(0, NUM_KEYS - 1);
+    }
+    Stats stats = GetStats();
+    bool counts_match = stats.Latency(Operation::INSERT).Count() == NUM_KEYS &&
+                        stats.Latency(Operation::SEARCH).Count() == NUM_KEYS &&
+                        stats.Latency(Operation::REMOVE).Count() == NUM_KEYS / 100 &&
+                        stats.Latency(Operation::SCAN).Count() == 1;
+    std::cout << (counts_match ? "  ✓" : "  ✗") << " Operation counts recorded, "
+              << stats.splits[0] << " leaf splits, " << stats.Get(Counter::POOL_MISSES) << " pool misses, "
+              << stats.Get(Counter::DISK_BYTES_WRITTEN) / 1024 << " KB written" << std::endl;
+    std::string json = stats.ToJson();
+    std::cout << "  JSON dump: " << json.size() << " bytes, starts " << json.substr(0, 40) << "..." << std::endl;
+    std::istringstream text(stats.ToText());
+    for (std::string line; std::getline(text, line);) {
+        std::cout << "    " << line << std::endl;
+    }
+    std::remove(METRICS_DB_FILE);
+
+    // ==================== Phase 16: Page Access Trace ====================
+    std::cout << "\n=== Phase 16: Page Access Trace ===" << std::endl;
+    std::remove(TRACE_DB_FILE);
+    Stats trace_stats;
+    {
+        DiskManager disk_manager(TRACE_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        ResetStats();
+        buffer_pool.StartTrace(TRACE_FILE);
+        for (int key : keys) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+        for (int key : keys) {
+            tree.Search(key);
+        }
+        buffer_pool.StopTrace();
+        trace_stats = GetStats();
+        tree.Search(0);  // Not traced
+    }
+    uint64_t trace_counts[4] = {};
+    uint64_t trace_hits = 0;
+    uint64_t untagged = 0;
+    bool ordered = true;
+    uint64_t last_timestamp = 0;
+    {
+        PageTraceReader reader(TRACE_FILE);
+        PageTraceRecord record;
+        while (reader.Next(&record)) {
+            trace_counts[static_cast<int>(record.event)]++;
+            trace_hits += (record.flags & TRACE_HIT) ? 1 : 0;
+            untagged += record.operation == TRACE_NO_OPERATION ? 1 : 0;
+            ordered = ordered && record.timestamp_ns >= last_timestamp;
+            last_timestamp = record.timestamp_ns;
+        }
+        std::cout << "  Trace header: pool " << reader.Header().pool_size << " frames, page size "
+                  << reader.Header().page_size << std::endl;
+    }
+    uint64_t traced_fetches = trace_counts[static_cast<int>(TraceEvent::FETCH)];
+    uint64_t traced_pins = traced_fetches + trace_counts[static_cast<int>(TraceEvent::NEW)];
+    // Every traced fetch shows up in the metrics, and every pin is matched by an unpin
+    uint64_t metric_fetches = trace_stats.Get(Counter::POOL_HITS) + trace_stats.Get(Counter::POOL_MISSES);
+    bool trace_matches = traced_fetches == metric_fetches &&
+                         trace_hits == trace_stats.Get(Counter::POOL_HITS) &&
+                         traced_pins == trace_counts[static_cast<int>(TraceEvent::UNPIN)];
+    std::cout << (trace_matches ? "  ✓" : "  ✗") << " " << traced_fetches << " fetches ("
+              << trace_hits << " hits), " << trace_counts[static_cast<int>(TraceEvent::NEW)] << " new pages, "
+              << trace_counts[static_cast<int>(TraceEvent::UNPIN)] << " unpins traced" << std::endl;
+    std::cout << (ordered && untagged == 0 ? "  ✓" : "  ✗")
+              << " Records are time-ordered and tagged with their tree operation" << std::endl;
+    std::remove(TRACE_FILE);
+    std::remove(TRACE_DB_FILE);
+
+    // ==================== Phase 17: Tree Analysis ====================
+    std::cout << "\n=== Phase 17: Tree Analysis & Integrity Check ===" << std::endl;
+    std::remove(ANALYZE_DB_FILE);
+    {
+        DiskManager disk_manager(ANALYZE_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        std::mt19937 analyze_rng(17);
+        std::vector<int> shuffled = keys;
+        std::shuffle(shuffled.begin(), shuffled.end(), analyze_rng);
+        for (int key : shuffled) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+        for (int key = 0; key < NUM_KEYS; key += 10) {
+            tree.Remove(key);
+        }
+
+        AnalyzeOptions serial;
+        serial.threads = 1;
+        AnalyzeOptions parallel;
+        parallel.threads = 4;
+        TreeStats stats = tree.Analyze(serial);
+        TreeStats parallel_stats = tree.Analyze(parallel);
+        bool shape_ok = stats.IsConsistent() &&
+                        stats.live_entries == static_cast<uint64_t>(NUM_KEYS - NUM_KEYS / 10) &&
+                        stats.tombstones == static_cast<uint64_t>(NUM_KEYS / 10) &&
+                        stats.levels[0].pages == stats.sequential_links + stats.forward_links +
+                                                     stats.backward_links + 1;
+        bool parallel_ok = parallel_stats.IsConsistent() && parallel_stats.pages == stats.pages &&
+                           parallel_stats.tombstones == stats.tombstones;
+        std::cout << (shape_ok ? "  ✓" : "  ✗") << " Height " << stats.height << ", " << stats.levels[0].pages
+                  << " leaves, " << std::fixed << std::setprecision(1) << 100 * stats.AverageLeafFill()
+                  << "% leaf fill, " << 100 * stats.TombstoneRatio() << "% tombstones" << std::endl;
+        std::cout << (parallel_ok ? "  ✓" : "  ✗") << " 4 reader threads find the same "
+                  << parallel_stats.pages.size() << " pages" << std::endl;
+
+        // Break the leaf chain and the key order of two leaves; both must be reported
+        int first_leaf = stats.pages[stats.pages.size() - stats.levels[0].pages];
+        int second_leaf = stats.pages[stats.pages.size() - stats.levels[0].pages + 1];
+        Page *page = buffer_pool.FetchPage(first_leaf);
+        LeafPageHeader *leaf = reinterpret_cast<LeafPageHeader *>(page->data);
+        leaf->next_page_id = META_PAGE_ID;
+        buffer_pool.UnpinPage(first_leaf, true);
+        page = buffer_pool.FetchPage(second_leaf);
+        LeafEntry *entries = reinterpret_cast<LeafEntry *>(page->data + LEAF_HEADER_SIZE);
+        std::swap(entries[0].key, entries[1].key);
+        buffer_pool.UnpinPage(second_leaf, true);
+
+        TreeStats damaged = tree.Analyze(parallel);
+        bool chain_reported = false;
+        bool order_reported = false;
+        for (const std::string &message : damaged.errors) {
+            chain_reported |= message.find("leaf " + std::to_string(first_leaf) + " links to") != std::string::npos;
+            order_reported |= message.find("page " + std::to_string(second_leaf) + ": keys out of order") !=
+                              std::string::npos;
+        }
+        std::cout << (chain_reported && order_reported ? "  ✓" : "  ✗") << " Corruption reported: "
+                  << damaged.errors.size() << " errors, first: " << damaged.errors.front() << std::endl;
+    }
+    std::remove(ANALYZE_DB_FILE);
+    {
+        // Ascending inserts split the rightmost leaf at its end, so the
+        // leaves left behind stay full
+        DiskManager disk_manager(ANALYZE_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        for (int key = 0; key < NUM_KEYS; ++key) {
+            tree.Insert(key, "value_" + std::to_string(key));
+        }
+        TreeStats stats = tree.Analyze();
+        std::cout << (stats.IsConsistent() && stats.AverageLeafFill() > 0.95 ? "  ✓" : "  ✗")
+                  << " Ascending inserts fill leaves to " << std::fixed << std::setprecision(1)
+                  << 100 * stats.AverageLeafFill() << "% (" << stats.levels[0].pages << " leaves)" << std::endl;
+    }
+    std::remove(ANALYZE_DB_FILE);
+
+    // ==================== Phase 18: Key-Value Server ====================
+    std::cout << "\n=== Phase 18: Key-Value Server ===" << std::endl;
+    std::remove(SERVER_DB_FILE);
+    {
+        DiskManager disk_manager(SERVER_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        ServerOptions server_options;
+        server_options.unix_path = SERVER_SOCKET;
+        server_options.tcp_port = 0;
+        KvServer server(&tree, server_options);
+        std::thread server_thread([&server] { server.Run(); });
+
+        // 1000 pipelined inserts in one write, answered in order
+        KvClient client(SERVER_SOCKET);
+        for (int key = 0; key < 1000; ++key) {
+            Request request;
+            request.type = RequestType::INSERT;
+            request.key = key;
+            request.value = "server_" + std::to_string(key);
+            client.Send(std::move(request));
+        }
+        bool pipelined_ok = client.Outstanding() == 1000;
+        for (uint32_t id = 1; id <= 1000; ++id) {
+            Response response = client.Receive();
+            pipelined_ok &= response.id == id && response.status == ResponseStatus::OK;
+        }
+        std::cout << (pipelined_ok ? "  ✓" : "  ✗") << " 1000 pipelined inserts answered in order" << std::endl;
+
+        std::optional<std::string> found = client.Search(500);
+        std::vector<std::optional<std::string>> multi = client.MultiGet({1, 5000, 999});
+        std::vector<std::pair<int64_t, std::string>> range = client.Scan(100, 199);
+        bool removed = client.Remove(7);
+        bool removed_missing = client.Remove(5000);
+        bool calls_ok = found == "server_500" && multi.size() == 3 && multi[0] == "server_1" && !multi[1] &&
+                        multi[2] == "server_999" && range.size() == 100 && range.front().first == 100 &&
+                        range.back().second == "server_199" && removed && !removed_missing && !client.Search(7);
+        std::cout << (calls_ok ? "  ✓" : "  ✗") << " Search, MultiGet, Scan and Remove over the socket"
+                  << std::endl;
+
+        // Concurrent clients on both transports see each other's writes
+        int tcp_port = server.TcpPort();
+        std::vector<std::thread> clients;
+        std::atomic<int> client_errors{0};
+        for (int c = 0; c < 4; ++c) {
+            clients.emplace_back([c, tcp_port, &client_errors] {
+                try {
+                    std::unique_ptr<KvClient> own = c % 2 == 0 ? std::make_unique<KvClient>(SERVER_SOCKET)
+                                                               : std::make_unique<KvClient>(tcp_port);
+                    for (int key = 10000 + c * 250; key < 10000 + (c + 1) * 250; ++key) {
+                        own->Insert(key, "client_" + std::to_string(c));
+                    }
+                } catch (const std::exception &) {
+                    client_errors.fetch_add(1);
+                }
+            });
+        }
+        for (std::thread &thread : clients) {
+            thread.join();
+        }
+        KvClient tcp_client(tcp_port);
+        std::vector<std::pair<int64_t, std::string>> written = tcp_client.Scan(10000, 10999);
+        bool concurrent_ok = client_errors.load() == 0 && written.size() == 1000 &&
+                             written[999].second == "client_3";
+        std::cout << (concurrent_ok ? "  ✓" : "  ✗") << " 4 concurrent clients (Unix and TCP on port " << tcp_port
+                  << ") inserted " << written.size() << " keys" << std::endl;
+
+        // One SCAN response is capped; the client pages through the rest
+        Request unbounded;
+        unbounded.type = RequestType::SCAN;
+        unbounded.key = 0;
+        unbounded.end_key = INT64_MAX;
+        tcp_client.Send(std::move(unbounded));
+        size_t one_response = tcp_client.Receive().entries.size();
+        std::vector<std::pair<int64_t, std::string>> everything = tcp_client.Scan(0, INT64_MAX);
+        std::vector<std::pair<int64_t, std::string>> first_five = tcp_client.Scan(0, INT64_MAX, 5);
+        bool paged_ok = one_response == MAX_SCAN_ENTRIES && everything.size() == 1999 &&
+                        everything.back().first == 10999 && first_five.size() == 5 && first_five[4].first == 4;
+        std::cout << (paged_ok ? "  ✓" : "  ✗") << " SCAN response capped at " << one_response
+                  << " entries; client paged " << everything.size() << std::endl;
+
+        // A malformed frame drops only the connection that sent it
+        int raw = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, SERVER_SOCKET);
+        bool raw_connected = connect(raw, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        const char garbage[] = {5, 0, 0, 0, 1, 0, 0, 0, 99};  // Unknown request type
+        ssize_t raw_written = write(raw, garbage, sizeof(garbage));
+        char reply;
+        bool dropped = raw_connected && raw_written == sizeof(garbage) && read(raw, &reply, 1) <= 0;
+        close(raw);
+        bool survivor_ok = client.Search(500) == "server_500";
+        std::cout << (dropped && survivor_ok ? "  ✓" : "  ✗")
+                  << " Malformed frame closes its connection; other clients unaffected" << std::endl;
+
+        server.Stop();
+        server_thread.join();
+        bool disconnected = false;
+        try {
+            client.Search(500);
+        } catch (const std::runtime_error &) {
+            disconnected = true;
+        }
+        std::cout << (disconnected ? "  ✓" : "  ✗") << " Stop() closes open connections" << std::endl;
+    }
+    std::remove(SERVER_DB_FILE);
+
+    // ==================== Phase 19: Redis Protocol ====================
+    std::cout << "\n=== Phase 19: Redis Protocol Front End ===" << std::endl;
+    std::remove(SERVER_DB_FILE);
+    {
+        DiskManager disk_manager(SERVER_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        ServerOptions server_options;
+        server_options.resp_unix_path = RESP_SOCKET;
+        server_options.resp_key_prefix = "key:";
+        KvServer server(&tree, server_options);
+        std::thread server_thread([&server] { server.Run(); });
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, RESP_SOCKET);
+        bool connected = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        // Send a pipeline in one write and read back exactly the expected replies
+        auto exchange = [fd](const std::string &commands, const std::string &expected) {
+            if (write(fd, commands.data(), commands.size()) != static_cast<ssize_t>(commands.size())) {
+                return false;
+            }
+            std::string replies;
+            char buffer[4096];
+            while (replies.size() < expected.size()) {
+                ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
+                if (bytes_read <= 0) {
+                    break;
+                }
+                replies.append(buffer, bytes_read);
+            }
+            return replies == expected;
+        };
+
+        std::string pipeline;
+        std::string expected;
+        for (int key = 0; key < 100; ++key) {
+            std::string k = "key:" + std::to_string(key);
+            std::string v = "v" + std::to_string(key);
+            pipeline += "*3\r\n$3\r\nSET\r\n$" + std::to_string(k.size()) + "\r\n" + k + "\r\n$" +
+                        std::to_string(v.size()) + "\r\n" + v + "\r\n";
+            expected += "+OK\r\n";
+        }
+        bool set_ok = connected && exchange(pipeline, expected);
+        std::cout << (set_ok ? "  ✓" : "  ✗") << " 100 pipelined SETs answered +OK" << std::endl;
+
+        bool commands_ok =
+            exchange("*2\r\n$3\r\nGET\r\n$6\r\nkey:42\r\n", "$3\r\nv42\r\n") &&
+            exchange("GET 4242\r\n", "$-1\r\n") &&
+            exchange("*4\r\n$4\r\nMGET\r\n$1\r\n1\r\n$3\r\nabc\r\n$2\r\n99\r\n",
+                     "*3\r\n$2\r\nv1\r\n$-1\r\n$3\r\nv99\r\n") &&
+            exchange("MSET 500 a 501 b\r\nDEL 500 500 777\r\nEXISTS 500 501\r\n", "+OK\r\n:1\r\n:1\r\n") &&
+            exchange("ZRANGEBYSCORE s (10 12 WITHSCORES\r\n",
+                     "*4\r\n$3\r\nv11\r\n$2\r\n11\r\n$3\r\nv12\r\n$2\r\n12\r\n") &&
+            exchange("ZRANGEBYSCORE s -inf +inf LIMIT 98 10\r\n", "*3\r\n$3\r\nv98\r\n$3\r\nv99\r\n$1\r\nb\r\n") &&
+            exchange("GET user:42\r\nSET order:42 x\r\nGET 42\r\n",
+                     "-ERR key must be a decimal integer\r\n-ERR key must be a decimal integer\r\n$3\r\nv42\r\n") &&
+            exchange("SET 1000 " + std::string(VALUE_SIZE, 'x') + "\r\nPING\r\n",
+                     "-ERR value must be 1 to " + std::to_string(VALUE_SIZE - 1) + " bytes without NUL\r\n+PONG\r\n");
+        std::cout << (commands_ok ? "  ✓" : "  ✗")
+                  << " GET, MGET, MSET, DEL, EXISTS and ZRANGEBYSCORE; only the key: prefix parses" << std::endl;
+
+        std::string hello_reply = "%7\r\n$6\r\nserver\r\n$6\r\nbptree\r\n$7\r\nversion\r\n$5\r\n1.0.0\r\n"
+                                  "$5\r\nproto\r\n:3\r\n$2\r\nid\r\n:0\r\n$4\r\nmode\r\n$10\r\nstandalone\r\n"
+                                  "$4\r\nrole\r\n$6\r\nmaster\r\n$7\r\nmodules\r\n*0\r\n";
+        bool resp3_ok = exchange("HELLO 3\r\n", hello_reply) && exchange("GET 4242\r\n", "_\r\n") &&
+                        exchange("ZRANGEBYSCORE s 1 1 WITHSCORES\r\n", "*1\r\n*2\r\n$2\r\nv1\r\n,1\r\n");
+        std::cout << (resp3_ok ? "  ✓" : "  ✗") << " HELLO 3 switches the connection to RESP3 replies" << std::endl;
+
+        char ignored;
+        bool quit_ok = exchange("QUIT\r\nGET 1\r\n", "+OK\r\n") && read(fd, &ignored, 1) <= 0;
+        close(fd);
+        std::cout << (quit_ok ? "  ✓" : "  ✗") << " QUIT answers, then closes without running later commands"
+                  << std::endl;
+
+        server.Stop();
+        server_thread.join();
+    }
+    std::remove(SERVER_DB_FILE);
+
+    // ==================== Phase 20: Interleaved MultiGet ====================
+    std::cout << "\n=== Phase 20: Interleaved MultiGet ===" << std::endl;
+    std::remove(MULTIGET_DB_FILE);
+    {
+        DiskManager disk_manager(MULTIGET_DB_FILE);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        bool empty_ok = tree.MultiGet({1, 2, 3}) == std::vector<std::optional<std::string>>(3);
+
+        for (int key = 0; key < NUM_KEYS; key += 2) {
+            tree.Insert(key, "multi_" + std::to_string(key));
+        }
+        for (int key = 0; key < NUM_KEYS; key += 10) {
+            tree.Remove(key);
+        }
+        // Random keys with repeats, half of them absent, some removed, some out of range
+        std::mt19937 multiget_rng(20);
+        std::vector<int64_t> lookups;
+        for (int i = 0; i < 3000; ++i) {
+            lookups.push_back(std::uniform_int_distribution<int64_t>(-100, NUM_KEYS + 100)(multiget_rng));
+        }
+        std::vector<std::optional<std::string>> expected;
+        for (int64_t key : lookups) {
+            expected.push_back(tree.Search(key));
+        }
+        bool groups_ok = true;
+        for (size_t group : {size_t(1), size_t(3), MULTIGET_GROUP_SIZE, size_t(1000)}) {
+            groups_ok &= tree.MultiGet(lookups, nullptr, group) == expected;
+        }
+        std::cout << (empty_ok && groups_ok ? "  ✓" : "  ✗") << " MultiGet of " << lookups.size()
+                  << " keys matches Search for group sizes 1, 3, " << MULTIGET_GROUP_SIZE << " and 1000"
+                  << std::endl;
+
+        const Snapshot *snapshot = tree.GetSnapshot();
+        tree.Insert(1, "after_snapshot");
+        tree.Remove(2);
+        std::vector<std::optional<std::string>> now = tree.MultiGet({1, 2});
+        std::vector<std::optional<std::string>> then = tree.MultiGet({1, 2}, snapshot);
+        tree.ReleaseSnapshot(snapshot);
+        bool snapshot_ok = now[0] == "after_snapshot" && !now[1] && !then[0] && then[1] == "multi_2";
+        std::cout << (snapshot_ok ? "  ✓" : "  ✗") << " MultiGet reads as of a snapshot" << std::endl;
+
+        // Every lookup released its pins: the pool can still be cycled through completely
+        ResetStats();
+        tree.MultiGet(lookups);
+        bool pins_ok = tree.Scan(0, NUM_KEYS).size() == static_cast<size_t>(NUM_KEYS / 2 - NUM_KEYS / 10);
+        bool counted = GetStats().Latency(Operation::MULTI_GET).Count() == 1 &&
+                       GetStats().Latency(Operation::SEARCH).Count() == 0;
+        std::cout << (pins_ok && counted ? "  ✓" : "  ✗")
+                  << " No pins leaked; one batch records one multi_get latency" << std::endl;
+    }
+    std::remove(MULTIGET_DB_FILE);
+
+    // ==================== Phase 21: Async Search/Insert ====================
+    std::cout << "\n=== Phase 21: Async Search/Insert Suspending on Pool Misses ===" << std::endl;
+    // io_uring over a plain file, then the pread thread pool over a copy-on-write
+    // file with compressed leaves (reads land in a side buffer, not the frame)
+    for (int variant = 0; variant <= 1; ++variant) {
+        bool thread_pool = variant == 1;
+        std::remove(ASYNC_DB_FILE);
+        TreeOptions options;
+        options.leaf_codec = thread_pool ? PageCodec::LZ : PageCodec::NONE;
+        DiskManager disk_manager(ASYNC_DB_FILE, thread_pool);
+        BufferPoolManager buffer_pool(MAX_PAGES_IN_RAM, &disk_manager);
+        BPlusTree tree(&buffer_pool, "", options);
+        for (int key = 0; key < NUM_KEYS; key += 2) {
+            tree.Insert(key, "async_" + std::to_string(key));
+        }
+        buffer_pool.FlushAllPages();
+
+        std::atomic<int> wrong{0};
+        bool callback_ok = false;
+        size_t peak_reads = 0;
+        AsyncBackend backend;
+        {
+            AsyncTreeOptions async_options;
+            async_options.use_io_uring = !thread_pool;
+            AsyncTree async_tree(&tree, async_options);
+            backend = async_tree.Backend();
+
+            // Four clients each queue searches for a quarter of the keys, then
+            // insert the odd keys of their own share while other clients'
+            // searches are still descending
+            std::vector<std::thread> clients;
+            for (int t = 0; t < 4; ++t) {
+                clients.emplace_back([&, t] {
+                    std::vector<std::pair<int, std::future<std::optional<std::string>>>> searches;
+                    for (int key = t; key < NUM_KEYS; key += 4) {
+                        searches.emplace_back(key, async_tree.Search(key));
+                    }
+                    std::vector<std::future<bool>> inserts;
+                    for (int key = 2 * t + 1; key < NUM_KEYS; key += 8) {
+                        inserts.push_back(async_tree.Insert(key, "async_" + std::to_string(key)));
+                    }
+                    for (auto &[key, future] : searches) {
+                        std::optional<std::string> value = future.get();
+                        bool may_be_absent = key % 2 == 1;  // Unless its insert got there first
+                        if (value ? *value != "async_" + std::to_string(key) : !may_be_absent) {
+                            ++wrong;
+                        }
+                    }
+                    for (std::future<bool> &future : inserts) {
+                        if (!future.get()) {
+                            ++wrong;
+                        }
+                    }
+                });
+            }
+            for (std::thread &client : clients) {
+                client.join();
+            }
+
+            std::promise<bool> called;
+            async_tree.Search(NUM_KEYS + 1, [&](std::optional<std::string> value, std::exception_ptr error) {
+                called.set_value(!value && !error);
+            });
+            callback_ok = called.get_future().get();
+            peak_reads = async_tree.PeakReadsInFlight();
+        }
+
+        // Back to synchronous use once the AsyncTree is gone: every insert landed
+        for (int key = 0; key < NUM_KEYS; ++key) {
+            if (tree.Search(key) != "async_" + std::to_string(key)) {
+                ++wrong;
+            }
+        }
+        std::cout << (wrong == 0 && callback_ok && peak_reads > 1 ? "  ✓" : "  ✗") << " "
+                  << (backend == AsyncBackend::IO_URING ? "io_uring" : "thread pool") << ": " << NUM_KEYS
+                  << " searches and " << NUM_KEYS / 2 << " inserts from 4 threads, up to " << peak_reads
+                  << " reads in flight" << (thread_pool ? " (compressed copy-on-write file)" : "") << std::endl;
+    }
+    std::remove(ASYNC_DB_FILE);
+
+    // ==================== Phase 22: Sharded Store ====================
+    std::cout << "\n=== Phase 22: Hash- and Range-Partitioned Sharded Store ===" << std::endl;
+    ShardedStore::Destroy(SHARDED_STORE);
+    {
+        ShardedStore store(SHARDED_STORE);
+        // Four writers on disjoint keys, in parallel wherever they hit different shards
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&, t] {
+                for (int key = t; key < NUM_KEYS; key += 4) {
+                    store.Insert(key, "shard_" + std::to_string(key));
+                }
+            });
+        }
+        for (std::thread &writer : writers) {
+            writer.join();
+        }
+        bool spread = true;
+        for (size_t s = 0; s < store.NumShards(); ++s) {
+            size_t count = store.ShardTree(s)->Scan(0, NUM_KEYS).size();
+            spread &= count > NUM_KEYS / 8 && count < NUM_KEYS / 2;
+        }
+        auto all = store.Scan(0, NUM_KEYS - 1);
+        bool merged = all.size() == static_cast<size_t>(NUM_KEYS);
+        for (size_t i = 0; merged && i < all.size(); ++i) {
+            merged = all[i].first == static_cast<int64_t>(i) && all[i].second == "shard_" + std::to_string(i);
+        }
+        std::cout << (spread && merged ? "  ✓" : "  ✗") << " " << NUM_KEYS << " keys from 4 threads over "
+                  << store.NumShards() << " hash shards; merged Scan returns them all in order" << std::endl;
+
+        WriteBatch batch;
+        for (int key = 0; key < 40; ++key) {
+            batch.Put(key, "batched_" + std::to_string(key));
+        }
+        batch.Delete(41);
+        store.Write(batch);
+        store.Remove(42);
+        std::vector<std::optional<std::string>> values = store.MultiGet({5, 41, 42, 43, NUM_KEYS + 1});
+        bool point_ok = values[0] == "batched_5" && !values[1] && !values[2] && values[3] == "shard_43" &&
+                        !values[4] && store.Search(39) == "batched_39";
+        auto middle = store.Scan(38, 44);
+        bool range_ok = middle.size() == 5 && middle.front().first == 38 && middle.back().first == 44;
+        std::cout << (point_ok && range_ok ? "  ✓" : "  ✗")
+                  << " Cross-shard WriteBatch, MultiGet and a sub-range Scan" << std::endl;
+    }
+    {
+        // The manifest's layout wins over the options on reopen
+        ShardedStoreOptions options;
+        options.num_shards = 2;
+        ShardedStore store(SHARDED_STORE, options);
+        bool reopened = store.NumShards() == 4 &&
+                        store.Search(NUM_KEYS - 1) == "shard_" + std::to_string(NUM_KEYS - 1) &&
+                        store.Scan(0, NUM_KEYS - 1).size() == static_cast<size_t>(NUM_KEYS - 2);
+        std::cout << (reopened ? "  ✓" : "  ✗") << " Reopened with the recorded 4-shard layout" << std::endl;
+    }
+    ShardedStore::Destroy(SHARDED_STORE);
+    {
+        ShardedStoreOptions options;
+        options.partitioning = Partitioning::RANGE;
+        options.boundaries = {NUM_KEYS / 4, NUM_KEYS / 2, 3 * NUM_KEYS / 4};
+        ShardedStore store(SHARDED_STORE, options);
+        for (int key : keys) {
+            store.Insert(key, "range_" + std::to_string(key));
+        }
+        bool routed = store.ShardOf(-5) == 0 && store.ShardOf(NUM_KEYS / 4) == 1 &&
+                      store.ShardOf(NUM_KEYS) == 3 &&
+                      store.ShardTree(1)->Scan(0, NUM_KEYS).size() == static_cast<size_t>(NUM_KEYS / 4);
+        auto crossing = store.Scan(NUM_KEYS / 4 - 10, NUM_KEYS / 2 + 9);
+        bool crossing_ok = crossing.size() == static_cast<size_t>(NUM_KEYS / 4 + 20) &&
+                           std::is_sorted(crossing.begin(), crossing.end());
+        bool rejected = false;
+        try {
+            ShardedStoreOptions bad;
+            bad.partitioning = Partitioning::RANGE;
+            bad.boundaries = {10, 5, 20};
+            ShardedStore invalid("test_sharded_invalid", bad);
+        } catch (const std::runtime_error &) {
+            rejected = true;
+        }
+        std::cout << (routed && crossing_ok && rejected ? "  ✓" : "  ✗")
+                  << " Range shards: routing, a Scan across a boundary, unordered boundaries rejected" << std::endl;
+    }
+    ShardedStore::Destroy(SHARDED_STORE);
+
+    // ==================== Phase 23: Splitting and Moving Partitions ====================
+    std::cout << "\n=== Phase 23: Range Partitions That Split and Migrate ===" << std::endl;
+    std::filesystem::create_directories(VOLUME_A);
+    std::filesystem::create_directories(VOLUME_B);
+    auto count_files = [](const char *directory) {
+        return std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator());
+    };
+    {
+        // One partition to start with; it splits by size while four writers load it
+        ShardedStoreOptions options;
+        options.num_shards = 1;
+        options.partitioning = Partitioning::RANGE;
+        options.split_pages = 60;
+        options.volumes = {VOLUME_A, VOLUME_B};
+        ShardedStore store(SHARDED_STORE, options);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&, t] {
+                for (size_t i = t; i < keys.size(); i += 4) {
+                    store.Insert(keys[i], "part_" + std::to_string(keys[i]));
+                }
+            });
+        }
+        for (std::thread &writer : writers) {
+            writer.join();
+        }
+        std::vector<PartitionInfo> partitions = store.Partitions();
+        bool ordered = !partitions[0].lower_bound;
+        for (size_t i = 1; i < partitions.size(); ++i) {
+            ordered &= partitions[i].lower_bound &&
+                       (i == 1 || *partitions[i].lower_bound > *partitions[i - 1].lower_bound);
+        }
+        auto all = store.Scan(0, NUM_KEYS - 1);
+        bool complete = all.size() == static_cast<size_t>(NUM_KEYS) && store.Search(1234) == "part_1234";
+        for (size_t i = 0; complete && i < all.size(); ++i) {
+            complete = all[i].first == static_cast<int64_t>(i);
+        }
+        // Every superseded file is gone; the rest are spread over both volumes
+        auto on_a = count_files(VOLUME_A);
+        auto on_b = count_files(VOLUME_B);
+        bool placed = on_a + on_b == static_cast<long>(partitions.size()) && std::abs(on_a - on_b) <= 1;
+        std::cout << (partitions.size() > 4 && ordered && complete && placed ? "  ✓" : "  ✗")
+                  << " Size splits during a 4-thread load: " << partitions.size() << " partitions (" << on_a
+                  << " on " << VOLUME_A << ", " << on_b << " on " << VOLUME_B << "), all keys in order" << std::endl;
+
+        size_t before = partitions.size();
+        std::string hot_volume = partitions[0].volume;
+        std::string other_volume = hot_volume == VOLUME_A ? VOLUME_B : VOLUME_A;
+        store.MovePartition(0, other_volume);
+        partitions = store.Partitions();
+        bool moved = partitions.size() == before && partitions[0].volume == other_volume &&
+                     std::filesystem::exists(partitions[0].file) && store.Search(0) == "part_0" &&
+                     count_files(VOLUME_A) + count_files(VOLUME_B) == static_cast<long>(before);
+        std::cout << (moved ? "  ✓" : "  ✗") << " MovePartition rewrote partition 0 onto " << other_volume
+                  << std::endl;
+
+        // A manifest that cannot be written leaves the routing table and files as they were
+        std::string blocked = std::string(SHARDED_STORE) + ".tmp";
+        std::filesystem::create_directory(blocked);
+        bool refused = false;
+        try {
+            store.MovePartition(0, hot_volume);
+        } catch (const std::runtime_error &) {
+            refused = true;
+        }
+        std::filesystem::remove(blocked);
+        std::vector<PartitionInfo> after_failure = store.Partitions();
+        bool unchanged = refused && after_failure.size() == before && after_failure[0].file == partitions[0].file &&
+                         store.Search(0) == "part_0" &&
+                         count_files(VOLUME_A) + count_files(VOLUME_B) == static_cast<long>(before);
+        std::cout << (unchanged ? "  ✓" : "  ✗")
+                  << " A failed manifest write kept the old routing table and removed the new file" << std::endl;
+    }
+    {
+        // A partition keeps serving writes while its split is built; they are
+        // replayed into the new files, and the other partition never waits
+        ShardedStoreOptions options;
+        options.num_shards = 2;
+        options.partitioning = Partitioning::RANGE;
+        options.boundaries = {1000000};
+        ShardedStore::Destroy(LIVE_SPLIT_STORE);
+        ShardedStore store(LIVE_SPLIT_STORE, options);
+        std::map<int64_t, std::string> model;
+        for (int64_t key = 0; key < 20000; ++key) {
+            store.Insert(key, "before");
+            model[key] = "before";
+        }
+        std::atomic<bool> splitting{true};
+        auto split_start = std::chrono::steady_clock::now();
+        std::thread splitter([&] {
+            store.SplitPartition(0);
+            splitting = false;
+        });
+        std::mt19937_64 rng(23);
+        size_t during = 0;
+        std::chrono::steady_clock::duration longest_wait{};
+        while (splitting.load()) {
+            auto write_start = std::chrono::steady_clock::now();
+            int64_t key = static_cast<int64_t>(rng() % 20000);
+            if (during % 4 == 3) {
+                store.Remove(key);
+                model.erase(key);
+            } else {
+                std::string value = "during_" + std::to_string(during);
+                store.Insert(key, value);
+                model[key] = value;
+            }
+            store.Insert(1000000 + static_cast<int64_t>(during), "other");
+            longest_wait = std::max(longest_wait, std::chrono::steady_clock::now() - write_start);
+            ++during;
+        }
+        splitter.join();
+        auto split_time = std::chrono::steady_clock::now() - split_start;
+        std::vector<std::pair<int64_t, std::string>> expected(model.begin(), model.end());
+        bool replayed = store.NumShards() == 3 && store.Scan(0, 19999) == expected &&
+                        store.Scan(1000000, INT64_MAX).size() == during;
+        auto ms = [](std::chrono::steady_clock::duration d) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+        };
+        std::cout << (replayed && longest_wait * 2 < split_time ? "  ✓" : "  ✗") << " " << during
+                  << " writes ran during a " << ms(split_time) << " ms split, none waiting over "
+                  << ms(longest_wait) << " ms; all reached the new files" << std::endl;
+    }
+    ShardedStore::Destroy(LIVE_SPLIT_STORE);
+    {
+        // Traffic on a narrow hot range splits its partition inside that range
+        ShardedStoreOptions options;
+        options.split_operations = 2000;
+        options.volumes = {VOLUME_A, VOLUME_B};
+        ShardedStore store(SHARDED_STORE, options);
+        size_t hot = store.ShardOf(5000);
+        size_t before = store.NumShards();
+        for (int i = 0; i < 4000; ++i) {
+            store.Search(5000 + i % 50);
+        }
+        std::vector<PartitionInfo> partitions = store.Partitions();
+        bool split_inside = false;
+        for (const PartitionInfo &partition : partitions) {
+            split_inside |= partition.lower_bound && *partition.lower_bound > 5000 && *partition.lower_bound < 5050;
+        }
+        bool intact = store.Scan(0, NUM_KEYS - 1).size() == static_cast<size_t>(NUM_KEYS);
+        std::cout << (partitions.size() > before && split_inside && intact ? "  ✓" : "  ✗")
+                  << " Traffic split of partition " << hot << " at the median of its hot keys" << std::endl;
+    }
+    {
+        ShardedStore store(SHARDED_STORE);
+        std::cout << (store.Scan(0, NUM_KEYS - 1).size() == static_cast<size_t>(NUM_KEYS) ? "  ✓" : "  ✗")
+                  << " Reopened from the manifest's routing table: " << store.NumShards() << " partitions"
+                  << std::endl;
+    }
+    ShardedStore::Destroy(SHARDED_STORE);
+    std::filesystem::remove_all(VOLUME_A);
+    std::filesystem::remove_all(VOLUME_B);
+
+    // ==================== Phase 24: Replication ====================
+    std::cout << "\n=== Phase 24: Log-Based Replication to a Follower ===" << std::endl;
+    std::remove(PRIMARY_DB_FILE);
+    std::remove(FOLLOWER_DB_FILE);
+    {
+        DiskManager primary_disk(PRIMARY_DB_FILE);
+        BufferPoolManager primary_pool(MAX_PAGES_IN_RAM, &primary_disk);
+        BPlusTree primary_tree(&primary_pool);
+        std::mutex primary_mutex;
+        for (int key = 0; key < 5000; ++key) {
+            primary_tree.Insert(key, "rep_" + std::to_string(key));
+        }
+        // The follower's file starts out with keys the primary lacks or holds differently
+        DiskManager follower_disk(FOLLOWER_DB_FILE);
+        BufferPoolManager follower_pool(MAX_PAGES_IN_RAM, &follower_disk);
+        BPlusTree follower_tree(&follower_pool);
+        std::mutex follower_mutex;
+        follower_tree.Insert(-5, "stale");
+        follower_tree.Insert(100, "old");
+        follower_tree.Insert(99999, "stale");
+        auto replicas_match = [&] {
+            std::lock_guard<std::mutex> primary_lock(primary_mutex);
+            std::lock_guard<std::mutex> follower_lock(follower_mutex);
+            return primary_tree.Scan(INT64_MIN, INT64_MAX) == follower_tree.Scan(INT64_MIN, INT64_MAX);
+        };
+
+        ReplicationOptions options;
+        options.snapshot_chunk = 256;
+        auto primary = std::make_unique<ReplicationPrimary>(&primary_tree, &primary_mutex, REPLICATION_SOCKET,
+                                                            options);
+        ReplicationFollower follower(&follower_tree, &follower_mutex, REPLICATION_SOCKET);
+        bool synced = follower.WaitFor(primary->Epoch(), primary->Sequence(), std::chrono::seconds(10)) &&
+                      replicas_match() && follower.Resyncs() == 1;
+        std::cout << (synced ? "  ✓" : "  ✗") << " Snapshot resync in chunks of 256: follower file matches the "
+                  << "primary's 5000 keys, stale keys removed" << std::endl;
+
+        // Writes stream while a reader scans the follower; each batch of four
+        // keys must show up whole or not at all
+        std::atomic<bool> writing{true};
+        std::atomic<int> torn{0};
+        std::atomic<int> follower_scans{0};
+        std::thread reader([&] {
+            while (writing.load()) {
+                std::vector<std::pair<int64_t, std::string>> batches;
+                {
+                    std::lock_guard<std::mutex> lock(follower_mutex);
+                    batches = follower_tree.Scan(100000, 199999);
+                }
+                torn.fetch_add(batches.size() % 4 != 0);
+                follower_scans.fetch_add(1);
+            }
+        });
+        for (int i = 0; i < 3000; ++i) {
+            std::lock_guard<std::mutex> lock(primary_mutex);
+            if (i % 3 == 0) {
+                primary_tree.Remove(i);
+            } else if (i % 3 == 1) {
+                primary_tree.Insert(5000 + i, "live_" + std::to_string(i));
+            } else {
+                WriteBatch batch;
+                for (int k = 0; k < 4; ++k) {
+                    batch.Put(100000 + i * 4 + k, "batch_" + std::to_string(i));
+                }
+                primary_tree.Write(batch);
+            }
+        }
+        bool caught_up = follower.WaitFor(primary->Epoch(), primary->Sequence(), std::chrono::seconds(10));
+        writing.store(false);
+        reader.join();
+        bool streamed = caught_up && replicas_match() && torn.load() == 0 && follower.Resyncs() == 1;
+        std::cout << (streamed ? "  ✓" : "  ✗") << " 3000 inserts, removes and batches streamed during "
+                  << follower_scans.load() << " follower scans; batches applied whole" << std::endl;
+
+        // A restarted primary has a new epoch: the follower reconnects and
+        // resynchronizes, picking up what changed while nobody streamed it
+        primary.reset();
+        {
+            std::lock_guard<std::mutex> lock(primary_mutex);
+            for (int key = 1; key < 100; key += 3) {
+                primary_tree.Remove(key);
+            }
+            primary_tree.Insert(200000, "offline");
+        }
+        primary = std::make_unique<ReplicationPrimary>(&primary_tree, &primary_mutex, REPLICATION_SOCKET);
+        bool resynced = follower.WaitFor(primary->Epoch(), primary->Sequence(), std::chrono::seconds(10)) &&
+                        replicas_match() && follower.Resyncs() == 2 && primary->Resyncs() == 1;
+        std::cout << (resynced ? "  ✓" : "  ✗") << " Follower reconnected to a restarted primary and resynced"
+                  << std::endl;
+        primary.reset();
+    }
+    std::remove(PRIMARY_DB_FILE);
+    std::remove(FOLLOWER_DB_FILE);
+    {
+        // A follower server answers reads and refuses writes on both protocols
+        DiskManager primary_disk(PRIMARY_DB_FILE);
+        BufferPoolManager primary_pool(MAX_PAGES_IN_RAM, &primary_disk);
+        BPlusTree primary_tree(&primary_pool);
+        ServerOptions primary_options;
+        primary_options.unix_path = SERVER_SOCKET;
+        primary_options.replication_path = REPLICATION_SOCKET;
+        KvServer primary_server(&primary_tree, primary_options);
+        std::thread primary_thread([&primary_server] { primary_server.Run(); });
+
+        DiskManager follower_disk(FOLLOWER_DB_FILE);
+        BufferPoolManager follower_pool(MAX_PAGES_IN_RAM, &follower_disk);
+        BPlusTree follower_tree(&follower_pool);
+        ServerOptions follower_options;
+        follower_options.unix_path = FOLLOWER_SOCKET;
+        follower_options.resp_unix_path = RESP_SOCKET;
+        follower_options.follow_path = REPLICATION_SOCKET;
+        KvServer follower_server(&follower_tree, follower_options);
+        std::thread follower_thread([&follower_server] { follower_server.Run(); });
+
+        KvClient primary_client(SERVER_SOCKET);
+        for (int key = 0; key < 1000; ++key) {
+            Request request;
+            request.type = RequestType::INSERT;
+            request.key = key;
+            request.value = "served_" + std::to_string(key);
+            primary_client.Send(std::move(request));
+        }
+        for (int i = 0; i < 1000; ++i) {
+            primary_client.Receive();
+        }
+        primary_client.Remove(10);
+        ReplicationPrimary *primary = primary_server.Primary();
+        bool caught_up = follower_server.Follower()->WaitFor(primary->Epoch(), primary->Sequence(),
+                                                             std::chrono::seconds(10));
+        KvClient follower_client(FOLLOWER_SOCKET);
+        std::vector<std::pair<int64_t, std::string>> range = follower_client.Scan(0, 999);
+        bool reads_ok = caught_up && range.size() == 999 && range[500].second == "served_501" &&
+                        !follower_client.Search(10) && primary->Followers() == 1;
+        bool refused = false;
+        try {
+            follower_client.Insert(5, "direct");
+        } catch (const std::runtime_error &e) {
+            refused = std::strstr(e.what(), "read-only") != nullptr;
+        }
+
+        int raw = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, RESP_SOCKET);
+        bool raw_connected = connect(raw, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        const char command[] = "SET 5 direct\r\nGET 5\r\n";
+        ssize_t raw_written = write(raw, command, sizeof(command) - 1);
+        std::string reply;
+        char buffer[256];
+        while (raw_connected && raw_written > 0 && reply.find("served_5") == std::string::npos) {
+            ssize_t n = read(raw, buffer, sizeof(buffer));
+            if (n <= 0) {
+                break;
+            }
+            reply.append(buffer, n);
+        }
+        close(raw);
+        refused &= reply.rfind("-READONLY", 0) == 0 && reply.find("served_5") != std::string::npos;
+        std::cout << (reads_ok && refused ? "  ✓" : "  ✗") << " Follower server: " << range.size()
+                  << " keys scanned off the replica; writes refused over both protocols" << std::endl;
+
+        follower_server.Stop();
+        follower_thread.join();
+        primary_server.Stop();
+        primary_thread.join();
+    }
+    std::remove(PRIMARY_DB_FILE);
+    std::remove(FOLLOWER_DB_FILE);
+
+    // ==================== Phase 25: Write Buffers ====================
+    std::cout << "\n=== Phase 25: Bε-Style Write Buffers on Internal Pages ===" << std::endl;
+    std::remove(BUFFERED_DB_FILE);
+    {
+        std::map<int64_t, std::string> model;
+        TreeOptions options;
+        options.write_buffer_entries = 128;
+        options.write_buffer_total_entries = 512;
+        {
+            DiskManager disk_manager(BUFFERED_DB_FILE);
+            BufferPoolManager buffer_pool(64, &disk_manager);
+            BPlusTree tree(&buffer_pool, "", options);
+            std::mt19937_64 rng(2025);
+            size_t most_buffered = 0;
+            for (int i = 0; i < 30000; ++i) {
+                int64_t key = static_cast<int64_t>(rng() % 20000);
+                std::string value = "buf_" + std::to_string(i);
+                uint64_t action = rng() % 10;
+                if (action < 7) {
+                    tree.Insert(key, value);
+                    model[key] = value;
+                } else if (action < 9) {
+                    tree.Remove(key);
+                    model.erase(key);
+                } else {
+                    WriteBatch batch;
+                    for (int64_t k = 1; k <= 4; ++k) {
+                        batch.Put(key + k * 7, value);
+                        model[key + k * 7] = value;
+                    }
+                    batch.Delete(key);
+                    model.erase(key);
+                    tree.Write(batch);
+                }
+                most_buffered = std::max(most_buffered, tree.BufferedWrites());
+            }
+            bool searches = true;
+            for (int64_t key = -10; key < 20040; ++key) {
+                auto it = model.find(key);
+                searches &= tree.Search(key) == (it == model.end() ? std::nullopt
+                                                                   : std::optional<std::string>(it->second));
+            }
+            std::vector<std::pair<int64_t, std::string>> expected(model.begin(), model.end());
+            bool scans = tree.Scan(INT64_MIN, INT64_MAX) == expected;
+            auto from = model.lower_bound(5000);
+            std::vector<std::pair<int64_t, std::string>> expected_limited(from, std::next(from, 100));
+            scans &= tree.Scan(5000, 15000, nullptr, 100) == expected_limited;
+            std::vector<int64_t> lookups;
+            for (int i = 0; i < 1000; ++i) {
+                lookups.push_back(static_cast<int64_t>(rng() % 20000));
+            }
+            std::vector<std::optional<std::string>> found = tree.MultiGet(lookups);
+            for (size_t i = 0; i < lookups.size(); ++i) {
+                auto it = model.find(lookups[i]);
+                scans &= found[i] == (it == model.end() ? std::nullopt : std::optional<std::string>(it->second));
+            }
+            std::cout << (searches && scans && most_buffered > 128 && most_buffered <= 512 ? "  ✓" : "  ✗")
+                      << " 30000 random inserts, removes and batches, up to " << most_buffered
+                      << " buffered at once (cap 512): Search, Scan and MultiGet match" << std::endl;
+
+            // Buffered overwrites and deletes stay invisible to an older snapshot
+            const Snapshot *snapshot = tree.GetSnapshot();
+            for (int64_t key = 0; key < 20000; key += 5) {
+                if (key % 2 == 0) {
+                    tree.Insert(key, "later");
+                } else {
+                    tree.Remove(key);
+                }
+            }
+            bool isolated = tree.Scan(INT64_MIN, INT64_MAX, snapshot) == expected &&
+                            tree.Search(10) == "later" && !tree.Search(15);
+            tree.ReleaseSnapshot(snapshot);
+            for (int64_t key = 0; key < 20000; key += 5) {
+                if (key % 2 == 0) {
+                    model[key] = "later";
+                } else {
+                    model.erase(key);
+                }
+            }
+            std::cout << (isolated ? "  ✓" : "  ✗")
+                      << " A snapshot ignores buffered overwrites and deletes made after it" << std::endl;
+
+            // Buffered values read as the leaf will store them
+            tree.Insert(40000, std::string(200, 'x'));
+            tree.Insert(40001, "");
+            tree.Insert(40002, std::string("ab\0cd", 5));
+            auto stored_as_leaf = [&] {
+                return tree.Search(40000) == std::string(VALUE_SIZE - 1, 'x') && !tree.Search(40001) &&
+                       tree.Search(40002) == "ab" && tree.Scan(40000, 40002).size() == 2;
+            };
+            bool normalized = tree.BufferedWrites() > 0 && stored_as_leaf();
+            tree.FlushBuffers();
+            normalized &= stored_as_leaf();
+            model[40000] = std::string(VALUE_SIZE - 1, 'x');
+            model[40002] = "ab";
+            std::cout << (normalized ? "  ✓" : "  ✗")
+                      << " A 200-byte, an empty and a NUL-cut value read the same before and after the flush"
+                      << std::endl;
+
+            TreeStats stats = tree.Analyze();
+            std::cout << (stats.IsConsistent() && tree.BufferedWrites() == 0 && stats.live_entries == model.size()
+                          ? "  ✓" : "  ✗")
+                      << " Analyze applied every buffered write: " << stats.live_entries
+                      << " live entries, tree consistent" << std::endl;
+
+            // Removes report missing keys unless they are blind
+            TreeOptions blind_options = options;
+            blind_options.blind_removes = true;
+            BPlusTree blind(&buffer_pool, "blind", blind_options);
+            for (int64_t key = 0; key < 100; ++key) {
+                blind.Insert(key, "blind");
+            }
+            bool removes_ok = tree.BufferedWrites() == 0 && tree.Remove(10) && tree.BufferedWrites() == 1 &&
+                              !tree.Remove(15) && !tree.Remove(987654) && tree.BufferedWrites() == 1 &&
+                              blind.Remove(987654) && blind.Remove(5);
+            model.erase(10);
+            std::cout << (removes_ok ? "  ✓" : "  ✗")
+                      << " Buffered Remove returns false for missing keys; with blind_removes always true"
+                      << std::endl;
+
+            for (int64_t key = 30000; key < 30500; ++key) {
+                tree.Insert(key, "at_close");
+                model[key] = "at_close";
+            }
+            size_t buffered_before_flush = tree.BufferedWrites();
+            buffer_pool.FlushAllPages();
+            std::cout << (buffered_before_flush > 0 && tree.BufferedWrites() == 0 && blind.BufferedWrites() == 0
+                          ? "  ✓" : "  ✗")
+                      << " FlushAllPages applied " << buffered_before_flush << " buffered writes first" << std::endl;
+        }
+        {
+            DiskManager disk_manager(BUFFERED_DB_FILE);
+            BufferPoolManager buffer_pool(64, &disk_manager);
+            BPlusTree tree(&buffer_pool);
+            std::vector<std::pair<int64_t, std::string>> expected(model.begin(), model.end());
+            std::cout << (tree.Scan(INT64_MIN, INT64_MAX) == expected ? "  ✓" : "  ✗")
+                      << " Writes buffered until the pool flush at close reached the file" << std::endl;
+        }
+    }
+    {
+        // Random inserts into a tree much larger than its pool
+        auto cold_inserts = [](size_t write_buffer_entries) {
+            std::remove(BUFFERED_DB_FILE);
+            DiskManager disk_manager(BUFFERED_DB_FILE);
+            BufferPoolManager buffer_pool(32, &disk_manager);
+            TreeOptions options;
+            options.write_buffer_entries = write_buffer_entries;
+            BPlusTree tree(&buffer_pool, "", options);
+            for (int64_t key = 0; key < 40000; ++key) {
+                tree.Insert(key * 16, "loaded");
+            }
+            tree.FlushBuffers();
+            ResetStats();
+            std::mt19937_64 rng(7);
+            for (int i = 0; i < 20000; ++i) {
+                tree.Insert(static_cast<int64_t>(rng() % 640000), "random");
+            }
+            tree.FlushBuffers();
+            return GetStats().Get(Counter::POOL_MISSES);
+        };
+        uint64_t direct = cold_inserts(0);
+        uint64_t buffered = cold_inserts(1024);
+        std::cout << (buffered * 3 < direct ? "  ✓" : "  ✗") << " 20000 random inserts into 40000 keys through a "
+                  << "32-frame pool: " << direct << " page reads written through, " << buffered << " buffered"
+                  << std::endl;
+    }
+    std::remove(BUFFERED_DB_FILE);
+
+    // ==================== Phase 26: Memtable Ingestion ====================
+    std::cout << "\n=== Phase 26: Memtable Ingestion with Sorted Merges ===" << std::endl;
+    std::remove(MEMTABLE_DB_FILE);
+    {
+        DiskManager disk_manager(MEMTABLE_DB_FILE);
+        BufferPoolManager buffer_pool(64, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        std::mutex tree_mutex;
+        for (int64_t key = 0; key < 10000; ++key) {
+            tree.Insert(key, "base");
+        }
+
+        // Four writers own disjoint keys; a reader checks the preloaded keys
+        // throughout, while tables are sealed and merged under it
+        constexpr int WRITERS = 4;
+        std::vector<std::map<int64_t, std::string>> written(WRITERS);
+        std::atomic<bool> writing{true};
+        std::atomic<int> misread{0};
+        std::atomic<uint64_t> reads{0};
+        {
+            MemTableOptions options;
+            options.memtable_bytes = 64 << 10;
+            options.merge_batch = 512;
+            MemTableTree memtable(&tree, &tree_mutex, options);
+            std::thread reader([&] {
+                std::mt19937_64 rng(11);
+                while (writing) {
+                    int64_t key = static_cast<int64_t>(rng() % 10000);
+                    misread += memtable.Search(key) != "base";
+                    if (reads++ % 64 == 0) {
+                        int64_t last = std::min<int64_t>(key + 20, 9999);
+                        misread += memtable.Scan(key, last).size() != static_cast<size_t>(last - key + 1);
+                    }
+                }
+            });
+            std::vector<std::thread> writers;
+            for (int w = 0; w < WRITERS; ++w) {
+                writers.emplace_back([&, w] {
+                    std::mt19937_64 rng(100 + w);
+                    for (int i = 0; i < 6000; ++i) {
+                        int64_t key = 10000 + static_cast<int64_t>(rng() % 5000) * WRITERS + w;
+                        if (rng() % 5 == 0) {
+                            memtable.Remove(key);
+                            written[w].erase(key);
+                        } else {
+                            std::string value = "m" + std::to_string(w) + "_" + std::to_string(i);
+                            memtable.Insert(key, value);
+                            written[w][key] = value;
+                        }
+                    }
+                });
+            }
+            for (std::thread &writer : writers) {
+                writer.join();
+            }
+            writing = false;
+            reader.join();
+
+            std::map<int64_t, std::string> model;
+            for (int64_t key = 0; key < 10000; ++key) {
+                model[key] = "base";
+            }
+            for (const auto &part : written) {
+                model.insert(part.begin(), part.end());
+            }
+            std::vector<std::pair<int64_t, std::string>> expected(model.begin(), model.end());
+            bool before_flush = memtable.Scan(INT64_MIN, INT64_MAX) == expected;
+            for (int64_t key = 10000; key < 30000; key += 7) {
+                auto it = model.find(key);
+                before_flush &= memtable.Search(key) == (it == model.end() ? std::nullopt
+                                                                           : std::optional<std::string>(it->second));
+            }
+            std::cout << (before_flush && misread == 0 && memtable.Merges() > 0 ? "  ✓" : "  ✗")
+                      << " 4 writers x 6000 inserts/removes with a concurrent reader (" << reads
+                      << " reads): " << memtable.Merges() << " merges, " << memtable.MemTableEntries()
+                      << " entries still in memory, reads see every write" << std::endl;
+
+            memtable.Flush();
+            bool merged = memtable.MemTableEntries() == 0;
+            {
+                std::lock_guard<std::mutex> lock(tree_mutex);
+                merged &= tree.Scan(INT64_MIN, INT64_MAX) == expected;
+            }
+            std::cout << (merged ? "  ✓" : "  ✗") << " Flush merged every table: the tree alone holds "
+                      << expected.size() << " entries, " << memtable.MergedEntries() << " merged in total"
+                      << std::endl;
+
+            // Values enter the memtable as the tree stores them
+            const std::vector<std::pair<int64_t, std::string>> odd_values = {
+                {50000, std::string(200, 'x')},   {50001, ""}, {50002, std::string("ab\0cd", 5)},
+                {50003, std::string(70000, 'y')}, {50004, std::string(65535, 'z')}};
+            for (const auto &[key, value] : odd_values) {
+                memtable.Insert(key, value);
+            }
+            auto stored_as_leaf = [&] {
+                return memtable.Search(50000) == std::string(VALUE_SIZE - 1, 'x') && !memtable.Search(50001) &&
+                       memtable.Search(50002) == "ab" && memtable.Search(50003) == std::string(VALUE_SIZE - 1, 'y') &&
+                       memtable.Search(50004) == std::string(VALUE_SIZE - 1, 'z') &&
+                       memtable.Scan(50000, 50004).size() == 4;
+            };
+            bool normalized = memtable.MemTableEntries() > 0 && stored_as_leaf();
+            memtable.Flush();
+            normalized &= stored_as_leaf();
+            MemTable table;
+            try {
+                table.Put(1, std::string(70000, 'v'));  // Would wrap the 16-bit length
+                normalized = false;
+            } catch (const std::runtime_error &) {
+            }
+            std::cout << (normalized && table.Entries() == 0 ? "  ✓" : "  ✗")
+                      << " Oversized (200, 65535 and 70000 bytes), empty and NUL-cut values read the same before and "
+                      << "after the merge" << std::endl;
+        }
+        TreeStats stats = tree.Analyze();
+        std::cout << (stats.IsConsistent() ? "  ✓" : "  ✗") << " Tree consistent after the merges" << std::endl;
+    }
+    {
+        // Foreground writes into a tree much larger than its pool
+        std::remove(MEMTABLE_DB_FILE);
+        DiskManager disk_manager(MEMTABLE_DB_FILE);
+        BufferPoolManager buffer_pool(32, &disk_manager);
+        BPlusTree tree(&buffer_pool);
+        std::mutex tree_mutex;
+        for (int64_t key = 0; key < 40000; ++key) {
+            tree.Insert(key * 16, "loaded");
+        }
+        std::vector<int64_t> keys;
+        std::mt19937_64 rng(7);
+        for (int i = 0; i < 20000; ++i) {
+            keys.push_back(static_cast<int64_t>(rng() % 640000));
+        }
+
+        ResetStats();
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t key : keys) {
+            tree.Insert(key, "random");
+        }
+        double direct_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        uint64_t direct_misses = GetStats().Get(Counter::POOL_MISSES);
+
+        MemTableOptions options;
+        options.merge_interval = std::chrono::milliseconds(0);  // Merge only on Flush
+        MemTableTree memtable(&tree, &tree_mutex, options);
+        ResetStats();
+        start = std::chrono::steady_clock::now();
+        for (int64_t key : keys) {
+            memtable.Insert(key + 1, "ingested");
+        }
+        double ingest_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        uint64_t ingest_misses = GetStats().Get(Counter::POOL_MISSES);
+        start = std::chrono::steady_clock::now();
+        memtable.Flush();
+        double merge_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        uint64_t merge_misses = GetStats().Get(Counter::POOL_MISSES);
+
+        bool decoupled = ingest_misses == 0 && merge_misses * 2 < direct_misses;
+        std::cout << (decoupled && memtable.Search(keys[0] + 1) == "ingested" ? "  ✓" : "  ✗")
+                  << " 20000 random inserts through a 32-frame pool: written through " << direct_misses
+                  << " page reads in " << std::fixed << std::setprecision(1) << direct_ms << " ms; into the memtable "
+                  << ingest_misses << " in " << ingest_ms << " ms, merged with " << merge_misses << " in " << merge_ms
+                  << " ms" << std::endl;
+        std::cout << std::defaultfloat;
+    }
+    std::remove(MEMTABLE_DB_FILE);
+
     std::cout << "\n*** B+ Tree test completed successfully! ***" << std::endl;
 
     std::remove(DB_FILE);
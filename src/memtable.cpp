@@ -0,0 +1,370 @@
+#include "memtable.h"
+#include "write_batch.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <new>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t ARENA_BLOCK = 64 << 10;
+constexpr int BRANCHING = 4;  // A node reaches each further level with probability 1/BRANCHING
+
+}  // namespace
+
+// ==================== MemTable ====================
+
+MemTable::MemTable()
+    : max_height_(1), random_state_(0x9e3779b97f4a7c15ULL), block_next_(nullptr), block_left_(0), entries_(0),
+      bytes_(0) {
+    head_ = NewNode(std::numeric_limits<int64_t>::min(), MAX_HEIGHT);
+}
+
+void *MemTable::Allocate(size_t bytes) {
+    bytes = (bytes + alignof(Node) - 1) & ~(alignof(Node) - 1);
+    if (bytes > block_left_) {
+        size_t size = std::max(bytes, ARENA_BLOCK);
+        blocks_.push_back(std::make_unique<char[]>(size));
+        block_next_ = blocks_.back().get();
+        block_left_ = size;
+    }
+    void *memory = block_next_;
+    block_next_ += bytes;
+    block_left_ -= bytes;
+    return memory;
+}
+
+MemTable::Node *MemTable::NewNode(int64_t key, int height) {
+    void *memory = Allocate(sizeof(Node) + (height - 1) * sizeof(std::atomic<Node *>));
+    Node *node = new (memory) Node;
+    node->key = key;
+    for (int level = 0; level < height; ++level) {
+        new (&node->next[level]) std::atomic<Node *>(nullptr);
+    }
+    return node;
+}
+
+int MemTable::RandomHeight() {
+    int height = 1;
+    while (height < MAX_HEIGHT) {
+        // xorshift64
+        random_state_ ^= random_state_ << 13;
+        random_state_ ^= random_state_ >> 7;
+        random_state_ ^= random_state_ << 17;
+        if (random_state_ % BRANCHING != 0) {
+            break;
+        }
+        ++height;
+    }
+    return height;
+}
+
+MemTable::Node *MemTable::FindGreaterOrEqual(int64_t key, Node **prev) const {
+    Node *node = head_;
+    for (int level = max_height_.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+        Node *next = node->next[level].load(std::memory_order_acquire);
+        while (next && next->key < key) {
+            node = next;
+            next = node->next[level].load(std::memory_order_acquire);
+        }
+        if (prev) {
+            prev[level] = node;
+        }
+        if (level == 0) {
+            return next;
+        }
+    }
+    return nullptr;
+}
+
+void MemTable::Put(int64_t key, const std::optional<std::string> &value) {
+    if (value && value->size() >= VALUE_SIZE) {
+        throw std::runtime_error("Memtable value longer than " + std::to_string(VALUE_SIZE - 1) + " bytes");
+    }
+    // The new node goes before the key's older nodes, so Get meets it first
+    Node *prev[MAX_HEIGHT];
+    FindGreaterOrEqual(key, prev);
+
+    int height = RandomHeight();
+    int max_height = max_height_.load(std::memory_order_relaxed);
+    if (height > max_height) {
+        for (int level = max_height; level < height; ++level) {
+            prev[level] = head_;
+        }
+        // A reader seeing the new height before the node finds null links at
+        // the new levels from head_ and just descends
+        max_height_.store(height, std::memory_order_relaxed);
+    }
+
+    Node *node = NewNode(key, height);
+    if (value) {
+        char *bytes = static_cast<char *>(Allocate(value->size()));
+        std::memcpy(bytes, value->data(), value->size());
+        node->value = bytes;
+        node->value_size = static_cast<uint16_t>(value->size());
+    } else {
+        node->value = nullptr;
+        node->value_size = DELETED;
+    }
+
+    // Publish bottom-up: once a reader can reach the node, it is complete
+    for (int level = 0; level < height; ++level) {
+        node->next[level].store(prev[level]->next[level].load(std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+        prev[level]->next[level].store(node, std::memory_order_release);
+    }
+    entries_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(sizeof(Node) + (height - 1) * sizeof(std::atomic<Node *>) + (value ? value->size() : 0),
+                     std::memory_order_relaxed);
+}
+
+bool MemTable::Get(int64_t key, std::optional<std::string> *value) const {
+    Node *node = FindGreaterOrEqual(key, nullptr);
+    if (!node || node->key != key) {
+        return false;
+    }
+    *value = node->value_size == DELETED ? std::nullopt : std::optional<std::string>(std::in_place, node->value,
+                                                                                       node->value_size);
+    return true;
+}
+
+MemTable::Iterator::Iterator(const MemTable &table, int64_t start_key)
+    : node_(table.FindGreaterOrEqual(start_key, nullptr)) {}
+
+std::optional<std::string> MemTable::Iterator::Value() const {
+    if (node_->value_size == DELETED) {
+        return std::nullopt;
+    }
+    return std::string(node_->value, node_->value_size);
+}
+
+void MemTable::Iterator::Next() {
+    // Skip the key's older nodes
+    int64_t key = node_->key;
+    do {
+        node_ = node_->next[0].load(std::memory_order_acquire);
+    } while (node_ && node_->key == key);
+}
+
+// ==================== MemTableTree ====================
+
+MemTableTree::MemTableTree(BPlusTree *tree, std::mutex *tree_mutex, MemTableOptions options)
+    : tree_(tree), tree_mutex_(tree_mutex), options_(options), active_since_(std::chrono::steady_clock::now()),
+      stopping_(false), merges_(0), merged_entries_(0), stalls_(0) {
+    options_.max_sealed = std::max<size_t>(options_.max_sealed, 1);
+    options_.merge_batch = std::max<size_t>(options_.merge_batch, 1);
+    tables_.push_back(std::make_shared<MemTable>());
+    merge_thread_ = std::thread([this] { MergeLoop(); });
+}
+
+MemTableTree::~MemTableTree() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    merge_cv_.notify_one();
+    merge_thread_.join();
+}
+
+bool MemTableTree::Insert(int64_t key, const std::string &value) {
+    // An empty or NUL-led value reads as deleted once stored, so it is one now
+    Write(key, BPlusTree::StoredValue(value));
+    return true;
+}
+
+bool MemTableTree::Remove(int64_t key) {
+    Write(key, std::nullopt);
+    return true;
+}
+
+void MemTableTree::Write(int64_t key, const std::optional<std::string> &value) {
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::shared_ptr<MemTable> active;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (tables_[0]->ApproximateBytes() >= options_.memtable_bytes) {
+            if (tables_.size() - 1 >= options_.max_sealed && !error_) {
+                ++stalls_;
+                done_cv_.wait(lock, [this] { return tables_.size() - 1 < options_.max_sealed || error_; });
+            }
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            Seal();
+        } else if (tables_[0]->Entries() == 0) {
+            // Start the merge interval with the table's first write
+            active_since_ = std::chrono::steady_clock::now();
+            merge_cv_.notify_one();
+        }
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        active = tables_[0];
+    }
+    active->Put(key, value);
+}
+
+// Caller holds write_mutex_ and mutex_
+void MemTableTree::Seal() {
+    tables_.insert(tables_.begin(), std::make_shared<MemTable>());
+    active_since_ = std::chrono::steady_clock::now();
+    merge_cv_.notify_one();
+}
+
+std::vector<std::shared_ptr<MemTable>> MemTableTree::Tables() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tables_;
+}
+
+std::optional<std::string> MemTableTree::Search(int64_t key) {
+    // The tables are taken before the tree is read: a table merged meanwhile
+    // is then still consulted, and one merged earlier is in the tree
+    for (const std::shared_ptr<MemTable> &table : Tables()) {
+        std::optional<std::string> value;
+        if (table->Get(key, &value)) {
+            return value;
+        }
+    }
+    std::lock_guard<std::mutex> lock(*tree_mutex_);
+    return tree_->Search(key);
+}
+
+std::vector<std::pair<int64_t, std::string>> MemTableTree::Scan(int64_t start_key, int64_t end_key) {
+    std::vector<std::shared_ptr<MemTable>> tables = Tables();
+    std::vector<std::pair<int64_t, std::string>> stored;
+    {
+        std::lock_guard<std::mutex> lock(*tree_mutex_);
+        stored = tree_->Scan(start_key, end_key);
+    }
+
+    // Newer tables overwrite older ones
+    std::map<int64_t, std::optional<std::string>> recent;
+    for (auto table = tables.rbegin(); table != tables.rend(); ++table) {
+        for (MemTable::Iterator it(**table, start_key); it.Valid() && it.Key() <= end_key; it.Next()) {
+            recent.insert_or_assign(it.Key(), it.Value());
+        }
+    }
+    if (recent.empty()) {
+        return stored;
+    }
+
+    std::vector<std::pair<int64_t, std::string>> results;
+    results.reserve(stored.size() + recent.size());
+    auto next_recent = recent.begin();
+    for (auto &entry : stored) {
+        for (; next_recent != recent.end() && next_recent->first < entry.first; ++next_recent) {
+            if (next_recent->second) {
+                results.emplace_back(next_recent->first, std::move(*next_recent->second));
+            }
+        }
+        if (next_recent != recent.end() && next_recent->first == entry.first) {
+            if (next_recent->second) {
+                results.emplace_back(entry.first, std::move(*next_recent->second));
+            }
+            ++next_recent;
+        } else {
+            results.push_back(std::move(entry));
+        }
+    }
+    for (; next_recent != recent.end(); ++next_recent) {
+        if (next_recent->second) {
+            results.emplace_back(next_recent->first, std::move(*next_recent->second));
+        }
+    }
+    return results;
+}
+
+void MemTableTree::Flush() {
+    std::unique_lock<std::mutex> write_lock(write_mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (tables_[0]->Entries() > 0) {
+        Seal();
+    }
+    write_lock.unlock();
+    done_cv_.wait(lock, [this] { return tables_.size() == 1 || error_; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+size_t MemTableTree::MemTableEntries() const {
+    size_t entries = 0;
+    for (const std::shared_ptr<MemTable> &table : Tables()) {
+        entries += table->Entries();
+    }
+    return entries;
+}
+
+void MemTableTree::MergeLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!error_) {
+        if (tables_.size() > 1) {
+            std::shared_ptr<MemTable> oldest = tables_.back();
+            lock.unlock();
+            try {
+                Merge(*oldest);
+            } catch (const std::exception &) {
+                // The table stays readable; writers and Flush report the error
+                lock.lock();
+                error_ = std::current_exception();
+                done_cv_.notify_all();
+                return;
+            }
+            lock.lock();
+            tables_.pop_back();
+            ++merges_;
+            done_cv_.notify_all();
+            continue;
+        }
+
+        bool idle = tables_[0]->Entries() == 0;
+        bool due = !idle && options_.merge_interval.count() > 0 &&
+                   std::chrono::steady_clock::now() >= active_since_ + options_.merge_interval;
+        if (stopping_ && idle) {
+            return;
+        }
+        if (stopping_ || due) {
+            // Never wait for write_mutex_ here: a stalled writer holds it
+            // while it waits for this thread
+            std::unique_lock<std::mutex> write_lock(write_mutex_, std::try_to_lock);
+            if (write_lock.owns_lock()) {
+                Seal();
+                continue;
+            }
+            merge_cv_.wait_for(lock, std::chrono::milliseconds(1));
+        } else if (idle || options_.merge_interval.count() == 0) {
+            merge_cv_.wait(lock);
+        } else {
+            merge_cv_.wait_until(lock, active_since_ + options_.merge_interval);
+        }
+    }
+}
+
+void MemTableTree::Merge(const MemTable &table) {
+    // Key order lets each Write visit its leaves once, left to right
+    WriteBatch batch;
+    auto apply = [&] {
+        std::lock_guard<std::mutex> lock(*tree_mutex_);
+        if (!tree_->Write(batch)) {
+            throw std::runtime_error("Buffer pool exhausted while merging a memtable");
+        }
+        merged_entries_ += batch.Count();
+        batch.Clear();
+    };
+    for (MemTable::Iterator it(table, std::numeric_limits<int64_t>::min()); it.Valid(); it.Next()) {
+        std::optional<std::string> value = it.Value();
+        if (value) {
+            batch.Put(it.Key(), *value);
+        } else {
+            batch.Delete(it.Key());
+        }
+        if (batch.Count() >= options_.merge_batch) {
+            apply();
+        }
+    }
+    if (batch.Count() > 0) {
+        apply();
+    }
+}
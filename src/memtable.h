@@ -0,0 +1,167 @@
+#ifndef MEMTABLE_H
+#define MEMTABLE_H
+
+#include "btree.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Sorted in-memory table of recent writes: a skiplist whose nodes are
+// allocated from an arena and never freed or changed before the table is
+// destroyed. Put calls must be serialized by the caller; Get and iteration
+// need no lock and may run concurrently with a Put, since a node is linked
+// in (with release stores) only once it is complete. An overwrite adds a
+// newer node for the key in front of the old one instead of changing it.
+class MemTable {
+public:
+    MemTable();
+
+    MemTable(const MemTable &) = delete;
+    MemTable &operator=(const MemTable &) = delete;
+
+    // nullopt records a delete. Values are at most VALUE_SIZE - 1 bytes;
+    // longer ones throw std::runtime_error.
+    void Put(int64_t key, const std::optional<std::string> &value);
+    // True if the table holds `key`; *value is its newest value, nullopt if deleted
+    bool Get(int64_t key, std::optional<std::string> *value) const;
+
+    size_t Entries() const { return entries_.load(std::memory_order_relaxed); }
+    size_t ApproximateBytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int MAX_HEIGHT = 12;
+    static constexpr uint16_t DELETED = UINT16_MAX;  // value_size of a delete
+
+    struct Node {
+        int64_t key;
+        const char *value;
+        uint16_t value_size;
+        std::atomic<Node *> next[1];  // `height` links, allocated in place
+    };
+
+public:
+    // Visits the newest node of each key in key order
+    class Iterator {
+    public:
+        // Positioned at the first key >= start_key
+        Iterator(const MemTable &table, int64_t start_key);
+
+        bool Valid() const { return node_ != nullptr; }
+        int64_t Key() const { return node_->key; }
+        std::optional<std::string> Value() const;
+        void Next();
+
+    private:
+        const Node *node_;
+    };
+
+private:
+    Node *head_;
+    std::atomic<int> max_height_;  // Raised only by Put; readers may see it stale
+    uint64_t random_state_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *block_next_;
+    size_t block_left_;
+    std::atomic<size_t> entries_;
+    std::atomic<size_t> bytes_;
+
+    void *Allocate(size_t bytes);
+    Node *NewNode(int64_t key, int height);
+    int RandomHeight();
+    // First node with a key >= `key`, the key's newest if it is there;
+    // fills prev[] if given
+    Node *FindGreaterOrEqual(int64_t key, Node **prev) const;
+};
+
+struct MemTableOptions {
+    size_t memtable_bytes = 4 << 20;  // Active table size at which it is sealed for merging
+    size_t max_sealed = 2;            // Sealed tables waiting to merge before writers stall
+    // A non-empty active table is also sealed after this long (0 disables),
+    // so a quiet period still drains writes into the tree
+    std::chrono::milliseconds merge_interval{1000};
+    size_t merge_batch = 4096;        // Entries per BPlusTree::Write, each under `tree_mutex`
+};
+
+// An ingest path that keeps foreground writes off the buffer pool.
+//
+// Insert and Remove only add to the active MemTable, under a short writer
+// lock, with the value as the tree would store it (BPlusTree::StoredValue):
+// reads return the same before and after the merge. Once the active table
+// reaches `memtable_bytes` it is sealed, a new one takes its place, and a
+// background thread merges sealed tables into the tree, oldest first. A merge
+// walks the table in key order and applies it with BPlusTree::Write in batches
+// of `merge_batch`, which groups the writes by leaf, so each leaf along the
+// chain is read and written once per batch no matter how many of its keys
+// changed. Writers stall only while `max_sealed` tables are already waiting.
+//
+// Reads check the active table, then the sealed ones from newest to oldest,
+// then the tree. A table leaves the read path only once its merge is done,
+// so a read never misses a write. `tree_mutex` must be held around every use
+// of the tree, by the owner as by this class, and the tree must not be
+// written except through this class while it exists. Remove is a blind
+// delete and always returns true. The destructor merges everything still in
+// memory; a crash loses it. A failed merge is rethrown as std::runtime_error
+// by the next write or Flush.
+class MemTableTree {
+public:
+    MemTableTree(BPlusTree *tree, std::mutex *tree_mutex, MemTableOptions options = MemTableOptions());
+    ~MemTableTree();
+
+    MemTableTree(const MemTableTree &) = delete;
+    MemTableTree &operator=(const MemTableTree &) = delete;
+
+    bool Insert(int64_t key, const std::string &value);
+    bool Remove(int64_t key);
+    std::optional<std::string> Search(int64_t key);
+    std::vector<std::pair<int64_t, std::string>> Scan(int64_t start_key, int64_t end_key);
+
+    // Seal the active table and wait until every table has been merged
+    void Flush();
+
+    // Entries held in memory, active and sealed
+    size_t MemTableEntries() const;
+    uint64_t Merges() const { return merges_; }
+    uint64_t MergedEntries() const { return merged_entries_; }
+    // Writes that had to wait for a merge
+    uint64_t Stalls() const { return stalls_; }
+
+private:
+    BPlusTree *tree_;
+    std::mutex *tree_mutex_;
+    MemTableOptions options_;
+
+    std::mutex write_mutex_;  // Serializes MemTable::Put
+
+    // Tables newest first: tables_[0] is the active one, the rest are sealed
+    mutable std::mutex mutex_;
+    std::condition_variable merge_cv_;  // A table was sealed, or stopping
+    std::condition_variable done_cv_;   // A merge finished or failed
+    std::vector<std::shared_ptr<MemTable>> tables_;
+    std::chrono::steady_clock::time_point active_since_;
+    std::exception_ptr error_;
+    bool stopping_;
+
+    std::atomic<uint64_t> merges_;
+    std::atomic<uint64_t> merged_entries_;
+    std::atomic<uint64_t> stalls_;
+
+    std::thread merge_thread_;
+
+    void Write(int64_t key, const std::optional<std::string> &value);
+    void Seal();
+    std::vector<std::shared_ptr<MemTable>> Tables() const;
+    void MergeLoop();
+    void Merge(const MemTable &table);
+};
+
+#endif // MEMTABLE_H
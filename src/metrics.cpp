@@ -0,0 +1,296 @@
+#include "metrics.h"
+#include "probes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// One thread's metrics. Only the owning thread writes, so updates are a
+// relaxed load + store; GetStats() reads concurrently through the atomics.
+struct MetricsShard {
+    std::atomic<uint64_t> buckets[NUM_OPERATIONS][LatencyHistogram::NUM_BUCKETS];
+    std::atomic<uint64_t> latency_count[NUM_OPERATIONS];
+    std::atomic<uint64_t> latency_sum[NUM_OPERATIONS];
+    std::atomic<uint64_t> latency_max[NUM_OPERATIONS];
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+    std::atomic<uint64_t> splits[MAX_SPLIT_LEVELS];
+
+    MetricsShard() { Reset(); }
+
+    void Reset() {
+        for (auto &op_buckets : buckets) {
+            for (auto &bucket : op_buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (size_t op = 0; op < NUM_OPERATIONS; ++op) {
+            latency_count[op].store(0, std::memory_order_relaxed);
+            latency_sum[op].store(0, std::memory_order_relaxed);
+            latency_max[op].store(0, std::memory_order_relaxed);
+        }
+        for (auto &counter : counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto &split : splits) {
+            split.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+inline void Bump(std::atomic<uint64_t> &value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Shards outlive their threads: an exiting thread hands its shard back for
+// reuse, so its counts stay in the totals and the number of shards is
+// bounded by the peak number of threads rather than by threads ever created
+class ShardRegistry {
+public:
+    static ShardRegistry &Instance() {
+        static ShardRegistry *registry = new ShardRegistry();  // Never destroyed: threads may exit late
+        return *registry;
+    }
+
+    MetricsShard *Acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            MetricsShard *shard = free_.back();
+            free_.pop_back();
+            return shard;
+        }
+        shards_.push_back(std::make_unique<MetricsShard>());
+        return shards_.back().get();
+    }
+
+    void Release(MetricsShard *shard) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(shard);
+    }
+
+    template <typename Fn>
+    void ForEach(Fn fn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &shard : shards_) {
+            fn(*shard);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<MetricsShard>> shards_;
+    std::vector<MetricsShard *> free_;
+};
+
+struct ShardHandle {
+    MetricsShard *shard = ShardRegistry::Instance().Acquire();
+    ~ShardHandle() { ShardRegistry::Instance().Release(shard); }
+};
+
+MetricsShard &LocalShard() {
+    thread_local ShardHandle handle;
+    return *handle.shard;
+}
+
+thread_local int operation_depth = 0;
+thread_local Operation current_operation = Operation::NUM_OPERATIONS;
+
+const char *const OPERATION_NAMES[NUM_OPERATIONS] = {"search", "insert", "remove", "scan", "write_batch",
+                                                       "multi_get"};
+
+}  // namespace
+
+// ==================== LatencyHistogram ====================
+
+size_t LatencyHistogram::BucketIndex(uint64_t value_ns) {
+    constexpr uint64_t sub_bucket_count = uint64_t(1) << SUB_BUCKET_BITS;
+    constexpr uint64_t half = sub_bucket_count / 2;
+    if (value_ns < sub_bucket_count) {
+        return static_cast<size_t>(value_ns);
+    }
+    value_ns = std::min(value_ns, (uint64_t(1) << MAX_VALUE_BITS) - 1);
+    int msb = 63 - __builtin_clzll(value_ns);
+    int shift = msb - SUB_BUCKET_BITS + 1;
+    return static_cast<size_t>(shift * half + (value_ns >> shift));
+}
+
+uint64_t LatencyHistogram::BucketValue(size_t index) {
+    constexpr uint64_t sub_bucket_count = uint64_t(1) << SUB_BUCKET_BITS;
+    constexpr uint64_t half = sub_bucket_count / 2;
+    if (index < sub_bucket_count) {
+        return index;
+    }
+    int shift = static_cast<int>(index / half) - 1;
+    uint64_t top = index - shift * half;
+    return (top << shift) + (uint64_t(1) << shift) / 2;
+}
+
+void LatencyHistogram::AddTotals(uint64_t count, uint64_t sum_ns, uint64_t max_ns) {
+    count_ += count;
+    sum_ += sum_ns;
+    max_ = std::max(max_, max_ns);
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+    uint64_t total = 0;
+    for (uint64_t bucket : buckets_) {
+        total += bucket;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            return std::min(BucketValue(i), max_);
+        }
+    }
+    return max_;
+}
+
+// ==================== Recording ====================
+
+void CountMetric(Counter counter, uint64_t amount) {
+    Bump(LocalShard().counters[static_cast<size_t>(counter)], amount);
+}
+
+void RecordSplit(int level) {
+    Bump(LocalShard().splits[std::min(level, MAX_SPLIT_LEVELS - 1)], 1);
+}
+
+void RecordLatency(Operation op, uint64_t latency_ns) {
+    MetricsShard &shard = LocalShard();
+    size_t idx = static_cast<size_t>(op);
+    Bump(shard.buckets[idx][LatencyHistogram::BucketIndex(latency_ns)], 1);
+    Bump(shard.latency_count[idx], 1);
+    Bump(shard.latency_sum[idx], latency_ns);
+    if (latency_ns > shard.latency_max[idx].load(std::memory_order_relaxed)) {
+        shard.latency_max[idx].store(latency_ns, std::memory_order_relaxed);
+    }
+}
+
+OperationTimer::OperationTimer(Operation op) : op_(op), outermost_(operation_depth++ == 0) {
+    if (outermost_) {
+        current_operation = op;
+        BPTREE_PROBE1(op__start, static_cast<int>(op));
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+OperationTimer::~OperationTimer() {
+    operation_depth--;
+    if (outermost_) {
+        current_operation = Operation::NUM_OPERATIONS;
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        BPTREE_PROBE2(op__done, static_cast<int>(op_), latency_ns);
+        RecordLatency(op_, latency_ns);
+    }
+}
+
+const char *OperationName(Operation op) {
+    return OPERATION_NAMES[static_cast<size_t>(op)];
+}
+
+Operation CurrentOperation() {
+    return current_operation;
+}
+
+// ==================== Aggregation ====================
+
+Stats GetStats() {
+    Stats stats;
+    ShardRegistry::Instance().ForEach([&](MetricsShard &shard) {
+        for (size_t op = 0; op < NUM_OPERATIONS; ++op) {
+            for (size_t i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+                uint64_t count = shard.buckets[op][i].load(std::memory_order_relaxed);
+                if (count) {
+                    stats.latency[op].Add(i, count);
+                }
+            }
+            stats.latency[op].AddTotals(shard.latency_count[op].load(std::memory_order_relaxed),
+                                        shard.latency_sum[op].load(std::memory_order_relaxed),
+                                        shard.latency_max[op].load(std::memory_order_relaxed));
+        }
+        for (size_t c = 0; c < NUM_COUNTERS; ++c) {
+            stats.counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+        }
+        for (int level = 0; level < MAX_SPLIT_LEVELS; ++level) {
+            stats.splits[level] += shard.splits[level].load(std::memory_order_relaxed);
+        }
+    });
+    return stats;
+}
+
+void ResetStats() {
+    ShardRegistry::Instance().ForEach([](MetricsShard &shard) { shard.Reset(); });
+}
+
+// ==================== Dumps ====================
+
+std::string Stats::ToText() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << std::left << std::setw(13) << "operation" << std::right << std::setw(10) << "count" << std::setw(11)
+        << "mean(us)" << std::setw(10) << "p50(us)" << std::setw(10) << "p95(us)" << std::setw(10) << "p99(us)"
+        << std::setw(11) << "p99.9(us)" << std::setw(10) << "max(us)" << "\n";
+    for (size_t op = 0; op < NUM_OPERATIONS; ++op) {
+        const LatencyHistogram &histogram = latency[op];
+        out << std::left << std::setw(13) << OPERATION_NAMES[op] << std::right << std::setw(10)
+            << histogram.Count() << std::setw(11) << histogram.Mean() / 1000.0 << std::setw(10)
+            << histogram.Percentile(50) / 1000.0 << std::setw(10) << histogram.Percentile(95) / 1000.0
+            << std::setw(10) << histogram.Percentile(99) / 1000.0 << std::setw(11)
+            << histogram.Percentile(99.9) / 1000.0 << std::setw(10) << histogram.Max() / 1000.0 << "\n";
+    }
+
+    uint64_t hits = Get(Counter::POOL_HITS);
+    uint64_t misses = Get(Counter::POOL_MISSES);
+    out << "buffer pool: " << hits << " hits, " << misses << " misses ("
+        << (hits + misses ? 100.0 * hits / (hits + misses) : 0.0) << "% hit), " << Get(Counter::POOL_EVICTIONS)
+        << " evictions, " << Get(Counter::POOL_DIRTY_WRITEBACKS) << " dirty writebacks, pin wait "
+        << Get(Counter::PIN_WAIT_NS) / 1e6 << " ms\n";
+    out << "splits:";
+    for (int level = 0; level < MAX_SPLIT_LEVELS; ++level) {
+        if (splits[level]) {
+            out << " level " << level << (level == 0 ? " (leaf)" : "") << ": " << splits[level];
+        }
+    }
+    out << "\n";
+    out << "disk: " << Get(Counter::DISK_BYTES_READ) / 1024 << " KB read, " << Get(Counter::DISK_BYTES_WRITTEN) / 1024
+        << " KB written, " << Get(Counter::DISK_SYNCS) << " syncs\n";
+    return out.str();
+}
+
+std::string Stats::ToJson() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"operations\":{";
+    for (size_t op = 0; op < NUM_OPERATIONS; ++op) {
+        const LatencyHistogram &histogram = latency[op];
+        out << (op ? "," : "") << "\"" << OPERATION_NAMES[op] << "\":{\"count\":" << histogram.Count()
+            << ",\"mean_us\":" << histogram.Mean() / 1000.0 << ",\"p50_us\":" << histogram.Percentile(50) / 1000.0
+            << ",\"p95_us\":" << histogram.Percentile(95) / 1000.0
+            << ",\"p99_us\":" << histogram.Percentile(99) / 1000.0
+            << ",\"p999_us\":" << histogram.Percentile(99.9) / 1000.0
+            << ",\"max_us\":" << histogram.Max() / 1000.0 << "}";
+    }
+    out << "},\"buffer_pool\":{\"hits\":" << Get(Counter::POOL_HITS) << ",\"misses\":" << Get(Counter::POOL_MISSES)
+        << ",\"evictions\":" << Get(Counter::POOL_EVICTIONS)
+        << ",\"dirty_writebacks\":" << Get(Counter::POOL_DIRTY_WRITEBACKS)
+        << ",\"pin_wait_ns\":" << Get(Counter::PIN_WAIT_NS) << "},\"splits\":[";
+    for (int level = 0; level < MAX_SPLIT_LEVELS; ++level) {
+        out << (level ? "," : "") << splits[level];
+    }
+    out << "],\"disk\":{\"bytes_read\":" << Get(Counter::DISK_BYTES_READ)
+        << ",\"bytes_written\":" << Get(Counter::DISK_BYTES_WRITTEN) << ",\"syncs\":" << Get(Counter::DISK_SYNCS)
+        << "}}";
+    return out.str();
+}
@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Engine-wide metrics: per-operation latency histograms plus counters for the
+// buffer pool, tree splits and disk I/O. Every thread records into its own
+// shard (plain relaxed stores, no shared cache lines), and GetStats() merges
+// all shards on demand, so recording costs a few nanoseconds plus the clock
+// reads of the operation timer.
+
+enum class Operation {
+    SEARCH,
+    INSERT,
+    REMOVE,
+    SCAN,
+    WRITE_BATCH,
+    MULTI_GET,
+    NUM_OPERATIONS
+};
+
+enum class Counter {
+    POOL_HITS,
+    POOL_MISSES,
+    POOL_EVICTIONS,
+    POOL_DIRTY_WRITEBACKS,  // Dirty victims written back to make room
+    PIN_WAIT_NS,            // Time callers waited for a frame to be filled (writeback + read)
+    DISK_BYTES_READ,
+    DISK_BYTES_WRITTEN,
+    DISK_SYNCS,
+    NUM_COUNTERS
+};
+
+constexpr size_t NUM_OPERATIONS = static_cast<size_t>(Operation::NUM_OPERATIONS);
+constexpr size_t NUM_COUNTERS = static_cast<size_t>(Counter::NUM_COUNTERS);
+constexpr int MAX_SPLIT_LEVELS = 8;  // Splits above this level count at the top one
+
+// Log-linear latency histogram in the style of HdrHistogram. Values below
+// 2^SUB_BUCKET_BITS ns are exact; above that every power of two is split into
+// 2^(SUB_BUCKET_BITS-1) linear buckets, bounding the relative error at ~3%.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 6;
+    static constexpr int MAX_VALUE_BITS = 40;  // ~18 minutes in ns; larger values are clamped
+    static constexpr size_t NUM_BUCKETS =
+        (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * (size_t(1) << (SUB_BUCKET_BITS - 1)) +
+        (size_t(1) << (SUB_BUCKET_BITS - 1));
+
+    static size_t BucketIndex(uint64_t value_ns);
+    static uint64_t BucketValue(size_t index);  // Midpoint of the bucket's range
+
+    void Add(size_t bucket, uint64_t count) { buckets_[bucket] += count; }
+    void AddTotals(uint64_t count, uint64_t sum_ns, uint64_t max_ns);
+
+    uint64_t Count() const { return count_; }
+    uint64_t Max() const { return max_; }
+    double Mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+    uint64_t Percentile(double percentile) const;  // percentile in [0, 100]
+
+private:
+    uint64_t buckets_[NUM_BUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+// Aggregated snapshot of all shards
+struct Stats {
+    LatencyHistogram latency[NUM_OPERATIONS];
+    uint64_t counters[NUM_COUNTERS] = {};
+    uint64_t splits[MAX_SPLIT_LEVELS] = {};  // Index 0: leaf splits
+
+    uint64_t Get(Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+    const LatencyHistogram &Latency(Operation op) const { return latency[static_cast<size_t>(op)]; }
+
+    std::string ToText() const;
+    std::string ToJson() const;
+};
+
+Stats GetStats();
+
+// Zero every shard (updates racing with the reset may survive it)
+void ResetStats();
+
+// Recording side, used by the engine
+void CountMetric(Counter counter, uint64_t amount = 1);
+void RecordSplit(int level);
+void RecordLatency(Operation op, uint64_t latency_ns);
+
+const char *OperationName(Operation op);  // "search", "insert", ...
+
+// The outermost operation running on this thread, or NUM_OPERATIONS outside one
+Operation CurrentOperation();
+
+// Times one public tree operation. Operations nested inside another (index
+// maintenance, the value dictionary) are part of their caller's latency and
+// are not recorded on their own.
+class OperationTimer {
+public:
+    explicit OperationTimer(Operation op);
+    ~OperationTimer();
+
+    OperationTimer(const OperationTimer &) = delete;
+    OperationTimer &operator=(const OperationTimer &) = delete;
+
+private:
+    Operation op_;
+    bool outermost_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,595 @@
+// Microbenchmarks for individual hot paths: page searches, leaf shifts,
+// splits, buffer pool hits/misses, victim selection, disk I/O and checksums.
+//
+// Each benchmark is calibrated until one run takes at least --min-time, then
+// run --repetitions times; the median ns/op is reported together with the
+// spread of the runs so a regression in one path shows up in isolation.
+// Inputs come from fixed seeds, so runs are comparable across builds.
+
+#include "btree.h"
+#include "buffer_pool_manager.h"
+#include "checksum.h"
+#include "disk_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template <typename T>
+inline void DoNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Timer {
+public:
+    Timer() : start_(std::chrono::steady_clock::now()) {}
+    double Elapsed() const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// A benchmark runs `iterations` operations and returns the nanoseconds spent
+// in the part being measured
+struct Benchmark {
+    std::string name;
+    std::function<double(int64_t iterations)> run;
+};
+
+struct Result {
+    double median;
+    double min;
+    double max;
+};
+
+Result Measure(const Benchmark &benchmark, int repetitions, double min_time_ns) {
+    // Calibration doubles as warm-up
+    int64_t iterations = 1;
+    while (true) {
+        double ns = benchmark.run(iterations);
+        if (ns >= min_time_ns || iterations >= (int64_t(1) << 32)) {
+            break;
+        }
+        double scale = ns > 0 ? 1.4 * min_time_ns / ns : 10.0;
+        iterations = static_cast<int64_t>(iterations * std::clamp(scale, 2.0, 10.0));
+    }
+
+    std::vector<double> per_op;
+    for (int r = 0; r < repetitions; ++r) {
+        per_op.push_back(benchmark.run(iterations) / iterations);
+    }
+    std::sort(per_op.begin(), per_op.end());
+    return {per_op[per_op.size() / 2], per_op.front(), per_op.back()};
+}
+
+// Keys to look up, cycled through by index & (LOOKUPS - 1)
+constexpr int LOOKUPS = 1024;
+
+std::vector<int64_t> RandomKeys(int64_t limit, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<int64_t> keys(LOOKUPS);
+    for (int64_t &key : keys) {
+        key = std::uniform_int_distribution<int64_t>(0, limit - 1)(rng);
+    }
+    return keys;
+}
+
+}  // namespace
+
+// Owns a scratch database file with a pool and two trees (plain and with
+// packed internal keys / dictionary leaves). Page 0 is reserved as a
+// stamped, empty meta page so splits can publish new roots.
+class Microbench {
+public:
+    static void RegisterAll(std::vector<Benchmark> *benchmarks);
+
+private:
+    struct Fixture {
+        std::string file;
+        std::unique_ptr<DiskManager> disk_manager;
+        std::unique_ptr<BufferPoolManager> pool;
+        std::unique_ptr<BPlusTree> tree;
+        std::unique_ptr<BPlusTree> packed_tree;
+
+        Fixture(const std::string &db_file, size_t frames) : file(db_file) {
+            std::remove(file.c_str());
+            disk_manager = std::make_unique<DiskManager>(file);
+            pool = std::make_unique<BufferPoolManager>(frames, disk_manager.get());
+            tree = std::make_unique<BPlusTree>(pool.get());
+            TreeOptions options;
+            options.pack_internal_keys = true;
+            options.dedup_values = true;
+            packed_tree = std::make_unique<BPlusTree>(pool.get(), "packed", options);
+            int meta_id;
+            MetaPage *meta = reinterpret_cast<MetaPage *>(pool->NewPage(&meta_id)->data);
+            meta->magic = FORMAT_MAGIC;
+            meta->format_version = FORMAT_VERSION;
+            pool->UnpinPage(meta_id, true);
+        }
+
+        ~Fixture() {
+            packed_tree.reset();
+            tree.reset();
+            pool.reset();
+            disk_manager.reset();
+            std::remove(file.c_str());
+        }
+    };
+
+    // Pinned root leaf holding `entries` keys 0, 2, 4, ...
+    static Page *MakeLeaf(Fixture &fixture, BPlusTree &tree, ValueFormat format, int entries) {
+        int page_id;
+        Page *page = fixture.pool->NewPage(&page_id);
+        LeafPageHeader *header = tree.GetLeafHeader(page);
+        header->base.page_type = PageType::LEAF;
+        header->base.value_format = format;
+        header->base.num_keys = 0;
+        header->base.parent_page_id = INVALID_PAGE_ID;
+        header->next_page_id = INVALID_PAGE_ID;
+        for (int i = 0; i < entries; ++i) {
+            tree.LeafInsert(page, 2 * i, "value");
+        }
+        return page;
+    }
+
+    // Pinned root internal page with keys stride, 2 * stride, ...; children
+    // are fresh leaf pages when `real_children` is set (splits fetch them)
+    static Page *MakeInternal(Fixture &fixture, BPlusTree &tree, int keys, int64_t stride,
+                              KeyFormat expected, bool real_children) {
+        int page_id;
+        Page *page = fixture.pool->NewPage(&page_id);
+        BPlusTreePageHeader *header = tree.GetInternalHeader(page);
+        header->page_type = PageType::INTERNAL;
+        header->parent_page_id = INVALID_PAGE_ID;
+        int *children = tree.GetInternalChildren(page);
+        for (int i = 0; i <= keys; ++i) {
+            children[i] = real_children ? NewChild(fixture, page_id) : i;
+        }
+        std::vector<int64_t> separators(keys);
+        for (int i = 0; i < keys; ++i) {
+            separators[i] = (i + 1) * stride;
+        }
+        tree.WriteInternalKeys(page, separators.data(), keys);
+        if (header->key_format != expected) {
+            throw std::runtime_error("Unexpected internal key format in microbenchmark setup");
+        }
+        return page;
+    }
+
+    static int NewChild(Fixture &fixture, int parent_page_id) {
+        int child_id;
+        Page *child = fixture.pool->NewPage(&child_id);
+        BPlusTreePageHeader *header = reinterpret_cast<BPlusTreePageHeader *>(child->data);
+        header->page_type = PageType::LEAF;
+        header->parent_page_id = parent_page_id;
+        fixture.pool->UnpinPage(child_id, true);
+        return child_id;
+    }
+
+    static void AddSearchBenchmarks(std::vector<Benchmark> *benchmarks);
+    static void AddInsertBenchmarks(std::vector<Benchmark> *benchmarks);
+    static void AddSplitBenchmarks(std::vector<Benchmark> *benchmarks);
+    static void AddBufferPoolBenchmarks(std::vector<Benchmark> *benchmarks);
+    static void AddDiskBenchmarks(std::vector<Benchmark> *benchmarks);
+    static void AddMultiGetBenchmarks(std::vector<Benchmark> *benchmarks);
+};
+
+void Microbench::AddSearchBenchmarks(std::vector<Benchmark> *benchmarks) {
+    auto fixture = std::make_shared<Fixture>("microbench_search.db", 64);
+
+    struct LeafCase {
+        const char *name;
+        bool packed;
+        ValueFormat format;
+        int entries;
+    };
+    for (const LeafCase &leaf_case :
+         {LeafCase{"LeafFindKey/inline-29", false, ValueFormat::INLINE, static_cast<int>(LEAF_MAX_ENTRIES)},
+          LeafCase{"LeafFindKey/dictionary-254", true, ValueFormat::DICTIONARY,
+                   static_cast<int>(LEAF_MAX_DICTIONARY_ENTRIES)}}) {
+        BPlusTree *tree = leaf_case.packed ? fixture->packed_tree.get() : fixture->tree.get();
+        Page *page = MakeLeaf(*fixture, *tree, leaf_case.format, leaf_case.entries);
+        std::vector<int64_t> lookups = RandomKeys(2 * leaf_case.entries, 1);
+        benchmarks->push_back({leaf_case.name, [fixture, tree, page, lookups](int64_t n) {
+                                   Timer timer;
+                                   int64_t sum = 0;
+                                   for (int64_t i = 0; i < n; ++i) {
+                                       sum += tree->LeafFindKey(page, lookups[i & (LOOKUPS - 1)]);
+                                   }
+                                   DoNotOptimize(sum);
+                                   return timer.Elapsed();
+                               }});
+    }
+
+    struct InternalCase {
+        const char *name;
+        bool packed;
+        KeyFormat format;
+        int64_t stride;
+    };
+    for (const InternalCase &internal_case :
+         {InternalCase{"InternalFindChild/full-339", false, KeyFormat::FULL, 1000},
+          InternalCase{"InternalFindChild/delta32-507", true, KeyFormat::DELTA32, 1000},
+          InternalCase{"InternalFindChild/delta16-676", true, KeyFormat::DELTA16, 64}}) {
+        BPlusTree *tree = internal_case.packed ? fixture->packed_tree.get() : fixture->tree.get();
+        int keys = static_cast<int>(InternalMaxKeys(internal_case.format));
+        Page *page = MakeInternal(*fixture, *tree, keys, internal_case.stride, internal_case.format, false);
+        std::vector<int64_t> lookups = RandomKeys((keys + 1) * internal_case.stride, 2);
+        benchmarks->push_back({internal_case.name, [fixture, tree, page, lookups](int64_t n) {
+                                   Timer timer;
+                                   int64_t sum = 0;
+                                   for (int64_t i = 0; i < n; ++i) {
+                                       sum += tree->InternalFindChild(page, lookups[i & (LOOKUPS - 1)]);
+                                   }
+                                   DoNotOptimize(sum);
+                                   return timer.Elapsed();
+                               }});
+    }
+}
+
+// Insert into a leaf with one free entry, restoring the page after each
+// insert; the cost of the restore alone is measured first and subtracted
+void Microbench::AddInsertBenchmarks(std::vector<Benchmark> *benchmarks) {
+    auto fixture = std::make_shared<Fixture>("microbench_insert.db", 64);
+
+    struct InsertCase {
+        const char *name;
+        bool packed;
+        ValueFormat format;
+        int entries;
+        int64_t key;
+    };
+    const int inline_entries = static_cast<int>(LEAF_MAX_ENTRIES) - 1;
+    const int dictionary_entries = static_cast<int>(LEAF_MAX_DICTIONARY_ENTRIES) - 1;
+    for (const InsertCase &insert_case :
+         {InsertCase{"LeafInsert/inline-front", false, ValueFormat::INLINE, inline_entries, -1},
+          InsertCase{"LeafInsert/inline-back", false, ValueFormat::INLINE, inline_entries, 1 << 20},
+          InsertCase{"LeafInsert/dictionary-front", true, ValueFormat::DICTIONARY, dictionary_entries, -1},
+          InsertCase{"LeafInsert/dictionary-back", true, ValueFormat::DICTIONARY, dictionary_entries, 1 << 20}}) {
+        BPlusTree *tree = insert_case.packed ? fixture->packed_tree.get() : fixture->tree.get();
+        Page *page = MakeLeaf(*fixture, *tree, insert_case.format, insert_case.entries);
+        int64_t key = insert_case.key;
+        benchmarks->push_back({insert_case.name, [fixture, tree, page, key](int64_t n) {
+                                   std::vector<char> image(page->data, page->data + PAGE_SIZE);
+                                   Timer restore_timer;
+                                   for (int64_t i = 0; i < n; ++i) {
+                                       std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                       DoNotOptimize(page->data[0]);
+                                   }
+                                   double restore = restore_timer.Elapsed();
+                                   Timer timer;
+                                   for (int64_t i = 0; i < n; ++i) {
+                                       std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                       tree->LeafInsert(page, key, "value");
+                                   }
+                                   double total = timer.Elapsed();
+                                   std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                   return std::max(total - restore, 0.0);
+                               }});
+    }
+}
+
+// Split a full root page (including the new root); the page is restored and
+// the pages the split created are dropped from the pool between iterations
+void Microbench::AddSplitBenchmarks(std::vector<Benchmark> *benchmarks) {
+    auto fixture = std::make_shared<Fixture>("microbench_split.db", 2048);
+
+    struct LeafCase {
+        const char *name;
+        bool packed;
+        ValueFormat format;
+        int entries;
+    };
+    for (const LeafCase &leaf_case :
+         {LeafCase{"SplitLeaf/inline-29", false, ValueFormat::INLINE, static_cast<int>(LEAF_MAX_ENTRIES)},
+          LeafCase{"SplitLeaf/dictionary-254", true, ValueFormat::DICTIONARY,
+                   static_cast<int>(LEAF_MAX_DICTIONARY_ENTRIES)}}) {
+        BPlusTree *tree = leaf_case.packed ? fixture->packed_tree.get() : fixture->tree.get();
+        Page *page = MakeLeaf(*fixture, *tree, leaf_case.format, leaf_case.entries);
+        int64_t key = leaf_case.entries | 1;  // Odd, so it lands mid-page
+        benchmarks->push_back({leaf_case.name, [fixture, tree, page, key](int64_t n) {
+                                   std::vector<char> image(page->data, page->data + PAGE_SIZE);
+                                   double total = 0;
+                                   for (int64_t i = 0; i < n; ++i) {
+                                       std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                       tree->root_page_id_ = page->page_id;
+                                       Timer timer;
+                                       tree->SplitLeaf(page, key, "value");
+                                       total += timer.Elapsed();
+                                       fixture->pool->DeletePage(tree->GetLeafHeader(page)->next_page_id);
+                                       fixture->pool->DeletePage(tree->root_page_id_);
+                                   }
+                                   std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                   return total;
+                               }});
+    }
+
+    struct InternalCase {
+        const char *name;
+        bool packed;
+        KeyFormat format;
+        int64_t stride;
+    };
+    for (const InternalCase &internal_case :
+         {InternalCase{"SplitInternal/full-339", false, KeyFormat::FULL, 1000},
+          InternalCase{"SplitInternal/delta16-676", true, KeyFormat::DELTA16, 64}}) {
+        BPlusTree *tree = internal_case.packed ? fixture->packed_tree.get() : fixture->tree.get();
+        int keys = static_cast<int>(InternalMaxKeys(internal_case.format));
+        Page *page = MakeInternal(*fixture, *tree, keys, internal_case.stride, internal_case.format, true);
+        int right_child = NewChild(*fixture, page->page_id);
+        int64_t key = keys / 2 * internal_case.stride + internal_case.stride / 2;
+        benchmarks->push_back({internal_case.name, [fixture, tree, page, right_child, key](int64_t n) {
+                                   std::vector<char> image(page->data, page->data + PAGE_SIZE);
+                                   double total = 0;
+                                   for (int64_t i = 0; i < n; ++i) {
+                                       std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                       tree->root_page_id_ = page->page_id;
+                                       Timer timer;
+                                       tree->SplitInternal(page, key, right_child, 1);
+                                       total += timer.Elapsed();
+                                       Page *root = fixture->pool->FetchPage(tree->root_page_id_);
+                                       int new_internal = tree->GetInternalChildren(root)[1];
+                                       fixture->pool->UnpinPage(root->page_id, false);
+                                       fixture->pool->DeletePage(new_internal);
+                                       fixture->pool->DeletePage(tree->root_page_id_);
+                                   }
+                                   std::memcpy(page->data, image.data(), PAGE_SIZE);
+                                   return total;
+                               }});
+    }
+}
+
+void Microbench::AddBufferPoolBenchmarks(std::vector<Benchmark> *benchmarks) {
+    // Hits: 32 resident pages in a 64-frame pool
+    auto hit_fixture = std::make_shared<Fixture>("microbench_hit.db", 64);
+    std::vector<int> resident(32);
+    for (int &page_id : resident) {
+        hit_fixture->pool->NewPage(&page_id);
+        hit_fixture->pool->UnpinPage(page_id, true);
+    }
+    benchmarks->push_back({"BufferPool/FetchPage-hit", [hit_fixture, resident](int64_t n) {
+                               BufferPoolManager *pool = hit_fixture->pool.get();
+                               Timer timer;
+                               for (int64_t i = 0; i < n; ++i) {
+                                   int page_id = resident[i & 31];
+                                   DoNotOptimize(pool->FetchPage(page_id));
+                                   pool->UnpinPage(page_id, false);
+                               }
+                               return timer.Elapsed();
+                           }});
+
+    // Misses: cycling over 256 pages with 16 frames evicts on every fetch;
+    // victims are clean, so this is victim selection + read + checksum
+    auto miss_fixture = std::make_shared<Fixture>("microbench_miss.db", 16);
+    std::vector<int> on_disk(256);
+    for (int &page_id : on_disk) {
+        miss_fixture->pool->NewPage(&page_id);
+        miss_fixture->pool->UnpinPage(page_id, true);
+    }
+    miss_fixture->pool->FlushAllPages();
+    benchmarks->push_back({"BufferPool/FetchPage-miss", [miss_fixture, on_disk](int64_t n) {
+                               BufferPoolManager *pool = miss_fixture->pool.get();
+                               Timer timer;
+                               for (int64_t i = 0; i < n; ++i) {
+                                   int page_id = on_disk[i & 255];
+                                   DoNotOptimize(pool->FetchPage(page_id));
+                                   pool->UnpinPage(page_id, false);
+                               }
+                               return timer.Elapsed();
+                           }});
+
+    // Victim selection alone on a full pool; the victim goes back to the
+    // front of the LRU list so every iteration sees the same state
+    benchmarks->push_back({"BufferPool/FindVictimPage", [miss_fixture](int64_t n) {
+                               BufferPoolManager *pool = miss_fixture->pool.get();
+                               Timer timer;
+                               for (int64_t i = 0; i < n; ++i) {
+                                   size_t frame_id = pool->FindVictimPage();
+                                   pool->lru_list_.push_front(frame_id);
+                                   pool->lru_map_[frame_id] = pool->lru_list_.begin();
+                               }
+                               return timer.Elapsed();
+                           }});
+}
+
+// Random page reads/writes against a 16 MB file (mostly served by the OS page
+// cache); queue depth is the number of threads issuing synchronous I/O
+void Microbench::AddDiskBenchmarks(std::vector<Benchmark> *benchmarks) {
+    constexpr int DISK_PAGES = 4096;
+    struct DiskFixture {
+        std::string file = "microbench_disk.db";
+        std::unique_ptr<DiskManager> disk_manager;
+
+        DiskFixture() {
+            std::remove(file.c_str());
+            disk_manager = std::make_unique<DiskManager>(file);
+            alignas(8) char page[PAGE_SIZE];
+            std::mt19937_64 rng(3);
+            for (int i = 0; i < DISK_PAGES; ++i) {
+                for (char &c : page) {
+                    c = static_cast<char>(rng());
+                }
+                disk_manager->WritePage(disk_manager->AllocatePage(), page);
+            }
+        }
+        ~DiskFixture() {
+            disk_manager.reset();
+            std::remove(file.c_str());
+        }
+    };
+    auto fixture = std::make_shared<DiskFixture>();
+
+    auto run_threads = [fixture](int64_t n, int queue_depth, bool write) {
+        Timer timer;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < queue_depth; ++t) {
+            threads.emplace_back([&, t] {
+                std::mt19937_64 rng(100 + t);
+                alignas(8) char page[PAGE_SIZE] = {};
+                for (int64_t i = t; i < n; i += queue_depth) {
+                    int page_id = static_cast<int>(rng() % DISK_PAGES);
+                    if (write) {
+                        fixture->disk_manager->WritePage(page_id, page);
+                    } else {
+                        fixture->disk_manager->ReadPage(page_id, page);
+                    }
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        return timer.Elapsed();
+    };
+
+    for (int queue_depth : {1, 4, 16}) {
+        benchmarks->push_back({"DiskManager/ReadPage-qd" + std::to_string(queue_depth),
+                               [run_threads, queue_depth](int64_t n) { return run_threads(n, queue_depth, false); }});
+    }
+    benchmarks->push_back({"DiskManager/ReadPage-noverify-qd1", [fixture, run_threads](int64_t n) {
+                               fixture->disk_manager->SetChecksumVerify(ChecksumVerify::NEVER);
+                               double ns = run_threads(n, 1, false);
+                               fixture->disk_manager->SetChecksumVerify(ChecksumVerify::ALWAYS);
+                               return ns;
+                           }});
+    for (int queue_depth : {1, 4, 16}) {
+        benchmarks->push_back({"DiskManager/WritePage-qd" + std::to_string(queue_depth),
+                               [run_threads, queue_depth](int64_t n) { return run_threads(n, queue_depth, true); }});
+    }
+
+    benchmarks->push_back({"Crc32c/4KB-page", [](int64_t n) {
+                               std::vector<char> page(PAGE_SIZE, 'x');
+                               Timer timer;
+                               uint32_t crc = 0;
+                               for (int64_t i = 0; i < n; ++i) {
+                                   crc = Crc32c(page.data(), PAGE_SIZE, crc);
+                               }
+                               DoNotOptimize(crc);
+                               return timer.Elapsed();
+                           }});
+}
+
+// Point lookups on a tree far larger than the CPU caches but resident in the
+// pool, where descents are bound by memory latency: Search one key at a
+// time against MultiGet with lookups run in sequence or interleaved. Keys
+// are random over the whole tree; the tree is built on first use.
+void Microbench::AddMultiGetBenchmarks(std::vector<Benchmark> *benchmarks) {
+    constexpr int64_t TREE_KEYS = 1 << 20;
+    constexpr size_t BATCH = 256;
+    constexpr size_t KEY_STREAM = 1 << 20;
+    struct Resident {
+        std::unique_ptr<Fixture> fixture;
+        std::vector<int64_t> stream;
+        size_t position = 0;
+
+        // The next BATCH keys of the stream
+        std::vector<int64_t> Batch() {
+            if (!fixture) {
+                fixture = std::make_unique<Fixture>("microbench_multiget.db", TREE_KEYS / 10);
+                for (int64_t key = 0; key < TREE_KEYS; ++key) {
+                    fixture->tree->Insert(key, "value");
+                }
+                std::mt19937_64 rng(7);
+                stream.resize(KEY_STREAM);
+                for (int64_t &key : stream) {
+                    key = std::uniform_int_distribution<int64_t>(0, TREE_KEYS - 1)(rng);
+                }
+            }
+            std::vector<int64_t> batch(stream.begin() + position, stream.begin() + position + BATCH);
+            position = (position + BATCH) % KEY_STREAM;
+            return batch;
+        }
+    };
+    auto resident = std::make_shared<Resident>();
+
+    benchmarks->push_back({"Search/resident-1M", [resident](int64_t n) {
+                               double ns = 0;
+                               size_t found = 0;
+                               for (int64_t done = 0; done < n; done += BATCH) {
+                                   std::vector<int64_t> batch = resident->Batch();
+                                   Timer timer;
+                                   for (int64_t key : batch) {
+                                       found += resident->fixture->tree->Search(key).has_value();
+                                   }
+                                   ns += timer.Elapsed();
+                               }
+                               DoNotOptimize(found);
+                               return ns * n / ((n + BATCH - 1) / BATCH * BATCH);
+                           }});
+    for (size_t group : {size_t(1), size_t(4), MULTIGET_GROUP_SIZE, size_t(16)}) {
+        benchmarks->push_back({"MultiGet/resident-1M-group-" + std::to_string(group),
+                               [resident, group](int64_t n) {
+                                   double ns = 0;
+                                   size_t found = 0;
+                                   for (int64_t done = 0; done < n; done += BATCH) {
+                                       std::vector<int64_t> batch = resident->Batch();
+                                       Timer timer;
+                                       found += resident->fixture->tree->MultiGet(batch, nullptr, group).size();
+                                       ns += timer.Elapsed();
+                                   }
+                                   DoNotOptimize(found);
+                                   return ns * n / ((n + BATCH - 1) / BATCH * BATCH);
+                               }});
+    }
+}
+
+void Microbench::RegisterAll(std::vector<Benchmark> *benchmarks) {
+    AddSearchBenchmarks(benchmarks);
+    AddInsertBenchmarks(benchmarks);
+    AddSplitBenchmarks(benchmarks);
+    AddBufferPoolBenchmarks(benchmarks);
+    AddDiskBenchmarks(benchmarks);
+    AddMultiGetBenchmarks(benchmarks);
+}
+
+int main(int argc, char **argv) {
+    std::string filter;
+    int repetitions = 5;
+    double min_time = 0.2;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--filter") {
+            filter = argv[++i];
+        } else if (i + 1 < argc && arg == "--repetitions") {
+            repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "--min-time") {
+            min_time = std::atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--filter SUBSTRING] [--repetitions N] [--min-time SECONDS]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Benchmark> benchmarks;
+    Microbench::RegisterAll(&benchmarks);
+
+    std::cout << "=== B+ Tree Microbenchmarks (median of " << repetitions << " runs, >= " << min_time
+              << " s each) ===" << std::endl;
+    std::cout << std::left << std::setw(36) << "Benchmark" << std::right << std::setw(12) << "ns/op"
+              << std::setw(12) << "min" << std::setw(12) << "max" << std::setw(10) << "spread" << std::endl;
+    for (const Benchmark &benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        Result result = Measure(benchmark, repetitions, min_time * 1e9);
+        double spread = result.median > 0 ? 100.0 * (result.max - result.min) / result.median : 0;
+        std::cout << std::left << std::setw(36) << benchmark.name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << result.median << std::setw(12) << result.min
+                  << std::setw(12) << result.max << std::setw(9) << spread << "%" << std::endl;
+    }
+    return 0;
+}
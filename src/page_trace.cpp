@@ -0,0 +1,130 @@
+#include "page_trace.h"
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char TRACE_MAGIC[8] = {'B', 'P', 'T', 'R', 'A', 'C', 'E', '1'};
+constexpr uint32_t TRACE_VERSION = 1;
+
+void WriteAll(int fd, const void *data, size_t length) {
+    const char *bytes = static_cast<const char *>(data);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t bytes_written = write(fd, bytes + done, length - done);
+        if (bytes_written <= 0) {
+            throw std::runtime_error("Failed to write page trace");
+        }
+        done += bytes_written;
+    }
+}
+
+// Reads up to `length` bytes, stopping early only at end of file
+size_t ReadFully(int fd, void *data, size_t length) {
+    char *bytes = static_cast<char *>(data);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t bytes_read = read(fd, bytes + done, length - done);
+        if (bytes_read < 0) {
+            throw std::runtime_error("Failed to read page trace");
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        done += bytes_read;
+    }
+    return done;
+}
+
+}  // namespace
+
+// ==================== PageTraceWriter ====================
+
+PageTraceWriter::PageTraceWriter(const std::string &path, size_t pool_size)
+    : fd_(-1), start_(std::chrono::steady_clock::now()), record_count_(0) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open page trace: " + path);
+    }
+    PageTraceHeader header = {};
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.page_size = PAGE_SIZE;
+    header.pool_size = pool_size;
+    WriteAll(fd_, &header, sizeof(header));
+    buffer_.reserve(BUFFER_RECORDS);
+}
+
+PageTraceWriter::~PageTraceWriter() {
+    try {
+        Flush();
+    } catch (const std::exception &) {
+        // A destructor cannot report it; the trace simply ends early
+    }
+    close(fd_);
+}
+
+void PageTraceWriter::Record(TraceEvent event, int page_id, uint8_t flags, uint8_t operation) {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    PageTraceRecord record = {};
+    record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    record.page_id = page_id;
+    record.event = event;
+    record.flags = flags;
+    record.operation = operation;
+    buffer_.push_back(record);
+    ++record_count_;
+    if (buffer_.size() >= BUFFER_RECORDS) {
+        Flush();
+    }
+}
+
+void PageTraceWriter::Flush() {
+    if (buffer_.empty()) {
+        return;
+    }
+    WriteAll(fd_, buffer_.data(), buffer_.size() * sizeof(PageTraceRecord));
+    buffer_.clear();
+}
+
+// ==================== PageTraceReader ====================
+
+PageTraceReader::PageTraceReader(const std::string &path) : fd_(-1), header_(), position_(0) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open page trace: " + path);
+    }
+    if (ReadFully(fd_, &header_, sizeof(header_)) != sizeof(header_) ||
+        std::memcmp(header_.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        close(fd_);
+        throw std::runtime_error("Not a page trace: " + path);
+    }
+    if (header_.version != TRACE_VERSION) {
+        close(fd_);
+        throw std::runtime_error("Unsupported page trace version " + std::to_string(header_.version));
+    }
+}
+
+PageTraceReader::~PageTraceReader() {
+    close(fd_);
+}
+
+bool PageTraceReader::Next(PageTraceRecord *record) {
+    if (position_ == buffer_.size()) {
+        buffer_.resize(4096);
+        size_t bytes = ReadFully(fd_, buffer_.data(), buffer_.size() * sizeof(PageTraceRecord));
+        // A torn final record (the traced process died mid-write) is dropped
+        buffer_.resize(bytes / sizeof(PageTraceRecord));
+        position_ = 0;
+        if (buffer_.empty()) {
+            return false;
+        }
+    }
+    *record = buffer_[position_++];
+    return true;
+}
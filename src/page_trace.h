@@ -0,0 +1,87 @@
+#ifndef PAGE_TRACE_H
+#define PAGE_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary trace of buffer pool accesses, replayed offline by bptree_cachesim
+// to size the pool. A file is a PageTraceHeader followed by fixed-size
+// records in event order; the writer buffers records and appends them in
+// large writes, so an enabled trace costs a clock read per event.
+
+enum class TraceEvent : uint8_t {
+    FETCH,   // FetchPage; TRACE_HIT set when the page was resident
+    NEW,     // NewPage: a fresh page, resident without a read
+    UNPIN,   // UnpinPage; TRACE_DIRTY set when the caller dirtied the page
+    DELETE   // DeletePage: the page leaves the pool for good
+};
+
+constexpr uint8_t TRACE_HIT = 1;
+constexpr uint8_t TRACE_DIRTY = 2;
+constexpr uint8_t TRACE_NO_OPERATION = 0xFF;  // Access outside a tree operation
+
+struct PageTraceHeader {
+    char magic[8];       // "BPTRACE1"
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t pool_size;  // Frames of the traced pool
+};
+
+struct PageTraceRecord {
+    uint64_t timestamp_ns;  // Since the trace started
+    int32_t page_id;
+    TraceEvent event;
+    uint8_t flags;          // TRACE_HIT / TRACE_DIRTY
+    uint8_t operation;      // Enclosing Operation (metrics.h) or TRACE_NO_OPERATION
+    uint8_t reserved;
+};
+
+static_assert(sizeof(PageTraceHeader) == 24, "trace header layout is part of the file format");
+static_assert(sizeof(PageTraceRecord) == 16, "trace record layout is part of the file format");
+
+class PageTraceWriter {
+public:
+    PageTraceWriter(const std::string &path, size_t pool_size);
+    ~PageTraceWriter();
+
+    PageTraceWriter(const PageTraceWriter &) = delete;
+    PageTraceWriter &operator=(const PageTraceWriter &) = delete;
+
+    void Record(TraceEvent event, int page_id, uint8_t flags, uint8_t operation);
+    void Flush();
+
+    uint64_t RecordCount() const { return record_count_; }
+
+private:
+    static constexpr size_t BUFFER_RECORDS = 4096;
+
+    int fd_;
+    std::vector<PageTraceRecord> buffer_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t record_count_;
+};
+
+class PageTraceReader {
+public:
+    explicit PageTraceReader(const std::string &path);
+    ~PageTraceReader();
+
+    PageTraceReader(const PageTraceReader &) = delete;
+    PageTraceReader &operator=(const PageTraceReader &) = delete;
+
+    // Returns false at the end of the trace
+    bool Next(PageTraceRecord *record);
+
+    const PageTraceHeader &Header() const { return header_; }
+
+private:
+    int fd_;
+    PageTraceHeader header_;
+    std::vector<PageTraceRecord> buffer_;
+    size_t position_;
+};
+
+#endif // PAGE_TRACE_H
@@ -0,0 +1,103 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <type_traits>
+
+// USDT (user-level statically defined tracing) probes for perf, bpftrace and
+// SystemTap. Every probe site compiles to a single nop plus an ELF note
+// (.note.stapsdt) naming the probe and where its arguments live, so an
+// unattached probe costs one instruction and arguments already in registers.
+// A tracer turns the nop into a breakpoint when it attaches:
+//
+//   bpftrace -e 'usdt:./bptree_kvstore:bptree:op__done { @[arg0] = hist(arg1); }'
+//   perf probe -x ./bptree_kvstore sdt_bptree:page__miss
+//
+// <sys/sdt.h> is used when installed; otherwise x86-64 ELF builds emit the
+// same notes in-tree. Elsewhere, or with -DBPTREE_NO_PROBES, probes vanish.
+//
+// Probes (provider "bptree"):
+//   op__start(op)                     outermost tree operation begins (metrics.h Operation)
+//   op__done(op, latency_ns)          ... and ends
+//   page__hit(page_id)                FetchPage found the page resident
+//   page__miss(page_id)               FetchPage has to read the page
+//   page__evict(page_id, dirty)       a victim frame is reused
+//   page__flush(page_id)              FlushPage writes one page
+//   flush__start(pages) / flush__done(pages)   FlushAllPages
+//   split(page_id, level)             a page splits; level 0 is a leaf
+//   io__read__start(offset, length) / io__read__done(offset, bytes)
+//   io__write__start(offset, length) / io__write__done(offset, bytes)
+//   io__sync__start() / io__sync__done()
+
+#if defined(BPTREE_NO_PROBES)
+#define BPTREE_PROBES_ENABLED 0
+#elif defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define BPTREE_PROBES_ENABLED 1
+#include <sys/sdt.h>
+#elif defined(__x86_64__) && defined(__ELF__) && defined(__GNUC__)
+#define BPTREE_PROBES_ENABLED 2
+#else
+#define BPTREE_PROBES_ENABLED 0
+#endif
+#else
+#define BPTREE_PROBES_ENABLED 0
+#endif
+
+#if BPTREE_PROBES_ENABLED == 1
+
+#define BPTREE_PROBE0(name) STAP_PROBE(bptree, name)
+#define BPTREE_PROBE1(name, a1) STAP_PROBE1(bptree, name, a1)
+#define BPTREE_PROBE2(name, a1, a2) STAP_PROBE2(bptree, name, a1, a2)
+
+#elif BPTREE_PROBES_ENABLED == 2
+
+// Same note layout as <sys/sdt.h> (stapsdt version 3): the probe address,
+// the .stapsdt.base anchor used to fix up prelinked addresses, a zero
+// semaphore, then provider, name and "size@location" for each argument.
+// A negative size marks a signed argument; %n prints the operand negated.
+#define BPTREE_SDT_ARG_SIZE(arg) \
+    ((std::is_signed<std::decay_t<decltype(arg)>>::value ? 1 : -1) * static_cast<int>(sizeof(arg)))
+
+#define BPTREE_SDT_ASM(name, args)                                                 \
+    "990: nop\n"                                                                    \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                   \
+    ".balign 4\n"                                                                   \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                              \
+    "991: .asciz \"stapsdt\"\n"                                                     \
+    "992: .balign 4\n"                                                              \
+    "993: .8byte 990b\n"                                                            \
+    ".8byte _.stapsdt.base\n"                                                       \
+    ".8byte 0\n"                                                                    \
+    ".asciz \"bptree\"\n"                                                           \
+    ".asciz \"" #name "\"\n"                                                        \
+    ".asciz \"" args "\"\n"                                                         \
+    "994: .balign 4\n"                                                              \
+    ".popsection\n"                                                                 \
+    ".ifndef _.stapsdt.base\n"                                                      \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"        \
+    ".weak _.stapsdt.base\n"                                                        \
+    ".hidden _.stapsdt.base\n"                                                      \
+    "_.stapsdt.base: .space 1\n"                                                    \
+    ".size _.stapsdt.base, 1\n"                                                     \
+    ".popsection\n"                                                                 \
+    ".endif\n"
+
+#define BPTREE_PROBE0(name) __asm__ __volatile__(BPTREE_SDT_ASM(name, "") : :)
+// Operand names (s1, a1, ...) must differ from the macro parameters
+#define BPTREE_PROBE1(name, x1)                                              \
+    __asm__ __volatile__(BPTREE_SDT_ASM(name, "%n[s1]@%[a1]")                \
+                         : : [s1] "n"(BPTREE_SDT_ARG_SIZE(x1)), [a1] "nor"(x1))
+#define BPTREE_PROBE2(name, x1, x2)                                                          \
+    __asm__ __volatile__(BPTREE_SDT_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2]")                   \
+                         : : [s1] "n"(BPTREE_SDT_ARG_SIZE(x1)), [a1] "nor"(x1),              \
+                             [s2] "n"(BPTREE_SDT_ARG_SIZE(x2)), [a2] "nor"(x2))
+
+#else
+
+#define BPTREE_PROBE0(name) ((void)0)
+#define BPTREE_PROBE1(name, a1) ((void)sizeof(a1))
+#define BPTREE_PROBE2(name, a1, a2) ((void)sizeof(a1), (void)sizeof(a2))
+
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,233 @@
+#include "protocol.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the wire format is copied as little-endian");
+
+namespace {
+
+template <typename T>
+void Put(std::string *out, T value) {
+    out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void PutString(std::string *out, const std::string &value) {
+    size_t length = std::min<size_t>(value.size(), UINT16_MAX);
+    Put<uint16_t>(out, static_cast<uint16_t>(length));
+    out->append(value.data(), length);
+}
+
+// Bounds-checked cursor over a frame body; any overrun sets ok = false
+class Reader {
+public:
+    Reader(const char *data, size_t size) : data_(data), size_(size), position_(0), ok_(true) {}
+
+    template <typename T>
+    T Get() {
+        T value{};
+        if (!Take(sizeof(T))) {
+            return value;
+        }
+        std::memcpy(&value, data_ + position_ - sizeof(T), sizeof(T));
+        return value;
+    }
+
+    std::string GetString() {
+        uint16_t length = Get<uint16_t>();
+        if (!Take(length)) {
+            return std::string();
+        }
+        return std::string(data_ + position_ - length, length);
+    }
+
+    // Rejects counts that cannot fit in the remaining bytes before anything is allocated
+    bool CountFits(uint32_t count, size_t min_item_size) const {
+        return count <= (size_ - position_) / min_item_size;
+    }
+
+    bool Done() const { return ok_ && position_ == size_; }
+
+private:
+    bool Take(size_t length) {
+        if (!ok_ || size_ - position_ < length) {
+            ok_ = false;
+            return false;
+        }
+        position_ += length;
+        return true;
+    }
+
+    const char *data_;
+    size_t size_;
+    size_t position_;
+    bool ok_;
+};
+
+// Reserve the length field, returning where the body starts
+size_t BeginFrame(std::string *out) {
+    size_t start = out->size();
+    Put<uint32_t>(out, 0);
+    return start;
+}
+
+void EndFrame(std::string *out, size_t start) {
+    uint32_t length = static_cast<uint32_t>(out->size() - start - FRAME_HEADER_SIZE);
+    std::memcpy(&(*out)[start], &length, sizeof(length));
+}
+
+}  // namespace
+
+std::optional<size_t> CompleteFrame(const char *data, size_t size) {
+    if (size < FRAME_HEADER_SIZE) {
+        return std::nullopt;
+    }
+    uint32_t length;
+    std::memcpy(&length, data, sizeof(length));
+    if (size - FRAME_HEADER_SIZE < length) {
+        return std::nullopt;
+    }
+    return length;
+}
+
+void EncodeRequest(const Request &request, std::string *out) {
+    size_t start = BeginFrame(out);
+    Put<uint32_t>(out, request.id);
+    Put<uint8_t>(out, static_cast<uint8_t>(request.type));
+    switch (request.type) {
+        case RequestType::SEARCH:
+        case RequestType::REMOVE:
+            Put<int64_t>(out, request.key);
+            break;
+        case RequestType::INSERT:
+            Put<int64_t>(out, request.key);
+            PutString(out, request.value);
+            break;
+        case RequestType::SCAN:
+            Put<int64_t>(out, request.key);
+            Put<int64_t>(out, request.end_key);
+            Put<uint32_t>(out, request.limit);
+            break;
+        case RequestType::MULTI_GET:
+            Put<uint32_t>(out, static_cast<uint32_t>(request.keys.size()));
+            for (int64_t key : request.keys) {
+                Put<int64_t>(out, key);
+            }
+            break;
+    }
+    EndFrame(out, start);
+}
+
+bool DecodeRequest(const char *body, size_t size, Request *request) {
+    Reader reader(body, size);
+    request->id = reader.Get<uint32_t>();
+    request->type = static_cast<RequestType>(reader.Get<uint8_t>());
+    switch (request->type) {
+        case RequestType::SEARCH:
+        case RequestType::REMOVE:
+            request->key = reader.Get<int64_t>();
+            break;
+        case RequestType::INSERT:
+            request->key = reader.Get<int64_t>();
+            request->value = reader.GetString();
+            break;
+        case RequestType::SCAN:
+            request->key = reader.Get<int64_t>();
+            request->end_key = reader.Get<int64_t>();
+            request->limit = reader.Get<uint32_t>();
+            break;
+        case RequestType::MULTI_GET: {
+            uint32_t count = reader.Get<uint32_t>();
+            if (!reader.CountFits(count, sizeof(int64_t))) {
+                return false;
+            }
+            request->keys.resize(count);
+            for (int64_t &key : request->keys) {
+                key = reader.Get<int64_t>();
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    return reader.Done();
+}
+
+void EncodeResponse(const Response &response, std::string *out) {
+    size_t start = BeginFrame(out);
+    Put<uint32_t>(out, response.id);
+    Put<uint8_t>(out, static_cast<uint8_t>(response.status));
+    if (response.status == ResponseStatus::ERROR) {
+        PutString(out, response.value);
+    } else if (response.status == ResponseStatus::OK) {
+        switch (response.type) {
+            case RequestType::SEARCH:
+                PutString(out, response.value);
+                break;
+            case RequestType::SCAN:
+                Put<uint32_t>(out, static_cast<uint32_t>(response.entries.size()));
+                for (const auto &[key, value] : response.entries) {
+                    Put<int64_t>(out, key);
+                    PutString(out, value);
+                }
+                break;
+            case RequestType::MULTI_GET:
+                Put<uint32_t>(out, static_cast<uint32_t>(response.values.size()));
+                for (const std::optional<std::string> &value : response.values) {
+                    Put<uint8_t>(out, value.has_value());
+                    PutString(out, value.value_or(std::string()));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    EndFrame(out, start);
+}
+
+bool DecodeResponse(const char *body, size_t size, Response *response) {
+    Reader reader(body, size);
+    response->id = reader.Get<uint32_t>();
+    response->status = static_cast<ResponseStatus>(reader.Get<uint8_t>());
+    if (response->status == ResponseStatus::ERROR) {
+        response->value = reader.GetString();
+    } else if (response->status == ResponseStatus::OK) {
+        switch (response->type) {
+            case RequestType::SEARCH:
+                response->value = reader.GetString();
+                break;
+            case RequestType::SCAN: {
+                uint32_t count = reader.Get<uint32_t>();
+                if (!reader.CountFits(count, sizeof(int64_t) + sizeof(uint16_t))) {
+                    return false;
+                }
+                response->entries.resize(count);
+                for (auto &[key, value] : response->entries) {
+                    key = reader.Get<int64_t>();
+                    value = reader.GetString();
+                }
+                break;
+            }
+            case RequestType::MULTI_GET: {
+                uint32_t count = reader.Get<uint32_t>();
+                if (!reader.CountFits(count, sizeof(uint8_t) + sizeof(uint16_t))) {
+                    return false;
+                }
+                response->values.resize(count);
+                for (std::optional<std::string> &value : response->values) {
+                    bool found = reader.Get<uint8_t>() != 0;
+                    std::string bytes = reader.GetString();
+                    if (found) {
+                        value = std::move(bytes);
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    } else if (response->status != ResponseStatus::NOT_FOUND) {
+        return false;
+    }
+    return reader.Done();
+}
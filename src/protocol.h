@@ -0,0 +1,85 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary protocol of bptree_server. Every message is a frame:
+//
+//   [uint32 body length][uint32 request id][uint8 type or status][payload]
+//
+// with integers little-endian and strings as [uint16 length][bytes].
+// Requests carry a RequestType, responses a ResponseStatus and the id of the
+// request they answer. Clients may pipeline any number of requests; a
+// connection's requests execute in order and are answered in order.
+//
+// Request payloads:
+//   SEARCH, REMOVE   int64 key
+//   INSERT           int64 key, string value
+//   SCAN             int64 start key, int64 end key (inclusive), uint32 limit
+//   MULTI_GET        uint32 count, count x int64 key
+// Response payloads (status OK unless noted):
+//   SEARCH           string value                  (NOT_FOUND: none)
+//   INSERT, REMOVE   none                          (REMOVE of a missing key: NOT_FOUND)
+//   SCAN             uint32 count, count x (int64 key, string value); the
+//                    first `limit` live keys of the range, never more than
+//                    MAX_SCAN_ENTRIES (limit 0 asks for that many)
+//   MULTI_GET        uint32 count, count x (uint8 found, string value)
+//   any, on ERROR    string message
+
+enum class RequestType : uint8_t {
+    SEARCH = 1,
+    INSERT = 2,
+    REMOVE = 3,
+    SCAN = 4,
+    MULTI_GET = 5
+};
+
+enum class ResponseStatus : uint8_t {
+    OK = 0,
+    NOT_FOUND = 1,
+    ERROR = 2
+};
+
+constexpr size_t FRAME_HEADER_SIZE = sizeof(uint32_t);
+constexpr size_t MAX_FRAME_BODY = 16 << 20;  // Larger frames end the connection
+constexpr uint32_t MAX_SCAN_ENTRIES = 1024;  // Per SCAN response; longer ranges take several
+
+struct Request {
+    uint32_t id = 0;
+    RequestType type = RequestType::SEARCH;
+    int64_t key = 0;
+    int64_t end_key = 0;            // SCAN
+    uint32_t limit = 0;             // SCAN
+    std::string value;              // INSERT
+    std::vector<int64_t> keys;      // MULTI_GET
+};
+
+struct Response {
+    uint32_t id = 0;
+    RequestType type = RequestType::SEARCH;  // Not sent; tells DecodeResponse the payload layout
+    ResponseStatus status = ResponseStatus::OK;
+    std::string value;                                     // SEARCH, or the ERROR message
+    std::vector<std::pair<int64_t, std::string>> entries;  // SCAN
+    std::vector<std::optional<std::string>> values;        // MULTI_GET
+};
+
+// Length of the frame body at the front of `data`, once the whole frame is
+// buffered; nullopt while more bytes are needed
+std::optional<size_t> CompleteFrame(const char *data, size_t size);
+
+// Append one frame to `out`
+void EncodeRequest(const Request &request, std::string *out);
+void EncodeResponse(const Response &response, std::string *out);
+
+// Decode a frame body (the bytes after the length). DecodeResponse takes the
+// type of the request being answered in `response->type`. Both return false
+// on a malformed body.
+bool DecodeRequest(const char *body, size_t size, Request *request);
+bool DecodeResponse(const char *body, size_t size, Response *response);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,583 @@
+#include "replication.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr size_t MAX_FRAME_BODY = 64 << 20;  // Larger frames end the connection
+constexpr size_t SEND_CHUNK = 1 << 20;       // Log bytes a follower's thread sends per write
+
+[[noreturn]] void ThrowErrno(const std::string &what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+template <typename T>
+void Put(std::string *out, T value) {
+    out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void PutString(std::string *out, const std::string &value) {
+    Put<uint16_t>(out, static_cast<uint16_t>(value.size()));
+    out->append(value);
+}
+
+// Start a frame in `out`; FinishFrame fills in its length
+size_t BeginFrame(std::string *out, ReplicationFrame type) {
+    size_t start = out->size();
+    Put<uint32_t>(out, 0);
+    Put<uint8_t>(out, static_cast<uint8_t>(type));
+    return start;
+}
+
+void FinishFrame(std::string *out, size_t start) {
+    uint32_t length = static_cast<uint32_t>(out->size() - start - sizeof(uint32_t));
+    std::memcpy(out->data() + start, &length, sizeof(length));
+}
+
+// Decodes a frame body; throws on a truncated one
+class FrameReader {
+public:
+    explicit FrameReader(const std::string &body) : data_(body.data()), size_(body.size()), position_(0) {}
+
+    template <typename T>
+    T Get() {
+        Need(sizeof(T));
+        T value;
+        std::memcpy(&value, data_ + position_, sizeof(T));
+        position_ += sizeof(T);
+        return value;
+    }
+
+    std::string GetString() {
+        uint16_t length = Get<uint16_t>();
+        Need(length);
+        std::string value(data_ + position_, length);
+        position_ += length;
+        return value;
+    }
+
+private:
+    const char *data_;
+    size_t size_;
+    size_t position_;
+
+    void Need(size_t bytes) const {
+        if (size_ - position_ < bytes) {
+            throw std::runtime_error("Malformed replication frame");
+        }
+    }
+};
+
+bool SendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool ReadExactly(int fd, char *buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t n = recv(fd, buffer + received, length - received, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Read one frame body (type byte and payload); false once the peer is gone
+bool ReadFrame(int fd, std::string *body) {
+    uint32_t length;
+    if (!ReadExactly(fd, reinterpret_cast<char *>(&length), sizeof(length))) {
+        return false;
+    }
+    if (length == 0 || length > MAX_FRAME_BODY) {
+        throw std::runtime_error("Malformed replication frame");
+    }
+    body->resize(length);
+    return ReadExactly(fd, body->data(), length);
+}
+
+sockaddr_un SocketAddress(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+}  // namespace
+
+// ==================== Primary ====================
+
+ReplicationPrimary::ReplicationPrimary(BPlusTree *tree, std::mutex *tree_mutex, const std::string &socket_path,
+                                       ReplicationOptions options)
+    : tree_(tree), tree_mutex_(tree_mutex), socket_path_(socket_path), options_(options), epoch_(0),
+      listen_fd_(-1), wake_fd_(-1), log_size_(0), sequence_(0), stopping_(false), resyncs_(0) {
+    // Sequence numbers restart with every primary, so followers tell runs
+    // apart by a random epoch
+    std::random_device random;
+    epoch_ = (static_cast<uint64_t>(random()) << 32 | random()) | 1;
+    options_.snapshot_chunk = std::max<size_t>(1, options_.snapshot_chunk);
+
+    sockaddr_un address = SocketAddress(socket_path);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    unlink(socket_path.c_str());  // Left behind by a previous run
+    if (listen_fd_ < 0 || wake_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+                                               sizeof(address)) != 0 || listen(listen_fd_, SOMAXCONN) != 0) {
+        int saved = errno;
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+        }
+        if (wake_fd_ >= 0) {
+            close(wake_fd_);
+        }
+        errno = saved;
+        ThrowErrno("Failed to listen on " + socket_path);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(*tree_mutex_);
+        tree_->SetWriteObserver([this](const WriteBatch &batch) { Append(batch); });
+    }
+    accept_thread_ = std::thread([this] { AcceptLoop(); });
+}
+
+ReplicationPrimary::~ReplicationPrimary() {
+    {
+        std::lock_guard<std::mutex> lock(*tree_mutex_);
+        tree_->SetWriteObserver(nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (Follower &follower : followers_) {
+            shutdown(follower.fd, SHUT_RDWR);
+        }
+    }
+    log_cv_.notify_all();
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+    (void)ignored;
+    accept_thread_.join();
+    for (Follower &follower : followers_) {
+        follower.thread.join();
+        close(follower.fd);
+    }
+    close(listen_fd_);
+    close(wake_fd_);
+    unlink(socket_path_.c_str());
+}
+
+uint64_t ReplicationPrimary::Sequence() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sequence_;
+}
+
+size_t ReplicationPrimary::Followers() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const Follower &follower : followers_) {
+        count += !follower.done;
+    }
+    return count;
+}
+
+// Write observer: runs under the tree mutex, so batches are numbered in the
+// order they were applied
+void ReplicationPrimary::Append(const WriteBatch &batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Record record{++sequence_, std::string()};
+    size_t start = BeginFrame(&record.frame, ReplicationFrame::BATCH);
+    Put<uint64_t>(&record.frame, record.sequence);
+    Put<uint32_t>(&record.frame, static_cast<uint32_t>(batch.Count()));
+    for (const WriteBatch::Op &op : batch.Ops()) {
+        Put<uint8_t>(&record.frame, op.is_delete);
+        Put<int64_t>(&record.frame, op.key);
+        PutString(&record.frame, op.value);
+    }
+    FinishFrame(&record.frame, start);
+
+    log_size_ += record.frame.size();
+    log_.push_back(std::move(record));
+    while (log_size_ > options_.log_bytes && log_.size() > 1) {
+        log_size_ -= log_.front().frame.size();
+        log_.pop_front();
+    }
+    log_cv_.notify_all();
+}
+
+void ReplicationPrimary::AcceptLoop() {
+    while (true) {
+        pollfd poll_fds[2] = {{listen_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        if (poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (poll_fds[1].revents != 0) {
+            return;  // Stopping
+        }
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            close(fd);
+            return;
+        }
+        // Reap followers that have gone away
+        for (auto it = followers_.begin(); it != followers_.end();) {
+            if (it->done) {
+                it->thread.join();
+                close(it->fd);
+                it = followers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        Follower &follower = followers_.emplace_back();
+        follower.fd = fd;
+        follower.thread = std::thread([this, &follower] { Serve(&follower); });
+    }
+}
+
+// The log holds every batch after `applied` of this primary's epoch
+bool ReplicationPrimary::CanResume(uint64_t epoch, uint64_t applied) const {
+    if (epoch != epoch_ || applied > sequence_) {
+        return false;
+    }
+    return applied == sequence_ || (!log_.empty() && applied + 1 >= log_.front().sequence);
+}
+
+// One follower: handshake, then snapshot and log as needed. Returns when the
+// follower disconnects or the primary stops; the fd is closed by the owner.
+void ReplicationPrimary::Serve(Follower *follower) {
+    int fd = follower->fd;
+    try {
+        std::string body;
+        if (ReadFrame(fd, &body)) {
+            FrameReader reader(body);
+            if (static_cast<ReplicationFrame>(reader.Get<uint8_t>()) != ReplicationFrame::HELLO) {
+                throw std::runtime_error("Expected HELLO from follower");
+            }
+            uint64_t epoch = reader.Get<uint64_t>();
+            uint64_t applied = reader.Get<uint64_t>();
+
+            // Next sequence to send; 0 while a snapshot is needed first
+            uint64_t next = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (CanResume(epoch, applied)) {
+                    next = applied + 1;
+                }
+            }
+            while (true) {
+                if (next == 0) {
+                    next = SendSnapshot(fd) + 1;
+                }
+                std::string out;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    log_cv_.wait(lock, [&] { return stopping_ || sequence_ >= next; });
+                    if (stopping_) {
+                        break;
+                    }
+                    if (next < log_.front().sequence) {
+                        next = 0;  // Fell behind the log
+                        continue;
+                    }
+                    for (size_t i = next - log_.front().sequence; i < log_.size() && out.size() < SEND_CHUNK; ++i) {
+                        out += log_[i].frame;
+                        ++next;
+                    }
+                }
+                if (!SendAll(fd, out)) {
+                    break;
+                }
+            }
+        }
+    } catch (const std::exception &) {
+        // Malformed handshake or lost connection: drop this follower only
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    follower->done = true;
+}
+
+// Stream the tree as of now; returns the sequence the snapshot reflects.
+// Chunks are read under a Snapshot, each holding the tree mutex only for
+// its own scan, so writers keep going while a large tree is copied.
+uint64_t ReplicationPrimary::SendSnapshot(int fd) {
+    const Snapshot *snapshot;
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> tree_lock(*tree_mutex_);
+        snapshot = tree_->GetSnapshot();
+        std::lock_guard<std::mutex> lock(mutex_);
+        sequence = sequence_;
+    }
+    ++resyncs_;
+
+    try {
+        std::string out;
+        size_t start = BeginFrame(&out, ReplicationFrame::SNAPSHOT_BEGIN);
+        Put<uint64_t>(&out, epoch_);
+        Put<uint64_t>(&out, sequence);
+        FinishFrame(&out, start);
+
+        int64_t low = INT64_MIN;
+        while (true) {
+            std::vector<std::pair<int64_t, std::string>> entries;
+            {
+                std::lock_guard<std::mutex> tree_lock(*tree_mutex_);
+                entries = tree_->Scan(low, INT64_MAX, snapshot, options_.snapshot_chunk);
+            }
+            // A short chunk reached the end of the tree and covers the rest of the key space
+            bool last = entries.size() < options_.snapshot_chunk || entries.back().first == INT64_MAX;
+            int64_t high = last ? INT64_MAX : entries.back().first;
+            start = BeginFrame(&out, ReplicationFrame::SNAPSHOT_CHUNK);
+            Put<int64_t>(&out, low);
+            Put<int64_t>(&out, high);
+            Put<uint32_t>(&out, static_cast<uint32_t>(entries.size()));
+            for (const auto &[key, value] : entries) {
+                Put<int64_t>(&out, key);
+                PutString(&out, value);
+            }
+            FinishFrame(&out, start);
+            if (last) {
+                break;
+            }
+            if (!SendAll(fd, out)) {
+                throw std::runtime_error("Follower disconnected during snapshot");
+            }
+            out.clear();
+            low = high + 1;
+        }
+        start = BeginFrame(&out, ReplicationFrame::SNAPSHOT_END);
+        FinishFrame(&out, start);
+        if (!SendAll(fd, out)) {
+            throw std::runtime_error("Follower disconnected during snapshot");
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> tree_lock(*tree_mutex_);
+        tree_->ReleaseSnapshot(snapshot);
+        throw;
+    }
+    std::lock_guard<std::mutex> tree_lock(*tree_mutex_);
+    tree_->ReleaseSnapshot(snapshot);
+    return sequence;
+}
+
+// ==================== Follower ====================
+
+ReplicationFollower::ReplicationFollower(BPlusTree *tree, std::mutex *tree_mutex, const std::string &primary_socket)
+    : tree_(tree), tree_mutex_(tree_mutex), primary_socket_(primary_socket), epoch_(0), applied_(0), resyncs_(0),
+      fd_(-1), stopping_(false) {
+    SocketAddress(primary_socket);  // Reject a bad path here rather than on every retry
+    thread_ = std::thread([this] { Run(); });
+}
+
+ReplicationFollower::~ReplicationFollower() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (fd_ >= 0) {
+            shutdown(fd_, SHUT_RDWR);
+        }
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+uint64_t ReplicationFollower::AppliedSequence() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return epoch_ != 0 ? applied_ : 0;
+}
+
+bool ReplicationFollower::Connected() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0;
+}
+
+uint64_t ReplicationFollower::Resyncs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resyncs_;
+}
+
+bool ReplicationFollower::WaitFor(uint64_t epoch, uint64_t sequence, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [&] { return epoch_ == epoch && applied_ >= sequence; });
+}
+
+// Connect, follow until the stream ends, and retry
+void ReplicationFollower::Run() {
+    sockaddr_un address = SocketAddress(primary_socket_);
+    while (true) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool connected = fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        bool following = false;
+        if (connected) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!stopping_) {
+                fd_ = fd;
+                following = true;
+            }
+        }
+        if (following) {
+            try {
+                Follow(fd);
+            } catch (const std::exception &) {
+                // Malformed or out-of-order stream, or the tree refused a write: start over
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            fd_ = -1;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (cv_.wait_for(lock, RECONNECT_INTERVAL, [this] { return stopping_; })) {
+            return;
+        }
+    }
+}
+
+void ReplicationFollower::Follow(int fd) {
+    std::string out;
+    size_t start = BeginFrame(&out, ReplicationFrame::HELLO);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Put<uint64_t>(&out, epoch_);
+        Put<uint64_t>(&out, applied_);
+    }
+    FinishFrame(&out, start);
+    if (!SendAll(fd, out)) {
+        return;
+    }
+
+    uint64_t snapshot_epoch = 0;
+    uint64_t snapshot_sequence = 0;
+    std::string body;
+    while (ReadFrame(fd, &body)) {
+        FrameReader reader(body);
+        switch (static_cast<ReplicationFrame>(reader.Get<uint8_t>())) {
+            case ReplicationFrame::SNAPSHOT_BEGIN: {
+                snapshot_epoch = reader.Get<uint64_t>();
+                snapshot_sequence = reader.Get<uint64_t>();
+                // The tree matches no sequence until the snapshot is complete
+                std::lock_guard<std::mutex> lock(mutex_);
+                epoch_ = 0;
+                break;
+            }
+            case ReplicationFrame::SNAPSHOT_CHUNK: {
+                int64_t low = reader.Get<int64_t>();
+                int64_t high = reader.Get<int64_t>();
+                uint32_t count = reader.Get<uint32_t>();
+                std::vector<std::pair<int64_t, std::string>> incoming;
+                incoming.reserve(count);
+                for (uint32_t i = 0; i < count; ++i) {
+                    int64_t key = reader.Get<int64_t>();
+                    incoming.emplace_back(key, reader.GetString());
+                }
+
+                // Merge with what this range holds now: drop keys the primary
+                // lacks, write keys that are missing or differ
+                std::lock_guard<std::mutex> tree_lock(*tree_mutex_);
+                std::vector<std::pair<int64_t, std::string>> existing = tree_->Scan(low, high);
+                WriteBatch batch;
+                size_t i = 0;
+                size_t j = 0;
+                while (i < existing.size() || j < incoming.size()) {
+                    if (j == incoming.size() || (i < existing.size() && existing[i].first < incoming[j].first)) {
+                        batch.Delete(existing[i++].first);
+                    } else if (i == existing.size() || incoming[j].first < existing[i].first) {
+                        batch.Put(incoming[j].first, incoming[j].second);
+                        ++j;
+                    } else {
+                        if (existing[i].second != incoming[j].second) {
+                            batch.Put(incoming[j].first, incoming[j].second);
+                        }
+                        ++i;
+                        ++j;
+                    }
+                }
+                if (!tree_->Write(batch)) {
+                    throw std::runtime_error("Follower write failed: buffer pool exhausted");
+                }
+                break;
+            }
+            case ReplicationFrame::SNAPSHOT_END: {
+                std::lock_guard<std::mutex> lock(mutex_);
+                epoch_ = snapshot_epoch;
+                applied_ = snapshot_sequence;
+                ++resyncs_;
+                cv_.notify_all();
+                break;
+            }
+            case ReplicationFrame::BATCH: {
+                uint64_t sequence = reader.Get<uint64_t>();
+                uint32_t count = reader.Get<uint32_t>();
+                WriteBatch batch;
+                for (uint32_t i = 0; i < count; ++i) {
+                    bool is_delete = reader.Get<uint8_t>() != 0;
+                    int64_t key = reader.Get<int64_t>();
+                    std::string value = reader.GetString();
+                    if (is_delete) {
+                        batch.Delete(key);
+                    } else {
+                        batch.Put(key, value);
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (epoch_ == 0 || sequence != applied_ + 1) {
+                        throw std::runtime_error("Replication stream out of order");
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> tree_lock(*tree_mutex_);
+                    if (!tree_->Write(batch)) {
+                        throw std::runtime_error("Follower write failed: buffer pool exhausted");
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                applied_ = sequence;
+                cv_.notify_all();
+                break;
+            }
+            default:
+                throw std::runtime_error("Unexpected replication frame");
+        }
+    }
+}
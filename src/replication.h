@@ -0,0 +1,157 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include "btree.h"
+#include "write_batch.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Logical replication of one tree to follower processes on the same host.
+//
+// The primary numbers every Insert, Remove and Write of its tree with a
+// sequence number and keeps the encoded batches in an in-memory log. A
+// follower connects over a Unix socket and sends the primary epoch and last
+// sequence it applied; the primary then streams the log from there on. A
+// follower that is new, was following another primary (or an earlier run of
+// this one, which has a new epoch) or has fallen behind what the log retains
+// is first resynchronized from a snapshot: the primary scans its tree under
+// a Snapshot, in chunks that each cover a key range, and the follower makes
+// that range of its own tree match, removing keys the primary does not have.
+// A follower can therefore restart on its old file without copying it.
+//
+// Wire format, integers little-endian, strings as [uint16 length][bytes]:
+//
+//   frame           [uint32 body length][uint8 ReplicationFrame][payload]
+//   HELLO           uint64 epoch, uint64 applied sequence      (follower)
+//   SNAPSHOT_BEGIN  uint64 epoch, uint64 sequence it reflects  (primary)
+//   SNAPSHOT_CHUNK  int64 low, int64 high, uint32 count, count x (int64 key, string value)
+//   SNAPSHOT_END    none
+//   BATCH           uint64 sequence, uint32 count, count x (uint8 delete, int64 key, string value)
+
+enum class ReplicationFrame : uint8_t {
+    HELLO = 1,
+    SNAPSHOT_BEGIN = 2,
+    SNAPSHOT_CHUNK = 3,
+    SNAPSHOT_END = 4,
+    BATCH = 5
+};
+
+struct ReplicationOptions {
+    // Encoded batches kept for followers to catch up from; one that falls
+    // further behind is resynchronized from a snapshot
+    size_t log_bytes = 64 << 20;
+    size_t snapshot_chunk = 1024;  // Entries per SNAPSHOT_CHUNK
+};
+
+// Streams a tree's writes to followers. `tree_mutex` must be held around
+// every use of the tree, by the owner as by this class; writes are logged
+// from the tree's write observer, which the primary installs for its
+// lifetime. Each follower is served by its own thread; a slow follower
+// delays only itself. Errors setting up the socket throw std::runtime_error.
+class ReplicationPrimary {
+public:
+    ReplicationPrimary(BPlusTree *tree, std::mutex *tree_mutex, const std::string &socket_path,
+                       ReplicationOptions options = ReplicationOptions());
+    ~ReplicationPrimary();
+
+    ReplicationPrimary(const ReplicationPrimary &) = delete;
+    ReplicationPrimary &operator=(const ReplicationPrimary &) = delete;
+
+    // Sequence number of the latest write; a follower has caught up with a
+    // write once its AppliedSequence() reaches this
+    uint64_t Sequence() const;
+    uint64_t Epoch() const { return epoch_; }
+    size_t Followers() const;
+    // Snapshot resyncs served so far
+    uint64_t Resyncs() const { return resyncs_; }
+
+private:
+    struct Follower {
+        int fd;
+        std::thread thread;
+        bool done = false;  // Under mutex_
+    };
+
+    BPlusTree *tree_;
+    std::mutex *tree_mutex_;
+    std::string socket_path_;
+    ReplicationOptions options_;
+    uint64_t epoch_;
+    int listen_fd_;
+    int wake_fd_;  // eventfd ending the accept loop
+
+    // Log of encoded BATCH frames with consecutive sequence numbers
+    struct Record {
+        uint64_t sequence;
+        std::string frame;
+    };
+    mutable std::mutex mutex_;
+    std::condition_variable log_cv_;
+    std::deque<Record> log_;
+    size_t log_size_;
+    uint64_t sequence_;
+    bool stopping_;
+    std::list<Follower> followers_;
+    std::atomic<uint64_t> resyncs_;
+
+    std::thread accept_thread_;
+
+    void Append(const WriteBatch &batch);
+    void AcceptLoop();
+    void Serve(Follower *follower);
+    bool CanResume(uint64_t epoch, uint64_t applied) const;
+    uint64_t SendSnapshot(int fd);
+};
+
+// Applies a primary's stream to a local tree, which stays readable meanwhile
+// under `tree_mutex`: each primary write is applied as one Write, so readers
+// see whole batches. A snapshot resync rewrites the tree range by range, and
+// readers may see a mix of old and new ranges until it ends. The follower
+// reconnects on its own whenever the connection drops. Its tree must not be
+// written by anyone else.
+class ReplicationFollower {
+public:
+    ReplicationFollower(BPlusTree *tree, std::mutex *tree_mutex, const std::string &primary_socket);
+    ~ReplicationFollower();
+
+    ReplicationFollower(const ReplicationFollower &) = delete;
+    ReplicationFollower &operator=(const ReplicationFollower &) = delete;
+
+    // Last primary sequence applied; 0 until the first resync completes
+    uint64_t AppliedSequence() const;
+    bool Connected() const;
+    uint64_t Resyncs() const;
+    // Wait until write `sequence` of the primary run `epoch`
+    // (ReplicationPrimary::Epoch) has been applied
+    bool WaitFor(uint64_t epoch, uint64_t sequence, std::chrono::milliseconds timeout);
+
+private:
+    static constexpr std::chrono::milliseconds RECONNECT_INTERVAL{100};
+
+    BPlusTree *tree_;
+    std::mutex *tree_mutex_;
+    std::string primary_socket_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;  // Applied state changed, or stopping
+    uint64_t epoch_;  // 0: state not known to match any primary sequence
+    uint64_t applied_;
+    uint64_t resyncs_;
+    int fd_;
+    bool stopping_;
+
+    std::thread thread_;
+
+    void Run();
+    void Follow(int fd);
+};
+
+#endif // REPLICATION_H
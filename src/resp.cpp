@@ -0,0 +1,477 @@
+#include "resp.h"
+
+#include "protocol.h"
+#include "write_batch.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Bounds on what a client may make the server buffer for one command
+constexpr size_t MAX_INLINE_LENGTH = 64 << 10;
+constexpr long long MAX_ARGUMENTS = 1 << 20;
+constexpr size_t MAX_COMMAND_BYTES = MAX_FRAME_BODY;
+
+// ==================== Parsing ====================
+
+// Find the CRLF-terminated line starting at `position`; npos while incomplete
+size_t LineEnd(const char *data, size_t size, size_t position) {
+    const void *newline = std::memchr(data + position, '\n', size - position);
+    if (newline == nullptr) {
+        return std::string::npos;
+    }
+    return static_cast<const char *>(newline) - data;
+}
+
+// "<prefix><integer>\r\n" at `position`; advances past the line
+RespParse ParseLength(const char *data, size_t size, size_t *position, char prefix, long long *value) {
+    size_t end = LineEnd(data, size, *position);
+    if (end == std::string::npos) {
+        return size - *position > MAX_INLINE_LENGTH ? RespParse::MALFORMED : RespParse::INCOMPLETE;
+    }
+    if (data[*position] != prefix || end == *position + 1 || data[end - 1] != '\r') {
+        return RespParse::MALFORMED;
+    }
+    std::string digits(data + *position + 1, end - 1 - (*position + 1));
+    char *digits_end = nullptr;
+    errno = 0;
+    *value = std::strtoll(digits.c_str(), &digits_end, 10);
+    if (digits.empty() || *digits_end != '\0' || errno != 0) {
+        return RespParse::MALFORMED;
+    }
+    *position = end + 1;
+    return RespParse::COMPLETE;
+}
+
+RespParse ParseInline(const char *data, size_t size, size_t *consumed, RespCommand *command) {
+    size_t end = LineEnd(data, size, 0);
+    if (end == std::string::npos) {
+        return size > MAX_INLINE_LENGTH ? RespParse::MALFORMED : RespParse::INCOMPLETE;
+    }
+    size_t position = 0;
+    while (position < end) {
+        while (position < end && std::isspace(static_cast<unsigned char>(data[position]))) {
+            ++position;
+        }
+        size_t start = position;
+        while (position < end && !std::isspace(static_cast<unsigned char>(data[position]))) {
+            ++position;
+        }
+        if (position > start) {
+            command->args.emplace_back(data + start, position - start);
+        }
+    }
+    *consumed = end + 1;
+    return RespParse::COMPLETE;
+}
+
+// ==================== Replies ====================
+
+void Simple(std::string *out, const char *text) {
+    out->append("+").append(text).append("\r\n");
+}
+
+// Errors echo client input, which must not break the reply line
+void Error(std::string *out, const std::string &message) {
+    std::string line(message);
+    std::replace(line.begin(), line.end(), '\r', ' ');
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    out->append("-").append(line).append("\r\n");
+}
+
+void Integer(std::string *out, long long value) {
+    out->append(":").append(std::to_string(value)).append("\r\n");
+}
+
+void Bulk(std::string *out, const std::string &value) {
+    out->append("$").append(std::to_string(value.size())).append("\r\n").append(value).append("\r\n");
+}
+
+void Null(std::string *out, const RespSession &session) {
+    out->append(session.version >= 3 ? "_\r\n" : "$-1\r\n");
+}
+
+void Array(std::string *out, size_t count) {
+    out->append("*").append(std::to_string(count)).append("\r\n");
+}
+
+// RESP2 has no maps; they go out as flat key/value arrays
+void Map(std::string *out, const RespSession &session, size_t pairs) {
+    if (session.version >= 3) {
+        out->append("%").append(std::to_string(pairs)).append("\r\n");
+    } else {
+        Array(out, 2 * pairs);
+    }
+}
+
+// Sorted set scores are doubles in RESP3 and bulk strings in RESP2
+void Score(std::string *out, const RespSession &session, int64_t score) {
+    if (session.version >= 3) {
+        out->append(",").append(std::to_string(score)).append("\r\n");
+    } else {
+        Bulk(out, std::to_string(score));
+    }
+}
+
+// ==================== Arguments ====================
+
+bool ParseInteger(const std::string &text, int64_t *value) {
+    if (text.empty()) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (*end != '\0' || errno != 0 || std::isspace(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+// A decimal integer, optionally behind the session's key prefix. Other
+// prefixes are rejected rather than ignored, so "user:1" and "order:1" do
+// not both name key 1
+bool ParseKey(const std::string &text, const RespSession &session, int64_t *key) {
+    const std::string &prefix = session.key_prefix;
+    bool prefixed = !prefix.empty() && text.compare(0, prefix.size(), prefix) == 0;
+    return ParseInteger(prefixed ? text.substr(prefix.size()) : text, key);
+}
+
+std::string Upper(std::string text) {
+    for (char &c : text) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return text;
+}
+
+// Score bound: an integer, -inf/+inf, or '(' for exclusive. `empty` is set
+// when an exclusive bound excludes the whole key space
+bool ParseBound(const std::string &text, bool is_min, int64_t *bound, bool *empty) {
+    std::string upper = Upper(text);
+    if (upper == "-INF" || upper == "+INF" || upper == "INF") {
+        *bound = upper[0] == '-' ? INT64_MIN : INT64_MAX;
+        return true;
+    }
+    bool exclusive = !text.empty() && text[0] == '(';
+    if (!ParseInteger(exclusive ? text.substr(1) : text, bound)) {
+        return false;
+    }
+    if (exclusive) {
+        if (*bound == (is_min ? INT64_MAX : INT64_MIN)) {
+            *empty = true;
+        } else {
+            *bound += is_min ? 1 : -1;
+        }
+    }
+    return true;
+}
+
+bool ValidValue(const std::string &value) {
+    return !value.empty() && value.size() < VALUE_SIZE && value.find('\0') == std::string::npos;
+}
+
+const std::string INVALID_KEY = "ERR key must be a decimal integer";
+const std::string INVALID_VALUE = "ERR value must be 1 to " + std::to_string(VALUE_SIZE - 1) + " bytes without NUL";
+
+std::string WrongArity(const std::string &name) {
+    return "ERR wrong number of arguments for '" + name + "' command";
+}
+
+// ==================== Commands ====================
+
+void ZRangeByScore(BPlusTree *tree, const RespCommand &command, const RespSession &session, std::string *out) {
+    const std::vector<std::string> &args = command.args;
+    bool with_scores = false;
+    int64_t offset = 0;
+    int64_t count = -1;
+    for (size_t i = 4; i < args.size(); ++i) {
+        std::string option = Upper(args[i]);
+        if (option == "WITHSCORES") {
+            with_scores = true;
+        } else if (option == "LIMIT" && i + 2 < args.size() && ParseInteger(args[i + 1], &offset) &&
+                   ParseInteger(args[i + 2], &count)) {
+            i += 2;
+        } else {
+            Error(out, "ERR syntax error");
+            return;
+        }
+    }
+
+    int64_t min;
+    int64_t max;
+    bool empty = false;
+    if (!ParseBound(args[2], true, &min, &empty) || !ParseBound(args[3], false, &max, &empty)) {
+        Error(out, "ERR min or max is not an integer");
+        return;
+    }
+
+    // Like Redis, a negative offset selects nothing and a negative count means no limit.
+    // The scan stops after the last entry LIMIT can return
+    std::vector<std::pair<int64_t, std::string>> entries;
+    if (!empty && min <= max && offset >= 0) {
+        size_t limit = count < 0 || count > INT64_MAX - offset ? SIZE_MAX : static_cast<size_t>(offset + count);
+        entries = tree->Scan(min, max, nullptr, limit);
+    }
+    size_t first = std::min<size_t>(entries.size(), static_cast<size_t>(std::max<int64_t>(offset, 0)));
+    size_t last = count < 0 ? entries.size() : std::min<size_t>(entries.size(), first + count);
+    if (!with_scores) {
+        Array(out, last - first);
+        for (size_t i = first; i < last; ++i) {
+            Bulk(out, entries[i].second);
+        }
+    } else if (session.version >= 3) {
+        Array(out, last - first);
+        for (size_t i = first; i < last; ++i) {
+            Array(out, 2);
+            Bulk(out, entries[i].second);
+            Score(out, session, entries[i].first);
+        }
+    } else {
+        Array(out, 2 * (last - first));
+        for (size_t i = first; i < last; ++i) {
+            Bulk(out, entries[i].second);
+            Score(out, session, entries[i].first);
+        }
+    }
+}
+
+void Hello(const RespCommand &command, RespSession *session, std::string *out) {
+    if (command.args.size() >= 2) {
+        int64_t version;
+        if (!ParseInteger(command.args[1], &version) || (version != 2 && version != 3)) {
+            Error(out, "NOPROTO unsupported protocol version");
+            return;
+        }
+        session->version = static_cast<int>(version);
+    }
+    Map(out, *session, 7);
+    Bulk(out, "server");
+    Bulk(out, "bptree");
+    Bulk(out, "version");
+    Bulk(out, "1.0.0");
+    Bulk(out, "proto");
+    Integer(out, session->version);
+    Bulk(out, "id");
+    Integer(out, 0);
+    Bulk(out, "mode");
+    Bulk(out, "standalone");
+    Bulk(out, "role");
+    Bulk(out, "master");
+    Bulk(out, "modules");
+    Array(out, 0);
+}
+
+// redis-benchmark reads these two at startup
+void ConfigGet(const RespCommand &command, const RespSession &session, std::string *out) {
+    std::vector<std::pair<std::string, std::string>> found;
+    for (size_t i = 2; i < command.args.size(); ++i) {
+        if (command.args[i] == "save") {
+            found.emplace_back("save", "");
+        } else if (command.args[i] == "appendonly") {
+            found.emplace_back("appendonly", "no");
+        }
+    }
+    Map(out, session, found.size());
+    for (const auto &[name, value] : found) {
+        Bulk(out, name);
+        Bulk(out, value);
+    }
+}
+
+}  // namespace
+
+RespParse ParseRespCommand(const char *data, size_t size, size_t *consumed, RespCommand *command) {
+    command->args.clear();
+    if (size == 0) {
+        return RespParse::INCOMPLETE;
+    }
+    if (data[0] != '*') {
+        return ParseInline(data, size, consumed, command);
+    }
+
+    size_t position = 0;
+    long long count;
+    RespParse result = ParseLength(data, size, &position, '*', &count);
+    if (result != RespParse::COMPLETE) {
+        return result;
+    }
+    if (count > MAX_ARGUMENTS) {
+        return RespParse::MALFORMED;
+    }
+    for (long long i = 0; i < count; ++i) {
+        long long length;
+        result = ParseLength(data, size, &position, '$', &length);
+        if (result == RespParse::INCOMPLETE) {
+            return size > MAX_COMMAND_BYTES ? RespParse::MALFORMED : RespParse::INCOMPLETE;
+        }
+        if (result == RespParse::MALFORMED || length < 0 || static_cast<size_t>(length) > MAX_COMMAND_BYTES) {
+            return RespParse::MALFORMED;
+        }
+        if (size - position < static_cast<size_t>(length) + 2) {
+            return position + length > MAX_COMMAND_BYTES ? RespParse::MALFORMED : RespParse::INCOMPLETE;
+        }
+        if (data[position + length] != '\r' || data[position + length + 1] != '\n') {
+            return RespParse::MALFORMED;
+        }
+        command->args.emplace_back(data + position, length);
+        position += length + 2;
+    }
+    *consumed = position;
+    return RespParse::COMPLETE;
+}
+
+void ExecuteRespCommand(BPlusTree *tree, const RespCommand &command, RespSession *session, std::string *out) {
+    const std::vector<std::string> &args = command.args;
+    if (args.empty()) {
+        return;  // Blank inline line; Redis sends nothing back either
+    }
+    std::string name = Upper(args[0]);
+    size_t argc = args.size();
+
+    try {
+        if (session->read_only && (name == "SET" || name == "MSET" || name == "DEL")) {
+            Error(out, "READONLY You can't write against a read only replica.");
+        } else if (name == "GET") {
+            int64_t key;
+            if (argc != 2) {
+                Error(out, WrongArity("get"));
+            } else if (!ParseKey(args[1], *session, &key)) {
+                Error(out, INVALID_KEY);
+            } else if (std::optional<std::string> value = tree->Search(key)) {
+                Bulk(out, *value);
+            } else {
+                Null(out, *session);
+            }
+        } else if (name == "SET") {
+            int64_t key;
+            if (argc != 3) {
+                Error(out, argc < 3 ? WrongArity("set") : "ERR syntax error (SET options are not supported)");
+            } else if (!ParseKey(args[1], *session, &key)) {
+                Error(out, INVALID_KEY);
+            } else if (!ValidValue(args[2])) {
+                Error(out, INVALID_VALUE);
+            } else if (!tree->Insert(key, args[2])) {
+                Error(out, "ERR insert failed: buffer pool exhausted");
+            } else {
+                Simple(out, "OK");
+            }
+        } else if (name == "MGET") {
+            if (argc < 2) {
+                Error(out, WrongArity("mget"));
+                return;
+            }
+            // Like Redis, a key that cannot exist reads as missing
+            std::vector<int64_t> keys;
+            std::vector<size_t> positions;
+            for (size_t i = 1; i < argc; ++i) {
+                int64_t key;
+                if (ParseKey(args[i], *session, &key)) {
+                    keys.push_back(key);
+                    positions.push_back(i - 1);
+                }
+            }
+            std::vector<std::optional<std::string>> values(argc - 1);
+            std::vector<std::optional<std::string>> found = tree->MultiGet(keys);
+            for (size_t i = 0; i < found.size(); ++i) {
+                values[positions[i]] = std::move(found[i]);
+            }
+            Array(out, values.size());
+            for (const std::optional<std::string> &value : values) {
+                if (value) {
+                    Bulk(out, *value);
+                } else {
+                    Null(out, *session);
+                }
+            }
+        } else if (name == "MSET") {
+            if (argc < 3 || argc % 2 == 0) {
+                Error(out, WrongArity("mset"));
+                return;
+            }
+            WriteBatch batch;
+            for (size_t i = 1; i < argc; i += 2) {
+                int64_t key;
+                if (!ParseKey(args[i], *session, &key)) {
+                    Error(out, INVALID_KEY);
+                    return;
+                }
+                if (!ValidValue(args[i + 1])) {
+                    Error(out, INVALID_VALUE);
+                    return;
+                }
+                batch.Put(key, args[i + 1]);
+            }
+            if (!tree->Write(batch)) {
+                Error(out, "ERR write failed: buffer pool exhausted");
+            } else {
+                Simple(out, "OK");
+            }
+        } else if (name == "DEL" || name == "EXISTS") {
+            if (argc < 2) {
+                Error(out, WrongArity(name == "DEL" ? "del" : "exists"));
+                return;
+            }
+            // Remove() also succeeds on tombstones, so count keys that are live
+            long long count = 0;
+            for (size_t i = 1; i < argc; ++i) {
+                int64_t key;
+                if (ParseKey(args[i], *session, &key) && tree->Search(key)) {
+                    ++count;
+                    if (name == "DEL") {
+                        tree->Remove(key);
+                    }
+                }
+            }
+            Integer(out, count);
+        } else if (name == "ZRANGEBYSCORE") {
+            if (argc < 4) {
+                Error(out, WrongArity("zrangebyscore"));
+            } else {
+                ZRangeByScore(tree, command, *session, out);
+            }
+        } else if (name == "PING") {
+            if (argc > 2) {
+                Error(out, WrongArity("ping"));
+            } else if (argc == 2) {
+                Bulk(out, args[1]);
+            } else {
+                Simple(out, "PONG");
+            }
+        } else if (name == "ECHO") {
+            if (argc != 2) {
+                Error(out, WrongArity("echo"));
+            } else {
+                Bulk(out, args[1]);
+            }
+        } else if (name == "HELLO") {
+            Hello(command, session, out);
+        } else if (name == "SELECT") {
+            if (argc != 2) {
+                Error(out, WrongArity("select"));
+            } else if (args[1] != "0") {
+                Error(out, "ERR DB index is out of range");
+            } else {
+                Simple(out, "OK");
+            }
+        } else if (name == "QUIT") {
+            Simple(out, "OK");
+            session->quit = true;
+        } else if (name == "CONFIG" && argc >= 3 && Upper(args[1]) == "GET") {
+            ConfigGet(command, *session, out);
+        } else if (name == "CLIENT") {
+            Simple(out, "OK");
+        } else if (name == "COMMAND") {
+            Array(out, 0);
+        } else {
+            Error(out, "ERR unknown command '" + args[0] + "'");
+        }
+    } catch (const std::exception &e) {
+        Error(out, std::string("ERR ") + e.what());
+    }
+}
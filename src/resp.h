@@ -0,0 +1,53 @@
+#ifndef RESP_H
+#define RESP_H
+
+#include "btree.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Redis protocol (RESP2, and RESP3 after HELLO 3) front end for bptree_server,
+// so stock Redis clients and redis-benchmark can talk to a tree.
+//
+// Commands:
+//   GET key                     SET key value            DEL key [key ...]
+//   MGET key [key ...]          MSET key value [...]     EXISTS key [key ...]
+//   ZRANGEBYSCORE set min max [WITHSCORES] [LIMIT offset count]
+//   PING, ECHO, HELLO, SELECT 0, QUIT, and CONFIG GET / CLIENT / COMMAND
+//   stubs for client handshakes
+//
+// Keys are the tree's int64 keys written in decimal. A session's key_prefix
+// may precede the digits: with "key:", redis-benchmark's "key:000000001234"
+// is key 1234. Any other non-digit key is rejected. Values
+// are 1 to VALUE_SIZE - 1 bytes without NUL, as the tree stores them.
+// ZRANGEBYSCORE treats the whole tree as one sorted set, with keys as scores
+// and values as members; its set argument is ignored. min and max accept
+// -inf, +inf and '(' for exclusive bounds.
+
+struct RespCommand {
+    std::vector<std::string> args;
+};
+
+enum class RespParse {
+    COMPLETE,    // One command parsed; `consumed` bytes used
+    INCOMPLETE,  // Need more bytes
+    MALFORMED    // Protocol error; close the connection
+};
+
+// Per-connection protocol state
+struct RespSession {
+    int version = 2;         // RESP2 until HELLO 3
+    bool quit = false;       // QUIT answered; ignore the rest and close
+    bool read_only = false;  // Replica: SET, MSET and DEL answer -READONLY
+    std::string key_prefix;  // Accepted before a key's digits; empty for none
+};
+
+// Parse one command (multibulk, or an inline command line) from the front of
+// `data`. An empty line parses as a command with no arguments.
+RespParse ParseRespCommand(const char *data, size_t size, size_t *consumed, RespCommand *command);
+
+// Run one command against the tree and append its reply to `out`. The caller
+// serializes access to the tree.
+void ExecuteRespCommand(BPlusTree *tree, const RespCommand &command, RespSession *session, std::string *out);
+
+#endif // RESP_H
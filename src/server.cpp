@@ -0,0 +1,527 @@
+#include "server.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// A connection stops reading while this much output waits for the client,
+// or this many parsed requests wait for a worker
+constexpr size_t OUTPUT_HIGH_WATER = 4 << 20;
+constexpr size_t MAX_QUEUED_REQUESTS = 4096;
+constexpr size_t READ_CHUNK = 64 << 10;
+constexpr int MAX_EVENTS = 64;
+constexpr const char *READ_ONLY_ERROR = "read-only follower: write to the primary";
+
+[[noreturn]] void ThrowErrno(const std::string &what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+}  // namespace
+
+struct KvServer::Connection {
+    int fd;
+    WireProtocol protocol;
+    uint32_t events = 0;               // Current epoll interest
+    std::string input;                 // Bytes not yet parsed into requests
+    std::vector<Request> queued;       // Parsed, waiting for the next batch (BINARY)
+    std::vector<RespCommand> queued_commands;  // ... (RESP)
+    std::string output;                // Encoded responses waiting for the socket
+    size_t output_sent = 0;            // Prefix of `output` already written
+    bool read_closed = false;          // Client sent EOF; finish its requests, then close
+    bool broken = false;               // Socket error or malformed frame; drop it
+
+    // Owned by a worker while busy; the loop touches them only when idle
+    bool busy = false;
+    std::vector<Request> batch;
+    std::vector<RespCommand> batch_commands;
+    RespSession session;
+    std::string batch_output;
+
+    Connection(int socket_fd, WireProtocol wire_protocol) : fd(socket_fd), protocol(wire_protocol) {}
+
+    size_t QueuedCount() const { return queued.size() + queued_commands.size(); }
+};
+
+KvServer::KvServer(BPlusTree *tree, ServerOptions options)
+    : tree_(tree), options_(std::move(options)), epoll_fd_(-1), wake_fd_(-1), tcp_port_(-1), resp_port_(-1),
+      stopping_(false), shutting_down_(false) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        ThrowErrno("Failed to create event loop");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+    if (!options_.unix_path.empty()) {
+        ListenUnix(options_.unix_path, WireProtocol::BINARY);
+    }
+    if (options_.tcp_port >= 0) {
+        tcp_port_ = ListenTcp(options_.tcp_port, WireProtocol::BINARY);
+    }
+    if (!options_.resp_unix_path.empty()) {
+        ListenUnix(options_.resp_unix_path, WireProtocol::RESP);
+    }
+    if (options_.resp_port >= 0) {
+        resp_port_ = ListenTcp(options_.resp_port, WireProtocol::RESP);
+    }
+    if (listeners_.empty()) {
+        throw std::runtime_error("Server needs a Unix socket path or a TCP port");
+    }
+    if (!options_.replication_path.empty()) {
+        primary_ = std::make_unique<ReplicationPrimary>(tree_, &tree_mutex_, options_.replication_path);
+    }
+    if (!options_.follow_path.empty()) {
+        follower_ = std::make_unique<ReplicationFollower>(tree_, &tree_mutex_, options_.follow_path);
+    }
+
+    for (int i = 0; i < std::max(1, options_.workers); ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+KvServer::~KvServer() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        shutting_down_ = true;
+    }
+    queue_cv_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+    for (auto &[fd, conn] : connections_) {
+        close(fd);
+    }
+    for (const Listener &listener : listeners_) {
+        close(listener.fd);
+    }
+    for (const std::string &path : {options_.unix_path, options_.resp_unix_path}) {
+        if (!path.empty()) {
+            unlink(path.c_str());
+        }
+    }
+    close(wake_fd_);
+    close(epoll_fd_);
+}
+
+void KvServer::ListenUnix(const std::string &path, WireProtocol protocol) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path.c_str());  // Left behind by a previous run
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        ThrowErrno("Failed to listen on " + path);
+    }
+    listeners_.push_back({fd, protocol, false});
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+}
+
+// Returns the bound port
+int KvServer::ListenTcp(int port, WireProtocol protocol) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        ThrowErrno("Failed to listen on 127.0.0.1:" + std::to_string(port));
+    }
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length);
+    listeners_.push_back({fd, protocol, true});
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    return ntohs(address.sin_port);
+}
+
+void KvServer::Stop() {
+    stopping_.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+    (void)ignored;
+}
+
+// ==================== Event loop ====================
+
+void KvServer::Run() {
+    epoll_event events[MAX_EVENTS];
+    while (!stopping_.load()) {
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowErrno("epoll_wait failed");
+        }
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd_) {
+                uint64_t value;
+                ssize_t ignored = read(wake_fd_, &value, sizeof(value));
+                (void)ignored;
+                CollectFinished();
+                continue;
+            }
+            auto listener = std::find_if(listeners_.begin(), listeners_.end(),
+                                         [fd](const Listener &l) { return l.fd == fd; });
+            if (listener != listeners_.end()) {
+                Accept(*listener);
+                continue;
+            }
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection *conn = it->second.get();
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                ReadInput(conn);
+            }
+            if (events[i].events & EPOLLOUT) {
+                WriteOutput(conn);
+            }
+            Settle(conn);
+        }
+    }
+
+    // Let in-flight batches finish before their connections go away
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    for (Connection *conn : pending_) {
+        conn->busy = false;
+    }
+    pending_.clear();
+    queue_cv_.wait(lock, [this] {
+        for (auto &[fd, conn] : connections_) {
+            if (conn->busy && std::find(finished_.begin(), finished_.end(), conn.get()) == finished_.end()) {
+                return false;
+            }
+        }
+        return true;
+    });
+    finished_.clear();
+    lock.unlock();
+    for (auto &[fd, conn] : connections_) {
+        close(fd);
+    }
+    connections_.clear();
+}
+
+void KvServer::Accept(const Listener &listener) {
+    while (true) {
+        int fd = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;  // EAGAIN, or a connection that died while queued
+        }
+        if (listener.tcp) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        auto conn = std::make_unique<Connection>(fd, listener.protocol);
+        conn->session.read_only = follower_ != nullptr;
+        conn->session.key_prefix = options_.resp_key_prefix;
+        conn->events = EPOLLIN;
+        epoll_event event{};
+        event.events = conn->events;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+        connections_.emplace(fd, std::move(conn));
+    }
+}
+
+void KvServer::ReadInput(Connection *conn) {
+    while (!conn->read_closed && !conn->broken) {
+        size_t old_size = conn->input.size();
+        conn->input.resize(old_size + READ_CHUNK);
+        ssize_t bytes_read = read(conn->fd, &conn->input[old_size], READ_CHUNK);
+        conn->input.resize(old_size + std::max<ssize_t>(bytes_read, 0));
+        if (bytes_read > 0) {
+            if (static_cast<size_t>(bytes_read) < READ_CHUNK) {
+                break;  // Drained for now
+            }
+            continue;
+        }
+        if (bytes_read == 0) {
+            conn->read_closed = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            conn->broken = true;
+        } else if (errno == EINTR) {
+            continue;
+        }
+        break;
+    }
+
+    if (conn->protocol == WireProtocol::BINARY) {
+        ParseFrames(conn);
+    } else {
+        ParseCommands(conn);
+    }
+}
+
+// Parse every complete frame; the remainder waits for more bytes
+void KvServer::ParseFrames(Connection *conn) {
+    size_t consumed = 0;
+    while (!conn->broken) {
+        std::optional<size_t> body = CompleteFrame(conn->input.data() + consumed, conn->input.size() - consumed);
+        if (!body) {
+            if (conn->input.size() - consumed >= FRAME_HEADER_SIZE) {
+                uint32_t length;
+                std::memcpy(&length, conn->input.data() + consumed, sizeof(length));
+                conn->broken = length > MAX_FRAME_BODY;
+            }
+            break;
+        }
+        Request request;
+        if (!DecodeRequest(conn->input.data() + consumed + FRAME_HEADER_SIZE, *body, &request)) {
+            conn->broken = true;
+            break;
+        }
+        conn->queued.push_back(std::move(request));
+        consumed += FRAME_HEADER_SIZE + *body;
+    }
+    conn->input.erase(0, consumed);
+}
+
+void KvServer::ParseCommands(Connection *conn) {
+    size_t consumed = 0;
+    while (!conn->broken) {
+        RespCommand command;
+        size_t length = 0;
+        RespParse result =
+            ParseRespCommand(conn->input.data() + consumed, conn->input.size() - consumed, &length, &command);
+        if (result == RespParse::INCOMPLETE) {
+            break;
+        }
+        if (result == RespParse::MALFORMED) {
+            conn->broken = true;
+            break;
+        }
+        if (!command.args.empty()) {
+            conn->queued_commands.push_back(std::move(command));
+        }
+        consumed += length;
+    }
+    conn->input.erase(0, consumed);
+}
+
+void KvServer::WriteOutput(Connection *conn) {
+    while (conn->output_sent < conn->output.size()) {
+        ssize_t bytes_written = send(conn->fd, conn->output.data() + conn->output_sent,
+                                     conn->output.size() - conn->output_sent, MSG_NOSIGNAL);
+        if (bytes_written > 0) {
+            conn->output_sent += bytes_written;
+        } else if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (bytes_written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn->broken = true;
+            }
+            break;
+        }
+    }
+    if (conn->output_sent == conn->output.size()) {
+        conn->output.clear();
+        conn->output_sent = 0;
+    }
+}
+
+// Bring a connection up to date after its state changed: hand queued
+// requests to a worker, close it once nothing is left to do, and ask epoll
+// only for the events it can act on (no input under backpressure, nothing
+// at all while a worker holds a connection that has hung up)
+void KvServer::Settle(Connection *conn) {
+    if (!conn->busy) {
+        if (conn->broken || (conn->read_closed && conn->QueuedCount() == 0 && conn->output.empty())) {
+            Close(conn);
+            return;
+        }
+        if (conn->QueuedCount() > 0 && conn->output.size() < OUTPUT_HIGH_WATER) {
+            Dispatch(conn);
+        }
+    }
+
+    uint32_t events = 0;
+    if (!conn->broken && !conn->read_closed && conn->output.size() < OUTPUT_HIGH_WATER &&
+        conn->QueuedCount() < MAX_QUEUED_REQUESTS) {
+        events |= EPOLLIN;
+    }
+    if (!conn->broken && !conn->output.empty()) {
+        events |= EPOLLOUT;
+    }
+    if (events != conn->events) {
+        // An fd without interest leaves the set entirely; EPOLLHUP cannot be masked
+        int op = conn->events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        conn->events = events;
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = conn->fd;
+        epoll_ctl(epoll_fd_, op, conn->fd, &event);
+    }
+}
+
+void KvServer::Close(Connection *conn) {
+    int fd = conn->fd;
+    close(fd);  // Also drops it from the epoll set
+    connections_.erase(fd);
+}
+
+// ==================== Workers ====================
+
+void KvServer::Dispatch(Connection *conn) {
+    conn->batch.swap(conn->queued);
+    conn->batch_commands.swap(conn->queued_commands);
+    conn->busy = true;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        pending_.push_back(conn);
+    }
+    queue_cv_.notify_one();
+}
+
+void KvServer::CollectFinished() {
+    std::deque<Connection *> finished;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        finished.swap(finished_);
+    }
+    for (Connection *conn : finished) {
+        conn->busy = false;
+        conn->output += conn->batch_output;
+        conn->batch_output.clear();
+        if (conn->session.quit) {
+            // QUIT: answer what came before it, drop what came after
+            conn->read_closed = true;
+            conn->input.clear();
+            conn->queued_commands.clear();
+        }
+        WriteOutput(conn);
+        Settle(conn);
+    }
+}
+
+void KvServer::WorkerLoop() {
+    while (true) {
+        Connection *conn;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return shutting_down_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                return;
+            }
+            conn = pending_.front();
+            pending_.pop_front();
+        }
+        ExecuteBatch(conn);
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            finished_.push_back(conn);
+        }
+        queue_cv_.notify_all();  // Run() may be waiting for in-flight batches
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void KvServer::ExecuteBatch(Connection *conn) {
+    if (conn->protocol == WireProtocol::RESP) {
+        ExecuteCommands(conn);
+        return;
+    }
+    std::vector<Response> responses(conn->batch.size());
+    for (size_t i = 0; i < conn->batch.size(); ++i) {
+        const Request &request = conn->batch[i];
+        Response &response = responses[i];
+        response.id = request.id;
+        response.type = request.type;
+        // One request at a time, so a long pipeline does not hold off other
+        // connections
+        std::lock_guard<std::mutex> lock(tree_mutex_);
+        try {
+            switch (request.type) {
+                case RequestType::SEARCH: {
+                    std::optional<std::string> value = tree_->Search(request.key);
+                    if (value) {
+                        response.value = std::move(*value);
+                    } else {
+                        response.status = ResponseStatus::NOT_FOUND;
+                    }
+                    break;
+                }
+                case RequestType::INSERT:
+                    if (follower_) {
+                        response.status = ResponseStatus::ERROR;
+                        response.value = READ_ONLY_ERROR;
+                    } else if (!tree_->Insert(request.key, request.value)) {
+                        response.status = ResponseStatus::ERROR;
+                        response.value = "insert failed: buffer pool exhausted";
+                    }
+                    break;
+                case RequestType::REMOVE:
+                    if (follower_) {
+                        response.status = ResponseStatus::ERROR;
+                        response.value = READ_ONLY_ERROR;
+                    } else if (!tree_->Remove(request.key)) {
+                        response.status = ResponseStatus::NOT_FOUND;
+                    }
+                    break;
+                case RequestType::SCAN: {
+                    uint32_t limit = request.limit == 0 ? MAX_SCAN_ENTRIES : std::min(request.limit, MAX_SCAN_ENTRIES);
+                    response.entries = tree_->Scan(request.key, request.end_key, nullptr, limit);
+                    break;
+                }
+                case RequestType::MULTI_GET:
+                    response.values = tree_->MultiGet(request.keys);
+                    break;
+            }
+        } catch (const std::exception &e) {
+            response.status = ResponseStatus::ERROR;
+            response.value = e.what();
+        }
+    }
+
+    // Encoding needs no lock
+    conn->batch.clear();
+    for (const Response &response : responses) {
+        EncodeResponse(response, &conn->batch_output);
+    }
+}
+
+// RESP replies are short and written straight into the output, each under
+// the lock on its own
+void KvServer::ExecuteCommands(Connection *conn) {
+    for (const RespCommand &command : conn->batch_commands) {
+        if (conn->session.quit) {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(tree_mutex_);
+        ExecuteRespCommand(tree_, command, &conn->session, &conn->batch_output);
+    }
+    conn->batch_commands.clear();
+}
@@ -0,0 +1,119 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "btree.h"
+#include "protocol.h"
+#include "replication.h"
+#include "resp.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Ports are on 127.0.0.1: -1 for none, 0 for any free port
+struct ServerOptions {
+    std::string unix_path;       // Unix domain socket to listen on; empty for none
+    int tcp_port = -1;
+    std::string resp_unix_path;  // Same, speaking the Redis protocol (resp.h)
+    int resp_port = -1;
+    std::string resp_key_prefix;  // Allowed before RESP keys, e.g. "key:" for redis-benchmark
+    int workers = 4;             // Threads executing request batches
+    // Replication (replication.h): stream this tree's writes to followers
+    // connecting on `replication_path`, and/or follow the primary at
+    // `follow_path`, refusing client writes. Both at once relay a stream.
+    std::string replication_path;
+    std::string follow_path;
+};
+
+enum class WireProtocol : uint8_t {
+    BINARY,  // protocol.h
+    RESP     // resp.h
+};
+
+// Serves one tree to local processes over the binary protocol of protocol.h
+// or the Redis protocol of resp.h, so they share a single buffer pool instead
+// of embedding one each.
+//
+// One epoll loop accepts connections and moves bytes. Complete requests are
+// handed to the worker pool in per-connection batches: a batch executes in
+// order under the tree lock and its responses go back in order, so pipelined
+// requests of one connection apply in sequence and take the lock once, while
+// the loop keeps serving other connections. The tree itself is
+// single-threaded; workers overlap only decoding, encoding and socket I/O.
+// A follower server answers reads from its replica, so scans can be moved
+// off the primary; writes must go to the primary.
+class KvServer {
+public:
+    // Binds the listeners; throws std::runtime_error when that fails
+    KvServer(BPlusTree *tree, ServerOptions options);
+    ~KvServer();
+
+    KvServer(const KvServer &) = delete;
+    KvServer &operator=(const KvServer &) = delete;
+
+    // Serve until Stop(); connections still open are closed on return
+    void Run();
+    // Safe from any thread and from signal handlers
+    void Stop();
+
+    // Bound ports, or -1 when not listening
+    int TcpPort() const { return tcp_port_; }
+    int RespPort() const { return resp_port_; }
+    // Null unless configured in ServerOptions
+    ReplicationPrimary *Primary() { return primary_.get(); }
+    ReplicationFollower *Follower() { return follower_.get(); }
+
+private:
+    struct Connection;
+
+    BPlusTree *tree_;
+    ServerOptions options_;
+    int epoll_fd_;
+    int wake_fd_;      // eventfd: Stop() and finished batches wake the loop
+    struct Listener {
+        int fd;
+        WireProtocol protocol;
+        bool tcp;
+    };
+    std::vector<Listener> listeners_;
+    int tcp_port_;
+    int resp_port_;
+    std::atomic<bool> stopping_;
+
+    // Loop thread only
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+
+    std::mutex tree_mutex_;
+    std::unique_ptr<ReplicationPrimary> primary_;
+    std::unique_ptr<ReplicationFollower> follower_;
+
+    // Worker pool: connections with a batch to run, and those done with one
+    std::vector<std::thread> workers_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<Connection *> pending_;
+    std::deque<Connection *> finished_;
+    bool shutting_down_;
+
+    void ListenUnix(const std::string &path, WireProtocol protocol);
+    int ListenTcp(int port, WireProtocol protocol);
+    void Accept(const Listener &listener);
+    void ReadInput(Connection *conn);
+    void ParseFrames(Connection *conn);
+    void ParseCommands(Connection *conn);
+    void WriteOutput(Connection *conn);
+    void CollectFinished();
+    void Dispatch(Connection *conn);
+    void Settle(Connection *conn);
+    void Close(Connection *conn);
+    void WorkerLoop();
+    void ExecuteBatch(Connection *conn);
+    void ExecuteCommands(Connection *conn);
+};
+
+#endif // SERVER_H
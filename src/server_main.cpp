@@ -0,0 +1,127 @@
+// Key-value server: opens one database file and serves a tree from it to
+// every local client, so processes on a host share one buffer pool. See
+// protocol.h for the wire format, kv_client.h for a client, and resp.h for
+// the Redis-compatible front end.
+
+#include "btree.h"
+#include "buffer_pool_manager.h"
+#include "disk_manager.h"
+#include "server.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+KvServer *running_server = nullptr;
+
+void HandleSignal(int) {
+    if (running_server != nullptr) {
+        running_server->Stop();
+    }
+}
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " DB_FILE [options]\n"
+              << "  --socket PATH          Unix domain socket (default bptree.sock; \"\" for none)\n"
+              << "  --port N               also listen on 127.0.0.1:N (0 picks a free port)\n"
+              << "  --resp-socket PATH     Unix domain socket speaking the Redis protocol\n"
+              << "  --resp-port N          Redis protocol on 127.0.0.1:N (6379 for stock clients)\n"
+              << "  --resp-key-prefix P    accept RESP keys written as P<integer> (\"key:\" for redis-benchmark)\n"
+              << "  --workers N            threads executing requests (default 4)\n"
+              << "  --pool-pages N         buffer pool frames (default " << MAX_PAGES_IN_RAM << ")\n"
+              << "  --cow                  open the file in copy-on-write mode\n"
+              << "  --tree NAME            serve a named tree instead of the default one\n"
+              << "  --replicate PATH       stream writes to followers connecting on this Unix socket\n"
+              << "  --follow PATH          replicate from the primary at this socket; serve reads only\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string db_file;
+    ServerOptions options;
+    options.unix_path = "bptree.sock";
+    size_t pool_pages = MAX_PAGES_IN_RAM;
+    bool copy_on_write = false;
+    std::string tree_name;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cow") {
+            copy_on_write = true;
+        } else if (i + 1 < argc && arg == "--socket") {
+            options.unix_path = argv[++i];
+        } else if (i + 1 < argc && arg == "--port") {
+            options.tcp_port = std::atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "--resp-socket") {
+            options.resp_unix_path = argv[++i];
+        } else if (i + 1 < argc && arg == "--resp-port") {
+            options.resp_port = std::atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "--resp-key-prefix") {
+            options.resp_key_prefix = argv[++i];
+        } else if (i + 1 < argc && arg == "--workers") {
+            options.workers = std::max(1, std::atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "--pool-pages") {
+            pool_pages = std::max(1, std::atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "--tree") {
+            tree_name = argv[++i];
+        } else if (i + 1 < argc && arg == "--replicate") {
+            options.replication_path = argv[++i];
+        } else if (i + 1 < argc && arg == "--follow") {
+            options.follow_path = argv[++i];
+        } else if (arg[0] != '-' && db_file.empty()) {
+            db_file = arg;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (db_file.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    try {
+        DiskManager disk_manager(db_file, copy_on_write);
+        BufferPoolManager buffer_pool(pool_pages, &disk_manager);
+        BPlusTree tree(&buffer_pool, tree_name);
+        KvServer server(&tree, options);
+
+        running_server = &server;
+        std::signal(SIGINT, HandleSignal);
+        std::signal(SIGTERM, HandleSignal);
+        std::cout << "Serving " << db_file;
+        if (!options.unix_path.empty()) {
+            std::cout << " on " << options.unix_path;
+        }
+        if (server.TcpPort() >= 0) {
+            std::cout << " on 127.0.0.1:" << server.TcpPort();
+        }
+        if (!options.resp_unix_path.empty()) {
+            std::cout << ", RESP on " << options.resp_unix_path;
+        }
+        if (server.RespPort() >= 0) {
+            std::cout << ", RESP on 127.0.0.1:" << server.RespPort();
+        }
+        if (!options.replication_path.empty()) {
+            std::cout << ", followers on " << options.replication_path;
+        }
+        if (!options.follow_path.empty()) {
+            std::cout << ", following " << options.follow_path;
+        }
+        std::cout << " with " << options.workers << " workers" << std::endl;
+
+        server.Run();
+        running_server = nullptr;
+        buffer_pool.FlushAllPages();
+        disk_manager.Checkpoint();
+        std::cout << "Stopped" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
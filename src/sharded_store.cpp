@@ -0,0 +1,721 @@
+#include "sharded_store.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr const char *MANIFEST_MAGIC = "bptree-sharded-store";
+constexpr int MANIFEST_VERSION = 2;  // 1 had no file list: shards were always path.0 .. path.N-1
+
+// MurmurHash3's 64-bit finalizer. Part of the file format: changing it
+// would send existing keys to the wrong shard.
+uint64_t MixKey(int64_t key) {
+    uint64_t hash = static_cast<uint64_t>(key);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Make entries created or renamed in `directory` survive a crash
+void SyncDirectory(const std::filesystem::path &directory) {
+    std::string name = directory.empty() ? "." : directory.string();
+    int fd = open(name.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        std::string error = std::strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Failed to sync directory " + name + ": " + error);
+    }
+    close(fd);
+}
+
+}  // namespace
+
+ShardedStore::ShardedStore(const std::string &path, ShardedStoreOptions options)
+    : path_(path), options_(std::move(options)), next_file_(0) {
+    std::vector<std::string> files;
+    if (!ReadManifest(path_, &options_, &next_file_, &files)) {
+        if (options_.num_shards == 0) {
+            throw std::runtime_error("A sharded store needs at least one shard");
+        }
+        if (options_.partitioning == Partitioning::RANGE &&
+            (options_.boundaries.size() != options_.num_shards - 1 ||
+             std::adjacent_find(options_.boundaries.begin(), options_.boundaries.end(),
+                                std::greater_equal<int64_t>()) != options_.boundaries.end())) {
+            throw std::runtime_error("Range partitioning needs num_shards - 1 ascending boundaries");
+        }
+        for (size_t i = 0; i < options_.num_shards; ++i) {
+            files.push_back(path_ + "." + std::to_string(i));
+        }
+        next_file_ = options_.num_shards;
+    }
+
+    partitioning_ = options_.partitioning;
+    boundaries_ = options_.boundaries;
+    for (const std::string &file : files) {
+        shards_.push_back(std::make_unique<Shard>(file, VolumeOf(file), options_));
+    }
+    WriteManifest(files, boundaries_);
+}
+
+ShardedStore::~ShardedStore() = default;
+
+size_t ShardedStore::NumShards() const {
+    std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+    return shards_.size();
+}
+
+size_t ShardedStore::ShardOf(int64_t key) const {
+    std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+    return Route(key);
+}
+
+// The routing table: consulted under routing_mutex_ before any tree descent
+size_t ShardedStore::Route(int64_t key) const {
+    switch (partitioning_) {
+        case Partitioning::HASH:
+            return MixKey(key) % shards_.size();
+        case Partitioning::RANGE:
+            return std::upper_bound(boundaries_.begin(), boundaries_.end(), key) - boundaries_.begin();
+    }
+    return 0;
+}
+
+void ShardedStore::Shard::Touch(int64_t key) {
+    ++operations;
+    if (recent_keys.size() < RECENT_KEYS) {
+        recent_keys.push_back(key);
+    } else {
+        recent_keys[recent_next] = key;
+        recent_next = (recent_next + 1) % RECENT_KEYS;
+    }
+}
+
+void ShardedStore::Shard::Record(int64_t key, const std::string *value) {
+    if (!rebuilding) {
+        return;
+    }
+    if (value) {
+        rebuild_log.Put(key, *value);
+    } else {
+        rebuild_log.Delete(key);
+    }
+}
+
+// ==================== Point operations ====================
+
+bool ShardedStore::Insert(int64_t key, const std::string &value) {
+    bool inserted;
+    SplitReason split;
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        Shard &shard = *shards_[Route(key)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        inserted = shard.tree.Insert(key, value);
+        shard.Record(key, &value);
+        shard.Touch(key);
+        split = NeedsSplit(shard);
+    }
+    if (split != SplitReason::NONE) {
+        MaybeSplit(key);
+    }
+    return inserted;
+}
+
+bool ShardedStore::Remove(int64_t key) {
+    bool removed;
+    SplitReason split;
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        Shard &shard = *shards_[Route(key)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        removed = shard.tree.Remove(key);
+        shard.Record(key, nullptr);
+        shard.Touch(key);
+        split = NeedsSplit(shard);
+    }
+    if (split != SplitReason::NONE) {
+        MaybeSplit(key);
+    }
+    return removed;
+}
+
+std::optional<std::string> ShardedStore::Search(int64_t key) {
+    std::optional<std::string> value;
+    SplitReason split;
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        Shard &shard = *shards_[Route(key)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        value = shard.tree.Search(key);
+        shard.Touch(key);
+        split = NeedsSplit(shard);
+    }
+    if (split != SplitReason::NONE) {
+        MaybeSplit(key);
+    }
+    return value;
+}
+
+std::vector<std::optional<std::string>> ShardedStore::MultiGet(const std::vector<int64_t> &keys) {
+    std::vector<std::optional<std::string>> results(keys.size());
+    std::vector<int64_t> split_keys;  // One key of each shard that crossed a split threshold
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        std::vector<std::vector<size_t>> positions(shards_.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            positions[Route(keys[i])].push_back(i);
+        }
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            if (positions[s].empty()) {
+                continue;
+            }
+            std::vector<int64_t> shard_keys;
+            shard_keys.reserve(positions[s].size());
+            for (size_t position : positions[s]) {
+                shard_keys.push_back(keys[position]);
+            }
+            std::vector<std::optional<std::string>> shard_results;
+            {
+                Shard &shard = *shards_[s];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard_results = shard.tree.MultiGet(shard_keys);
+                for (int64_t key : shard_keys) {
+                    shard.Touch(key);
+                }
+                if (NeedsSplit(shard) != SplitReason::NONE) {
+                    split_keys.push_back(shard_keys.front());
+                }
+            }
+            for (size_t i = 0; i < positions[s].size(); ++i) {
+                results[positions[s][i]] = std::move(shard_results[i]);
+            }
+        }
+    }
+    for (int64_t key : split_keys) {
+        MaybeSplit(key);
+    }
+    return results;
+}
+
+bool ShardedStore::Write(const WriteBatch &batch) {
+    bool ok = true;
+    std::vector<int64_t> split_keys;
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        std::vector<WriteBatch> shard_batches(shards_.size());
+        for (const WriteBatch::Op &op : batch.Ops()) {
+            WriteBatch &shard_batch = shard_batches[Route(op.key)];
+            if (op.is_delete) {
+                shard_batch.Delete(op.key);
+            } else {
+                shard_batch.Put(op.key, op.value);
+            }
+        }
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            if (shard_batches[s].Count() == 0) {
+                continue;
+            }
+            Shard &shard = *shards_[s];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            ok &= shard.tree.Write(shard_batches[s]);
+            for (const WriteBatch::Op &op : shard_batches[s].Ops()) {
+                shard.Record(op.key, op.is_delete ? nullptr : &op.value);
+                shard.Touch(op.key);
+            }
+            if (NeedsSplit(shard) != SplitReason::NONE) {
+                split_keys.push_back(shard_batches[s].Ops().front().key);
+            }
+        }
+    }
+    for (int64_t key : split_keys) {
+        MaybeSplit(key);
+    }
+    return ok;
+}
+
+// ==================== Range scans ====================
+
+// Each shard returns its part of the range sorted; a heap over the shards'
+// next entries merges them. Range shards hold disjoint, ordered ranges, so
+// only the overlapping ones are read.
+std::vector<std::pair<int64_t, std::string>> ShardedStore::Scan(int64_t start_key, int64_t end_key) {
+    std::vector<std::pair<int64_t, std::string>> results;
+    if (start_key > end_key) {
+        return results;
+    }
+    std::vector<std::vector<std::pair<int64_t, std::string>>> runs;
+    size_t total = 0;
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        size_t first = 0;
+        size_t last = shards_.size() - 1;
+        if (partitioning_ == Partitioning::RANGE) {
+            first = Route(start_key);
+            last = Route(end_key);
+        }
+        for (size_t s = first; s <= last; ++s) {
+            std::lock_guard<std::mutex> lock(shards_[s]->mutex);
+            runs.push_back(shards_[s]->tree.Scan(start_key, end_key));
+            shards_[s]->Touch(std::max(start_key, s > 0 && partitioning_ == Partitioning::RANGE
+                                                      ? boundaries_[s - 1] : start_key));
+            total += runs.back().size();
+        }
+    }
+    results.reserve(total);
+
+    // (key, run) of each run's next entry, smallest key on top
+    using Head = std::pair<int64_t, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<size_t> next(runs.size(), 0);
+    for (size_t r = 0; r < runs.size(); ++r) {
+        if (!runs[r].empty()) {
+            heads.emplace(runs[r][0].first, r);
+        }
+    }
+    while (!heads.empty()) {
+        size_t r = heads.top().second;
+        heads.pop();
+        results.push_back(std::move(runs[r][next[r]++]));
+        if (next[r] < runs[r].size()) {
+            heads.emplace(runs[r][next[r]].first, r);
+        }
+    }
+    return results;
+}
+
+void ShardedStore::Flush() {
+    std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+    for (std::unique_ptr<Shard> &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->buffer_pool.FlushAllPages();
+        shard->disk_manager.Checkpoint();
+    }
+}
+
+// ==================== Splitting and moving partitions ====================
+
+// Caller holds the shard's mutex, or the routing table exclusively
+ShardedStore::SplitReason ShardedStore::NeedsSplit(const Shard &shard) const {
+    if (partitioning_ != Partitioning::RANGE || shards_.size() >= options_.max_partitions || shard.rebuilding) {
+        return SplitReason::NONE;
+    }
+    if (options_.split_pages > 0 && shard.disk_manager.GetNumPages() > options_.split_pages) {
+        return SplitReason::SIZE;
+    }
+    if (options_.split_operations > 0 && shard.operations >= options_.split_operations) {
+        return SplitReason::TRAFFIC;
+    }
+    return SplitReason::NONE;
+}
+
+// Another thread may have split the partition first, so look it up again.
+// While a split or move runs, the trigger is dropped; the partition's next
+// operation past the threshold tries again.
+void ShardedStore::MaybeSplit(int64_t key) {
+    std::unique_lock<std::mutex> rebuild(rebuild_mutex_, std::try_to_lock);
+    if (!rebuild.owns_lock()) {
+        return;
+    }
+    size_t partition;
+    SplitReason reason;
+    {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        partition = Route(key);
+        std::lock_guard<std::mutex> lock(shards_[partition]->mutex);
+        reason = NeedsSplit(*shards_[partition]);
+    }
+    if (reason != SplitReason::NONE && !Split(partition, reason)) {
+        std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+        std::lock_guard<std::mutex> lock(shards_[partition]->mutex);
+        shards_[partition]->operations = 0;  // Unsplittable for now; count afresh
+    }
+}
+
+bool ShardedStore::SplitPartition(size_t partition) {
+    if (partitioning_ != Partitioning::RANGE) {
+        throw std::runtime_error("Only range partitions can be split");
+    }
+    std::lock_guard<std::mutex> rebuild(rebuild_mutex_);
+    if (partition >= shards_.size()) {
+        throw std::runtime_error("No partition " + std::to_string(partition));
+    }
+    return shards_.size() < options_.max_partitions && Split(partition, SplitReason::SIZE);
+}
+
+// Rewrite both halves into new files; a traffic split cuts at the median of
+// the recently accessed keys, so a hot range ends up in two partitions
+// (on two volumes, when there are several). Caller holds rebuild_mutex_.
+bool ShardedStore::Split(size_t partition, SplitReason reason) {
+    Shard &shard = *shards_[partition];
+    std::vector<int64_t> recent;
+    std::vector<std::pair<int64_t, std::string>> entries = StartRebuild(shard, &recent);
+    if (entries.size() < 2) {
+        StopRebuild(shard);
+        return false;
+    }
+
+    size_t middle = entries.size() / 2;
+    if (reason == SplitReason::TRAFFIC && !recent.empty()) {
+        std::nth_element(recent.begin(), recent.begin() + recent.size() / 2, recent.end());
+        int64_t hot_median = recent[recent.size() / 2];
+        auto split_at = std::lower_bound(entries.begin(), entries.end(), hot_median,
+                                         [](const auto &entry, int64_t key) { return entry.first < key; });
+        middle = std::clamp<size_t>(split_at - entries.begin(), 1, entries.size() - 1);
+    }
+    int64_t split_key = entries[middle].first;
+
+    std::unique_ptr<Shard> lower;
+    std::unique_ptr<Shard> upper;
+    try {
+        std::string lower_volume = LeastLoadedVolume(&shard, "");
+        lower = BuildShard(entries.begin(), entries.begin() + middle, lower_volume);
+        upper = BuildShard(entries.begin() + middle, entries.end(), LeastLoadedVolume(&shard, lower_volume));
+    } catch (...) {
+        StopRebuild(shard);
+        if (lower) {
+            DeleteShard(std::move(lower));
+        }
+        throw;
+    }
+    Publish(partition, std::move(lower), std::move(upper), split_key);
+    return true;
+}
+
+void ShardedStore::MovePartition(size_t partition, const std::string &volume) {
+    std::lock_guard<std::mutex> rebuild(rebuild_mutex_);
+    if (partition >= shards_.size()) {
+        throw std::runtime_error("No partition " + std::to_string(partition));
+    }
+    Shard &shard = *shards_[partition];
+    std::vector<std::pair<int64_t, std::string>> entries = StartRebuild(shard, nullptr);
+    std::unique_ptr<Shard> moved;
+    try {
+        moved = BuildShard(entries.begin(), entries.end(), volume);
+    } catch (...) {
+        StopRebuild(shard);
+        throw;
+    }
+    Publish(partition, std::move(moved), nullptr, 0);
+}
+
+// Read a partition's entries and start logging its writes. Only this
+// shard waits for the scan; the routing table is shared as usual.
+std::vector<std::pair<int64_t, std::string>> ShardedStore::StartRebuild(Shard &shard,
+                                                                        std::vector<int64_t> *recent_keys) {
+    std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (recent_keys) {
+        *recent_keys = shard.recent_keys;
+    }
+    shard.rebuilding = true;
+    return shard.tree.Scan(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max());
+}
+
+void ShardedStore::StopRebuild(Shard &shard) {
+    std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.rebuilding = false;
+    shard.rebuild_log.Clear();
+}
+
+// Replace the partition with `lower` (and `upper`, holding keys from
+// `split_key` on, for a split). The writes logged while they were built are
+// replayed into them first without blocking anyone; the routing lock is
+// taken exclusively only for the writes logged since, the fsync of the new
+// files and the manifest update. Memory follows the manifest only once it is
+// durable; the old file goes last.
+void ShardedStore::Publish(size_t partition, std::unique_ptr<Shard> lower, std::unique_ptr<Shard> upper,
+                           int64_t split_key) {
+    Shard &old_shard = *shards_[partition];
+    std::unique_ptr<Shard> old;
+    try {
+        WriteBatch log;
+        {
+            std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+            std::lock_guard<std::mutex> lock(old_shard.mutex);
+            std::swap(log, old_shard.rebuild_log);
+        }
+        Replay(log, lower.get(), upper.get(), split_key);
+
+        // No operation holds a shard while the routing table is held exclusively
+        std::unique_lock<std::shared_mutex> routing(routing_mutex_);
+        Replay(old_shard.rebuild_log, lower.get(), upper.get(), split_key);
+        SyncShard(*lower);
+        if (upper) {
+            SyncShard(*upper);
+        }
+
+        std::vector<std::string> files = Files();
+        files[partition] = lower->file;
+        std::vector<int64_t> boundaries = boundaries_;
+        if (upper) {
+            files.insert(files.begin() + partition + 1, upper->file);
+            boundaries.insert(boundaries.begin() + partition, split_key);
+        } else {
+            lower->operations = old_shard.operations;
+        }
+        WriteManifest(files, boundaries);
+
+        old = std::move(shards_[partition]);
+        shards_[partition] = std::move(lower);
+        if (upper) {
+            shards_.insert(shards_.begin() + partition + 1, std::move(upper));
+        }
+        boundaries_ = std::move(boundaries);
+    } catch (...) {
+        StopRebuild(old_shard);
+        DeleteShard(std::move(lower));
+        if (upper) {
+            DeleteShard(std::move(upper));
+        }
+        throw;
+    }
+    DeleteShard(std::move(old));
+}
+
+// Apply logged writes to the shard (or the two halves) replacing a partition
+void ShardedStore::Replay(const WriteBatch &log, Shard *lower, Shard *upper, int64_t split_key) {
+    WriteBatch lower_batch;
+    WriteBatch upper_batch;
+    for (const WriteBatch::Op &op : log.Ops()) {
+        WriteBatch &batch = upper && op.key >= split_key ? upper_batch : lower_batch;
+        if (op.is_delete) {
+            batch.Delete(op.key);
+        } else {
+            batch.Put(op.key, op.value);
+        }
+    }
+    if (!lower->tree.Write(lower_batch) || (upper && !upper->tree.Write(upper_batch))) {
+        throw std::runtime_error("Buffer pool exhausted while replaying writes into a new partition");
+    }
+}
+
+void ShardedStore::SyncShard(Shard &shard) {
+    shard.buffer_pool.FlushAllPages();
+    shard.disk_manager.Checkpoint();
+}
+
+std::vector<std::string> ShardedStore::Files() const {
+    std::vector<std::string> files;
+    for (const std::unique_ptr<Shard> &shard : shards_) {
+        files.push_back(shard->file);
+    }
+    return files;
+}
+
+// Close a shard and delete its file
+void ShardedStore::DeleteShard(std::unique_ptr<Shard> shard) {
+    std::string file = shard->file;
+    shard.reset();
+    std::remove(file.c_str());
+}
+
+// A fresh file on `volume` holding [first, last), made durable, directory
+// entry included, before the manifest points at it
+std::unique_ptr<ShardedStore::Shard> ShardedStore::BuildShard(
+    std::vector<std::pair<int64_t, std::string>>::const_iterator first,
+    std::vector<std::pair<int64_t, std::string>>::const_iterator last, const std::string &volume) {
+    std::filesystem::path directory = volume.empty() ? std::filesystem::path(path_).parent_path()
+                                                     : std::filesystem::path(volume);
+    std::string file = (directory / std::filesystem::path(path_).filename()).string() + "." +
+                       std::to_string(next_file_++);
+    std::remove(file.c_str());
+    auto shard = std::make_unique<Shard>(file, volume, options_);
+    for (auto it = first; it != last; ++it) {
+        shard->tree.Insert(it->first, it->second);
+    }
+    SyncShard(*shard);
+    SyncDirectory(directory);
+    return shard;
+}
+
+// Volume with the fewest partitions, not counting `leaving` and counting
+// `taken` once more
+std::string ShardedStore::LeastLoadedVolume(const Shard *leaving, const std::string &taken) const {
+    if (options_.volumes.empty()) {
+        return "";
+    }
+    std::map<std::string, size_t> load;
+    for (const std::string &volume : options_.volumes) {
+        load[volume] = volume == taken ? 1 : 0;
+    }
+    for (const std::unique_ptr<Shard> &shard : shards_) {
+        if (shard.get() != leaving && load.count(shard->volume)) {
+            ++load[shard->volume];
+        }
+    }
+    return std::min_element(load.begin(), load.end(),
+                            [](const auto &a, const auto &b) { return a.second < b.second; })->first;
+}
+
+std::string ShardedStore::VolumeOf(const std::string &file) const {
+    std::filesystem::path directory = std::filesystem::path(file).parent_path().lexically_normal();
+    for (const std::string &volume : options_.volumes) {
+        if (std::filesystem::path(volume).lexically_normal() == directory) {
+            return volume;
+        }
+    }
+    return "";
+}
+
+std::vector<PartitionInfo> ShardedStore::Partitions() const {
+    std::shared_lock<std::shared_mutex> routing(routing_mutex_);
+    std::vector<PartitionInfo> partitions;
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s]->mutex);
+        PartitionInfo info;
+        if (partitioning_ == Partitioning::RANGE && s > 0) {
+            info.lower_bound = boundaries_[s - 1];
+        }
+        info.file = shards_[s]->file;
+        info.volume = shards_[s]->volume;
+        info.pages = shards_[s]->disk_manager.GetNumPages();
+        info.operations = shards_[s]->operations;
+        partitions.push_back(std::move(info));
+    }
+    return partitions;
+}
+
+// ==================== Manifest ====================
+
+// The manifest is the routing table. It must never change except together
+// with the files it names:
+//
+//   bptree-sharded-store 2
+//   shards 3
+//   partitioning range
+//   copy_on_write 0
+//   next_file 5
+//   boundaries 2500 5000
+//   files orders.0 /mnt/nvme1/orders.3 /mnt/nvme2/orders.4
+bool ShardedStore::ReadManifest(const std::string &path, ShardedStoreOptions *options, uint64_t *next_file,
+                                std::vector<std::string> *files) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string magic;
+    int version = 0;
+    std::string partitioning;
+    std::string field;
+    in >> magic >> version;
+    if (magic != MANIFEST_MAGIC || version < 1 || version > MANIFEST_VERSION) {
+        throw std::runtime_error("Not a sharded store manifest: " + path);
+    }
+    in >> field >> options->num_shards;
+    bool ok = field == "shards" && options->num_shards > 0;
+    in >> field >> partitioning;
+    ok &= field == "partitioning" && (partitioning == "hash" || partitioning == "range");
+    in >> field >> options->copy_on_write;
+    ok &= field == "copy_on_write";
+    *next_file = options->num_shards;
+    if (version >= 2) {
+        in >> field >> *next_file;
+        ok &= field == "next_file";
+    }
+    options->partitioning = partitioning == "range" ? Partitioning::RANGE : Partitioning::HASH;
+    options->boundaries.clear();
+    if (ok && options->partitioning == Partitioning::RANGE) {
+        in >> field;
+        ok &= field == "boundaries";
+        options->boundaries.resize(options->num_shards - 1);
+        for (int64_t &boundary : options->boundaries) {
+            in >> boundary;
+        }
+    }
+    files->clear();
+    if (ok && version >= 2) {
+        in >> field;
+        ok &= field == "files";
+        files->resize(options->num_shards);
+        for (std::string &file : *files) {
+            in >> file;
+        }
+    } else {
+        for (size_t i = 0; i < options->num_shards; ++i) {
+            files->push_back(path + "." + std::to_string(i));
+        }
+    }
+    if (!ok || in.fail()) {
+        throw std::runtime_error("Corrupt sharded store manifest: " + path);
+    }
+    return true;
+}
+
+// Written to a temporary file and renamed into place, so a crash leaves
+// either the old manifest or the new one
+void ShardedStore::WriteManifest(const std::vector<std::string> &files,
+                                 const std::vector<int64_t> &boundaries) const {
+    std::ostringstream text;
+    text << MANIFEST_MAGIC << " " << MANIFEST_VERSION << "\n"
+         << "shards " << files.size() << "\n"
+         << "partitioning " << (partitioning_ == Partitioning::RANGE ? "range" : "hash") << "\n"
+         << "copy_on_write " << (options_.copy_on_write ? 1 : 0) << "\n"
+         << "next_file " << next_file_ << "\n";
+    if (partitioning_ == Partitioning::RANGE) {
+        text << "boundaries";
+        for (int64_t boundary : boundaries) {
+            text << " " << boundary;
+        }
+        text << "\n";
+    }
+    text << "files";
+    for (const std::string &file : files) {
+        if (file.find_first_of(" \t\n") != std::string::npos) {
+            throw std::runtime_error("Shard file names cannot contain whitespace: " + file);
+        }
+        text << " " << file;
+    }
+    text << "\n";
+
+    // The new manifest is durable before it replaces the old one, and the
+    // rename is durable before the caller deletes files the old one listed
+    std::string temporary = path_ + ".tmp";
+    std::string contents = text.str();
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to write sharded store manifest: " + temporary);
+    }
+    bool written = write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()) &&
+                   fsync(fd) == 0;
+    written &= close(fd) == 0;
+    if (!written) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Failed to write sharded store manifest: " + temporary);
+    }
+    if (std::rename(temporary.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("Failed to update sharded store manifest: " + path_);
+    }
+    SyncDirectory(std::filesystem::path(path_).parent_path());
+}
+
+void ShardedStore::Destroy(const std::string &path) {
+    ShardedStoreOptions options;
+    uint64_t next_file;
+    std::vector<std::string> files;
+    if (!ReadManifest(path, &options, &next_file, &files)) {
+        return;
+    }
+    for (const std::string &file : files) {
+        std::remove(file.c_str());
+    }
+    std::remove(path.c_str());
+}
@@ -0,0 +1,182 @@
+#ifndef SHARDED_STORE_H
+#define SHARDED_STORE_H
+
+#include "btree.h"
+#include "buffer_pool_manager.h"
+#include "disk_manager.h"
+#include "write_batch.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class Partitioning {
+    HASH,  // Shard by a fixed 64-bit hash of the key: any key pattern spreads evenly
+    RANGE  // Contiguous key ranges: a scan only visits the shards it overlaps
+};
+
+struct ShardedStoreOptions {
+    // Layout, used only when the store is created; an existing store keeps
+    // the layout recorded in its manifest
+    size_t num_shards = 4;
+    Partitioning partitioning = Partitioning::HASH;
+    // RANGE: num_shards - 1 ascending split keys. Shard i holds keys in
+    // [boundaries[i - 1], boundaries[i]), the first and last shards are open-ended
+    std::vector<int64_t> boundaries;
+    bool copy_on_write = false;
+
+    size_t pool_pages = MAX_PAGES_IN_RAM;  // Frames per shard
+    TreeOptions tree_options;
+
+    // RANGE only: split a partition in two once its file has grown past
+    // `split_pages` pages, or once it has served `split_operations` operations
+    // since it was created (0 disables either trigger). Size splits cut at
+    // the median key, traffic splits at the median of recently accessed keys.
+    int split_pages = 0;
+    uint64_t split_operations = 0;
+    size_t max_partitions = 64;
+    // Directories (e.g. one per device) that new partition files are spread
+    // over: each goes to the volume holding the fewest partitions. Empty:
+    // next to the manifest.
+    std::vector<std::string> volumes;
+};
+
+// One entry of the routing table
+struct PartitionInfo {
+    std::optional<int64_t> lower_bound;  // RANGE: first key routed here; nullopt: unbounded or HASH
+    std::string file;
+    std::string volume;                  // Entry of `volumes` holding the file, "" if none
+    int pages;
+    uint64_t operations;                 // Served since the partition was created
+};
+
+// Keys partitioned over independent trees, each with its own file, buffer
+// pool and mutex, so operations on different shards run in parallel and no
+// root page or file is shared between them.
+//
+// The store at `path` is a small text manifest there plus one database file
+// per shard. Point operations consult the routing table, then lock only
+// their shard. MultiGet and Write split their keys by shard and visit each
+// shard once; a WriteBatch is atomic per shard, not across shards. Scan
+// collects each shard's part of the range and merges them in key order;
+// shards are read one after another, so a scan racing with writers is not a
+// point-in-time view. Errors throw std::runtime_error.
+//
+// Range partitions can be split and moved while the store is in use. Either
+// rewrites the partition's live entries into fresh, fsynced files, publishes
+// the new routing table by renaming an fsynced manifest over the old one and
+// syncing its directory, and only then deletes the old file, so a crash
+// leaves the old or the new layout intact. If the manifest cannot be
+// written, the new files are deleted and the store keeps its old layout.
+// The partition serves operations while its files are built; its writes in
+// that time are logged and replayed into the new files, and operations wait
+// only for the last replay and the manifest update. One split or move runs
+// at a time; an automatic split runs on the thread whose operation crossed
+// the threshold, and is skipped if another one is running.
+class ShardedStore {
+public:
+    explicit ShardedStore(const std::string &path, ShardedStoreOptions options = ShardedStoreOptions());
+    ~ShardedStore();
+
+    ShardedStore(const ShardedStore &) = delete;
+    ShardedStore &operator=(const ShardedStore &) = delete;
+
+    bool Insert(int64_t key, const std::string &value);
+    bool Remove(int64_t key);
+    std::optional<std::string> Search(int64_t key);
+    std::vector<std::pair<int64_t, std::string>> Scan(int64_t start_key, int64_t end_key);
+    std::vector<std::optional<std::string>> MultiGet(const std::vector<int64_t> &keys);
+    bool Write(const WriteBatch &batch);
+
+    // Flush and checkpoint every shard
+    void Flush();
+
+    // Split a RANGE partition at its median key; false if it holds fewer than
+    // two keys or the store is at max_partitions
+    bool SplitPartition(size_t partition);
+    // Rewrite a partition into a new file on `volume` ("" for next to the manifest)
+    void MovePartition(size_t partition, const std::string &volume);
+    std::vector<PartitionInfo> Partitions() const;
+
+    size_t NumShards() const;
+    Partitioning GetPartitioning() const { return partitioning_; }
+    size_t ShardOf(int64_t key) const;
+
+    // Direct access to one shard, for tools (tracing, Analyze). Not
+    // synchronized with the store's own operations.
+    BPlusTree *ShardTree(size_t shard) { return &shards_[shard]->tree; }
+    BufferPoolManager *ShardPool(size_t shard) { return &shards_[shard]->buffer_pool; }
+
+    // Delete the manifest and shard files of the store at `path`, if any
+    static void Destroy(const std::string &path);
+
+private:
+    static constexpr size_t RECENT_KEYS = 128;
+
+    struct Shard {
+        std::string file;
+        std::string volume;
+        DiskManager disk_manager;
+        BufferPoolManager buffer_pool;
+        BPlusTree tree;
+        std::mutex mutex;
+        // Traffic, under `mutex`
+        uint64_t operations = 0;
+        std::vector<int64_t> recent_keys;  // Ring of the last RECENT_KEYS keys accessed
+        size_t recent_next = 0;
+        // While the partition is rewritten into new files, its writes are
+        // also logged here for replay into them; under `mutex`
+        bool rebuilding = false;
+        WriteBatch rebuild_log;
+
+        Shard(const std::string &file, const std::string &volume, const ShardedStoreOptions &options)
+            : file(file), volume(volume), disk_manager(file, options.copy_on_write),
+              buffer_pool(options.pool_pages, &disk_manager), tree(&buffer_pool, "", options.tree_options) {}
+
+        void Touch(int64_t key);
+        void Record(int64_t key, const std::string *value);  // nullptr for a delete
+    };
+
+    enum class SplitReason { NONE, SIZE, TRAFFIC };
+
+    std::string path_;
+    ShardedStoreOptions options_;  // Layout fields mirror the manifest
+    Partitioning partitioning_;
+    std::vector<int64_t> boundaries_;
+    uint64_t next_file_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Shared by operations, exclusive while the routing table changes
+    mutable std::shared_mutex routing_mutex_;
+    // Held for a whole split or move; shards_ and next_file_ change only under it
+    std::mutex rebuild_mutex_;
+
+    size_t Route(int64_t key) const;
+    SplitReason NeedsSplit(const Shard &shard) const;
+    void MaybeSplit(int64_t key);
+    bool Split(size_t partition, SplitReason reason);
+    std::vector<std::pair<int64_t, std::string>> StartRebuild(Shard &shard, std::vector<int64_t> *recent_keys);
+    void StopRebuild(Shard &shard);
+    void Publish(size_t partition, std::unique_ptr<Shard> lower, std::unique_ptr<Shard> upper, int64_t split_key);
+    static void Replay(const WriteBatch &log, Shard *lower, Shard *upper, int64_t split_key);
+    static void SyncShard(Shard &shard);
+    std::unique_ptr<Shard> BuildShard(std::vector<std::pair<int64_t, std::string>>::const_iterator first,
+                                      std::vector<std::pair<int64_t, std::string>>::const_iterator last,
+                                      const std::string &volume);
+    std::string LeastLoadedVolume(const Shard *leaving, const std::string &taken) const;
+    std::string VolumeOf(const std::string &file) const;
+
+    static bool ReadManifest(const std::string &path, ShardedStoreOptions *options, uint64_t *next_file,
+                             std::vector<std::string> *files);
+    // Durably replace the manifest with one listing `files` and `boundaries`;
+    // the in-memory routing table is left to the caller to update afterwards
+    void WriteManifest(const std::vector<std::string> &files, const std::vector<int64_t> &boundaries) const;
+    std::vector<std::string> Files() const;
+    static void DeleteShard(std::unique_ptr<Shard> shard);
+};
+
+#endif // SHARDED_STORE_H
@@ -0,0 +1,58 @@
+#include "transaction.h"
+
+Transaction::Transaction(BPlusTree *tree) : tree_(tree), snapshot_(tree->GetSnapshot()) {}
+
+Transaction::~Transaction() {
+    Finish();
+}
+
+std::optional<std::string> Transaction::Get(int64_t key) {
+    auto it = writes_.find(key);
+    if (it != writes_.end()) {
+        return it->second;
+    }
+    read_set_.push_back(key);
+    return tree_->Search(key, snapshot_);
+}
+
+void Transaction::Put(int64_t key, const std::string &value) {
+    batch_.Put(key, value);
+    writes_[key] = value;
+}
+
+void Transaction::Delete(int64_t key) {
+    batch_.Delete(key);
+    writes_[key] = std::nullopt;
+}
+
+bool Transaction::Commit() {
+    if (!snapshot_) {
+        return false;  // Already finished
+    }
+
+    // Validate the read set against writes made since our snapshot
+    for (int64_t key : read_set_) {
+        if (tree_->ChangedSince(key, snapshot_)) {
+            Finish();
+            return false;
+        }
+    }
+
+    bool ok = tree_->Write(batch_);
+    Finish();
+    return ok;
+}
+
+void Transaction::Rollback() {
+    Finish();
+}
+
+void Transaction::Finish() {
+    if (snapshot_) {
+        tree_->ReleaseSnapshot(snapshot_);
+        snapshot_ = nullptr;
+    }
+    batch_.Clear();
+    writes_.clear();
+    read_set_.clear();
+}
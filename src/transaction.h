@@ -0,0 +1,37 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include "btree.h"
+#include "write_batch.h"
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Optimistic transaction: reads come from a snapshot taken at Begin, writes
+// are buffered in a WriteBatch, and Commit validates that no key in the
+// read set was written by anyone else in the meantime.
+class Transaction {
+public:
+    explicit Transaction(BPlusTree *tree);
+    ~Transaction();
+
+    std::optional<std::string> Get(int64_t key);
+    void Put(int64_t key, const std::string &value);
+    void Delete(int64_t key);
+
+    // Returns false (and applies nothing) if a read key changed since Begin
+    bool Commit();
+    void Rollback();
+
+private:
+    BPlusTree *tree_;
+    const Snapshot *snapshot_;
+    WriteBatch batch_;
+    std::unordered_map<int64_t, std::optional<std::string>> writes_;  // read-your-writes
+    std::vector<int64_t> read_set_;
+
+    void Finish();
+};
+
+#endif // TRANSACTION_H
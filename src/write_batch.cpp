@@ -0,0 +1,13 @@
+#include "write_batch.h"
+
+void WriteBatch::Put(int64_t key, const std::string &value) {
+    ops_.push_back(Op{key, false, value});
+}
+
+void WriteBatch::Delete(int64_t key) {
+    ops_.push_back(Op{key, true, std::string()});
+}
+
+void WriteBatch::Clear() {
+    ops_.clear();
+}
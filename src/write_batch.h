@@ -0,0 +1,28 @@
+#ifndef WRITE_BATCH_H
+#define WRITE_BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Ordered list of puts and deletes applied atomically by BPlusTree::Write
+class WriteBatch {
+public:
+    struct Op {
+        int64_t key;
+        bool is_delete;
+        std::string value;
+    };
+
+    void Put(int64_t key, const std::string &value);
+    void Delete(int64_t key);
+    void Clear();
+
+    size_t Count() const { return ops_.size(); }
+    const std::vector<Op> &Ops() const { return ops_; }
+
+private:
+    std::vector<Op> ops_;
+};
+
+#endif // WRITE_BATCH_H